@@ -0,0 +1,150 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// Pointer -> first index of an array that someone else changes (the arrays of the editor), open addressing.
+		// The index is stamped with the buffer, the number of items and the first and last of them, and checked
+		// against the array on each search: more items with the same buffer are added to it, anything else
+		// rebuilds it. A found index is checked against the item, and a miss is never trusted: the usual search
+		// confirms it, since an item may have been replaced in place.
+		class ArrayIndex
+		{
+		public:
+			constexpr static std::uint32_t NONE = 0xFFFFFFFF;
+		private:
+			void* const* _data{ nullptr };
+			const void* _first{ nullptr };
+			const void* _last{ nullptr };
+			std::uint32_t _indexed{ 0 };
+			std::vector<std::pair<const void*, std::uint32_t>> _table;
+
+			[[nodiscard]] inline static std::size_t Hash(const void* Key) noexcept(true)
+			{
+				// The low bits are taken, the high ones of the product are mixed into them
+				auto Value = ((std::uint64_t)Key >> 3) * 0x9E3779B97F4A7C15ull;
+				return (std::size_t)(Value ^ (Value >> 32));
+			}
+
+			void Insert(const void* Key, std::uint32_t Index) noexcept(true)
+			{
+				auto Mask = _table.size() - 1;
+				for (auto i = Hash(Key) & Mask;; i = (i + 1) & Mask)
+				{
+					if (!_table[i].first)
+					{
+						_table[i] = { Key, Index };
+						return;
+					}
+
+					// The first one is searched for
+					if (_table[i].first == Key)
+						return;
+				}
+			}
+
+			[[nodiscard]] std::uint32_t Find(const void* Key) const noexcept(true)
+			{
+				auto Mask = _table.size() - 1;
+				for (auto i = Hash(Key) & Mask; _table[i].first; i = (i + 1) & Mask)
+				{
+					if (_table[i].first == Key)
+						return _table[i].second;
+				}
+
+				return NONE;
+			}
+
+			void Rebuild(void* const* Items, std::uint32_t Count)
+			{
+				std::size_t Capacity = 64;
+				while (Capacity < ((std::size_t)Count * 2))
+					Capacity <<= 1;
+
+				_table.assign(Capacity, { nullptr, 0 });
+				_indexed = 0;
+				_data = Items;
+				_first = nullptr;
+				Append(Items, Count);
+			}
+
+			void Append(void* const* Items, std::uint32_t Count)
+			{
+				if (((std::size_t)Count * 2) > _table.size())
+				{
+					Rebuild(Items, Count);
+					return;
+				}
+
+				if (!_indexed && Count)
+					_first = Items[0];
+
+				for (; _indexed < Count; _indexed++)
+				{
+					// nullptr is the empty cell, such items are found by the linear search
+					if (Items[_indexed])
+						Insert(Items[_indexed], _indexed);
+				}
+
+				_last = Count ? Items[Count - 1] : nullptr;
+			}
+		public:
+			ArrayIndex() noexcept(true) = default;
+
+			// false - the index can't answer, search as usual.
+			// It can throw as the vector does, on that the index must be cleared.
+			bool Search(void* const* Items, std::uint32_t Count, const void* Target, std::uint32_t Start,
+				std::uint32_t& Result)
+			{
+				if (_table.empty() || (Items != _data) || (Count < _indexed) ||
+					(_indexed && ((Items[0] != _first) || (Items[_indexed - 1] != _last))))
+					Rebuild(Items, Count);
+				else if (Count > _indexed)
+					Append(Items, Count);
+
+				if (!Target)
+					return false;
+
+				// Not indexed or replaced in place, the usual search verifies it
+				auto Index = Find(Target);
+				if (Index == NONE)
+					return false;
+
+				// Replaced in place, build it again next time
+				if (Items[Index] != Target)
+				{
+					_data = nullptr;
+					return false;
+				}
+
+				// Before the start there may be more of the same further on
+				if (Index < Start)
+					return false;
+
+				Result = Index;
+				return true;
+			}
+
+			void Clear() noexcept(true)
+			{
+				_data = nullptr;
+				_first = nullptr;
+				_last = nullptr;
+				_indexed = 0;
+				_table.clear();
+				_table.shrink_to_fit();
+			}
+
+			[[nodiscard]] inline std::uint32_t GetCount() const noexcept(true) { return _indexed; }
+		};
+	}
+}
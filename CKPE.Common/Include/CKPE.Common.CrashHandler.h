@@ -7,6 +7,7 @@
 #include <cstdio>
 #include <cstdint>
 #include <string>
+#include <CKPE.Stream.h>
 #include <CKPE.Common.Common.h>
 
 namespace CKPE
@@ -34,6 +35,10 @@ namespace CKPE
 			virtual ~CrashHandler() noexcept(true) = default;
 
 			void Install() noexcept(true);
+			// The report of the exception (EXCEPTION_POINTERS) into the stream, as the crash dialog writes it.
+			// Nothing is taken from the heap, the lists come from the memory reserved by Install() and the lines
+			// are formatted on the stack. Only what Stream does with them is up to it.
+			bool WriteReport(TextFileStream& Stream, void* ExceptionInfo) noexcept(true);
 
 			static CrashHandler* GetSingleton() noexcept(true);
 		};
@@ -0,0 +1,60 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <CKPE.CriticalSection.h>
+#include <CKPE.Common.Common.h>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// All files and folders under the root, case-insensitive. It's scanned in parallel in the background
+		// and then kept up to date by the notifications of the system. The folders it isn't sure about
+		// (moved in, overflow) give rUnknown, that is, ask the file system. So do the misses while a change
+		// is not applied yet and for a second after each one.
+		class CKPE_COMMON_API DirectorySnapshot
+		{
+			void* _data{ nullptr };
+			CriticalSection _section;
+
+			DirectorySnapshot(const DirectorySnapshot&) = delete;
+			DirectorySnapshot& operator=(const DirectorySnapshot&) = delete;
+
+			static std::uint32_t WatchThread(void* param) noexcept(true);
+		public:
+			enum Result : std::uint8_t
+			{
+				rUnknown = 0,
+				rNotFound,
+				rFound,
+			};
+
+			struct FileInfo
+			{
+				std::uint32_t Attributes;
+				std::uint64_t Size;
+				std::uint64_t WriteTime;			// FILETIME
+			};
+
+			DirectorySnapshot() noexcept(true) = default;
+			virtual ~DirectorySnapshot() noexcept(true);
+
+			// Returns at once, until the scan is done everything is rUnknown
+			bool Start(const std::string& Root) noexcept(true);
+			void Stop() noexcept(true);
+
+			[[nodiscard]] bool IsReady() const noexcept(true);
+			[[nodiscard]] std::uint32_t GetCount() const noexcept(true);
+
+			// The full path under the root or relative to it (ANSI, as the editor gives them)
+			[[nodiscard]] Result Find(const char* Path, FileInfo* Info = nullptr) const noexcept(true);
+
+			[[nodiscard]] static DirectorySnapshot* GetSingleton() noexcept(true);
+		};
+	}
+}
@@ -0,0 +1,65 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <CKPE.Common.TableID.h>
+#include <string>
+#include <cstdint>
+#include <vector>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// Finds the functions of the old editor in the new one, so the tables of ids can be moved to a new build.
+		// Each function gets a fingerprint: hash of the instructions without addresses, referenced strings and
+		// constants, and the callees. The unique fingerprints are matched first, then the matches are
+		// spread over the call edges.
+		class CKPE_COMMON_API FunctionMatcher
+		{
+		public:
+			enum Method : std::uint32_t
+			{
+				mNone = 0,
+				mExact,			// the whole fingerprint is unique in both
+				mOpcodes,		// only the instructions are unique in both
+				mStrings,		// only the set of the strings is unique in both
+				mCallGraph,		// the same position in the callees of a matched function
+			};
+
+			struct Result
+			{
+				std::uint32_t id;
+				std::uint32_t old_rva;
+				std::uint32_t new_rva;
+				float confidence;
+				Method method;
+			};
+		private:
+			void* _old{ nullptr };
+			void* _new{ nullptr };
+			std::vector<Result>* _results{ nullptr };
+
+			void MatchFunctions() noexcept(true);
+
+			FunctionMatcher(const FunctionMatcher&) = delete;
+			FunctionMatcher& operator=(const FunctionMatcher&) = delete;
+		public:
+			FunctionMatcher() noexcept(true);
+			virtual ~FunctionMatcher() noexcept(true);
+
+			// Images must be mapped as images (sections at their RVA)
+			virtual bool Analyze(const void* old_base, const void* new_base) noexcept(true);
+			virtual bool Match(const TableID& table) noexcept(true);
+			virtual bool Match(const std::vector<std::uint32_t>& old_rvas) noexcept(true);
+			virtual void Clear() noexcept(true);
+
+			[[nodiscard]] virtual std::uint32_t Count() const noexcept(true);
+			[[nodiscard]] virtual const Result* At(std::uint32_t id) const noexcept(true);
+
+			virtual void Dump(const std::wstring& fname) const noexcept(true);
+		};
+	}
+}
@@ -0,0 +1,105 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// Items that take the address ranges [Start, End), which don't overlap (modules, memory regions),
+		// sorted once by Start into a flat array. Find() is a binary search, before it the recent hits are tried.
+		// The items aren't owned, the list given to Build() must outlive the index and not move.
+		template<typename T, template<typename> class Allocator = std::allocator>
+		class IntervalIndex
+		{
+		public:
+			constexpr static std::size_t CACHE_SIZE = 4;
+
+			struct Interval { std::uintptr_t Start, End; const T* Item; };
+		private:
+			std::vector<Interval, Allocator<Interval>> _items;
+			mutable const Interval* _cache[CACHE_SIZE]{};
+		public:
+			IntervalIndex() noexcept(true) = default;
+
+			// GetRange(Item, Start, End) gives the range of each item of Items.
+			// It can throw as the vector does, on that the index is empty.
+			template<typename Range, typename Func>
+			void Build(const Range& Items, Func&& GetRange)
+			{
+				Clear();
+
+				try
+				{
+					_items.reserve(std::size(Items));
+					for (auto& Item : Items)
+					{
+						Interval Value{ 0, 0, &Item };
+						GetRange(Item, Value.Start, Value.End);
+						if (Value.Start < Value.End)
+							_items.push_back(Value);
+					}
+
+					std::sort(_items.begin(), _items.end(),
+						[](const Interval& a, const Interval& b) { return a.Start < b.Start; });
+				}
+				catch (...)
+				{
+					Clear();
+					throw;
+				}
+			}
+
+			void Clear() noexcept(true)
+			{
+				_items.clear();
+				std::fill(std::begin(_cache), std::end(_cache), nullptr);
+			}
+
+			[[nodiscard]] const T* Find(std::uintptr_t Address) const noexcept(true)
+			{
+				std::size_t i = 0;
+				const Interval* Result = nullptr;
+
+				for (; i < CACHE_SIZE; i++)
+				{
+					auto Item = _cache[i];
+					if (Item && (Address >= Item->Start) && (Address < Item->End))
+					{
+						Result = Item;
+						break;
+					}
+				}
+
+				if (!Result)
+				{
+					// Last one that starts at or before the address
+					auto it = std::upper_bound(_items.begin(), _items.end(), Address,
+						[](std::uintptr_t Value, const Interval& Item) { return Value < Item.Start; });
+					if ((it == _items.begin()) || (Address >= (--it)->End))
+						return nullptr;
+
+					Result = &(*it);
+					i = CACHE_SIZE - 1;
+				}
+
+				// Move to the front
+				for (; i > 0; i--)
+					_cache[i] = _cache[i - 1];
+				_cache[0] = Result;
+
+				return Result->Item;
+			}
+
+			[[nodiscard]] inline std::size_t GetCount() const noexcept(true) { return _items.size(); }
+			[[nodiscard]] inline bool Empty() const noexcept(true) { return _items.empty(); }
+		};
+	}
+}
@@ -0,0 +1,107 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <cstdarg>
+#include <string>
+#include <CKPE.CriticalSection.h>
+#include <CKPE.Common.Common.h>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// Structured log sink: instead of the text, each message is saved as a compact binary record
+		// (time, thread, severity, source address, format id and packed args). The text isn't formatted
+		// at runtime, CKPE.Tools\logquery does it offline.
+		class CKPE_COMMON_API LogCapture
+		{
+			void* _handle{ nullptr };
+			void* _data{ nullptr };
+			CriticalSection _section;
+
+			LogCapture(const LogCapture&) = delete;
+			LogCapture& operator=(const LogCapture&) = delete;
+
+			void WriteBuffer(const void* data, std::uint32_t size) noexcept(true);
+		public:
+			enum Severity : std::uint8_t
+			{
+				sMessage = 0,
+				sWarning,
+				sError,
+				sFatalError,
+				sConsole,
+			};
+
+			constexpr static std::uint32_t MAGIC = 'GLKC';
+			constexpr static std::uint32_t VERSION = 1;
+
+			enum RecordType : std::uint8_t
+			{
+				rtTemplate = 1,
+				rtMessage,
+			};
+
+#pragma pack(push, 1)
+			struct FileHeader
+			{
+				std::uint32_t Magic;
+				std::uint32_t Version;
+				std::uint64_t StartTime;		// FILETIME
+				std::uint64_t StartCounter;		// QueryPerformanceCounter
+				std::uint64_t Frequency;		// QueryPerformanceFrequency
+			};
+
+			struct RecordHeader
+			{
+				std::uint8_t Type;
+				std::uint8_t Reserved[3];
+				std::uint32_t Size;				// with this header
+			};
+
+			// Followed by the format string
+			struct TemplateRecord
+			{
+				RecordHeader Header;
+				std::uint32_t Id;
+				std::uint32_t Length;
+			};
+
+			// Followed by the args: type byte and the value (see PackedArgs)
+			struct MessageRecord
+			{
+				RecordHeader Header;
+				std::uint64_t Counter;
+				std::uint64_t Source;
+				std::uint32_t ThreadId;
+				std::uint32_t TemplateId;
+				std::uint8_t Severity;
+				std::uint8_t ArgCount;
+				std::uint8_t Reserved[2];
+			};
+#pragma pack(pop)
+
+			LogCapture() noexcept(true) = default;
+			virtual ~LogCapture() noexcept(true);
+
+			[[nodiscard]] static LogCapture* GetSingleton() noexcept(true);
+			[[nodiscard]] inline bool HasOpen() const noexcept(true) { return _handle != nullptr; }
+
+			bool Open(const std::wstring& fname) noexcept(true);
+			void Close() noexcept(true);
+			void Flush() noexcept(true);
+
+			// The va_list isn't changed, the caller may format the message with it after
+			void Capture(Severity severity, std::uintptr_t source, const char* format, va_list va) noexcept(true);
+			// The format is saved as UTF-8
+			void Capture(Severity severity, std::uintptr_t source, const wchar_t* format, va_list va) noexcept(true);
+			// The args already packed by PackedArgs, to pack them once for the log file too
+			void CapturePacked(Severity severity, std::uintptr_t source, const char* format, const std::string& args,
+				std::uint32_t count) noexcept(true);
+		};
+	}
+}
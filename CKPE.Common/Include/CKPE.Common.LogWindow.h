@@ -22,7 +22,6 @@ namespace CKPE
 			void* _external_pipereader_handler{ nullptr };
 			void* _external_pipewriter_handler{ nullptr };
 			FILE* _output_file{ nullptr };
-			std::uint64_t _last_hash{ 0 };
 
 			bool Create();
 			void Destroy();
@@ -57,6 +56,11 @@ namespace CKPE
 
 			bool CreateStdoutListener() noexcept(true);
 			void CloseOutputFile() noexcept(true);
+			// Writes pending messages to the output file now (the log window shows them later)
+			void Flush() noexcept(true);
+			// Takes all pending messages in one block and writes them to the output file.
+			// Returns the number of lines.
+			std::size_t FetchPendingMessages(std::string& text) noexcept(true);
 
 			bool SaveRichTextToFile(const std::string& fname) const noexcept(true);
 			bool SaveRichTextToFile(const std::wstring& fname) const noexcept(true);
@@ -64,6 +68,8 @@ namespace CKPE
 			[[nodiscard]] constexpr inline void* GetStdoutListenerPipe() const noexcept(true) 
 			{ return _external_pipewriter_handler; }
 
+			// The message is queued, the UI timer (100 ms) takes the batch and writes it to the output file.
+			// Before then it is written only by Flush, CloseOutputFile or a queue overflow.
 			virtual void InputLog(const std::string_view& formatted_message, ...);
 			virtual void InputLogVa(const std::string_view& formatted_message, va_list va);
 			virtual void InputLog(const std::wstring_view& formatted_message, ...);
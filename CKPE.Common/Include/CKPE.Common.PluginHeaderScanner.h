@@ -0,0 +1,64 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <CKPE.Common.Common.h>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// The TES4 headers of all the plugins of a folder, read in parallel. The headers of the files with the same
+		// time and size are taken from the cache of the previous scan, so only the new and changed ones are read.
+		class CKPE_COMMON_API PluginHeaderScanner
+		{
+			void* _data{ nullptr };
+
+			PluginHeaderScanner(const PluginHeaderScanner&) = delete;
+			PluginHeaderScanner& operator=(const PluginHeaderScanner&) = delete;
+		public:
+			constexpr static std::uint32_t FLAG_MASTER = 0x1;
+			constexpr static std::uint32_t FLAG_LOCALIZED = 0x80;
+			constexpr static std::uint32_t FLAG_COMPRESSED = 0x40000;
+
+			struct Header
+			{
+				std::uint32_t Flags{ 0 };		// Of the record: ESM, localized, ESL (0x200 in SSE/FO4, 0x100/0x400 in SF)
+				std::uint16_t FormVersion{ 0 };
+				float Version{ 0.0f };			// HEDR
+				std::uint32_t RecordCount{ 0 };
+				std::uint32_t NextObjectID{ 0 };
+				std::string Author;				// CNAM, zstring even in a localized plugin
+				std::string Description;		// SNAM
+				std::vector<std::string> Masters;
+
+				[[nodiscard]] inline bool IsMaster() const noexcept(true) { return Flags & FLAG_MASTER; }
+				[[nodiscard]] inline bool IsLocalized() const noexcept(true) { return Flags & FLAG_LOCALIZED; }
+			};
+
+			PluginHeaderScanner() noexcept(true);
+			virtual ~PluginHeaderScanner() noexcept(true);
+
+			// The TES4 record at the start of the plugin, doesn't depend on the platform
+			static bool Parse(const void* Data, std::size_t Size, Header& Result) noexcept(true);
+			// Mapped, only the pages of the header are read
+			static bool Read(const std::wstring& fname, Header& Result) noexcept(true);
+
+			// *.esm, *.esp, *.esl of the Directory ("...\\Data\\"), returns their number
+			std::uint32_t Scan(const std::wstring& Directory, bool UseCache = true) noexcept(true);
+			void Clear() noexcept(true);
+
+			// By the name of the file, any case
+			[[nodiscard]] bool Find(const char* FileName, Header& Result) const noexcept(true);
+			[[nodiscard]] bool GetFlags(const char* FileName, std::uint32_t& Flags) const noexcept(true);
+			[[nodiscard]] std::uint32_t GetCount() const noexcept(true);
+
+			[[nodiscard]] static PluginHeaderScanner* GetSingleton() noexcept(true);
+		};
+	}
+}
@@ -0,0 +1,98 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <CKPE.Stream.h>
+#include <CKPE.CriticalSection.h>
+#include <CKPE.Common.Common.h>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// Gives names to the addresses and threads of the samples
+		class CKPE_COMMON_API ProfileSymbolizer
+		{
+		public:
+			virtual ~ProfileSymbolizer() noexcept(true) = default;
+
+			// Must not contain ';' or spaces
+			[[nodiscard]] virtual std::string GetName(std::uintptr_t Address) const noexcept(true) = 0;
+			[[nodiscard]] virtual std::string GetThreadName(std::uint32_t ThreadId) const noexcept(true) = 0;
+		};
+
+		// Names as "module+rva" of the function start (from the unwind info), threads by their description
+		class CKPE_COMMON_API ModuleSymbolizer : public ProfileSymbolizer
+		{
+			void* _data{ nullptr };
+
+			ModuleSymbolizer(const ModuleSymbolizer&) = delete;
+			ModuleSymbolizer& operator=(const ModuleSymbolizer&) = delete;
+		public:
+			ModuleSymbolizer() noexcept(true);
+			virtual ~ModuleSymbolizer() noexcept(true);
+
+			[[nodiscard]] virtual std::string GetName(std::uintptr_t Address) const noexcept(true);
+			[[nodiscard]] virtual std::string GetThreadName(std::uint32_t ThreadId) const noexcept(true);
+		};
+
+		// Counts the same stacks, doesn't know where they came from
+		class CKPE_COMMON_API ProfileAggregator
+		{
+			void* _data{ nullptr };
+
+			ProfileAggregator(const ProfileAggregator&) = delete;
+			ProfileAggregator& operator=(const ProfileAggregator&) = delete;
+		public:
+			ProfileAggregator() noexcept(true);
+			virtual ~ProfileAggregator() noexcept(true);
+
+			// Frames from the leaf to the root
+			void Add(std::uint32_t ThreadId, const std::uintptr_t* Frames, std::uint32_t Depth,
+				std::uint64_t Count = 1) noexcept(true);
+			void Clear() noexcept(true);
+
+			[[nodiscard]] std::uint64_t GetSampleCount() const noexcept(true);
+			[[nodiscard]] std::uint32_t GetStackCount() const noexcept(true);
+
+			// One line per stack: "thread;root;...;leaf count", the input of flamegraph.pl and the like
+			void WriteFolded(TextFileStream& Stream, const ProfileSymbolizer& Symbolizer) const noexcept(true);
+		};
+
+		// Suspends the threads of the process at the given rate and keeps their stacks
+		class CKPE_COMMON_API Profiler
+		{
+			void* _data{ nullptr };
+			CriticalSection _section;
+
+			Profiler(const Profiler&) = delete;
+			Profiler& operator=(const Profiler&) = delete;
+
+			static std::uint32_t SamplerThread(void* param) noexcept(true);
+			static std::uint32_t WriterThread(void* param) noexcept(true);
+		public:
+			constexpr static std::uint32_t MAX_DEPTH = 62;
+
+			struct Sample
+			{
+				std::uint32_t ThreadId;
+				std::uint32_t Depth;
+				std::uintptr_t Frames[MAX_DEPTH];
+			};
+
+			Profiler() noexcept(true) = default;
+			virtual ~Profiler() noexcept(true);
+
+			[[nodiscard]] static Profiler* GetSingleton() noexcept(true);
+			[[nodiscard]] inline bool IsRunning() const noexcept(true) { return _data != nullptr; }
+
+			// The profile is rewritten every FlushSeconds, so it's there even if the process is killed
+			bool Start(const std::wstring& fname, std::uint32_t Rate, std::uint32_t FlushSeconds) noexcept(true);
+			void Stop() noexcept(true);
+		};
+	}
+}
@@ -6,6 +6,7 @@
 #include <CKPE.Segment.h>
 #include <CKPE.Common.Common.h>
 #include <string_view>
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -105,14 +106,31 @@ namespace CKPE
 				RVA<ClassHierarchyDescriptor*> ClassDescriptor;		// Describes inheritance hierarchy
 			};
 
+			// Set once by another thread, copied along with the Info
+			struct DemangledSlot
+			{
+				std::atomic<const char*> Name;
+
+				DemangledSlot(const char* Value = nullptr) noexcept(true) : Name(Value) {}
+				DemangledSlot(const DemangledSlot& Rhs) noexcept(true) : Name(Rhs.Name.load(std::memory_order_acquire)) {}
+				DemangledSlot& operator=(const DemangledSlot& Rhs) noexcept(true)
+				{ Name.store(Rhs.Name.load(std::memory_order_acquire), std::memory_order_release); return *this; }
+			};
+
 			struct Info
 			{
 				std::uintptr_t VTableAddress;			// Address in .rdata section
 				std::uintptr_t VTableOffset;			// Offset of this vtable in complete class (from top)
 				std::uint64_t VFunctionCount;			// Number of contiguous functions
-				const char* Name;						// Demangled
+				mutable DemangledSlot DemangledName;	// Demangled, filled on first GetName()
 				const char* RawName;					// Mangled
 				CompleteObjectLocator* Locator;			//
+
+				[[nodiscard]] inline const char* GetName() const noexcept(true)
+				{
+					auto Name = DemangledName.Name.load(std::memory_order_acquire);
+					return Name ? Name : RTTI::GetSingleton()->Demangle(this);
+				}
 			};
 		private:
 			RTTI(const RTTI&) = delete;
@@ -122,17 +140,65 @@ namespace CKPE
 			[[nodiscard]] bool IsWithinCODE(std::uintptr_t addr) const noexcept(true);
 			[[nodiscard]] bool IsValidCOL(CompleteObjectLocator* Locator) const noexcept(true);
 			[[nodiscard]] std::uint32_t GetCountVFunc(std::uintptr_t addr) const noexcept(true);
+			void ScanRange(std::uintptr_t start, std::uintptr_t end, std::vector<Info>& result) const noexcept(true);
+			bool Scan() noexcept(true);
+			void BuildAddressIndex() noexcept(true);
+			bool LoadCache(const std::wstring& fname, std::uint64_t image_hash, std::uint64_t file_size) noexcept(true);
+			void SaveCache(const std::wstring& fname, std::uint64_t image_hash, std::uint64_t file_size) const noexcept(true);
 		public:
 			RTTI() noexcept(true) = default;
 
 			[[nodiscard]] static RTTI* GetSingleton() noexcept(true);
+			[[nodiscard]] const char* Demangle(const Info* info) const noexcept(true);
+			// For the crash handler: no heap and no lock, the plain names are demangled into Buffer,
+			// the rest is given mangled unless GetName() has already been called
+			[[nodiscard]] static const char* GetNameNoAlloc(const Info* info, char* Buffer, std::size_t Size) noexcept(true);
 
 			void Initialize() noexcept(true);
+			// Any image laid out in memory, scanned without the cache (tests, tools)
+			void Initialize(std::uintptr_t Base, const Segment& Text, const Segment& Data, const Segment& RData) noexcept(true);
 			virtual void Dump(const std::wstring& fname) const noexcept(true);
+			void DumpJson(const std::wstring& fname) const noexcept(true);
 			virtual const Info* Find(const std::string_view& name, bool error_if_no_found = true) const noexcept(true);
 			virtual const Info* Find(const std::uintptr_t address, bool error_if_no_found = true) const noexcept(true);
 			virtual void* Cast(const void* InPtr, long VfDelta,
 				const char* lpstrFromType, const char* lpstrTargetType, bool isReference = false);
+			void* Cast(const void* InPtr, long VfDelta, const Info* FromInfo, const Info* TargetInfo,
+				bool isReference = false);
+		};
+
+		// Resolves both types on the first cast, so the names aren't searched again,
+		// the handles are static and shared by every thread
+		// Example: static CastHandle<TESForm, TESFullName> FormToFullName("class TESForm", "class TESFullName");
+		template<typename From, typename To>
+		class CastHandle
+		{
+			const char* _fromType;
+			const char* _targetType;
+			mutable std::atomic<const RTTI::Info*> _fromInfo{ nullptr };
+			mutable std::atomic<const RTTI::Info*> _targetInfo{ nullptr };
+		public:
+			constexpr CastHandle(const char* lpstrFromType, const char* lpstrTargetType) noexcept(true) :
+				_fromType(lpstrFromType), _targetType(lpstrTargetType)
+			{}
+
+			[[nodiscard]] To* operator()(const From* InPtr, long VfDelta = 0) const
+			{
+				auto fromInfo = _fromInfo.load(std::memory_order_acquire);
+				auto targetInfo = _targetInfo.load(std::memory_order_acquire);
+
+				if (!fromInfo || !targetInfo)
+				{
+					// Racing threads find the same entries
+					auto rtti = RTTI::GetSingleton();
+					fromInfo = rtti->Find(_fromType);
+					targetInfo = rtti->Find(_targetType);
+					_fromInfo.store(fromInfo, std::memory_order_release);
+					_targetInfo.store(targetInfo, std::memory_order_release);
+				}
+
+				return (To*)RTTI::GetSingleton()->Cast(InPtr, VfDelta, fromInfo, targetInfo);
+			}
 		};
 	}
 
@@ -0,0 +1,44 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string_view>
+#include <CKPE.Common.TaskScheduler.h>
+#include <CKPE.Common.Common.h>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// Substring search over the texts of a list, case insensitive as StrStrIA. The texts are kept folded
+		// in one buffer, the trigrams of the query pick the candidates, so only those are compared. A query that
+		// extends the previous one is looked for only among its matches. Query() may run on another thread
+		// while Add() is called, it holds the lock only while it picks the candidates.
+		class CKPE_COMMON_API SearchIndex
+		{
+			void* _data{ nullptr };
+
+			SearchIndex(const SearchIndex&) = delete;
+			SearchIndex& operator=(const SearchIndex&) = delete;
+		public:
+			SearchIndex() noexcept(true);
+			virtual ~SearchIndex() noexcept(true);
+
+			void Clear() noexcept(true);
+			// Id is whatever the list knows its items by, the text of the same Id is replaced
+			void Add(std::uintptr_t Id, std::string_view Text) noexcept(true);
+			void Remove(std::uintptr_t Id) noexcept(true);
+
+			// Ids in the order they were added, false if Group was canceled (Result is incomplete)
+			bool Query(std::string_view Pattern, std::vector<std::uintptr_t>& Result,
+				const TaskGroup* Group = nullptr) const noexcept(true);
+
+			[[nodiscard]] std::uint32_t GetCount() const noexcept(true);
+			[[nodiscard]] std::size_t GetMemoryUsage() const noexcept(true);
+		};
+	}
+}
@@ -0,0 +1,38 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <CKPE.Common.Common.h>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// Interned strings, as BSStringCache does it: the same text is always the same pointer, and lives as long
+		// as the pool. Find() doesn't take any lock (the chains are only prepended to, with release/acquire),
+		// Intern() locks one of the stripes and only if the string is new.
+		class CKPE_COMMON_API StringPool
+		{
+			void* _data{ nullptr };
+
+			StringPool(const StringPool&) = delete;
+			StringPool& operator=(const StringPool&) = delete;
+		public:
+			// Case insensitive as BSFixedString, the text of the first one interned is kept
+			StringPool(bool CaseInsensitive = true) noexcept(true);
+			virtual ~StringPool() noexcept(true);
+
+			[[nodiscard]] const char* Find(std::string_view Str) const noexcept(true);
+			const char* Intern(std::string_view Str) noexcept(true);
+			// For loading: Result[i] for Strings[i], each stripe is locked once, many are hashed in parallel
+			void InternBulk(const std::string_view* Strings, std::size_t Count, const char** Result) noexcept(true);
+
+			[[nodiscard]] std::size_t GetCount() const noexcept(true);
+			[[nodiscard]] std::size_t GetMemoryUsage() const noexcept(true);
+		};
+	}
+}
@@ -30,11 +30,39 @@ namespace CKPE
 				std::uint32_t reserved0;
 				std::uint32_t reserved1;
 			};
+
+			// Version 2, the file is mapped as is:
+			// header, rva[count], crc32[blocks], and if fReverseIndex: id[count] sorted by rva, crc32 of them
+			struct CKPE_COMMON_API TableIDHeader2
+			{
+				std::uint32_t fourcc;
+				std::uint32_t version;
+				std::uint64_t image_hash;		// Module::GetImageHash of the image the rva belong to
+				char game[16];
+				std::uint64_t game_version;
+				std::uint64_t create_time;		// time_t, fixed size on disk
+				std::uint32_t count;
+				std::uint32_t block_size;		// Number of rva with one crc32
+				std::uint32_t flags;
+				std::uint32_t header_crc32;		// With this field as zero
+			};
+
+			enum : std::uint32_t
+			{
+				fReverseIndex = 1 << 0,
+			};
+
+			constexpr static std::uint32_t INVALID_ID = 0xFFFFFFFFul;
+			constexpr static std::uint32_t BLOCK_SIZE = 4096;
 		private:
-			std::vector<std::uint32_t>* _table{ nullptr };
+			void* _data{ nullptr };
 			TableIDHeader _header{ 0 };
 			std::uintptr_t _base{ 0 };
 
+			bool Parse(const void* data, std::size_t size) noexcept(true);
+			[[nodiscard]] bool CheckBlock(std::uint32_t block) const noexcept(true);
+			[[nodiscard]] const std::uint32_t* GetReverseIndex() const noexcept(true);
+
 			TableID(const TableID&) = delete;
 			TableID& operator=(const TableID&) = delete;
 		public:
@@ -45,6 +73,7 @@ namespace CKPE
 			virtual bool Open(const std::string& fname) noexcept(true);
 			virtual bool Open(const std::wstring& fname) noexcept(true);
 			virtual bool Open(Stream& stm) noexcept(true);
+			virtual bool Save(const std::wstring& fname, bool reverse_index = true) const noexcept(true);
 			virtual void Clear() noexcept(true);
 
 			[[nodiscard]] constexpr virtual std::uint32_t Crc32() const noexcept(true) { return _header.crc32; }
@@ -53,8 +82,13 @@ namespace CKPE
 			[[nodiscard]] constexpr virtual std::uint64_t GameVersion() const noexcept(true) { return _header.game_version; }
 			[[nodiscard]] constexpr virtual time_t CreateTime() const noexcept(true) { return _header.create_time; }
 
+			[[nodiscard]] virtual std::uint64_t ImageHash() const noexcept(true);
+
 			virtual std::uint32_t Rva(std::uint32_t id) const noexcept(true);
 			virtual std::uintptr_t Offset(std::uint32_t id) const noexcept(true);
+			// Reverse lookup, if not exact then the id of the nearest rva below (the function containing it)
+			virtual std::uint32_t Id(std::uint32_t rva, bool exact = true) const noexcept(true);
+			virtual std::uint32_t IdByOffset(std::uintptr_t offset, bool exact = true) const noexcept(true);
 
 			static TableID* GetSingleton() noexcept(true);
 		};
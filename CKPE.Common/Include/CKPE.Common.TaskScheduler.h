@@ -0,0 +1,75 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <CKPE.CriticalSection.h>
+#include <CKPE.Common.Common.h>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// Tasks that can be waited for and cancelled together. Wait() runs the queued tasks of the group itself
+		// and sleeps when the rest is running, so a group may be used from a task too (nested parallelism
+		// doesn't add threads).
+		class CKPE_COMMON_API TaskGroup
+		{
+			void* _data{ nullptr };
+
+			TaskGroup(const TaskGroup&) = delete;
+			TaskGroup& operator=(const TaskGroup&) = delete;
+		public:
+			TaskGroup(const char* Name = nullptr) noexcept(true);
+			virtual ~TaskGroup() noexcept(true);
+
+			void Run(std::function<void()> Func) noexcept(true);
+			void Wait() noexcept(true);
+			// The tasks that haven't started are skipped, the running ones can check IsCanceled()
+			void Cancel() noexcept(true);
+			[[nodiscard]] bool IsCanceled() const noexcept(true);
+			// All the tasks are done or skipped, then the group is deleted without waiting
+			[[nodiscard]] bool IsDone() const noexcept(true);
+		};
+
+		// Shared work-stealing pool: each worker has its own queue and takes from the others when it's empty
+		class CKPE_COMMON_API TaskScheduler
+		{
+			void* _data{ nullptr };
+			CriticalSection _section;
+
+			TaskScheduler(const TaskScheduler&) = delete;
+			TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+			static std::uint32_t WorkerThread(void* param) noexcept(true);
+			void* GetData() noexcept(true);
+
+			friend class TaskGroup;
+		public:
+			typedef void (*TTaskTimingHandler)(const char* Name, std::int32_t WorkerId, std::uint64_t Microseconds);
+			// Called after each task, from the thread that ran it
+			TTaskTimingHandler OnTaskTiming{ nullptr };
+
+			TaskScheduler() noexcept(true) = default;
+			virtual ~TaskScheduler() noexcept(true);
+
+			// 0 - the number of logical processors minus one (the caller works too)
+			bool Initialize(std::uint32_t WorkerCount = 0) noexcept(true);
+			void Shutdown() noexcept(true);
+
+			[[nodiscard]] std::uint32_t GetWorkerCount() const noexcept(true);
+			// -1 if the current thread isn't a worker
+			[[nodiscard]] static std::int32_t GetCurrentWorkerId() noexcept(true);
+
+			// Calls Func(begin, end) for the pieces of [Begin, End) of Grain items (0 - chosen by the size).
+			// False if a piece threw, the pieces after it may be not done.
+			bool ParallelFor(std::size_t Begin, std::size_t End, std::size_t Grain,
+				const std::function<void(std::size_t, std::size_t)>& Func, const char* Name = nullptr) noexcept(true);
+
+			[[nodiscard]] static TaskScheduler* GetSingleton() noexcept(true);
+		};
+	}
+}
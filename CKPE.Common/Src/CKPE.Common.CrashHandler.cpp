@@ -25,6 +25,8 @@
 #include <CKPE.Common.RTTI.h>
 #include <CKPE.Common.Interface.h>
 #include <CKPE.Common.CrashHandler.h>
+#include <CKPE.Common.IntervalIndex.h>
+#include <CKPE.Common.LogCapture.h>
 #include <CKPE.Common.PatchManager.h>
 #include <CKPE.Common.ModernTheme.h>
 #include <CKPE.Common.UIVarCommon.h>
@@ -32,19 +34,132 @@
 #include <atomic>
 #include <thread>
 #include <unordered_map>
+#include <algorithm>
+#include <span>
 
 namespace CKPE
 {
 	namespace Common
 	{
+		///////////////////////////////////////////////////
+		/// CrashArena
+
+		// Memory for the crash report, committed on install. When the report is written the heap may be
+		// damaged, so everything the report builds comes from here. Only the report thread allocates,
+		// nothing is ever freed.
+		class CrashArena
+		{
+			std::uint8_t* Base{ nullptr };
+			std::size_t Size{ 0 };
+			std::size_t Used{ 0 };
+
+			CrashArena(const CrashArena&) = delete;
+			CrashArena& operator=(const CrashArena&) = delete;
+		public:
+			constexpr static std::size_t ARENA_SIZE = 8 * 1024 * 1024;
+
+			CrashArena() noexcept(true) = default;
+
+			bool Reserve(std::size_t NewSize) noexcept(true)
+			{
+				if (Base)
+					return true;
+
+				Base = (std::uint8_t*)VirtualAlloc(nullptr, NewSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+				Size = Base ? NewSize : 0;
+				return Base != nullptr;
+			}
+
+			[[nodiscard]] void* Allocate(std::size_t Bytes, std::size_t Align) noexcept(true)
+			{
+				auto Start = (Used + (Align - 1)) & ~(Align - 1);
+				if (!Base || (Start > Size) || (Bytes > (Size - Start)))
+					return nullptr;
+
+				Used = Start + Bytes;
+				return Base + Start;
+			}
+		};
+
+		static CrashArena GlobalCrashArena;
+
+		template<typename T>
+		class CrashArenaAllocator
+		{
+		public:
+			using value_type = T;
+
+			CrashArenaAllocator() noexcept(true) = default;
+			template<typename U> CrashArenaAllocator(const CrashArenaAllocator<U>&) noexcept(true) {}
+
+			[[nodiscard]] T* allocate(std::size_t Count)
+			{
+				auto Result = GlobalCrashArena.Allocate(Count * sizeof(T), alignof(T));
+				// Out of the arena, the section being written is cut off by its __except
+				if (!Result)
+					RaiseException('ARNA', EXCEPTION_NONCONTINUABLE, 0, NULL);
+				return (T*)Result;
+			}
+
+			void deallocate(T*, std::size_t) noexcept(true) {}
+
+			template<typename U> bool operator==(const CrashArenaAllocator<U>&) const noexcept(true) { return true; }
+		};
+
+		using CrashString = std::basic_string<char, std::char_traits<char>, CrashArenaAllocator<char>>;
+		template<typename T> using CrashVector = std::vector<T, CrashArenaAllocator<T>>;
+
+		static void CrashAppendFormat(CrashString& String, const char* Format, ...) noexcept(true)
+		{
+			char Buffer[2048];
+
+			va_list ap;
+			va_start(ap, Format);
+			auto len = _vsnprintf_s(Buffer, _TRUNCATE, Format, ap);
+			va_end(ap);
+
+			String.append(Buffer, (len < 0) ? strnlen(Buffer, sizeof(Buffer)) : (std::size_t)len);
+		}
+
+		///////////////////////////////////////////////////
+		/// CrashReportStream
+
+		// Formats each line into its own buffer and writes it through a file buffer taken from the arena,
+		// the file is the only thing that goes through the CRT.
+		class CrashReportStream : public TextFileStream
+		{
+			constexpr static std::size_t LINE_SIZE = 4096;
+			constexpr static std::size_t FILE_BUFFER_SIZE = 64 * 1024;
+
+			mutable char Line[LINE_SIZE];
+			mutable wchar_t LineW[LINE_SIZE];
+
+			void WriteFormat(const char* Format, va_list Args, bool NewLine) const noexcept(true);
+			void WriteFormat(const wchar_t* Format, va_list Args, bool NewLine) const noexcept(true);
+		public:
+			CrashReportStream(const std::string& fname);
+
+			virtual void WriteString(const std::string_view& formatted_string, ...) const noexcept(true);
+			virtual void WriteString(const std::wstring_view& formatted_string, ...) const noexcept(true);
+			virtual void WriteString(const char* formatted_string, ...) const noexcept(true);
+			virtual void WriteString(const wchar_t* formatted_string, ...) const noexcept(true);
+			virtual void WriteLine(const std::string_view& formatted_string, ...) const noexcept(true);
+			virtual void WriteLine(const std::wstring_view& formatted_string, ...) const noexcept(true);
+			virtual void WriteLine(const char* formatted_string, ...) const noexcept(true);
+			virtual void WriteLine(const wchar_t* formatted_string, ...) const noexcept(true);
+		};
+
 		///////////////////////////////////////////////////
 		/// CrashEvent
 
 		class CrashEvent
 		{
+			constexpr static std::size_t CALLSTACK_MAX = 256;
+
 			HANDLE Trigger{ nullptr };
 			NT_TIB64* Tib{ nullptr };
-			std::vector<std::uintptr_t> ProbablyCallStack;
+			std::uintptr_t ProbablyCallStack[CALLSTACK_MAX]{};
+			std::size_t ProbablyCallStackCount{ 0 };
 
 			CrashEvent(const CrashEvent&) = delete;
 			CrashEvent& operator=(const CrashEvent&) = delete;
@@ -53,7 +168,7 @@ namespace CKPE
 			virtual ~CrashEvent() noexcept(true);
 
 			virtual void IntoProbablyCallStack(std::uintptr_t address) noexcept(true);
-			virtual std::vector<std::uintptr_t>& GetProbablyCallStack() noexcept(true);
+			virtual std::span<const std::uintptr_t> GetProbablyCallStack() const noexcept(true);
 			virtual NT_TIB64* GetTib() noexcept(true);
 			virtual void CallError(NT_TIB64* tib) noexcept(true);
 			virtual bool Wait() noexcept(true);
@@ -64,13 +179,22 @@ namespace CKPE
 
 		class Introspection
 		{
+		public:
+			struct Module { std::uintptr_t Start, End; CKPE::Segment SecCode; };
+			using ModuleMapInfo = CrashVector<std::pair<CrashString, Module>>;
+			using ArrayMemoryInfo = CrashVector<CKPE::Segment>;
+		private:
 			bool Init{ false };
 			ZydisDecoder Decoder{};
 			ZydisFormatter Formatter{};
+
+			// Modules and memory regions sorted by address, built once per report. The stack is mostly
+			// pointers into the same few modules and regions, the recent hits are tried first.
+			IntervalIndex<ModuleMapInfo::value_type, CrashArenaAllocator> ModuleIndex;
+			IntervalIndex<CKPE::Segment, CrashArenaAllocator> MemoryIndex;
+			const ModuleMapInfo* ModuleIndexOwner{ nullptr };
+			const ArrayMemoryInfo* MemoryIndexOwner{ nullptr };
 		public:
-			struct Module { std::uintptr_t Start, End; CKPE::Segment SecCode; };
-			using ModuleMapInfo = std::unordered_map<std::string, Module>;
-			using ArrayMemoryInfo = std::vector<CKPE::Segment>;
 
 			enum AnalyzeItemType
 			{
@@ -85,8 +209,8 @@ namespace CKPE
 			struct AnalyzeInfo
 			{
 				AnalyzeItemType Type{ aitUnknown };
-				std::string Text;
-				std::string Additional;
+				CrashString Text;
+				CrashString Additional;
 			};
 
 			Introspection();
@@ -107,6 +231,7 @@ namespace CKPE
 			static void PrintStackSafe(TextFileStream& Stream, ModuleMapInfo* Modules, ArrayMemoryInfo* Memory,
 				PEXCEPTION_POINTERS lpExceptionInfo);
 			static void PrintPatches(TextFileStream& Stream) noexcept(true);
+			static void PrintPatchesSafe(TextFileStream& Stream);
 			static void PrintModules(TextFileStream& Stream, ModuleMapInfo* Modules) noexcept(true);
 
 			static void ContextWriteToCrashLogSafe(TextFileStream& Stream, 
@@ -115,6 +240,12 @@ namespace CKPE
 
 			[[nodiscard]] AnalyzeInfo Analyze(std::uintptr_t Address, ModuleMapInfo* Modules,
 				ArrayMemoryInfo* Memory) const noexcept(true);
+
+			void BuildIndex(ModuleMapInfo* Modules, ArrayMemoryInfo* Memory) noexcept(true);
+			[[nodiscard]] const ModuleMapInfo::value_type* FindModule(std::uintptr_t Address,
+				const ModuleMapInfo* Modules) const noexcept(true);
+			[[nodiscard]] const CKPE::Segment* FindMemory(std::uintptr_t Address,
+				const ArrayMemoryInfo* Memory) const noexcept(true);
 		private:
 			[[nodiscard]] bool AnalyzeClass(std::uintptr_t Address, AnalyzeInfo* Info,
 				std::uintptr_t RefAddress = 0) const noexcept(true);
@@ -136,12 +267,13 @@ namespace CKPE
 
 		void CrashEvent::IntoProbablyCallStack(std::uintptr_t address) noexcept(true)
 		{
-			ProbablyCallStack.push_back(address);
+			if (ProbablyCallStackCount < CALLSTACK_MAX)
+				ProbablyCallStack[ProbablyCallStackCount++] = address;
 		}
 
-		std::vector<std::uintptr_t>& CrashEvent::GetProbablyCallStack() noexcept(true)
+		std::span<const std::uintptr_t> CrashEvent::GetProbablyCallStack() const noexcept(true)
 		{
-			return ProbablyCallStack;
+			return { ProbablyCallStack, ProbablyCallStackCount };
 		}
 
 		NT_TIB64* CrashEvent::GetTib() noexcept(true)
@@ -162,6 +294,111 @@ namespace CKPE
 			return result;
 		}
 
+		///////////////////////////////////////////////////
+		/// CrashReportStream continue
+
+		CrashReportStream::CrashReportStream(const std::string& fname) :
+			TextFileStream(fname, FileStream::fmCreate)
+		{
+			// Otherwise the CRT allocates the file buffer on the first write
+			auto Buffer = GlobalCrashArena.Allocate(FILE_BUFFER_SIZE, 16);
+			if (_Handle && Buffer)
+				setvbuf(_Handle, (char*)Buffer, _IOFBF, FILE_BUFFER_SIZE);
+		}
+
+		void CrashReportStream::WriteFormat(const char* Format, va_list Args, bool NewLine) const noexcept(true)
+		{
+			if (!_Handle || !Format)
+				return;
+
+			auto len = _vsnprintf_s(Line, _TRUNCATE, Format, Args);
+			if (len < 0) len = (int)strnlen(Line, LINE_SIZE);
+			if (len < 1) return;
+
+			fwrite(Line, 1, (std::size_t)len, _Handle);
+			if (NewLine) fputc('\n', _Handle);
+		}
+
+		void CrashReportStream::WriteFormat(const wchar_t* Format, va_list Args, bool NewLine) const noexcept(true)
+		{
+			if (!_Handle || !Format)
+				return;
+
+			auto len = _vsnwprintf_s(LineW, _TRUNCATE, Format, Args);
+			if (len < 0) len = (int)wcsnlen(LineW, LINE_SIZE);
+			if (len < 1) return;
+
+			len = WideCharToMultiByte(CP_UTF8, 0, LineW, len, Line, (int)LINE_SIZE, nullptr, nullptr);
+			if (len < 1) return;
+
+			fwrite(Line, 1, (std::size_t)len, _Handle);
+			if (NewLine) fputc('\n', _Handle);
+		}
+
+		void CrashReportStream::WriteString(const std::string_view& formatted_string, ...) const noexcept(true)
+		{
+			va_list ap;
+			va_start(ap, &formatted_string);
+			WriteFormat(formatted_string.data(), ap, false);
+			va_end(ap);
+		}
+
+		void CrashReportStream::WriteString(const std::wstring_view& formatted_string, ...) const noexcept(true)
+		{
+			va_list ap;
+			va_start(ap, &formatted_string);
+			WriteFormat(formatted_string.data(), ap, false);
+			va_end(ap);
+		}
+
+		void CrashReportStream::WriteString(const char* formatted_string, ...) const noexcept(true)
+		{
+			va_list ap;
+			va_start(ap, &formatted_string);
+			WriteFormat(formatted_string, ap, false);
+			va_end(ap);
+		}
+
+		void CrashReportStream::WriteString(const wchar_t* formatted_string, ...) const noexcept(true)
+		{
+			va_list ap;
+			va_start(ap, &formatted_string);
+			WriteFormat(formatted_string, ap, false);
+			va_end(ap);
+		}
+
+		void CrashReportStream::WriteLine(const std::string_view& formatted_string, ...) const noexcept(true)
+		{
+			va_list ap;
+			va_start(ap, &formatted_string);
+			WriteFormat(formatted_string.data(), ap, true);
+			va_end(ap);
+		}
+
+		void CrashReportStream::WriteLine(const std::wstring_view& formatted_string, ...) const noexcept(true)
+		{
+			va_list ap;
+			va_start(ap, &formatted_string);
+			WriteFormat(formatted_string.data(), ap, true);
+			va_end(ap);
+		}
+
+		void CrashReportStream::WriteLine(const char* formatted_string, ...) const noexcept(true)
+		{
+			va_list ap;
+			va_start(ap, &formatted_string);
+			WriteFormat(formatted_string, ap, true);
+			va_end(ap);
+		}
+
+		void CrashReportStream::WriteLine(const wchar_t* formatted_string, ...) const noexcept(true)
+		{
+			va_list ap;
+			va_start(ap, &formatted_string);
+			WriteFormat(formatted_string, ap, true);
+			va_end(ap);
+		}
+
 		///////////////////////////////////////////////////
 		/// Global
 
@@ -171,6 +408,9 @@ namespace CKPE
 		std::atomic<PEXCEPTION_POINTERS> GlobalCrashDumpExceptionInfo;
 		std::atomic_uint32_t GlobalCrashDumpTargetThreadId;
 		HMODULE GlobalModuleList[1024];
+		// Reserved on install for the handlers that return text
+		std::string GlobalCrashCallbackText;
+		char GlobalCrashSysInfo[2048];
 
 		///////////////////////////////////////////////////
 		/// Introspection continue
@@ -188,13 +428,21 @@ namespace CKPE
 			auto ObjRtti = Common::RTTI::GetSingleton()->Find(Address, false);
 			if (ObjRtti)
 			{
+				// Demangling would take the heap and the lock of the RTTI
+				static char NameBuffer[512];
+				auto Name = Common::RTTI::GetNameNoAlloc(ObjRtti, NameBuffer, sizeof(NameBuffer));
+
 				Info->Type = aitClass;
-				Info->Text = ObjRtti->Name;
+				Info->Text = Name;
 				auto it = Info->Text.find_first_of(' ');
-				if (it != std::string::npos) Info->Text.erase(0, it + 1);
+				if (it != CrashString::npos) Info->Text.erase(0, it + 1);
 
 				if (RefAddress && GlobalCrashHandler.OnAnalyzeClassRef)
-					GlobalCrashHandler.OnAnalyzeClassRef(RefAddress, ObjRtti->Name, Info->Additional);
+				{
+					GlobalCrashCallbackText.clear();
+					GlobalCrashHandler.OnAnalyzeClassRef(RefAddress, Name, GlobalCrashCallbackText);
+					Info->Additional.assign(GlobalCrashCallbackText.data(), GlobalCrashCallbackText.length());
+				}
 
 				return true;
 			}
@@ -202,11 +450,71 @@ namespace CKPE
 			return false;
 		}
 
+		void Introspection::BuildIndex(ModuleMapInfo* Modules, ArrayMemoryInfo* Memory) noexcept(true)
+		{
+			ModuleIndexOwner = nullptr;
+			MemoryIndexOwner = nullptr;
+
+			try
+			{
+				if (Modules)
+				{
+					ModuleIndex.Build(*Modules, [](const ModuleMapInfo::value_type& Item, std::uintptr_t& Start,
+						std::uintptr_t& End) { Start = Item.second.Start; End = Item.second.End; });
+					ModuleIndexOwner = Modules;
+				}
+
+				if (Memory)
+				{
+					MemoryIndex.Build(*Memory, [](const CKPE::Segment& Item, std::uintptr_t& Start,
+						std::uintptr_t& End) { Start = Item.GetAddress(); End = Item.GetEndAddress(); });
+					MemoryIndexOwner = Memory;
+				}
+			}
+			catch (...)
+			{
+				// Lookups fall back to the linear search
+				ModuleIndexOwner = nullptr;
+				MemoryIndexOwner = nullptr;
+			}
+		}
+
+		const Introspection::ModuleMapInfo::value_type* Introspection::FindModule(std::uintptr_t Address,
+			const ModuleMapInfo* Modules) const noexcept(true)
+		{
+			if (!Modules)
+				return nullptr;
+
+			// The index belongs to the lists given to BuildIndex
+			if (ModuleIndexOwner == Modules)
+				return ModuleIndex.Find(Address);
+
+			for (auto it = Modules->begin(); it != Modules->end(); it++)
+				if ((Address >= it->second.Start) && (Address < it->second.End))
+					return &(*it);
+			return nullptr;
+		}
+
+		const CKPE::Segment* Introspection::FindMemory(std::uintptr_t Address,
+			const ArrayMemoryInfo* Memory) const noexcept(true)
+		{
+			if (!Memory)
+				return nullptr;
+
+			if (MemoryIndexOwner == Memory)
+				return MemoryIndex.Find(Address);
+
+			// Not indexed list
+			for (auto it = Memory->begin(); it != Memory->end(); it++)
+				if ((Address >= it->GetAddress()) && (Address < it->GetEndAddress()))
+					return &(*it);
+			return nullptr;
+		}
+
 		Introspection::AnalyzeInfo Introspection::Analyze(std::uintptr_t Address,
 			ModuleMapInfo* Modules, ArrayMemoryInfo* Memory) const noexcept(true)
 		{
 			AnalyzeInfo Info;
-			ZeroMemory(&Info, sizeof(Info));
 
 			if (!Init)
 			{
@@ -220,14 +528,8 @@ namespace CKPE
 				return Info;
 			}
 
-			auto itMod = Modules->begin();
-			for (; itMod != Modules->end(); itMod++)
-			{
-				if ((Address >= itMod->second.Start) && (Address < itMod->second.End))
-					break;
-			}
-
-			if (itMod != Modules->end())
+			auto itMod = FindModule(Address, Modules);
+			if (itMod)
 			{
 				// Address module
 
@@ -237,7 +539,7 @@ namespace CKPE
 				if ((Address >= itMod->second.SecCode.GetAddress()) && (Address < itMod->second.SecCode.GetEndAddress()))
 				{
 					Info.Type = aitCode;
-					Info.Text = StringUtils::FormatString("%s+%X ", itMod->first.c_str(),
+					CrashAppendFormat(Info.Text, "%s+%X ", itMod->first.c_str(),
 						(uint32_t)(Address - itMod->second.Start));
 
 					char InstructionText[256];
@@ -265,14 +567,7 @@ namespace CKPE
 			Analize_Continue:
 				if (Memory)
 				{
-					auto itMem = Memory->begin();
-					for (; itMem != Memory->end(); itMem++)
-					{
-						if ((Address >= itMem->GetAddress()) && (Address < itMem->GetEndAddress()))
-							break;
-					}
-
-					if (itMem != Memory->end())
+					if (FindMemory(Address, Memory))
 					{
 						auto Tib = GlobalCrashEvent.GetTib();
 						if (Tib && (Tib->StackLimit <= Address) && (Tib->StackBase > Address))
@@ -283,7 +578,7 @@ namespace CKPE
 							{
 								Info.Type = RefInfo.Type;
 								if ((RefInfo.Type == aitNumber) || (RefInfo.Type == aitClass) || (RefInfo.Type == aitString))
-									Info.Text.append(StringUtils::FormatString("&%s", RefInfo.Text.c_str()));
+									CrashAppendFormat(Info.Text, "&%s", RefInfo.Text.c_str());
 								else
 								{
 									if (!AnalyzeClass(*(uintptr_t*)Address, &Info, Address))
@@ -312,7 +607,7 @@ namespace CKPE
 								if ((len > 4) && (len < max))
 								{
 									Info.Type = aitString;
-									Info.Text.append(StringUtils::FormatString("\"%s\"", str));
+									CrashAppendFormat(Info.Text, "\"%s\"", str);
 								}
 							}
 						}
@@ -337,9 +632,8 @@ namespace CKPE
 
 							if ((len > 5) && (len <= max))
 							{
-								std::string a(str, len);
 								Info.Type = aitString;
-								Info.Text.append(StringUtils::FormatString("\"%s\"", a.c_str()));
+								CrashAppendFormat(Info.Text, "\"%.*s\"", (int)len, str);
 							}
 							else
 								Info.Type = aitNumber;
@@ -351,6 +645,18 @@ namespace CKPE
 			return Info;
 		}
 
+		// The code section from the headers of the loaded module, as CKPE::Module reads it but without the heap
+		static CKPE::Segment GetCodeSegment(std::uintptr_t Base) noexcept(true)
+		{
+			auto NtHeaders = (PIMAGE_NT_HEADERS)(Base + ((PIMAGE_DOS_HEADER)Base)->e_lfanew);
+			auto Section = IMAGE_FIRST_SECTION(NtHeaders);
+			for (WORD i = 0; i < NtHeaders->FileHeader.NumberOfSections; i++, Section++)
+				if (!strncmp((const char*)Section->Name, ".text", sizeof(Section->Name)))
+					return CKPE::Segment{ Base, Base + Section->VirtualAddress, Section->Misc.VirtualSize };
+
+			return CKPE::Segment{};
+		}
+
 		void Introspection::ContextWriteToCrashLogSafe(TextFileStream& Stream,
 			PEXCEPTION_POINTERS ExceptionInfo) noexcept(true)
 		{
@@ -358,16 +664,16 @@ namespace CKPE
 			
 			if (GlobalCrashHandler.OnOutputCKVersion)
 			{
-				std::string str;
-				GlobalCrashHandler.OnOutputCKVersion(str);
-				Stream.WriteLine("CK %s", str.c_str());
+				GlobalCrashCallbackText.clear();
+				GlobalCrashHandler.OnOutputCKVersion(GlobalCrashCallbackText);
+				Stream.WriteLine("CK %s", GlobalCrashCallbackText.c_str());
 			}
 
 			if (GlobalCrashHandler.OnOutputVersion)
 			{
-				std::string str;
-				GlobalCrashHandler.OnOutputVersion(str);
-				Stream.WriteLine(str.c_str());
+				GlobalCrashCallbackText.clear();
+				GlobalCrashHandler.OnOutputVersion(GlobalCrashCallbackText);
+				Stream.WriteLine("%s", GlobalCrashCallbackText.c_str());
 			}
 
 			Stream.Flush();
@@ -380,6 +686,9 @@ namespace CKPE
 			// Get a list of all the modules in this process.
 			if (EnumProcessModules(hProcess, GlobalModuleList, sizeof(GlobalModuleList), &cbNeeded))
 			{
+				cbNeeded = std::min(cbNeeded, (DWORD)sizeof(GlobalModuleList));
+				Modules.reserve(cbNeeded / sizeof(HMODULE));
+
 				for (DWORD i = 0; i < (cbNeeded / sizeof(HMODULE)); i++)
 				{
 					CHAR szModName[MAX_PATH];
@@ -389,31 +698,42 @@ namespace CKPE
 						MODULEINFO Info;
 						GetModuleInformation(hProcess, GlobalModuleList[i], &Info, sizeof(MODULEINFO));
 
-						CKPE::Module smodule(GlobalModuleList[i]);
-						auto secCode = smodule.GetSegment(CKPE::Segment::text);
-						Modules.insert(Modules.end(),
-							std::make_pair<std::string, Module>(PathFindFileNameA(szModName),
-								{ (uintptr_t)Info.lpBaseOfDll, (uintptr_t)Info.lpBaseOfDll + (uintptr_t)Info.SizeOfImage, 
-								  secCode }));
+						Modules.emplace_back(CrashString(PathFindFileNameA(szModName)),
+							Module{ (uintptr_t)Info.lpBaseOfDll, (uintptr_t)Info.lpBaseOfDll + (uintptr_t)Info.SizeOfImage, 
+								GetCodeSegment((uintptr_t)Info.lpBaseOfDll) });
 					}
 				}
 			}
 
-			MEMORY_BASIC_INFORMATION mbi;
-			ZeroMemory(&mbi, sizeof(mbi));
+			const auto lamda_enum_memory = [](auto&& Callback)
+				{
+					MEMORY_BASIC_INFORMATION mbi;
+					ZeroMemory(&mbi, sizeof(mbi));
 
-			uint64_t Address = 0;
-			while (Address < std::numeric_limits<uint64_t>::max() &&
-				VirtualQuery((LPCVOID)Address, std::addressof(mbi), sizeof(mbi)))
-			{
-				if ((mbi.State == MEM_COMMIT) && !(mbi.Protect & PAGE_GUARD) &&
-					!((mbi.Protect & PAGE_EXECUTE) || (mbi.Protect & PAGE_EXECUTE_READ) ||
-						(mbi.Protect & PAGE_EXECUTE_READWRITE) || (mbi.Protect & PAGE_EXECUTE_WRITECOPY)))
+					uint64_t Address = 0;
+					while (Address < std::numeric_limits<uint64_t>::max() &&
+						VirtualQuery((LPCVOID)Address, std::addressof(mbi), sizeof(mbi)))
+					{
+						if ((mbi.State == MEM_COMMIT) && !(mbi.Protect & PAGE_GUARD) &&
+							!((mbi.Protect & PAGE_EXECUTE) || (mbi.Protect & PAGE_EXECUTE_READ) ||
+								(mbi.Protect & PAGE_EXECUTE_READWRITE) || (mbi.Protect & PAGE_EXECUTE_WRITECOPY)))
+							Callback(mbi);
+
+						Address += mbi.RegionSize;
+						ZeroMemory(&mbi, sizeof(mbi));
+					}
+				};
+
+			// Count first, the arena doesn't get back what a growing array leaves behind
+			std::size_t MemoryCount = 0;
+			lamda_enum_memory([&MemoryCount](const MEMORY_BASIC_INFORMATION&) { MemoryCount++; });
+			Memory.reserve(MemoryCount + 64);
+			lamda_enum_memory([&Memory](const MEMORY_BASIC_INFORMATION& mbi)
+				{
 					Memory.push_back({ (uintptr_t)mbi.BaseAddress, (uintptr_t)mbi.BaseAddress, mbi.RegionSize });
+				});
 
-				Address += mbi.RegionSize;
-				ZeroMemory(&mbi, sizeof(mbi));
-			}
+			GlobalCrashIntrospection.BuildIndex(&Modules, &Memory);
 
 			PEXCEPTION_RECORD lpExceptionRecord = ExceptionInfo->ExceptionRecord;
 
@@ -424,7 +744,7 @@ namespace CKPE
 			PrintRegistrySafe(Stream, &Modules, &Memory, ExceptionInfo);
 			PrintStackSafe(Stream, &Modules, &Memory, ExceptionInfo);
 			PrintCallStackSafe(Stream, &Modules);
-			PrintPatches(Stream);
+			PrintPatchesSafe(Stream);
 			PrintModules(Stream, &Modules);
 		}
 
@@ -446,9 +766,8 @@ namespace CKPE
 			if (!lpExceptionRecord || !Modules)
 				return;
 
-			std::string ExceptionName;
-			std::string ExceptionDescription;
-			std::string ExceptionInstructionText;
+			const char* ExceptionName = nullptr;
+			const char* ExceptionDescription = nullptr;
 
 			switch (lpExceptionRecord->ExceptionCode)
 			{
@@ -544,17 +863,16 @@ namespace CKPE
 
 			auto Analize = GlobalCrashIntrospection.Analyze((uintptr_t)lpExceptionRecord->ExceptionAddress, 
 				Modules, nullptr);
-			ExceptionInstructionText.append(Analize.Text);
 
-			Stream.WriteLine("\nUnhandled exception ""%s"" at 0x%016llX %s", ExceptionName.c_str(),
-				(uintptr_t)lpExceptionRecord->ExceptionAddress, ExceptionInstructionText.c_str());
+			Stream.WriteLine("\nUnhandled exception ""%s"" at 0x%016llX %s", ExceptionName,
+				(uintptr_t)lpExceptionRecord->ExceptionAddress, Analize.Text.c_str());
 
 			// Log exception flags
 			Stream.WriteLine("Exception Flags: 0x%08X", lpExceptionRecord->ExceptionFlags);
 			// Log number of parameters
 			Stream.WriteLine("Number of Parameters: %u", lpExceptionRecord->NumberParameters);
 			// Description
-			Stream.WriteLine("Exception Description: %s", ExceptionDescription.c_str());
+			Stream.WriteLine("Exception Description: %s", ExceptionDescription);
 
 			// Log additional exception information for specific exception types
 			if (lpExceptionRecord->ExceptionCode == EXCEPTION_ACCESS_VIOLATION)
@@ -598,25 +916,29 @@ namespace CKPE
 
 		void Introspection::PrintSettings(TextFileStream& Stream) noexcept(true)
 		{
-			Interface::GetSingleton()->GetSettings()->Dump(Stream);
+			auto Settings = Interface::GetSingleton()->GetSettings();
+			if (Settings)
+				Settings->Dump(Stream);
 			Stream.WriteString("\n");
 			Stream.Flush();
 		}
 
 		void Introspection::PrintSysInfo(TextFileStream& Stream) noexcept(true)
 		{
+			// OS, CPU and GPU are written on install
 			Stream.WriteLine("SYSTEM SPECS:");
-			Stream.WriteLine("\tOS: %s", StringUtils::Utf16ToWinCP(HardwareInfo::OS::GetVersionByStringEx()).c_str());
-			Stream.WriteLine("\tCPU: %s", HardwareInfo::CPU::GetBrand().c_str());
-
-			for (uint8_t i = 0; i < HardwareInfo::GPU::GetCount(); i++)
-				Stream.WriteLine("\tGPU #%u: %s %u Gb", i + 1, 
-					HardwareInfo::GPU::GetName(i).c_str(), HardwareInfo::GPU::GetMemorySizeByUint(i));
+			Stream.WriteString("%s", GlobalCrashSysInfo);
 
-			auto pm = HardwareInfo::OS::GetPhysicalMemory();
-			Stream.WriteLine("\tPHYSICAL MEMORY: %.2f GB / %.2f GB", pm.Total - pm.Free, pm.Total);
-			auto sm = HardwareInfo::OS::GetSharedMemory();
-			Stream.WriteLine("\tSHARED MEMORY: %.2f GB / %.2f GB\n", sm.Total - sm.Free, sm.Total);
+			// HardwareInfo keeps the first values it got, and may take the heap on the first call
+			constexpr double GB = 1073741824.0;
+			MEMORYSTATUSEX Status{ .dwLength = sizeof(MEMORYSTATUSEX) };
+			if (GlobalMemoryStatusEx(&Status))
+			{
+				Stream.WriteLine("\tPHYSICAL MEMORY: %.2f GB / %.2f GB", (Status.ullTotalPhys - Status.ullAvailPhys) / GB,
+					Status.ullTotalPhys / GB);
+				Stream.WriteLine("\tSHARED MEMORY: %.2f GB / %.2f GB\n", (Status.ullTotalPageFile - Status.ullAvailPageFile) / GB,
+					Status.ullTotalPageFile / GB);
+			}
 			Stream.Flush();
 		}
 
@@ -647,7 +969,6 @@ namespace CKPE
 				{
 					Stream.WriteString("\t%s %-*llX ", NameReg, 16, Value);
 
-					std::string AnalizeText;
 					auto Analize = GlobalCrashIntrospection.Analyze(Value, Modules, Memory);
 
 					switch (Analize.Type)
@@ -812,7 +1133,6 @@ namespace CKPE
 
 				while ((stack_iter < (stack_end - 8)) && ((stack_iter - stack_last) < 0x2500))
 				{
-					std::string AnalizeText;
 					auto Analize = GlobalCrashIntrospection.Analyze(*(uintptr_t*)stack_iter, Modules, Memory);
 
 					Stream.WriteString("\t[RSP+%-*X] 0x%-*llX ", 4, (uint32_t)(stack_iter - stack_last), 16, 
@@ -893,6 +1213,19 @@ namespace CKPE
 			Stream.Flush();
 		}
 
+		void Introspection::PrintPatchesSafe(TextFileStream& Stream)
+		{
+			__try
+			{
+				// Patch::GetName returns a copy, this is the only part of the report on the heap
+				PrintPatches(Stream);
+			}
+			__except (1)
+			{
+				Stream.WriteString("\n");
+			}
+		}
+
 		void Introspection::PrintModules(TextFileStream& Stream, ModuleMapInfo* Modules) noexcept(true)
 		{
 			Stream.WriteLine("MODULES:");
@@ -1204,12 +1537,15 @@ namespace CKPE
 				return FALSE;
 				};
 
+			// The messages still in the async queue and in the capture buffer belong to the report
+			Interface::GetSingleton()->GetLogger()->Flush();
+			LogCapture::GetSingleton()->Flush();
 			LogWindow::GetSingleton()->CloseOutputFile();
 
 			if (Param.ExceptionInfo)
 			{
-				TextFileStream stm(CrashReportFName, FileStream::fmCreate);
-				Introspection::ContextWriteToCrashLog(stm, Param.ExceptionInfo);
+				CrashReportStream stm(CrashReportFName);
+				WriteReport(stm, Param.ExceptionInfo);
 			}
 
 			if (DialogBoxParamA((HINSTANCE)Interface::GetSingleton()->GetInstanceDLL(),
@@ -1235,6 +1571,7 @@ namespace CKPE
 
 				// Close and added archive the log's
 				Interface::GetSingleton()->GetLogger()->Close();
+				LogCapture::GetSingleton()->Close();
 
 				// Generate minidump
 				if (Param.ExceptionInfo)
@@ -1311,6 +1648,24 @@ namespace CKPE
 			SetProcessExceptionHandlers();
 			SetThreadExceptionHandlers();
 
+			// Everything the report needs from the heap is taken now, while it's healthy
+			if (!GlobalCrashArena.Reserve(CrashArena::ARENA_SIZE))
+				_WARNING("CrashHandler: can't reserve memory for the crash report");
+
+			GlobalCrashCallbackText.reserve(4096);
+
+			auto SysInfoLen = (std::size_t)_snprintf_s(GlobalCrashSysInfo, _TRUNCATE, "\tOS: %s\n\tCPU: %s\n",
+				StringUtils::Utf16ToWinCP(HardwareInfo::OS::GetVersionByStringEx()).c_str(),
+				HardwareInfo::CPU::GetBrand().c_str());
+			for (uint8_t i = 0; (i < HardwareInfo::GPU::GetCount()) && (SysInfoLen < sizeof(GlobalCrashSysInfo)); i++)
+			{
+				auto len = _snprintf_s(GlobalCrashSysInfo + SysInfoLen, sizeof(GlobalCrashSysInfo) - SysInfoLen, _TRUNCATE,
+					"\tGPU #%u: %s %u Gb\n", i + 1, HardwareInfo::GPU::GetName(i).c_str(), 
+					HardwareInfo::GPU::GetMemorySizeByUint(i));
+				if (len < 0) break;
+				SysInfoLen += (std::size_t)len;
+			}
+
 			std::thread t([]()
 				{
 					if (UI::IsDarkTheme())
@@ -1360,6 +1715,16 @@ namespace CKPE
 			t.detach();
 		}
 
+		bool CrashHandler::WriteReport(TextFileStream& Stream, void* ExceptionInfo) noexcept(true)
+		{
+			// Done by Install, unless the report is written without the handlers
+			if (!ExceptionInfo || !GlobalCrashArena.Reserve(CrashArena::ARENA_SIZE))
+				return false;
+
+			Introspection::ContextWriteToCrashLog(Stream, (PEXCEPTION_POINTERS)ExceptionInfo);
+			return true;
+		}
+
 		CrashHandler* CrashHandler::GetSingleton() noexcept(true)
 		{
 			return &GlobalCrashHandler;
@@ -0,0 +1,604 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <CKPE.HashUtils.h>
+#include <CKPE.Common.Interface.h>
+#include <CKPE.Common.Threads.h>
+#include <CKPE.Common.TaskScheduler.h>
+#include <CKPE.Common.DirectorySnapshot.h>
+#include <shared_mutex>
+#include <string_view>
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <set>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		constexpr static std::uint32_t SNAPSHOT_EMPTY = 0xFFFFFFFFul;
+		constexpr static std::uint32_t SNAPSHOT_DELETED = 0xFFFFFFFEul;
+		constexpr static std::uint32_t SNAPSHOT_PATH_MAX = 1024;
+		constexpr static std::uint32_t SNAPSHOT_NOTIFY_BUFFER = 64 * 1024;
+		constexpr static std::uint32_t SNAPSHOT_UNSURE_MAX = 1024;		// More and it's scanned again
+		constexpr static std::uint64_t SNAPSHOT_SETTLE_MS = 1000;		// The misses are checked on disk for so long after a change
+		constexpr static std::uint32_t SNAPSHOT_NOTIFY_FILTER = FILE_NOTIFY_CHANGE_FILE_NAME |
+			FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+		static DirectorySnapshot sdirectory_snapshot;
+
+		// Lower case (ASCII, as NTFS compares most names), '\' only, without the one at the end.
+		// Returns the length or 0 if it doesn't fit or isn't ASCII: the case of the other characters
+		// depends on the code page and the volume, and '?' is what the conversion leaves of them.
+		// Such paths are never in the table and Find gives rUnknown for them.
+		static std::uint32_t SnapshotFold(const char* Path, std::size_t Length, char* Buffer) noexcept(true)
+		{
+			if (Length >= SNAPSHOT_PATH_MAX)
+				return 0;
+
+			for (std::size_t i = 0; i < Length; i++)
+			{
+				auto Ch = Path[i];
+				if (((std::uint8_t)Ch >= 0x80) || (Ch == '?'))
+					return 0;
+				else if (Ch == '/')
+					Ch = '\\';
+				else if ((Ch >= 'A') && (Ch <= 'Z'))
+					Ch += 'a' - 'A';
+				Buffer[i] = Ch;
+			}
+
+			while (Length && (Buffer[Length - 1] == '\\'))
+				Length--;
+
+			Buffer[Length] = '\0';
+			return (std::uint32_t)Length;
+		}
+
+		[[nodiscard]] static inline std::uint64_t SnapshotFileTime(const FILETIME& Time) noexcept(true)
+		{
+			return ((std::uint64_t)Time.dwHighDateTime << 32) | Time.dwLowDateTime;
+		}
+
+		struct SnapshotEntry
+		{
+			std::uint64_t Hash;
+			std::uint32_t Offset;
+			std::uint32_t Length;
+			DirectorySnapshot::FileInfo Info;
+		};
+
+		// Open addressing over the entries, the names are all in one buffer
+		struct SnapshotTable
+		{
+			std::string Pool;
+			std::vector<SnapshotEntry> Entries;
+			std::vector<std::uint32_t> Slots;
+			std::uint32_t Used{ 0 };				// With the deleted ones
+
+			[[nodiscard]] std::uint32_t Find(const char* Key, std::uint32_t Length, std::uint64_t Hash) const noexcept(true)
+			{
+				if (Slots.empty())
+					return SNAPSHOT_EMPTY;
+
+				auto Mask = Slots.size() - 1;
+				for (auto i = (std::size_t)Hash & Mask; Slots[i] != SNAPSHOT_EMPTY; i = (i + 1) & Mask)
+				{
+					if (Slots[i] == SNAPSHOT_DELETED)
+						continue;
+
+					auto& Entry = Entries[Slots[i]];
+					if ((Entry.Hash == Hash) && (Entry.Length == Length) && !memcmp(Pool.data() + Entry.Offset, Key, Length))
+						return (std::uint32_t)i;
+				}
+
+				return SNAPSHOT_EMPTY;
+			}
+
+			void Rehash(std::size_t Capacity)
+			{
+				std::vector<std::uint32_t> Old(Capacity, SNAPSHOT_EMPTY);
+				Old.swap(Slots);
+				Used = 0;
+
+				auto Mask = Slots.size() - 1;
+				for (auto Index : Old)
+				{
+					if ((Index == SNAPSHOT_EMPTY) || (Index == SNAPSHOT_DELETED))
+						continue;
+
+					auto i = (std::size_t)Entries[Index].Hash & Mask;
+					while (Slots[i] != SNAPSHOT_EMPTY)
+						i = (i + 1) & Mask;
+
+					Slots[i] = Index;
+					Used++;
+				}
+			}
+
+			void Insert(const char* Key, std::uint32_t Length, const DirectorySnapshot::FileInfo& Info)
+			{
+				auto Hash = HashUtils::FastHash64(Key, Length);
+				auto Slot = Find(Key, Length, Hash);
+				if (Slot != SNAPSHOT_EMPTY)
+				{
+					Entries[Slots[Slot]].Info = Info;
+					return;
+				}
+
+				if (((std::size_t)Used + 1) * 2 > Slots.size())
+					Rehash(std::max<std::size_t>(1024, Slots.size() * 2));
+
+				auto Mask = Slots.size() - 1;
+				auto i = (std::size_t)Hash & Mask;
+				while ((Slots[i] != SNAPSHOT_EMPTY) && (Slots[i] != SNAPSHOT_DELETED))
+					i = (i + 1) & Mask;
+
+				if (Slots[i] == SNAPSHOT_EMPTY)
+					Used++;
+
+				Slots[i] = (std::uint32_t)Entries.size();
+				Entries.push_back({ Hash, (std::uint32_t)Pool.size(), Length, Info });
+				Pool.append(Key, Length);
+			}
+
+			// Returns the attributes of the one erased or INVALID_FILE_ATTRIBUTES
+			std::uint32_t Erase(const char* Key, std::uint32_t Length) noexcept(true)
+			{
+				auto Slot = Find(Key, Length, HashUtils::FastHash64(Key, Length));
+				if (Slot == SNAPSHOT_EMPTY)
+					return INVALID_FILE_ATTRIBUTES;
+
+				auto Attributes = Entries[Slots[Slot]].Info.Attributes;
+				Slots[Slot] = SNAPSHOT_DELETED;
+				return Attributes;
+			}
+		};
+
+		struct DirectorySnapshotData
+		{
+			std::string RootPath;					// As given, with '\' at the end
+			std::string Root;						// Folded
+			mutable std::shared_mutex Lock;
+			SnapshotTable Table;
+			std::set<std::string, std::less<>> Unsure;		// Folded, with '\' at the end
+			std::atomic_bool Ready{ false };
+			std::atomic_bool Applying{ false };
+			std::atomic_uint64_t LastChange{ 0 };	// GetTickCount64
+			OVERLAPPED Overlapped{};				// Of the read of the notifications, the event is owned
+			HANDLE StopEvent{ nullptr };
+			HANDLE Thread{ nullptr };
+
+			~DirectorySnapshotData() noexcept(true)
+			{
+				if (StopEvent) CloseHandle(StopEvent);
+				if (Overlapped.hEvent) CloseHandle(Overlapped.hEvent);
+			}
+
+			// The table may not know of a change yet: its notification waits in the completed read or is
+			// being applied, or it was a moment ago and the writes of the editor may still be on the way.
+			// A miss is sure only when nothing of that is going on.
+			[[nodiscard]] bool IsChanging() const noexcept(true)
+			{
+				return Applying || HasOverlappedIoCompleted(&Overlapped) ||
+					((GetTickCount64() - LastChange) < SNAPSHOT_SETTLE_MS);
+			}
+
+			// The lock must be taken. The folders of the path are looked up, not the whole set.
+			[[nodiscard]] bool IsUnsure(std::string_view Path) const noexcept(true)
+			{
+				if (Unsure.empty())
+					return false;
+
+				if (Unsure.contains(std::string_view()))
+					return true;
+
+				for (auto Pos = Path.find('\\'); Pos != std::string_view::npos; Pos = Path.find('\\', Pos + 1))
+					if (Unsure.contains(Path.substr(0, Pos + 1)))
+						return true;
+
+				return false;
+			}
+
+			// The lock must be taken. false - there are too many, it's better to scan again.
+			bool AddUnsure(std::string Prefix)
+			{
+				if (IsUnsure(Prefix))
+					return true;
+
+				if (Unsure.size() >= SNAPSHOT_UNSURE_MAX)
+					return false;
+
+				Unsure.insert(std::move(Prefix));
+				return true;
+			}
+
+			bool Scan() noexcept(true)
+			{
+				SnapshotTable NewTable;
+				std::vector<std::string> NewUnsure;
+				CriticalSection Section;
+				TaskGroup Group("DirectorySnapshot");
+
+				std::function<void(std::string)> ScanFolder = [&](std::string Folder)
+					{
+						std::vector<std::pair<std::string, DirectorySnapshot::FileInfo>> Found;
+						WIN32_FIND_DATAA FindData;
+
+						auto Handle = FindFirstFileExA((RootPath + Folder + "*").c_str(), FindExInfoBasic, &FindData,
+							FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+
+						if (Handle == INVALID_HANDLE_VALUE)
+						{
+							// Not readable, the file system knows better
+							char Key[SNAPSHOT_PATH_MAX];
+							auto Length = SnapshotFold(Folder.c_str(), Folder.length(), Key);
+
+							// Otherwise Find doesn't answer for it anyway
+							if (Length || Folder.empty())
+							{
+								ScopeCriticalSection guard(Section);
+								NewUnsure.emplace_back(Length ? std::string(Key, Length) + "\\" : std::string());
+							}
+							return;
+						}
+
+						do
+						{
+							if (!strcmp(FindData.cFileName, ".") || !strcmp(FindData.cFileName, ".."))
+								continue;
+
+							auto Name = Folder + FindData.cFileName;
+
+							if (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+								Group.Run([&ScanFolder, Sub = Name + "\\"]() { ScanFolder(Sub); });
+
+							Found.emplace_back(std::move(Name), DirectorySnapshot::FileInfo
+								{
+									.Attributes = FindData.dwFileAttributes,
+									.Size = ((std::uint64_t)FindData.nFileSizeHigh << 32) | FindData.nFileSizeLow,
+									.WriteTime = SnapshotFileTime(FindData.ftLastWriteTime),
+								});
+						} while (FindNextFileA(Handle, &FindData));
+
+						FindClose(Handle);
+
+						ScopeCriticalSection guard(Section);
+						for (auto& File : Found)
+						{
+							char Key[SNAPSHOT_PATH_MAX];
+							auto Length = SnapshotFold(File.first.c_str(), File.first.length(), Key);
+							// Too long or not ASCII, Find gives rUnknown for it and everything in it
+							if (Length)
+								NewTable.Insert(Key, Length, File.second);
+						}
+					};
+
+				try
+				{
+					Group.Run([&ScanFolder]() { ScanFolder(""); });
+					Group.Wait();
+
+					if (Group.IsCanceled())
+						return false;
+
+					std::unique_lock lock(Lock);
+					Table = std::move(NewTable);
+					Unsure.clear();
+					for (auto& Prefix : NewUnsure)
+						if (!AddUnsure(std::move(Prefix)))
+						{
+							// Too many not readable folders, nothing is known for sure
+							Unsure.clear();
+							Unsure.insert(std::string());
+							break;
+						}
+				}
+				catch (const std::exception& e)
+				{
+					_ERROR("DirectorySnapshot: %s", e.what());
+					return false;
+				}
+
+				return true;
+			}
+
+			// false - the snapshot can't follow it, scan again
+			bool Apply(const FILE_NOTIFY_INFORMATION* Notify)
+			{
+				char Name[SNAPSHOT_PATH_MAX];
+				auto NameLength = WideCharToMultiByte(CP_ACP, 0, Notify->FileName,
+					(int)(Notify->FileNameLength / sizeof(wchar_t)), Name, SNAPSHOT_PATH_MAX - 1, nullptr, nullptr);
+
+				// Can't tell where it is
+				if (NameLength <= 0)
+					return false;
+
+				// Not kept, Find doesn't answer for it
+				char Key[SNAPSHOT_PATH_MAX];
+				auto Length = SnapshotFold(Name, NameLength, Key);
+				if (!Length)
+					return true;
+
+				// Asked before the lock, the searches of the editor don't wait for the disk.
+				// Only this thread changes the table, so the order of the notifications is kept.
+				WIN32_FILE_ATTRIBUTE_DATA FileData{};
+				bool Exists = (Notify->Action != FILE_ACTION_REMOVED) && (Notify->Action != FILE_ACTION_RENAMED_OLD_NAME) &&
+					GetFileAttributesExA((RootPath + std::string(Name, NameLength)).c_str(), GetFileExInfoStandard, &FileData);
+
+				std::unique_lock lock(Lock);
+
+				if (!Exists)
+				{
+					auto Attributes = Table.Erase(Key, Length);
+
+					// What was in the folder is gone too
+					if ((Attributes != INVALID_FILE_ATTRIBUTES) && (Attributes & FILE_ATTRIBUTE_DIRECTORY))
+						return AddUnsure(std::string(Key, Length) + "\\");
+
+					return true;
+				}
+
+				Table.Insert(Key, Length, DirectorySnapshot::FileInfo
+					{
+						.Attributes = FileData.dwFileAttributes,
+						.Size = ((std::uint64_t)FileData.nFileSizeHigh << 32) | FileData.nFileSizeLow,
+						.WriteTime = SnapshotFileTime(FileData.ftLastWriteTime),
+					});
+
+				// A folder moved in comes with all its files, and there is only one notification
+				if ((FileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && (Notify->Action != FILE_ACTION_MODIFIED))
+					return AddUnsure(std::string(Key, Length) + "\\");
+
+				return true;
+			}
+		};
+
+		DirectorySnapshot::~DirectorySnapshot() noexcept(true)
+		{
+			Stop();
+		}
+
+		std::uint32_t DirectorySnapshot::WatchThread(void* param) noexcept(true)
+		{
+			auto data = (DirectorySnapshotData*)param;
+
+			// Watching first, what is changed during the scan waits in the buffer
+			auto Folder = CreateFileA(data->RootPath.c_str(), FILE_LIST_DIRECTORY,
+				FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+				FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+			if (Folder == INVALID_HANDLE_VALUE)
+			{
+				_WARNING("DirectorySnapshot: can't watch \"%s\", not used", data->RootPath.c_str());
+				return 1;
+			}
+
+			auto& Overlapped = data->Overlapped;
+			Overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+			auto Buffer = std::make_unique<DWORD[]>(SNAPSHOT_NOTIFY_BUFFER / sizeof(DWORD));
+
+			auto Arm = [&]() -> bool
+				{
+					ResetEvent(Overlapped.hEvent);
+					return Overlapped.hEvent && ReadDirectoryChangesW(Folder, Buffer.get(), SNAPSHOT_NOTIFY_BUFFER, TRUE,
+						SNAPSHOT_NOTIFY_FILTER, nullptr, &Overlapped, nullptr);
+				};
+
+			bool Armed = Arm();
+			bool Rescan = Armed;
+
+			while (Armed)
+			{
+				if (Rescan)
+				{
+					data->Ready = false;
+					data->Ready = data->Scan();
+					Rescan = false;
+
+					if (data->Ready)
+						_MESSAGE("DirectorySnapshot: \"%s\" %u items", data->RootPath.c_str(),
+							(std::uint32_t)data->Table.Entries.size());
+				}
+
+				HANDLE Handles[2] = { data->StopEvent, Overlapped.hEvent };
+				if (WaitForMultipleObjects(2, Handles, FALSE, INFINITE) != (WAIT_OBJECT_0 + 1))
+					break;
+
+				DWORD Bytes = 0;
+				if (!GetOverlappedResult(Folder, &Overlapped, &Bytes, FALSE))
+					break;
+
+				data->Applying = true;
+
+				if (!Bytes)
+					// Overflow, it's unknown what was missed
+					Rescan = true;
+				else
+				{
+					try
+					{
+						auto Notify = (const FILE_NOTIFY_INFORMATION*)Buffer.get();
+						for (;;)
+						{
+							if (!data->Apply(Notify))
+							{
+								Rescan = true;
+								break;
+							}
+
+							if (!Notify->NextEntryOffset)
+								break;
+
+							Notify = (const FILE_NOTIFY_INFORMATION*)((const std::uint8_t*)Notify + Notify->NextEntryOffset);
+						}
+					}
+					catch (const std::exception&)
+					{
+						Rescan = true;
+					}
+				}
+
+				// Until the read is armed again, a change only waits in the buffer of the system
+				data->LastChange = GetTickCount64();
+				Armed = Arm();
+				data->Applying = false;
+			}
+
+			// Nothing tells about the changes anymore
+			data->Ready = false;
+
+			if (Armed)
+			{
+				CancelIoEx(Folder, &Overlapped);
+				DWORD Bytes = 0;
+				GetOverlappedResult(Folder, &Overlapped, &Bytes, TRUE);
+			}
+
+			CloseHandle(Folder);
+
+			return 0;
+		}
+
+		bool DirectorySnapshot::Start(const std::string& Root) noexcept(true)
+		{
+			ScopeCriticalSection guard(_section);
+
+			if (_data)
+				return true;
+
+			DirectorySnapshotData* data = nullptr;
+
+			try
+			{
+				data = new DirectorySnapshotData;
+				data->RootPath = Root;
+				if (data->RootPath.empty() || ((data->RootPath.back() != '\\') && (data->RootPath.back() != '/')))
+					data->RootPath.push_back('\\');
+
+				char Key[SNAPSHOT_PATH_MAX];
+				auto Length = SnapshotFold(data->RootPath.c_str(), data->RootPath.length(), Key);
+				if (!Length)
+				{
+					delete data;
+					return false;
+				}
+
+				data->Root.assign(Key, Length).push_back('\\');
+				data->StopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+				if (!data->StopEvent)
+				{
+					delete data;
+					return false;
+				}
+
+				data->Thread = CreateThread(nullptr, 0, [](LPVOID param) -> DWORD
+					{
+						return (DWORD)DirectorySnapshot::WatchThread(param);
+					}, data, 0, nullptr);
+
+				if (!data->Thread)
+				{
+					delete data;
+					return false;
+				}
+
+				Threads::SetThreadDesc(data->Thread, "CKPE Directory Snapshot");
+			}
+			catch (const std::exception& e)
+			{
+				_ERROR("DirectorySnapshot: %s", e.what());
+				delete data;
+				return false;
+			}
+
+			_data = data;
+			return true;
+		}
+
+		void DirectorySnapshot::Stop() noexcept(true)
+		{
+			ScopeCriticalSection guard(_section);
+
+			auto data = (DirectorySnapshotData*)_data;
+			if (!data)
+				return;
+
+			data->Ready = false;
+			SetEvent(data->StopEvent);
+
+			// When DLL unloads, the threads can't terminate under the loader lock, don't wait forever
+			bool terminated = WaitForSingleObject(data->Thread, 1000) == WAIT_OBJECT_0;
+			CloseHandle(data->Thread);
+
+			_data = nullptr;
+
+			// If the thread is still alive, it owns the data, leave it
+			if (terminated)
+				delete data;
+		}
+
+		bool DirectorySnapshot::IsReady() const noexcept(true)
+		{
+			return _data ? ((DirectorySnapshotData*)_data)->Ready.load() : false;
+		}
+
+		std::uint32_t DirectorySnapshot::GetCount() const noexcept(true)
+		{
+			auto data = (DirectorySnapshotData*)_data;
+			if (!data)
+				return 0;
+
+			std::shared_lock lock(data->Lock);
+			return (std::uint32_t)data->Table.Entries.size();
+		}
+
+		DirectorySnapshot::Result DirectorySnapshot::Find(const char* Path, FileInfo* Info) const noexcept(true)
+		{
+			auto data = (DirectorySnapshotData*)_data;
+			if (!data || !data->Ready || !Path)
+				return rUnknown;
+
+			char Key[SNAPSHOT_PATH_MAX];
+			auto Length = SnapshotFold(Path, strlen(Path), Key);
+			if (!Length)
+				return rUnknown;
+
+			const char* Relative = Key;
+			if (!strncmp(Key, data->Root.c_str(), data->Root.length()))
+			{
+				Relative += data->Root.length();
+				Length -= (std::uint32_t)data->Root.length();
+			}
+			// Somewhere else
+			else if ((Key[0] == '\\') || (Key[1] == ':'))
+				return rUnknown;
+
+			if (!Length)
+				return rUnknown;
+
+			std::shared_lock lock(data->Lock);
+
+			if (data->IsUnsure(std::string_view(Relative, Length)))
+				return rUnknown;
+
+			auto Slot = data->Table.Find(Relative, Length, HashUtils::FastHash64(Relative, Length));
+			if (Slot == SNAPSHOT_EMPTY)
+				return data->IsChanging() ? rUnknown : rNotFound;
+
+			if (Info)
+				*Info = data->Table.Entries[data->Table.Slots[Slot]].Info;
+
+			return rFound;
+		}
+
+		DirectorySnapshot* DirectorySnapshot::GetSingleton() noexcept(true)
+		{
+			return &sdirectory_snapshot;
+		}
+	}
+}
@@ -0,0 +1,515 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <Zydis/Zydis.h>
+#include <CKPE.Common.Interface.h>
+#include <CKPE.Common.TaskScheduler.h>
+#include <CKPE.Common.FunctionMatcher.h>
+#include <CKPE.HashUtils.h>
+#include <CKPE.Module.h>
+#include <CKPE.Stream.h>
+#include <algorithm>
+#include <unordered_map>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		constexpr static std::uint32_t MATCHER_MAX_FUNCTION_SIZE = 0x4000;
+		constexpr static std::uint32_t MATCHER_MAX_CONSTANTS = 32;
+		constexpr static std::uint32_t MATCHER_MAX_STRING = 256;
+		constexpr static std::size_t MATCHER_WORK_ITEM = 256;
+
+		struct MatcherFunction
+		{
+			std::uint32_t Rva;
+			std::uint32_t Size;
+			std::uint64_t OpcodeHash;
+			std::uint64_t StringsHash;				// 0 if no strings
+			std::uint64_t ConstantsHash;
+			std::uint64_t ExactHash;
+			std::uint32_t Callers;
+			std::int32_t Match;						// Index in the other image or -1
+			float Confidence;
+			FunctionMatcher::Method Method;
+			std::vector<std::uint32_t> Callees;		// In the order of the calls
+		};
+
+		struct MatcherImage
+		{
+			std::uintptr_t Base;
+			std::uintptr_t PreferredBase;			// The image may be mapped without relocations
+			std::uint32_t ImageSize;
+			std::uintptr_t RDataStart;
+			std::uintptr_t RDataEnd;
+			std::vector<MatcherFunction> Functions;
+			std::unordered_map<std::uint32_t, std::uint32_t> ByRva;
+		};
+
+		static inline std::uint64_t MatcherMix(std::uint64_t hash, std::uint64_t value) noexcept(true)
+		{
+			return hash ^ (value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2));
+		}
+
+		static std::uint64_t MatcherHashSet(std::vector<std::uint64_t>& values) noexcept(true)
+		{
+			if (values.empty())
+				return 0;
+
+			std::sort(values.begin(), values.end());
+			values.erase(std::unique(values.begin(), values.end()), values.end());
+
+			std::uint64_t hash = 0xCBF29CE484222325ull;
+			for (auto value : values)
+				hash = MatcherMix(hash, value);
+			return hash;
+		}
+
+		static bool MatcherIsAddress(const MatcherImage& image, std::uint64_t value) noexcept(true)
+		{
+			return ((value >= image.Base) && (value < (image.Base + image.ImageSize))) ||
+				((value >= image.PreferredBase) && (value < (image.PreferredBase + image.ImageSize)));
+		}
+
+		// Only the text of the string is used, its address differs in each build
+		static void MatcherReference(const MatcherImage& image, std::uint64_t address,
+			std::vector<std::uint64_t>& strings) noexcept(true)
+		{
+			if ((address < image.RDataStart) || (address >= image.RDataEnd))
+				return;
+
+			auto str = (const char*)address;
+			auto max_len = (std::uint32_t)std::min<std::uint64_t>(MATCHER_MAX_STRING, image.RDataEnd - address);
+
+			std::uint32_t len = 0;
+			while ((len < max_len) && str[len] && (((str[len] >= 0x20) && (str[len] < 0x7F)) ||
+				(str[len] == '\t') || (str[len] == '\n') || (str[len] == '\r')))
+				len++;
+
+			if ((len >= 4) && (len < max_len) && !str[len])
+				strings.push_back(HashUtils::FastHash64(str, len));
+		}
+
+		static void MatcherAnalyzeFunction(const ZydisDecoder* decoder, const MatcherImage& image,
+			MatcherFunction& func) noexcept(true)
+		{
+			std::vector<std::uint64_t> strings, constants;
+			std::uint64_t opcodes = 0xCBF29CE484222325ull;
+
+			auto end = func.Rva + std::min(func.Size, MATCHER_MAX_FUNCTION_SIZE);
+			for (std::uint32_t offset = func.Rva; offset < end;)
+			{
+				const std::uintptr_t ip = image.Base + offset;
+				ZydisDecodedInstruction instruction;
+
+				if (!ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(decoder, (void*)ip, end - offset, ip, &instruction)))
+				{
+					// Decode failed. Always increase byte offset by 1.
+					offset += 1;
+					continue;
+				}
+
+				offset += instruction.length;
+				opcodes = MatcherMix(opcodes, instruction.mnemonic);
+
+				for (std::uint8_t i = 0; i < instruction.operandCount; i++)
+				{
+					auto& operand = instruction.operands[i];
+					if (operand.visibility == ZYDIS_OPERAND_VISIBILITY_HIDDEN)
+						continue;
+
+					opcodes = MatcherMix(opcodes, operand.type);
+
+					switch (operand.type)
+					{
+					case ZYDIS_OPERAND_TYPE_REGISTER:
+						opcodes = MatcherMix(opcodes, operand.reg.value);
+						break;
+					case ZYDIS_OPERAND_TYPE_MEMORY:
+					{
+						opcodes = MatcherMix(opcodes, ((std::uint64_t)operand.mem.base << 32) |
+							((std::uint64_t)operand.mem.index << 8) | operand.mem.scale);
+
+						ZydisU64 address;
+						if (operand.mem.base == ZYDIS_REGISTER_RIP)
+						{
+							if (ZYDIS_SUCCESS(ZydisCalcAbsoluteAddress(&instruction, &operand, &address)))
+								MatcherReference(image, address, strings);
+						}
+						else if (operand.mem.disp.hasDisplacement && !MatcherIsAddress(image, operand.mem.disp.value))
+							// Offsets of the fields
+							opcodes = MatcherMix(opcodes, (std::uint64_t)operand.mem.disp.value);
+						break;
+					}
+					case ZYDIS_OPERAND_TYPE_IMMEDIATE:
+					{
+						ZydisU64 address;
+						if (operand.imm.isRelative)
+						{
+							if (((instruction.mnemonic == ZYDIS_MNEMONIC_CALL) || (instruction.mnemonic == ZYDIS_MNEMONIC_JMP)) &&
+								ZYDIS_SUCCESS(ZydisCalcAbsoluteAddress(&instruction, &operand, &address)))
+							{
+								auto target = (std::uint32_t)(address - image.Base);
+								// Jumps inside the function aren't edges
+								if (((target < func.Rva) || (target >= (func.Rva + func.Size))) && image.ByRva.contains(target))
+									func.Callees.push_back(target);
+							}
+						}
+						else if (!MatcherIsAddress(image, operand.imm.value.u))
+						{
+							opcodes = MatcherMix(opcodes, operand.imm.value.u);
+							if ((operand.imm.value.u > 0xFF) && (constants.size() < MATCHER_MAX_CONSTANTS))
+								constants.push_back(operand.imm.value.u);
+						}
+						break;
+					}
+					default:
+						break;
+					}
+				}
+			}
+
+			func.OpcodeHash = opcodes;
+			func.StringsHash = MatcherHashSet(strings);
+			func.ConstantsHash = MatcherHashSet(constants);
+		}
+
+		static bool MatcherLoadImage(const void* base, MatcherImage& image) noexcept(true)
+		{
+			Module module(base);
+			module.LoadInfo();
+
+			if (!module.Is64())
+			{
+				_ERROR("FunctionMatcher: support only x64");
+				return false;
+			}
+
+			auto dos = (const IMAGE_DOS_HEADER*)base;
+			auto nt = (const IMAGE_NT_HEADERS64*)((std::uintptr_t)base + dos->e_lfanew);
+
+			image.Base = (std::uintptr_t)base;
+			image.PreferredBase = nt->OptionalHeader.ImageBase;
+			image.ImageSize = nt->OptionalHeader.SizeOfImage;
+			image.RDataStart = module.GetSegment(Segment::rdata).GetAddress();
+			image.RDataEnd = module.GetSegment(Segment::rdata).GetEndAddress();
+			image.Functions.clear();
+			image.ByRva.clear();
+
+			// Enumerate all functions present in the x64 exception directory section
+			const auto dir_exception = module.GetPEDirectory(PEDirectory::e_exception);
+			if (!dir_exception.GetAddress() || !dir_exception.GetSize())
+			{
+				_ERROR("FunctionMatcher: no exception directory");
+				return false;
+			}
+
+			const auto functionEntries = dir_exception.GetPointer<RUNTIME_FUNCTION>();
+			const auto functionEntryCount = dir_exception.GetSize() / sizeof(RUNTIME_FUNCTION);
+
+			std::vector<std::pair<std::uint32_t, std::uint32_t>> ordered;
+			ordered.reserve(functionEntryCount);
+			for (auto Function = functionEntries; Function < (functionEntries + functionEntryCount); Function++)
+				if (Function->BeginAddress && (Function->EndAddress > Function->BeginAddress))
+					ordered.emplace_back(Function->BeginAddress, Function->EndAddress - Function->BeginAddress);
+
+			std::sort(ordered.begin(), ordered.end());
+			ordered.erase(std::unique(ordered.begin(), ordered.end(),
+				[](const auto& a, const auto& b) { return a.first == b.first; }), ordered.end());
+
+			image.Functions.resize(ordered.size());
+			image.ByRva.reserve(ordered.size());
+			for (std::uint32_t i = 0; i < (std::uint32_t)ordered.size(); i++)
+			{
+				auto& func = image.Functions[i];
+				func.Rva = ordered[i].first;
+				func.Size = ordered[i].second;
+				func.Match = -1;
+				func.Confidence = 0.0f;
+				func.Method = FunctionMatcher::mNone;
+				image.ByRva.insert({ func.Rva, i });
+			}
+
+			ZydisDecoder decoder;
+			if (!ZYDIS_SUCCESS(ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_ADDRESS_WIDTH_64)))
+				return false;
+
+			// Each function has its own slot, so the result doesn't depend on the number of threads
+			if (!TaskScheduler::GetSingleton()->ParallelFor(0, image.Functions.size(), MATCHER_WORK_ITEM,
+				[&](std::size_t begin, std::size_t end)
+				{
+					// Decoder of the piece
+					ZydisDecoder thread_decoder = decoder;
+
+					for (auto i = begin; i < end; i++)
+						MatcherAnalyzeFunction(&thread_decoder, image, image.Functions[i]);
+				}, "FunctionMatcher"))
+				return false;
+
+			// Callees to indices and the degree of the call graph
+			for (auto& func : image.Functions)
+				for (auto& callee : func.Callees)
+				{
+					callee = image.ByRva[callee];
+					image.Functions[callee].Callers++;
+				}
+
+			for (auto& func : image.Functions)
+			{
+				auto hash = MatcherMix(func.OpcodeHash, func.StringsHash);
+				hash = MatcherMix(hash, func.ConstantsHash);
+				func.ExactHash = MatcherMix(hash, ((std::uint64_t)func.Callees.size() << 32) | func.Callers);
+			}
+
+			return true;
+		}
+
+		FunctionMatcher::FunctionMatcher() noexcept(true) :
+			_old(new MatcherImage), _new(new MatcherImage), _results(new std::vector<Result>)
+		{}
+
+		FunctionMatcher::~FunctionMatcher() noexcept(true)
+		{
+			delete (MatcherImage*)_old;
+			delete (MatcherImage*)_new;
+			delete _results;
+		}
+
+		void FunctionMatcher::MatchFunctions() noexcept(true)
+		{
+			auto& old_funcs = ((MatcherImage*)_old)->Functions;
+			auto& new_funcs = ((MatcherImage*)_new)->Functions;
+
+			std::vector<std::uint32_t> queue;
+
+			auto link = [&](std::uint32_t o, std::uint32_t n, Method method, float confidence)
+			{
+				old_funcs[o].Match = (std::int32_t)n;
+				old_funcs[o].Method = method;
+				old_funcs[o].Confidence = confidence;
+				new_funcs[n].Match = (std::int32_t)o;
+				queue.push_back(o);
+			};
+
+			// The key must be unique among the free functions of both images
+			auto unique_pass = [&](auto key_of, Method method, float confidence)
+			{
+				std::unordered_map<std::uint64_t, std::int64_t> old_keys, new_keys;
+
+				auto collect = [&](std::vector<MatcherFunction>& funcs, std::unordered_map<std::uint64_t, std::int64_t>& keys)
+				{
+					for (std::uint32_t i = 0; i < (std::uint32_t)funcs.size(); i++)
+					{
+						if (funcs[i].Match >= 0) continue;
+						auto key = key_of(funcs[i]);
+						if (!key) continue;
+						auto [it, inserted] = keys.insert({ key, i });
+						if (!inserted) it->second = -1;
+					}
+				};
+
+				collect(old_funcs, old_keys);
+				collect(new_funcs, new_keys);
+
+				for (const auto& [key, o] : old_keys)
+				{
+					if (o < 0) continue;
+					auto it = new_keys.find(key);
+					if ((it != new_keys.end()) && (it->second >= 0))
+						link((std::uint32_t)o, (std::uint32_t)it->second, method, confidence);
+				}
+			};
+
+			unique_pass([](const MatcherFunction& f) { return f.ExactHash; }, mExact, 1.0f);
+			unique_pass([](const MatcherFunction& f) { return f.OpcodeHash; }, mOpcodes, 0.9f);
+			unique_pass([](const MatcherFunction& f) { return f.StringsHash; }, mStrings, 0.8f);
+
+			// The order of the queue must not depend on the hash maps
+			std::sort(queue.begin(), queue.end());
+
+			// Spread over the call edges of the matched functions
+			for (std::size_t q = 0; q < queue.size(); q++)
+			{
+				auto& old_func = old_funcs[queue[q]];
+				auto& new_func = new_funcs[old_func.Match];
+
+				auto& old_callees = old_func.Callees;
+				auto& new_callees = new_func.Callees;
+
+				if (old_callees.size() == new_callees.size())
+				{
+					// Same number of calls, the functions are compared by position
+					for (std::size_t k = 0; k < old_callees.size(); k++)
+					{
+						auto o = old_callees[k], n = new_callees[k];
+						if ((old_funcs[o].Match >= 0) || (new_funcs[n].Match >= 0))
+							continue;
+
+						if (old_funcs[o].OpcodeHash == new_funcs[n].OpcodeHash)
+							link(o, n, mCallGraph, old_func.Confidence * 0.85f);
+						else
+						{
+							auto min_size = std::min(old_funcs[o].Size, new_funcs[n].Size);
+							auto max_size = std::max(old_funcs[o].Size, new_funcs[n].Size);
+							if ((min_size * 4) >= (max_size * 3))
+								link(o, n, mCallGraph, old_func.Confidence * 0.5f);
+						}
+					}
+				}
+				else
+				{
+					// The calls changed, only the unique instructions among the callees
+					std::unordered_map<std::uint64_t, std::int64_t> old_keys, new_keys;
+					for (auto o : old_callees)
+						if (old_funcs[o].Match < 0)
+						{
+							auto [it, inserted] = old_keys.insert({ old_funcs[o].OpcodeHash, o });
+							if (!inserted && (it->second != o)) it->second = -1;
+						}
+					for (auto n : new_callees)
+						if (new_funcs[n].Match < 0)
+						{
+							auto [it, inserted] = new_keys.insert({ new_funcs[n].OpcodeHash, n });
+							if (!inserted && (it->second != n)) it->second = -1;
+						}
+
+					for (auto o : old_callees)
+					{
+						if (old_funcs[o].Match >= 0) continue;
+						auto it_old = old_keys.find(old_funcs[o].OpcodeHash);
+						auto it_new = new_keys.find(old_funcs[o].OpcodeHash);
+						if ((it_old->second >= 0) && (it_new != new_keys.end()) && (it_new->second >= 0) &&
+							(new_funcs[it_new->second].Match < 0))
+							link(o, (std::uint32_t)it_new->second, mCallGraph, old_func.Confidence * 0.7f);
+					}
+				}
+			}
+		}
+
+		bool FunctionMatcher::Analyze(const void* old_base, const void* new_base) noexcept(true)
+		{
+			Clear();
+
+			if (!old_base || !new_base)
+				return false;
+
+			try
+			{
+				if (!MatcherLoadImage(old_base, *(MatcherImage*)_old) ||
+					!MatcherLoadImage(new_base, *(MatcherImage*)_new))
+					return false;
+
+				_MESSAGE("\tFunctions: %llu (old) / %llu (new)", ((MatcherImage*)_old)->Functions.size(),
+					((MatcherImage*)_new)->Functions.size());
+
+				MatchFunctions();
+			}
+			catch (const std::exception& e)
+			{
+				_ERROR(e.what());
+				Clear();
+				return false;
+			}
+
+			return true;
+		}
+
+		bool FunctionMatcher::Match(const TableID& table) noexcept(true)
+		{
+			try
+			{
+				std::vector<std::uint32_t> old_rvas(table.Count());
+				for (std::uint32_t id = 0; id < table.Count(); id++)
+					old_rvas[id] = table.Rva(id);
+
+				return Match(old_rvas);
+			}
+			catch (const std::exception& e)
+			{
+				_ERROR(e.what());
+				return false;
+			}
+		}
+
+		bool FunctionMatcher::Match(const std::vector<std::uint32_t>& old_rvas) noexcept(true)
+		{
+			auto old_image = (MatcherImage*)_old;
+			auto new_image = (MatcherImage*)_new;
+
+			if (old_image->Functions.empty() || new_image->Functions.empty())
+				return false;
+
+			try
+			{
+				_results->resize(old_rvas.size());
+
+				std::size_t matched = 0;
+				for (std::uint32_t id = 0; id < (std::uint32_t)old_rvas.size(); id++)
+				{
+					auto& result = (*_results)[id];
+					result = { id, old_rvas[id], 0, 0.0f, mNone };
+
+					auto it = old_image->ByRva.find(old_rvas[id]);
+					if (it == old_image->ByRva.end())
+						continue;
+
+					auto& func = old_image->Functions[it->second];
+					if (func.Match < 0)
+						continue;
+
+					result.new_rva = new_image->Functions[func.Match].Rva;
+					result.confidence = func.Confidence;
+					result.method = func.Method;
+					matched++;
+				}
+
+				_MESSAGE("\tMatched ids: %llu / %llu", matched, old_rvas.size());
+			}
+			catch (const std::exception& e)
+			{
+				_ERROR(e.what());
+				return false;
+			}
+
+			return true;
+		}
+
+		void FunctionMatcher::Clear() noexcept(true)
+		{
+			((MatcherImage*)_old)->Functions.clear();
+			((MatcherImage*)_old)->ByRva.clear();
+			((MatcherImage*)_new)->Functions.clear();
+			((MatcherImage*)_new)->ByRva.clear();
+			_results->clear();
+		}
+
+		std::uint32_t FunctionMatcher::Count() const noexcept(true)
+		{
+			return (std::uint32_t)_results->size();
+		}
+
+		const FunctionMatcher::Result* FunctionMatcher::At(std::uint32_t id) const noexcept(true)
+		{
+			return (id < _results->size()) ? &(*_results)[id] : nullptr;
+		}
+
+		void FunctionMatcher::Dump(const std::wstring& fname) const noexcept(true)
+		{
+			static const char* methods[] = { "none", "exact", "opcodes", "strings", "callgraph" };
+
+			try
+			{
+				TextFileStream fstm(fname, FileStream::fmCreate);
+				fstm.WriteLine("id\told_rva\tnew_rva\tconfidence\tmethod");
+				for (auto& result : *_results)
+					fstm.WriteLine("%u\t0x%08X\t0x%08X\t%.2f\t%s", result.id, result.old_rva, result.new_rva,
+						result.confidence, methods[result.method]);
+			}
+			catch (const std::exception&)
+			{
+			}
+		}
+	}
+}
@@ -6,18 +6,184 @@
 #include <mmsystem.h>
 #include <Zydis/Zydis.h>
 #include <CKPE.Common.Interface.h>
+#include <CKPE.Common.TaskScheduler.h>
 #include <CKPE.Common.GenerateTableID.h>
 #include <CKPE.FileUtils.h>
 #include <CKPE.Patterns.h>
+#include <CKPE.HashUtils.h>
 #include <algorithm>
 #include <execution>
-#include <map>
 #include <unordered_map>
 
 namespace CKPE
 {
 	namespace Common
 	{
+		constexpr static std::size_t GENERATE_TABLEID_WORK_ITEM = 256;
+
+		// Masks the first 64 bytes of the function, relative offsets are removed
+		static void AnalizeFunction(const ZydisDecoder* decoder, std::uintptr_t base, std::uint32_t rva,
+			std::uint32_t real_size, GenerateTableID::Entry& entry) noexcept(true)
+		{
+			std::uint32_t size = real_size;
+			if (size > 64) size = 64;
+
+			std::uint8_t buffer[128];
+			ZeroMemory(buffer, 128);
+			memcpy(buffer, (const void*)(base + rva), (real_size > 127) ? 127 : real_size);
+
+			for (std::uint32_t offset = rva; offset < (rva + real_size);)
+			{
+				const std::uintptr_t ip = base + offset;
+				const std::uint8_t opcode = *(std::uint8_t*)ip;
+				ZydisDecodedInstruction instruction;
+
+				if (!ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(decoder, (void*)ip, ZYDIS_MAX_INSTRUCTION_LENGTH, ip,
+					&instruction)))
+				{
+					// Decode failed. Always increase byte offset by 1.
+					offset += 1;
+
+					if (offset >= (rva + size))
+						break;
+
+					continue;
+				}
+
+				if (instruction.attributes & ZYDIS_ATTRIB_IS_RELATIVE)
+				{
+					// remove reloff
+
+					switch (instruction.opcode)
+					{
+						// weird cmds begin
+					case 0x00:
+					case 0x01:
+					case 0x02:
+					case 0x03:
+					case 0x0A:
+					case 0x0B:
+					case 0x1A:
+					case 0x1B:
+					case 0x32:
+					case 0xD8:
+					case 0xDD:
+					case 0xDF:
+						// weird cmds end
+					case 0x10:
+					case 0x11:
+					case 0x15:
+					case 0x23:
+					case 0x28:
+					case 0x29:
+					case 0x2B:
+					case 0x2C:
+					case 0x2E:
+					case 0x2F:
+					case 0x33:
+					case 0x38:
+					case 0x39:
+					case 0x3A:
+					case 0x3B:
+					case 0x44:
+					case 0x45:
+					case 0x54:
+					case 0x57:
+					case 0x58:
+					case 0x59:
+					case 0x5A:
+					case 0x5C:
+					case 0x5D:
+					case 0x5E:
+					case 0x5F:
+					case 0x63:
+					case 0x6F:
+					case 0x82:
+					case 0x84:
+					case 0x85:
+					case 0x86:
+					case 0x87:
+					case 0x88:
+					case 0x89:
+					case 0x8A:
+					case 0x8B:
+					case 0x8C:
+					case 0x8D:
+					case 0x8E:
+					case 0x8F:
+					case 0xB0:
+					case 0xB1:
+					case 0xB6:
+					case 0xB7:
+					case 0xBE:
+					case 0xC1:
+					case 0xE8:
+					case 0xE9:
+					case 0xDE:
+					case 0xFF:
+						ZeroMemory(buffer + (offset - rva) + (instruction.length - 4), 4);
+						break;
+					case 0x70:
+					case 0x71:
+					case 0x72:
+					case 0x73:
+					case 0x74:
+					case 0x75:
+					case 0x76:
+					case 0x77:
+					case 0x78:
+					case 0x79:
+					case 0x7A:
+					case 0x7B:
+					case 0x7C:
+					case 0x7D:
+					case 0x7E:
+					case 0x7F:
+					case 0xE0:
+					case 0xE1:
+					case 0xE2:
+					case 0xE3:
+					case 0xEB:
+						buffer[(offset - rva) + 1] = 0x0;	
+						break;
+					case 0x80:
+					case 0x83:
+					case 0xC0:
+					case 0xC2:
+					case 0xC6:
+					case 0xF6:
+						ZeroMemory(buffer + (offset - rva) + (instruction.length - 5), 4);
+						break;
+					case 0x69:
+					case 0x81:
+					case 0xC7:
+						ZeroMemory(buffer + (offset - rva) + (instruction.length - 8), 4);
+						break;
+					default:
+						// The other relative forms keep their bytes
+						break;
+					}								
+				}
+
+				offset += instruction.length;
+				if (offset >= (rva + size))
+				{
+					size = (offset - rva);
+					break;
+				}
+			}
+
+			auto pattern = Patterns::CreateMask((std::uintptr_t)buffer, size);
+
+			ZeroMemory(&entry, sizeof(GenerateTableID::Entry));
+
+			entry.rva = rva;
+			entry.real_size = real_size;
+			entry.mask_len = (std::uint32_t)std::min(pattern.length(), sizeof(entry.mask) - 1);
+			memcpy(entry.mask, pattern.c_str(), entry.mask_len);
+			entry.mask[entry.mask_len] = '\0';
+		}
+
 		void GenerateTableID::Analize() noexcept(true)
 		{
 			if (!_mbase || !_entries)
@@ -42,7 +208,7 @@ namespace CKPE
 
 				auto base = _mbase->GetBase();
 
-				// Init threadsafe instruction decoder
+				// Init threadsafe instruction decoder, each thread gets a copy
 				ZydisDecoder decoder;
 				if (ZYDIS_SUCCESS(ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_ADDRESS_WIDTH_64)))
 				{
@@ -56,174 +222,23 @@ namespace CKPE
 						unordered.insert({ Function->BeginAddress, Function->EndAddress - Function->BeginAddress });
 					}
 					
-					std::map<std::uint32_t, std::uint32_t> ordered(unordered.begin(), unordered.end());
-					_entries->reserve(unordered.size());
+					std::vector<std::pair<std::uint32_t, std::uint32_t>> ordered(unordered.begin(), unordered.end());
+					std::sort(ordered.begin(), ordered.end());
+					_entries->resize(ordered.size());
 
-					_MESSAGE("\tTotal functions: %llu", unordered.size());
+					_MESSAGE("\tTotal functions: %llu", ordered.size());
 
-					for (auto& Function : ordered)
-					{
-						std::uint32_t size = Function.second;
-						if (size > 64) size = 64;
-
-						std::uint8_t buffer[128];
-						ZeroMemory(buffer, 128);
-						memcpy(buffer, (const void*)(base + Function.first), (Function.second > 127) ? 127 : Function.second);
-
-						for (std::uint32_t offset = Function.first; offset < (Function.first + Function.second);)
+					// Each entry has its own slot, so the result doesn't depend on the number of threads
+					if (!TaskScheduler::GetSingleton()->ParallelFor(0, ordered.size(), GENERATE_TABLEID_WORK_ITEM,
+						[&](std::size_t begin, std::size_t end)
 						{
-							const std::uintptr_t ip = base + offset;
-							const std::uint8_t opcode = *(std::uint8_t*)ip;
-							ZydisDecodedInstruction instruction;
-
-							if (!ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(&decoder, (void*)ip, ZYDIS_MAX_INSTRUCTION_LENGTH, ip,
-								&instruction)))
-							{
-								// Decode failed. Always increase byte offset by 1.
-								offset += 1;
-
-								if (offset >= (Function.first + size))
-									break;
-
-								continue;
-							}
-
-							if (instruction.attributes & ZYDIS_ATTRIB_IS_RELATIVE)
-							{
-								// remove reloff
-
-								switch (instruction.opcode)
-								{
-									// weird cmds begin
-								case 0x00:
-								case 0x01:
-								case 0x02:
-								case 0x03:
-								case 0x0A:
-								case 0x0B:
-								case 0x1A:
-								case 0x1B:
-								case 0x32:
-								case 0xD8:
-								case 0xDD:
-								case 0xDF:
-									// weird cmds end
-								case 0x10:
-								case 0x11:
-								case 0x15:
-								case 0x23:
-								case 0x28:
-								case 0x29:
-								case 0x2B:
-								case 0x2C:
-								case 0x2E:
-								case 0x2F:
-								case 0x33:
-								case 0x38:
-								case 0x39:
-								case 0x3A:
-								case 0x3B:
-								case 0x44:
-								case 0x45:
-								case 0x54:
-								case 0x57:
-								case 0x58:
-								case 0x59:
-								case 0x5A:
-								case 0x5C:
-								case 0x5D:
-								case 0x5E:
-								case 0x5F:
-								case 0x63:
-								case 0x6F:
-								case 0x82:
-								case 0x84:
-								case 0x85:
-								case 0x86:
-								case 0x87:
-								case 0x88:
-								case 0x89:
-								case 0x8A:
-								case 0x8B:
-								case 0x8C:
-								case 0x8D:
-								case 0x8E:
-								case 0x8F:
-								case 0xB0:
-								case 0xB1:
-								case 0xB6:
-								case 0xB7:
-								case 0xBE:
-								case 0xC1:
-								case 0xE8:
-								case 0xE9:
-								case 0xDE:
-								case 0xFF:
-									ZeroMemory(buffer + (offset - Function.first) + (instruction.length - 4), 4);
-									break;
-								case 0x70:
-								case 0x71:
-								case 0x72:
-								case 0x73:
-								case 0x74:
-								case 0x75:
-								case 0x76:
-								case 0x77:
-								case 0x78:
-								case 0x79:
-								case 0x7A:
-								case 0x7B:
-								case 0x7C:
-								case 0x7D:
-								case 0x7E:
-								case 0x7F:
-								case 0xE0:
-								case 0xE1:
-								case 0xE2:
-								case 0xE3:
-								case 0xEB:
-									buffer[(offset - Function.first) + 1] = 0x0;	
-									break;
-								case 0x80:
-								case 0x83:
-								case 0xC0:
-								case 0xC2:
-								case 0xC6:
-								case 0xF6:
-									ZeroMemory(buffer + (offset - Function.first) + (instruction.length - 5), 4);
-									break;
-								case 0x69:
-								case 0x81:
-								case 0xC7:
-									ZeroMemory(buffer + (offset - Function.first) + (instruction.length - 8), 4);
-									break;
-								default:
-									_MESSAGE("Dbg rel %llX %02X %u", ip, instruction.opcode, instruction.length);
-									break;
-								}								
-							}
-
-							offset += instruction.length;
-							if (offset >= (Function.first + size))
-							{
-								size = (offset - Function.first);
-								break;
-							}
-						}
-
-						auto pattern = Patterns::CreateMask((std::uintptr_t)buffer, size);
+							// Decoder of the piece
+							ZydisDecoder thread_decoder = decoder;
 
-						Entry entry;
-						ZeroMemory(&entry, sizeof(Entry));
-
-						entry.rva = Function.first;
-						entry.real_size = Function.second;
-						entry.mask_len = (std::uint32_t)pattern.length();
-						memcpy(entry.mask, pattern.c_str(), entry.mask_len);
-						entry.mask[entry.mask_len] = '\0';
-
-						_entries->push_back(entry);
-					}
+							for (auto i = begin; i < end; i++)
+								AnalizeFunction(&thread_decoder, base, ordered[i].first, ordered[i].second, (*_entries)[i]);
+						}, "GenerateTableID"))
+						_ERROR("GenerateTableID: the analysis of the functions failed");
 				}
 			}
 			catch (const std::exception& e)
@@ -301,109 +316,67 @@ namespace CKPE
 				if (tableid._version_file == _version_file)
 					throw std::runtime_error("GenerateTableID::Merging same game version");
 
-				//auto merging_size = std::max(dst->size(), src->size());
-				std::vector<Entry> new_entries, 
-					merging_entries(dst->begin(), dst->end());
+				// The ids of this table are kept, the functions are searched in the new table by the mask.
+				// Identical masks are matched in the order of the addresses.
+				std::unordered_map<std::uint64_t, std::vector<std::size_t>> buckets;
+				buckets.reserve(dst->size());
 
-				auto current_it = src->begin();
-				for (auto merging_it = merging_entries.begin(); merging_it != merging_entries.end(); merging_it++, current_it++)
+				for (std::size_t i = 0; i < dst->size(); i++)
 				{
-					if ((merging_it->mask_len == current_it->mask_len) &&
-						!memcmp(merging_it->mask, current_it->mask, current_it->mask_len))
-						// same
-						continue;
-					else
+					auto& entry = (*dst)[i];
+					buckets[HashUtils::FastHash64(entry.mask, entry.mask_len)].push_back(i);
+				}
+
+				std::unordered_map<std::uint64_t, std::size_t> cursors;
+				std::vector<bool> used(dst->size(), false);
+				std::vector<Entry> merging_entries(src->begin(), src->end());
+
+				for (auto& entry : merging_entries)
+				{
+					auto hash = HashUtils::FastHash64(entry.mask, entry.mask_len);
+					auto it = buckets.find(hash);
+					bool found = false;
+
+					if (it != buckets.end())
 					{
-						auto find_entry = std::find_if(merging_it, dst->end(),
-							[&current_it](const Entry& entry) -> bool {
-								if (entry.mask_len != current_it->mask_len)
-									return false;
-								else
-									return !memcmp(entry.mask, current_it->mask, current_it->mask_len);
-							});
-
-						if (find_entry == dst->end())
-							new_entries.push_back(*current_it);
-						else
+						auto& cursor = cursors[hash];
+						for (; cursor < it->second.size(); cursor++)
 						{
+							auto& candidate = (*dst)[it->second[cursor]];
+							if ((candidate.mask_len != entry.mask_len) || memcmp(candidate.mask, entry.mask, entry.mask_len))
+								continue;
 
+							used[it->second[cursor]] = true;
+							entry.rva = candidate.rva;
+							entry.real_size = candidate.real_size;
+							found = true;
+							cursor++;
+							break;
 						}
 					}
+
+					if (!found)
+					{
+						// This function has not been found, I assume that it has been removed
+						entry.rva = 0;
+						remove_func++;
+					}
+				}
+
+				// New functions get the new ids
+				std::size_t new_func = 0;
+				for (std::size_t i = 0; i < dst->size(); i++)
+				{
+					if (used[i]) continue;
+					merging_entries.push_back((*dst)[i]);
+					new_func++;
 				}
 
+				_MESSAGE("\tFind fuctions: %llu\n\tRemoved fuctions: %llu\n\tNew fuctions: %llu",
+					merging_entries.size() - remove_func - new_func, remove_func, new_func);
 
-				////merging_entries.resize(merging_size);
-
-				//auto dst_current = dst->begin();
-
-				////tableid.Dump("dst_dump.txt");
-				////Dump("src_dump.txt");
-
-				//for (auto src_current = src->begin(); src_current != src->end(); src_current++)
-				//{
-				//	if (dst_current == dst->end())
-				//		break;
-
-				//	if (src_current->mask_len == dst_current->mask_len)
-				//	{
-				//		if (!memcmp(src_current->mask, dst_current->mask, dst_current->mask_len))
-				//		{
-				//			merging_entries[std::distance(dst->begin(), dst_current)] = *src_current;
-				//			dst_current++;
-				//		}
-				//		else
-				//			goto no_matches;
-				//	}
-				//	else
-				//	{
-				//	no_matches:
-				//		// find function current
-
-				
-
-				//		if (find_entry == dst->end())
-				//		{
-				//			// New function
-				//			new_entries.push_back(*src_current);
-				//			// This function has not been found, I assume that it has been removed
-				//			auto idx = std::distance(dst->begin(), dst_current);
-				//			_MESSAGE("The function %lld was not found and appears to have been removed\n\t\"%s\"",
-				//				idx, dst_current->mask);
-
-				//			merging_entries[idx].rva = 0;
-				//			dst_current++;
-				//			remove_func++;
-				//		}
-				//		else
-				//		{
-				//			// The function was found, but not at this index, which means that the functions in between were removed			
-				//			auto dist = std::distance(dst_current, find_entry);
-				//			auto beg = std::distance(dst->begin(), dst_current);
-
-				//			_MESSAGE("Starting from index %lld to %lld, the functions were presumably deleted", 
-				//				beg, beg + (dist - 1));
-				//			
-				//			// Assume that some functions have been removed from the code section
-
-				//			std::ptrdiff_t i = 0;
-				//			while (i++ < dist)
-				//			{
-				//				if (dst_current == dst->end())
-				//					break;
-
-				//				merging_entries[std::distance(dst->begin(), dst_current)].rva = 0;
-				//				dst_current++;
-				//				remove_func++;
-				//			}
-				//		}
-				//	}
-				//}
-
-				//merging_entries.erase(dst_current, merging_entries.end());
-				//merging_entries.insert(merging_entries.end(), new_entries.begin(), new_entries.end());
-
-				/*_MESSAGE("\tFind fuctions: %u\n\tRemoved fuctions: %u\n\tNew fuctions: %u",
-					merging_entries.size(), remove_func, new_entries.size());*/
+				*src = std::move(merging_entries);
+				_version_file = tableid._version_file;
 			}
 			catch (const std::exception& e)
 			{
@@ -5,6 +5,7 @@
 #include <cstdarg>
 #include <CKPE.PathUtils.h>
 #include <CKPE.StringUtils.h>
+#include <CKPE.PackedArgs.h>
 #include <CKPE.Application.h>
 #include <CKPE.FileUtils.h>
 #include <CKPE.Graphics.h>
@@ -15,10 +16,15 @@
 #if 0
 #include <CKPE.Common.GenerateTableID.h>
 #endif
+#include <CKPE.Common.FunctionMatcher.h>
 #include <CKPE.Common.Registry.h>
 #include <CKPE.Common.RTTI.h>
+#include <CKPE.Common.LogCapture.h>
+#include <CKPE.Common.Profiler.h>
+#include <CKPE.Common.TaskScheduler.h>
 #include <CKPE.Exception.h>
 #include <algorithm>
+#include <intrin.h>
 #include <time.h>
 
 namespace CKPE
@@ -71,6 +77,15 @@ namespace CKPE
 				std::wstring spath = _interface->application->GetPath();
 				_cmdline = new CommandLineParser;
 				_settings = new TOMLSettingCollection(spath + _ssettings_fname);
+				if (_settings->ReadBool("Log", "bAsyncFileWrite", false))
+					_interface->logger->StartAsync((Logger::FullPolicy)_settings->ReadUInt("Log", "uAsyncFullPolicy",
+						Logger::fpSpill));
+				if (_settings->ReadBool("Log", "bStructuredCapture", false))
+					LogCapture::GetSingleton()->Open(PathUtils::GetCKPELogsPath() + L"CreationKitPlatformExtended.cklog");
+				TaskScheduler::GetSingleton()->Initialize(_settings->ReadUInt("CreationKit", "uWorkerThreads", 0));
+				if (_settings->ReadBool("Profiler", "bEnabled", false))
+					Profiler::GetSingleton()->Start(PathUtils::GetCKPELogsPath() + L"CreationKitPlatformExtended.folded",
+						_settings->ReadUInt("Profiler", "uSampleRate", 1000), _settings->ReadUInt("Profiler", "uFlushSeconds", 10));
 				if (PathUtils::FileExists(spath + _stheme_settings_fname))
 					_theme_settings = new TOMLSettingCollection(spath + _stheme_settings_fname);
 				else
@@ -245,6 +260,28 @@ namespace CKPE
 							}
 						}
 
+						// Close Creation Kit				
+						_interface->application->Terminate();
+					}
+					else if (!_wcsicmp(Command.c_str(), L"-PEExportRTTIJson"))
+					{
+						if (cmd.Count() != 2)
+						{
+							_ERROR("Invalid number of command arguments: %u", cmd.Count());
+							_MESSAGE("Example: CreationKit -PEExportRTTIJson \"rtti.json\"");
+						}
+						else
+						{
+							try
+							{
+								RTTI::GetSingleton()->DumpJson(cmd[1]);
+							}
+							catch (const std::exception&)
+							{
+								_ERROR("It was not possible to create a file and write data there.");
+							}
+						}
+
 						// Close Creation Kit				
 						_interface->application->Terminate();
 					} 
@@ -302,6 +339,42 @@ namespace CKPE
 						_interface->application->Terminate();
 					}
 #endif
+					// Matching the functions of the old editor with the current process 
+					else if (!_wcsicmp(Command.c_str(), L"-PEMatchTableID"))
+					{
+						if (cmd.Count() != 4)
+						{
+							_ERROR("Invalid number of command arguments: %u", cmd.Count());
+							_MESSAGE("Example: CreationKit -PEMatchTableID \"old\\CreationKit.exe\" \"old.tableid\" \"report.txt\"");
+						}
+						else
+						{
+							// Sections at their RVA, without relocations
+							auto OldModule = LoadLibraryExW(cmd[1].c_str(), nullptr, LOAD_LIBRARY_AS_IMAGE_RESOURCE);
+							if (!OldModule)
+								_ERROR(L"Couldn't load the old editor: \"%s\"", cmd[1].c_str());
+							else
+							{
+								// The table belongs to the old image, its image hash is checked against it
+								auto OldBase = (std::uintptr_t)OldModule & ~3;
+								TableID OldTable(OldBase);
+								FunctionMatcher Matcher;
+
+								if (OldTable.Open(cmd[2]) &&
+									Matcher.Analyze((const void*)OldBase, 
+										(const void*)_interface->application->GetBase()) &&
+									Matcher.Match(OldTable))
+									Matcher.Dump(cmd[3]);
+								else
+									_ERROR("Couldn't match the functions of the old editor");
+
+								FreeLibrary(OldModule);
+							}
+						}
+
+						// Close Creation Kit				
+						_interface->application->Terminate();
+					}
 				}
 
 				// INSTALL RUN
@@ -419,12 +492,42 @@ namespace CKPE
 	}
 
 #ifdef CKPE_NO_LOGGER_FUNCTION
+	// The args are packed once for both: the capture stores them, the async writer of the log formats them
+	static void LogWriteVa(Logger::TypeMsg type_msg, Common::LogCapture::Severity severity, std::uintptr_t source,
+		const char* format, va_list ap) noexcept(true)
+	{
+		// Not initialized, as in the tests, there is no log to write to
+		if (!Common::Interface::GetSingleton()->GetCKPEInterface())
+			return;
+
+		auto capture = Common::LogCapture::GetSingleton();
+		auto logger = Common::Interface::GetSingleton()->GetLogger();
+
+		if (capture->HasOpen() && format)
+		{
+			thread_local std::string args;
+			args.clear();
+
+			std::uint32_t count = 0;
+			va_list copy;
+			va_copy(copy, ap);
+			bool packed = PackedArgs::Pack(args, format, copy, count);
+			va_end(copy);
+
+			capture->CapturePacked(severity, source, format, args, count);
+
+			if (packed && logger->WriteStringPacked(type_msg, format, args, count))
+				return;
+		}
+
+		logger->WriteStringVa(type_msg, format, ap);
+	}
+
 	CKPE_COMMON_API void _FATALERROR(const std::string_view& formatted_message, ...)
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
-		Common::Interface::GetSingleton()->GetLogger()->WriteString(Logger::tFatalError,
-			StringUtils::FormatStringVa(formatted_message.data(), ap));
+		LogWriteVa(Logger::tFatalError, Common::LogCapture::sFatalError, (std::uintptr_t)_ReturnAddress(), formatted_message.data(), ap);
 		va_end(ap);
 	}
 
@@ -432,8 +535,7 @@ namespace CKPE
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
-		Common::Interface::GetSingleton()->GetLogger()->WriteString(Logger::tError,
-			StringUtils::FormatStringVa(formatted_message.data(), ap));
+		LogWriteVa(Logger::tError, Common::LogCapture::sError, (std::uintptr_t)_ReturnAddress(), formatted_message.data(), ap);
 		va_end(ap);
 	}
 
@@ -441,8 +543,7 @@ namespace CKPE
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
-		Common::Interface::GetSingleton()->GetLogger()->WriteString(Logger::tWarning,
-			StringUtils::FormatStringVa(formatted_message.data(), ap));
+		LogWriteVa(Logger::tWarning, Common::LogCapture::sWarning, (std::uintptr_t)_ReturnAddress(), formatted_message.data(), ap);
 		va_end(ap);
 	}
 
@@ -450,8 +551,7 @@ namespace CKPE
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
-		Common::Interface::GetSingleton()->GetLogger()->WriteString(Logger::tMessage,
-			StringUtils::FormatStringVa(formatted_message.data(), ap));
+		LogWriteVa(Logger::tMessage, Common::LogCapture::sMessage, (std::uintptr_t)_ReturnAddress(), formatted_message.data(), ap);
 		va_end(ap);
 	}
 
@@ -459,6 +559,8 @@ namespace CKPE
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
+		Common::LogCapture::GetSingleton()->Capture(Common::LogCapture::sFatalError, (std::uintptr_t)_ReturnAddress(),
+			formatted_message.data(), ap);
 		Common::Interface::GetSingleton()->GetLogger()->WriteString(Logger::tFatalError,
 			StringUtils::Utf16ToUtf8(StringUtils::FormatStringVa(formatted_message.data(), ap)));
 		va_end(ap);
@@ -468,6 +570,8 @@ namespace CKPE
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
+		Common::LogCapture::GetSingleton()->Capture(Common::LogCapture::sError, (std::uintptr_t)_ReturnAddress(),
+			formatted_message.data(), ap);
 		Common::Interface::GetSingleton()->GetLogger()->WriteString(Logger::tError,
 			StringUtils::Utf16ToUtf8(StringUtils::FormatStringVa(formatted_message.data(), ap)));
 		va_end(ap);
@@ -477,6 +581,8 @@ namespace CKPE
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
+		Common::LogCapture::GetSingleton()->Capture(Common::LogCapture::sWarning, (std::uintptr_t)_ReturnAddress(),
+			formatted_message.data(), ap);
 		Common::Interface::GetSingleton()->GetLogger()->WriteString(Logger::tWarning,
 			StringUtils::Utf16ToUtf8(StringUtils::FormatStringVa(formatted_message.data(), ap)));
 		va_end(ap);
@@ -486,6 +592,8 @@ namespace CKPE
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
+		Common::LogCapture::GetSingleton()->Capture(Common::LogCapture::sMessage, (std::uintptr_t)_ReturnAddress(),
+			formatted_message.data(), ap);
 		Common::Interface::GetSingleton()->GetLogger()->WriteString(Logger::tMessage,
 			StringUtils::Utf16ToUtf8(StringUtils::FormatStringVa(formatted_message.data(), ap)));
 		va_end(ap);
@@ -0,0 +1,240 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <algorithm>
+#include <CKPE.HashUtils.h>
+#include <CKPE.StringUtils.h>
+#include <CKPE.PackedArgs.h>
+#include <CKPE.Common.LogCapture.h>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		constexpr static std::size_t CAPTURE_BUFFER_SIZE = 256 * 1024;
+
+		struct LogCaptureTemplate
+		{
+			std::uint32_t id;
+			std::string format;
+		};
+
+		struct LogCaptureData
+		{
+			// Different formats may have the same hash, the format is compared too
+			std::unordered_multimap<std::uint64_t, LogCaptureTemplate> templates;
+			std::string buffer;
+		};
+
+		static LogCapture slogcapture;
+
+		LogCapture::~LogCapture() noexcept(true)
+		{
+			Close();
+		}
+
+		LogCapture* LogCapture::GetSingleton() noexcept(true)
+		{
+			return &slogcapture;
+		}
+
+		bool LogCapture::Open(const std::wstring& fname) noexcept(true)
+		{
+			Close();
+
+			ScopeCriticalSection guard(_section);
+
+			try
+			{
+				auto f = _wfsopen(fname.c_str(), L"wb", _SH_DENYWR);
+				if (!f)
+					return false;
+
+				auto data = new LogCaptureData;
+				data->buffer.reserve(CAPTURE_BUFFER_SIZE);
+
+				LARGE_INTEGER counter, frequency;
+				FILETIME start;
+				QueryPerformanceFrequency(&frequency);
+				QueryPerformanceCounter(&counter);
+				GetSystemTimeAsFileTime(&start);
+
+				FileHeader header
+				{
+					.Magic = MAGIC,
+					.Version = VERSION,
+					.StartTime = ((std::uint64_t)start.dwHighDateTime << 32) | start.dwLowDateTime,
+					.StartCounter = (std::uint64_t)counter.QuadPart,
+					.Frequency = (std::uint64_t)frequency.QuadPart,
+				};
+
+				_handle = f;
+				_data = data;
+
+				WriteBuffer(&header, sizeof(header));
+
+				return true;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		}
+
+		void LogCapture::Close() noexcept(true)
+		{
+			ScopeCriticalSection guard(_section);
+
+			if (!_handle)
+				return;
+
+			Flush();
+
+			fclose((FILE*)_handle);
+			_handle = nullptr;
+
+			delete (LogCaptureData*)_data;
+			_data = nullptr;
+		}
+
+		void LogCapture::Flush() noexcept(true)
+		{
+			ScopeCriticalSection guard(_section);
+
+			if (!_handle)
+				return;
+
+			auto& buffer = ((LogCaptureData*)_data)->buffer;
+			if (!buffer.empty())
+			{
+				fwrite(buffer.data(), 1, buffer.length(), (FILE*)_handle);
+				buffer.clear();
+			}
+
+			fflush((FILE*)_handle);
+		}
+
+		void LogCapture::WriteBuffer(const void* data, std::uint32_t size) noexcept(true)
+		{
+			// The section must be locked
+			auto& buffer = ((LogCaptureData*)_data)->buffer;
+			if ((buffer.length() + size) > CAPTURE_BUFFER_SIZE)
+			{
+				fwrite(buffer.data(), 1, buffer.length(), (FILE*)_handle);
+				buffer.clear();
+			}
+
+			if (size > CAPTURE_BUFFER_SIZE)
+				fwrite(data, 1, size, (FILE*)_handle);
+			else
+				buffer.append((const char*)data, size);
+		}
+
+		void LogCapture::Capture(Severity severity, std::uintptr_t source, const char* format, va_list va) noexcept(true)
+		{
+			if (!_handle || !format)
+				return;
+
+			thread_local std::string args;
+			args.clear();
+
+			std::uint32_t count = 0;
+			va_list copy;
+			va_copy(copy, va);
+			PackedArgs::Pack(args, format, copy, count);
+			va_end(copy);
+
+			CapturePacked(severity, source, format, args, count);
+		}
+
+		void LogCapture::Capture(Severity severity, std::uintptr_t source, const wchar_t* format, va_list va) noexcept(true)
+		{
+			if (!_handle || !format)
+				return;
+
+			try
+			{
+				// The args keep their types, logquery doesn't need the wide format
+				auto utf8_format = StringUtils::Utf16ToUtf8(format);
+
+				thread_local std::string args;
+				args.clear();
+
+				std::uint32_t count = 0;
+				va_list copy;
+				va_copy(copy, va);
+				PackedArgs::Pack(args, utf8_format.c_str(), copy, count, true);
+				va_end(copy);
+
+				CapturePacked(severity, source, utf8_format.c_str(), args, count);
+			}
+			catch (const std::exception&)
+			{}
+		}
+
+		void LogCapture::CapturePacked(Severity severity, std::uintptr_t source, const char* format,
+			const std::string& args, std::uint32_t count) noexcept(true)
+		{
+			if (!_handle || !format)
+				return;
+
+			try
+			{
+				// Staging buffer of the thread, the record is built without the lock
+				thread_local std::string record;
+				record.resize(sizeof(MessageRecord));
+				record.append(args);
+
+				LARGE_INTEGER counter;
+				QueryPerformanceCounter(&counter);
+
+				auto msg = (MessageRecord*)record.data();
+				memset(msg, 0, sizeof(MessageRecord));
+				msg->Header.Type = rtMessage;
+				msg->Header.Size = (std::uint32_t)record.length();
+				msg->Counter = (std::uint64_t)counter.QuadPart;
+				msg->Source = source;
+				msg->ThreadId = GetCurrentThreadId();
+				msg->Severity = severity;
+				msg->ArgCount = (std::uint8_t)count;
+
+				auto length = (std::uint32_t)strlen(format);
+				auto hash = HashUtils::FastHash64(format, length);
+
+				ScopeCriticalSection guard(_section);
+
+				if (!_handle)
+					return;
+
+				auto& templates = ((LogCaptureData*)_data)->templates;
+				auto range = templates.equal_range(hash);
+				auto it = std::find_if(range.first, range.second, [format, length](const auto& value)
+					{ return (value.second.format.length() == length) && !memcmp(value.second.format.data(), format, length); });
+				if (it == range.second)
+				{
+					// The format is written once, before the first message that uses it
+					TemplateRecord tmpl
+					{
+						.Header = { .Type = rtTemplate, .Size = (std::uint32_t)(sizeof(TemplateRecord) + length) },
+						.Id = (std::uint32_t)templates.size(),
+						.Length = length,
+					};
+
+					it = templates.emplace(hash, LogCaptureTemplate{ tmpl.Id, std::string(format, length) });
+
+					WriteBuffer(&tmpl, sizeof(tmpl));
+					WriteBuffer(format, length);
+				}
+
+				msg->TemplateId = it->second.id;
+				WriteBuffer(record.data(), (std::uint32_t)record.length());
+			}
+			catch (const std::exception&)
+			{}
+		}
+	}
+}
@@ -10,13 +10,16 @@
 #include <CKPE.Stream.h>
 #include <CKPE.PathUtils.h>
 #include <CKPE.MessageBox.h>
+#include <CKPE.CriticalSection.h>
 #include <CKPE.Common.Interface.h>
+#include <CKPE.Common.LogCapture.h>
 #include <CKPE.Common.MemoryManager.h>
 #include <CKPE.Common.ClassicTheme.h>
 #include <CKPE.Common.ModernTheme.h>
-#include <concurrent_vector.h>
 #include <unordered_set>
+#include <atomic>
 #include <thread>
+#include <intrin.h>
 #include <stdexcept>
 #include <memory>
 #include <string>
@@ -32,11 +35,61 @@ namespace CKPE
 		constexpr static auto UI_LOG_CMD_AUTOSCROLL = 0x23002;
 
 		constexpr static size_t LINECOUNT_MAX = 50000;
+		// More messages than that are written out by the producer itself
+		constexpr static size_t PENDING_MAX = 4096;
+		// Slots of the set of the batch hashes, a power of two
+		constexpr static size_t SEEN_SIZE = PENDING_MAX * 2;
+		constexpr static size_t SEEN_PROBES = 16;
+
+		// A message is allocated once with its text and pushed to a lock-free list,
+		// the consumer takes the whole list at a time
+		struct LogMessageNode
+		{
+			LogMessageNode* next;
+			std::uint32_t length;
+			char text[1];
+		};
 
 		static LogWindow* slogwindow = nullptr;
-		concurrency::concurrent_vector<const char*> _pendingMessages;
+		static std::atomic<LogMessageNode*> _pendingMessages{ nullptr };
+		static std::atomic<std::size_t> _pendingCount{ 0 };
+		static std::atomic<std::uint64_t> _lastHash{ 0 };
+		// Hashes of the messages of the pending batch, open addressing without locks (0 is a free slot).
+		// The consumer clears it when it takes the batch, the duplicates of the batch are dropped.
+		static std::atomic<std::uint64_t> _seenHashes[SEEN_SIZE];
+		// Only for consumers (UI timer and Flush), producers never lock
+		static CriticalSection _fetchSection;
+		static std::string _fetchedText;
+		static std::size_t _fetchedCount{ 0 };
+		// Read only after LoadWarningBlacklist
 		std::unordered_set<uint64_t> _messageBlacklist;
 
+		// False if the hash is already in the set. When the probes are over, the message is kept.
+		static bool InsertSeenHash(std::uint64_t hash) noexcept(true)
+		{
+			if (!hash) hash = 1;
+
+			for (std::size_t i = 0, slot = (std::size_t)hash; i < SEEN_PROBES; i++, slot++)
+			{
+				auto& value = _seenHashes[slot & (SEEN_SIZE - 1)];
+				auto expected = value.load(std::memory_order_relaxed);
+				if (!expected && value.compare_exchange_strong(expected, hash, std::memory_order_relaxed))
+					return true;
+				// Another thread could take the slot for the same hash
+				if (expected == hash)
+					return false;
+			}
+
+			return true;
+		}
+
+		static void ClearSeenHashes() noexcept(true)
+		{
+			for (auto& value : _seenHashes)
+				if (value.load(std::memory_order_relaxed))
+					value.store(0, std::memory_order_relaxed);
+		}
+
 		static LRESULT CALLBACK LogWindowProc(HWND Hwnd, UINT Message, WPARAM wParam, LPARAM lParam)
 		{
 			static size_t LineCount = 0;
@@ -96,7 +149,7 @@ namespace CKPE
 						LineCount = (size_t)SendMessageA((HWND)rich, EM_GETLINECOUNT, 0, 0);
 					}
 
-					if (_pendingMessages.size() <= 0)
+					if (!_pendingMessages.load(std::memory_order_relaxed) && !_fetchedCount)
 						break;
 
 					return LogWindowProc(Hwnd, UI_LOG_CMD_ADDTEXT, 0, 0);
@@ -169,10 +222,11 @@ namespace CKPE
 					if (!log->HasAutoScroll())
 						SendMessageA(rich, EM_GETSCROLLPOS, 0, reinterpret_cast<LPARAM>(&scrollRange));
 
-					// Получить копию всех элементов и очистить целевой список
-					auto messages(std::move(_pendingMessages));
+					// Забрать все накопленные сообщения одним блоком
+					std::string messages;
+					auto count = log->FetchPendingMessages(messages);
 
-					for (const char* message : messages)
+					if (count)
 					{
 						// Переместить курсор в конец, затем написать
 						CHARRANGE range
@@ -182,10 +236,9 @@ namespace CKPE
 						};
 
 						SendMessageA(rich, EM_EXSETSEL, 0, reinterpret_cast<LPARAM>(&range));
-						SendMessageA(rich, EM_REPLACESEL, FALSE, reinterpret_cast<LPARAM>(message));
+						SendMessageA(rich, EM_REPLACESEL, FALSE, reinterpret_cast<LPARAM>(messages.c_str()));
 
-						CKPE::free((void*)message);
-						LineCount++;
+						LineCount += count;
 					}
 
 					if (!log->HasAutoScroll())
@@ -350,6 +403,11 @@ namespace CKPE
 
 		void LogWindow::CloseOutputFile() noexcept(true)
 		{
+			// Nothing is fetched between the last write and the closing
+			ScopeCriticalSection guard(_fetchSection);
+
+			Flush();
+
 			if (_output_file)
 			{
 				fclose(_output_file);
@@ -357,6 +415,94 @@ namespace CKPE
 			}
 		}
 
+		std::size_t LogWindow::FetchPendingMessages(std::string& text) noexcept(true)
+		{
+			ScopeCriticalSection guard(_fetchSection);
+
+			// Take the whole list, it's in reverse order
+			auto node = _pendingMessages.exchange(nullptr, std::memory_order_acquire);
+			LogMessageNode* head = nullptr;
+			std::size_t count = 0, length = 0;
+
+			while (node)
+			{
+				auto next = node->next;
+				node->next = head;
+				head = node;
+				node = next;
+				length += head->length;
+				count++;
+			}
+
+			_pendingCount.fetch_sub(count, std::memory_order_relaxed);
+			// A hash of the next batch may be cleared too, then one duplicate of it passes
+			if (count)
+				ClearSeenHashes();
+
+			try
+			{
+				std::string batch;
+				batch.reserve(length);
+
+				for (node = head; node; node = head)
+				{
+					batch.append(node->text, node->length);
+					head = node->next;
+					CKPE::free(node);
+				}
+
+				if (_output_file && !batch.empty())
+				{
+					fwrite(batch.data(), 1, batch.length(), _output_file);
+					fflush(_output_file);
+				}
+
+				// Messages that Flush has already written to the file
+				text = std::move(_fetchedText);
+				text.append(batch);
+				_fetchedText.clear();
+				count += _fetchedCount;
+				_fetchedCount = 0;
+
+				return count;
+			}
+			catch (const std::exception&)
+			{
+				for (node = head; node; node = head)
+				{
+					head = node->next;
+					CKPE::free(node);
+				}
+
+				return 0;
+			}
+		}
+
+		void LogWindow::Flush() noexcept(true)
+		{
+			ScopeCriticalSection guard(_fetchSection);
+
+			std::string text;
+			auto count = FetchPendingMessages(text);
+
+			// Keep them for the log window, no more than it can show
+			if (count > LINECOUNT_MAX)
+			{
+				std::size_t offset = 0;
+				for (auto skip = count - LINECOUNT_MAX; skip && (offset != std::string::npos); skip--)
+				{
+					offset = text.find('\n', offset);
+					if (offset != std::string::npos) offset++;
+				}
+
+				text.erase(0, (offset != std::string::npos) ? offset : text.length());
+				count = LINECOUNT_MAX;
+			}
+
+			_fetchedText = std::move(text);
+			_fetchedCount = count;
+		}
+
 		void LogWindow::LoadWarningBlacklist() noexcept(true)
 		{
 			auto app = Interface::GetSingleton()->GetApplication();
@@ -599,34 +745,47 @@ namespace CKPE
 			if (len <= 0)
 				return;
 
-			std::string sbuffer;
-			sbuffer.resize(len);
-			if (!sbuffer.empty())
-			{
-				_vsnprintf_s(sbuffer.data(), (std::size_t)len + 1, _TRUNCATE, formatted_message.data(), va);
+			// Staging buffer of the thread, doesn't allocate on each message
+			thread_local std::string sbuffer;
+			sbuffer.resize((std::size_t)len);
+			_vsnprintf_s(sbuffer.data(), (std::size_t)len + 1, _TRUNCATE, formatted_message.data(), va);
 
-				sbuffer = StringUtils::Trim(sbuffer);
-				std::replace_if(sbuffer.begin(), sbuffer.end(), [](auto const& x) { return x == '\n' || x == '\r'; }, ' ');
-				if (!sbuffer.length())
-					return;
+			// Trim without copying
+			auto first = sbuffer.find_first_not_of(" \t\n\r\f\v");
+			if (first == std::string::npos)
+				return;
+			auto end = sbuffer.find_last_not_of(" \t\n\r\f\v") + 1;
 
-				auto HashMsg = HashUtils::MurmurHash64A(sbuffer.c_str(), sbuffer.length());
-				if ((_last_hash == HashMsg) || (_messageBlacklist.count(HashMsg) > 0))
-					return;
+			auto text = sbuffer.data() + first;
+			auto length = end - first;
+			std::replace_if(text, text + length, [](auto const& x) { return x == '\n' || x == '\r'; }, ' ');
 
-				_last_hash = HashMsg;
-				// fix length string sbuffer
-				sbuffer = std::string(sbuffer.c_str()).append("\n");
+			auto HashMsg = HashUtils::MurmurHash64A(text, length);
+			if (_messageBlacklist.count(HashMsg) > 0)
+				return;
 
-				if (_output_file)
-				{
-					fputs(sbuffer.c_str(), _output_file);
-					fflush(_output_file);
-				}
+			// The last message is for the repeats across the batches
+			if ((_lastHash.exchange(HashMsg, std::memory_order_relaxed) == HashMsg) || !InsertSeenHash(HashMsg))
+				return;
 
-				if (_pendingMessages.size() < LINECOUNT_MAX)
-					_pendingMessages.push_back(CKPE::strdup(sbuffer.c_str()));
-			}
+			// The window doesn't take them, write them to the file and keep only what it can show
+			if (_pendingCount.load(std::memory_order_relaxed) >= PENDING_MAX)
+				Flush();
+
+			auto node = (LogMessageNode*)CKPE::malloc(sizeof(LogMessageNode) + length + 1);
+			if (!node)
+				return;
+
+			memcpy(node->text, text, length);
+			node->text[length] = '\n';
+			node->text[length + 1] = '\0';
+			node->length = (std::uint32_t)(length + 1);
+
+			_pendingCount.fetch_add(1, std::memory_order_relaxed);
+
+			node->next = _pendingMessages.load(std::memory_order_relaxed);
+			while (!_pendingMessages.compare_exchange_weak(node->next, node, std::memory_order_release,
+				std::memory_order_relaxed));
 		}
 
 		void LogWindow::InputLog(const std::wstring_view& formatted_message, ...)
@@ -647,37 +806,52 @@ namespace CKPE
 			sbuffer.resize(len);
 			if (!sbuffer.empty())
 			{
-				_vsnwprintf_s(sbuffer.data(), (std::size_t)len, _TRUNCATE, formatted_message.data(), va);
-				InputLog(StringUtils::Utf16ToWinCP(sbuffer));
+				_vsnwprintf_s(sbuffer.data(), (std::size_t)len + 1, _TRUNCATE, formatted_message.data(), va);
+				InputLog("%s", StringUtils::Utf16ToWinCP(sbuffer).c_str());
 			}
 		}
 	}
 
+	// The source is the caller of _CONSOLE or _CONSOLEVA, not the wrapper itself
+	static void ConsoleVa(std::uintptr_t source, const std::string_view& formatted_message, va_list va) noexcept(true)
+	{
+		Common::LogCapture::GetSingleton()->Capture(Common::LogCapture::sConsole, source, formatted_message.data(), va);
+
+		if (Common::slogwindow)
+			Common::slogwindow->InputLogVa(formatted_message, va);
+	}
+
+	static void ConsoleVa(std::uintptr_t source, const std::wstring_view& formatted_message, va_list va) noexcept(true)
+	{
+		Common::LogCapture::GetSingleton()->Capture(Common::LogCapture::sConsole, source, formatted_message.data(), va);
+
+		if (Common::slogwindow)
+			Common::slogwindow->InputLogVa(formatted_message, va);
+	}
+
 	CKPE_COMMON_API void _CONSOLE(const std::string_view& formatted_message, ...) noexcept(true)
 	{
 		va_list va;
 		va_start(va, &formatted_message);
-		_CONSOLEVA(formatted_message, va);
+		ConsoleVa((std::uintptr_t)_ReturnAddress(), formatted_message, va);
 		va_end(va);
 	}
 
 	CKPE_COMMON_API void _CONSOLEVA(const std::string_view& formatted_message, va_list va) noexcept(true)
 	{
-		if (Common::slogwindow)
-			Common::slogwindow->InputLogVa(formatted_message, va);
+		ConsoleVa((std::uintptr_t)_ReturnAddress(), formatted_message, va);
 	}
 
 	CKPE_COMMON_API void _CONSOLE(const std::wstring_view& formatted_message, ...) noexcept(true)
 	{
 		va_list va;
 		va_start(va, &formatted_message);
-		_CONSOLEVA(formatted_message, va);
+		ConsoleVa((std::uintptr_t)_ReturnAddress(), formatted_message, va);
 		va_end(va);
 	}
 
 	CKPE_COMMON_API void _CONSOLEVA(const std::wstring_view& formatted_message, va_list va) noexcept(true)
 	{
-		if (Common::slogwindow)
-			Common::slogwindow->InputLogVa(formatted_message, va);
+		ConsoleVa((std::uintptr_t)_ReturnAddress(), formatted_message, va);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,595 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <CKPE.Logger.h>
+#include <CKPE.HashUtils.h>
+#include <CKPE.PathUtils.h>
+#include <CKPE.StringUtils.h>
+#include <CKPE.Common.TaskScheduler.h>
+#include <CKPE.Common.PluginHeaderScanner.h>
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstring>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		constexpr static std::size_t PLUGIN_HEADER_SIZE = 24;
+		constexpr static std::size_t PLUGIN_SUBRECORD_SIZE = 6;
+		constexpr static std::size_t PLUGIN_SCAN_GRAIN = 8;
+
+		// Headers of the previous scan, valid for the same time and size of the file
+		constexpr static std::uint32_t PLUGIN_CACHE_MAGIC = 'CHLP';
+		constexpr static std::uint32_t PLUGIN_CACHE_VERSION = 1;
+		constexpr static wchar_t PLUGIN_CACHE_FNAME[] = L"CreationKitPlatformExtended_Plugins.cache";
+
+#pragma pack(push, 1)
+		struct PluginCacheHeader
+		{
+			std::uint32_t Magic;
+			std::uint32_t Version;
+			std::uint64_t DirectoryHash;	// FastHash64 of the lower-case folder
+			std::uint32_t Count;
+			std::uint32_t Reserved;
+			std::uint64_t Checksum;			// FastHash64 of the entries
+		};
+#pragma pack(pop)
+
+		struct PluginHeaderEntry
+		{
+			std::uint64_t WriteTime;
+			std::uint64_t Size;
+			PluginHeaderScanner::Header Header;
+		};
+
+		struct PluginHeaderScannerData
+		{
+			mutable std::shared_mutex Lock;
+			std::unordered_map<std::string, PluginHeaderEntry> Entries;
+		};
+
+		static PluginHeaderScanner splugin_header_scanner;
+
+		// Plugins are little-endian, read by bytes so it doesn't matter where
+		[[nodiscard]] static inline std::uint16_t PluginReadU16(const std::uint8_t* p) noexcept(true)
+		{
+			return (std::uint16_t)(p[0] | (p[1] << 8));
+		}
+
+		[[nodiscard]] static inline std::uint32_t PluginReadU32(const std::uint8_t* p) noexcept(true)
+		{
+			return (std::uint32_t)p[0] | ((std::uint32_t)p[1] << 8) | ((std::uint32_t)p[2] << 16) | ((std::uint32_t)p[3] << 24);
+		}
+
+		[[nodiscard]] static inline bool PluginIsSignature(const std::uint8_t* p, const char* Signature) noexcept(true)
+		{
+			return !memcmp(p, Signature, 4);
+		}
+
+		[[nodiscard]] static inline std::string PluginReadZString(const std::uint8_t* p, std::size_t Size)
+		{
+			return std::string((const char*)p, strnlen((const char*)p, Size));
+		}
+
+		[[nodiscard]] static std::string PluginKey(const std::string& FileName)
+		{
+			std::string Result = FileName;
+			if (!Result.empty())
+				CharLowerBuffA(Result.data(), (DWORD)Result.length());
+			return Result;
+		}
+
+		// The cache is a header and the entries one after another:
+		// time, size, flags, form version, version, records, next id, name, author, description, masters
+		class PluginCacheWriter
+		{
+			std::string& _buffer;
+		public:
+			PluginCacheWriter(std::string& Buffer) : _buffer(Buffer) {}
+
+			template<typename T>
+			void Write(T Value) { _buffer.append((const char*)&Value, sizeof(T)); }
+
+			void WriteString(const std::string& Value)
+			{
+				Write((std::uint32_t)Value.length());
+				_buffer.append(Value);
+			}
+		};
+
+		class PluginCacheReader
+		{
+			const std::uint8_t* _data;
+			std::size_t _size;
+			std::size_t _pos{ 0 };
+		public:
+			PluginCacheReader(const void* Data, std::size_t Size) : _data((const std::uint8_t*)Data), _size(Size) {}
+
+			template<typename T>
+			bool Read(T& Value)
+			{
+				if ((_size - _pos) < sizeof(T))
+					return false;
+				memcpy(&Value, _data + _pos, sizeof(T));
+				_pos += sizeof(T);
+				return true;
+			}
+
+			bool ReadString(std::string& Value)
+			{
+				std::uint32_t Length;
+				if (!Read(Length) || ((_size - _pos) < Length))
+					return false;
+				Value.assign((const char*)_data + _pos, Length);
+				_pos += Length;
+				return true;
+			}
+
+			[[nodiscard]] inline bool IsEnd() const noexcept(true) { return _pos == _size; }
+		};
+
+		static void PluginLoadCache(const std::wstring& fname, std::uint64_t DirectoryHash,
+			std::unordered_map<std::string, PluginHeaderEntry>& Cache) noexcept(true)
+		{
+			auto file = CreateFileW(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return;
+
+			LARGE_INTEGER size{};
+			HANDLE map = nullptr;
+			if (GetFileSizeEx(file, &size) && (size.QuadPart >= (LONGLONG)sizeof(PluginCacheHeader)))
+				map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			CloseHandle(file);
+
+			if (!map)
+				return;
+
+			auto view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(map);
+
+			if (!view)
+				return;
+
+			try
+			{
+				auto header = (const PluginCacheHeader*)view;
+				auto entries_size = (std::size_t)size.QuadPart - sizeof(PluginCacheHeader);
+
+				// A stale or damaged cache is just read again
+				if ((header->Magic == PLUGIN_CACHE_MAGIC) && (header->Version == PLUGIN_CACHE_VERSION) &&
+					(header->DirectoryHash == DirectoryHash) &&
+					(header->Checksum == HashUtils::FastHash64(header + 1, entries_size)))
+				{
+					PluginCacheReader Reader(header + 1, entries_size);
+					Cache.reserve(header->Count);
+
+					for (std::uint32_t i = 0; i < header->Count; i++)
+					{
+						std::string Key;
+						PluginHeaderEntry Entry;
+						std::uint32_t MasterCount;
+
+						if (!Reader.Read(Entry.WriteTime) || !Reader.Read(Entry.Size) || !Reader.Read(Entry.Header.Flags) ||
+							!Reader.Read(Entry.Header.FormVersion) || !Reader.Read(Entry.Header.Version) ||
+							!Reader.Read(Entry.Header.RecordCount) || !Reader.Read(Entry.Header.NextObjectID) ||
+							!Reader.ReadString(Key) || !Reader.ReadString(Entry.Header.Author) ||
+							!Reader.ReadString(Entry.Header.Description) || !Reader.Read(MasterCount))
+						{
+							Cache.clear();
+							break;
+						}
+
+						bool Broken = false;
+						Entry.Header.Masters.resize(std::min<std::uint32_t>(MasterCount, 0x1000));
+						for (auto& Master : Entry.Header.Masters)
+							if (!Reader.ReadString(Master))
+							{
+								Broken = true;
+								break;
+							}
+
+						if (Broken || (MasterCount > 0x1000))
+						{
+							Cache.clear();
+							break;
+						}
+
+						Cache.insert_or_assign(std::move(Key), std::move(Entry));
+					}
+				}
+			}
+			catch (const std::exception&)
+			{
+				Cache.clear();
+			}
+
+			UnmapViewOfFile(view);
+		}
+
+		static void PluginSaveCache(const std::wstring& fname, std::uint64_t DirectoryHash,
+			const std::unordered_map<std::string, PluginHeaderEntry>& Entries) noexcept(true)
+		{
+			try
+			{
+				std::string Buffer;
+				PluginCacheWriter Writer(Buffer);
+
+				for (auto& [Key, Entry] : Entries)
+				{
+					Writer.Write(Entry.WriteTime);
+					Writer.Write(Entry.Size);
+					Writer.Write(Entry.Header.Flags);
+					Writer.Write(Entry.Header.FormVersion);
+					Writer.Write(Entry.Header.Version);
+					Writer.Write(Entry.Header.RecordCount);
+					Writer.Write(Entry.Header.NextObjectID);
+					Writer.WriteString(Key);
+					Writer.WriteString(Entry.Header.Author);
+					Writer.WriteString(Entry.Header.Description);
+					Writer.Write((std::uint32_t)Entry.Header.Masters.size());
+					for (auto& Master : Entry.Header.Masters)
+						Writer.WriteString(Master);
+				}
+
+				PluginCacheHeader header{
+					.Magic = PLUGIN_CACHE_MAGIC,
+					.Version = PLUGIN_CACHE_VERSION,
+					.DirectoryHash = DirectoryHash,
+					.Count = (std::uint32_t)Entries.size(),
+					.Reserved = 0,
+					.Checksum = HashUtils::FastHash64(Buffer.data(), Buffer.length()),
+				};
+
+				// Written aside, another editor may be reading the old one
+				auto tmp_fname = fname + L".tmp";
+				auto f = _wfsopen(tmp_fname.c_str(), L"wb", _SH_DENYWR);
+				if (!f)
+					return;
+
+				bool ok = (fwrite(&header, sizeof(header), 1, f) == 1) &&
+					(Buffer.empty() || (fwrite(Buffer.data(), 1, Buffer.length(), f) == Buffer.length()));
+				fclose(f);
+
+				if (!ok || !MoveFileExW(tmp_fname.c_str(), fname.c_str(), MOVEFILE_REPLACE_EXISTING))
+					DeleteFileW(tmp_fname.c_str());
+			}
+			catch (const std::exception&)
+			{}
+		}
+
+		PluginHeaderScanner::PluginHeaderScanner() noexcept(true)
+		{
+			try
+			{
+				_data = new PluginHeaderScannerData;
+			}
+			catch (const std::exception&)
+			{}
+		}
+
+		PluginHeaderScanner::~PluginHeaderScanner() noexcept(true)
+		{
+			if (_data)
+			{
+				delete (PluginHeaderScannerData*)_data;
+				_data = nullptr;
+			}
+		}
+
+		bool PluginHeaderScanner::Parse(const void* Data, std::size_t Size, Header& Result) noexcept(true)
+		{
+			auto p = (const std::uint8_t*)Data;
+
+			try
+			{
+				Result = Header{};
+
+				if (!p || (Size < PLUGIN_HEADER_SIZE) || !PluginIsSignature(p, "TES4"))
+					return false;
+
+				auto DataSize = PluginReadU32(p + 4);
+				Result.Flags = PluginReadU32(p + 8);
+				Result.FormVersion = PluginReadU16(p + 20);
+
+				// The header is never compressed, and the file may be cut
+				if ((Result.Flags & FLAG_COMPRESSED) || (DataSize > (Size - PLUGIN_HEADER_SIZE)))
+					return false;
+
+				auto Sub = p + PLUGIN_HEADER_SIZE;
+				auto End = Sub + DataSize;
+				std::uint32_t ExtendedSize = 0;
+
+				while ((std::size_t)(End - Sub) >= PLUGIN_SUBRECORD_SIZE)
+				{
+					std::size_t SubSize = ExtendedSize ? ExtendedSize : PluginReadU16(Sub + 4);
+					auto SubData = Sub + PLUGIN_SUBRECORD_SIZE;
+
+					if (SubSize > (std::size_t)(End - SubData))
+						return false;
+
+					// The size of the next one doesn't fit in 16 bits
+					if (PluginIsSignature(Sub, "XXXX"))
+					{
+						if (SubSize != 4)
+							return false;
+
+						ExtendedSize = PluginReadU32(SubData);
+						Sub = SubData + SubSize;
+						continue;
+					}
+
+					ExtendedSize = 0;
+
+					if (PluginIsSignature(Sub, "HEDR") && (SubSize >= 12))
+					{
+						auto Bits = PluginReadU32(SubData);
+						memcpy(&Result.Version, &Bits, sizeof(float));
+						Result.RecordCount = PluginReadU32(SubData + 4);
+						Result.NextObjectID = PluginReadU32(SubData + 8);
+					}
+					else if (PluginIsSignature(Sub, "CNAM"))
+						Result.Author = PluginReadZString(SubData, SubSize);
+					else if (PluginIsSignature(Sub, "SNAM"))
+						Result.Description = PluginReadZString(SubData, SubSize);
+					else if (PluginIsSignature(Sub, "MAST"))
+						Result.Masters.emplace_back(PluginReadZString(SubData, SubSize));
+
+					Sub = SubData + SubSize;
+				}
+
+				return Sub == End;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		}
+
+		bool PluginHeaderScanner::Read(const std::wstring& fname, Header& Result) noexcept(true)
+		{
+			auto file = CreateFileW(fname.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+				nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER file_size{};
+			void* view = nullptr;
+
+			if (GetFileSizeEx(file, &file_size) && (file_size.QuadPart >= (LONGLONG)PLUGIN_HEADER_SIZE))
+			{
+				auto map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (map)
+				{
+					// The whole file, but only the pages of the header are touched
+					view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+					CloseHandle(map);
+				}
+			}
+
+			CloseHandle(file);
+
+			if (!view)
+				return false;
+
+			bool Success = false;
+			bool Failed = false;
+
+			// The file may be cut or on a network drive that's gone
+			__try
+			{
+				Success = Parse(view, (std::size_t)file_size.QuadPart, Result);
+			}
+			__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+			{
+				Failed = true;
+			}
+
+			UnmapViewOfFile(view);
+
+			if (Failed)
+				_ERROR(L"PluginHeaderScanner: can't read \"%s\"", fname.c_str());
+
+			return Success && !Failed;
+		}
+
+		std::uint32_t PluginHeaderScanner::Scan(const std::wstring& Directory, bool UseCache) noexcept(true)
+		{
+			auto data = (PluginHeaderScannerData*)_data;
+			if (!data)
+				return 0;
+
+			try
+			{
+				struct ScanItem
+				{
+					std::wstring FileName;
+					std::string Key;
+					PluginHeaderEntry Entry;
+					bool Ready;
+				};
+
+				std::vector<ScanItem> Items;
+				WIN32_FIND_DATAW FindData;
+
+				// The time and size come with the listing, the unchanged files aren't even opened
+				auto Handle = FindFirstFileExW((Directory + L"*").c_str(), FindExInfoBasic, &FindData,
+					FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+				if (Handle != INVALID_HANDLE_VALUE)
+				{
+					do
+					{
+						if (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+							continue;
+
+						auto Length = wcslen(FindData.cFileName);
+						if ((Length <= 4) || (_wcsicmp(FindData.cFileName + Length - 4, L".esm") &&
+							_wcsicmp(FindData.cFileName + Length - 4, L".esp") &&
+							_wcsicmp(FindData.cFileName + Length - 4, L".esl")))
+							continue;
+
+						ScanItem Item;
+						Item.FileName = FindData.cFileName;
+						Item.Key = PluginKey(StringUtils::Utf16ToWinCP(Item.FileName));
+						Item.Entry.WriteTime = ((std::uint64_t)FindData.ftLastWriteTime.dwHighDateTime << 32) |
+							FindData.ftLastWriteTime.dwLowDateTime;
+						Item.Entry.Size = ((std::uint64_t)FindData.nFileSizeHigh << 32) | FindData.nFileSizeLow;
+						Item.Ready = false;
+						Items.emplace_back(std::move(Item));
+					} while (FindNextFileW(Handle, &FindData));
+
+					FindClose(Handle);
+				}
+
+				// Next to the logs, the folder of the editor may be read-only
+				auto cache_fname = PathUtils::GetCKPELogsPath() + PLUGIN_CACHE_FNAME;
+				auto DirectoryHash = HashUtils::FastHash64(PluginKey(StringUtils::Utf16ToWinCP(Directory)));
+
+				std::unordered_map<std::string, PluginHeaderEntry> Cache;
+				if (UseCache)
+					PluginLoadCache(cache_fname, DirectoryHash, Cache);
+
+				std::vector<std::size_t> Missing;
+
+				{
+					std::shared_lock lock(data->Lock);
+
+					for (std::size_t i = 0; i < Items.size(); i++)
+					{
+						auto& Item = Items[i];
+
+						// What this session has already read, then the cache
+						auto It = data->Entries.find(Item.Key);
+						if ((It == data->Entries.end()) || (It->second.WriteTime != Item.Entry.WriteTime) ||
+							(It->second.Size != Item.Entry.Size))
+						{
+							It = Cache.find(Item.Key);
+							if ((It == Cache.end()) || (It->second.WriteTime != Item.Entry.WriteTime) ||
+								(It->second.Size != Item.Entry.Size))
+							{
+								Missing.push_back(i);
+								continue;
+							}
+						}
+
+						Item.Entry.Header = It->second.Header;
+						Item.Ready = true;
+					}
+				}
+
+				TaskScheduler::GetSingleton()->ParallelFor(0, Missing.size(), PLUGIN_SCAN_GRAIN,
+					[&](std::size_t Begin, std::size_t End)
+					{
+						for (auto i = Begin; i < End; i++)
+						{
+							auto& Item = Items[Missing[i]];
+							Item.Ready = Read(Directory + Item.FileName, Item.Entry.Header);
+						}
+					}, "PluginHeaderScanner");
+
+				std::unordered_map<std::string, PluginHeaderEntry> Entries;
+				Entries.reserve(Items.size());
+				for (auto& Item : Items)
+					if (Item.Ready)
+						Entries.insert_or_assign(std::move(Item.Key), std::move(Item.Entry));
+
+				if (UseCache && (!Missing.empty() || (Cache.size() != Entries.size())))
+				{
+					PathUtils::CreateFolder(PathUtils::GetCKPELogsPath());
+					PluginSaveCache(cache_fname, DirectoryHash, Entries);
+				}
+
+				auto Count = (std::uint32_t)Entries.size();
+				_MESSAGE("PluginHeaderScanner: %u plugins, %u read", Count, (std::uint32_t)Missing.size());
+
+				std::unique_lock lock(data->Lock);
+				data->Entries = std::move(Entries);
+
+				return Count;
+			}
+			catch (const std::exception& e)
+			{
+				_ERROR("PluginHeaderScanner: %s", e.what());
+				return 0;
+			}
+		}
+
+		void PluginHeaderScanner::Clear() noexcept(true)
+		{
+			auto data = (PluginHeaderScannerData*)_data;
+			if (!data)
+				return;
+
+			std::unique_lock lock(data->Lock);
+			data->Entries.clear();
+		}
+
+		bool PluginHeaderScanner::Find(const char* FileName, Header& Result) const noexcept(true)
+		{
+			auto data = (PluginHeaderScannerData*)_data;
+			if (!data || !FileName)
+				return false;
+
+			try
+			{
+				auto Key = PluginKey(FileName);
+
+				std::shared_lock lock(data->Lock);
+
+				auto It = data->Entries.find(Key);
+				if (It == data->Entries.end())
+					return false;
+
+				Result = It->second.Header;
+				return true;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		}
+
+		bool PluginHeaderScanner::GetFlags(const char* FileName, std::uint32_t& Flags) const noexcept(true)
+		{
+			auto data = (PluginHeaderScannerData*)_data;
+			if (!data || !FileName)
+				return false;
+
+			try
+			{
+				auto Key = PluginKey(FileName);
+
+				std::shared_lock lock(data->Lock);
+
+				auto It = data->Entries.find(Key);
+				if (It == data->Entries.end())
+					return false;
+
+				Flags = It->second.Header.Flags;
+				return true;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		}
+
+		std::uint32_t PluginHeaderScanner::GetCount() const noexcept(true)
+		{
+			auto data = (PluginHeaderScannerData*)_data;
+			if (!data)
+				return 0;
+
+			std::shared_lock lock(data->Lock);
+			return (std::uint32_t)data->Entries.size();
+		}
+
+		PluginHeaderScanner* PluginHeaderScanner::GetSingleton() noexcept(true)
+		{
+			return &splugin_header_scanner;
+		}
+	}
+}
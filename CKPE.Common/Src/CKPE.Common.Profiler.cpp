@@ -0,0 +1,695 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <psapi.h>
+#include <shlwapi.h>
+#include <tlhelp32.h>
+#include <CKPE.HashUtils.h>
+#include <CKPE.StringUtils.h>
+#include <CKPE.Common.Interface.h>
+#include <CKPE.Common.Threads.h>
+#include <CKPE.Common.Profiler.h>
+#include <unordered_map>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		constexpr static std::uint32_t PROFILER_RING_SIZE = 8192;		// Power of two
+		constexpr static std::uint32_t PROFILER_RATE_MIN = 10;
+		constexpr static std::uint32_t PROFILER_RATE_MAX = 10000;
+		constexpr static std::uint32_t PROFILER_THREADS_REFRESH_MS = 1000;
+		// The top of the stack copied while the thread is suspended, deeper frames are cut off
+		constexpr static std::size_t PROFILER_STACK_COPY = 64 * 1024;
+		// Zeroed tail after the copy, the unwinder may read a little past the last frame
+		constexpr static std::size_t PROFILER_STACK_SLACK = 4096;
+
+		static Profiler sprofiler;
+
+		static void ProfilerSanitizeName(std::string& Name) noexcept(true)
+		{
+			for (auto& ch : Name)
+				if ((ch == ';') || (ch == ' ') || (ch == '\t') || (ch == '\n') || (ch == '\r'))
+					ch = '_';
+		}
+
+		///////////////////////////////////////////////////
+		/// ModuleSymbolizer
+
+		struct ModuleSymbolizerData
+		{
+			struct Module { std::uintptr_t Start, End; std::string Name; };
+
+			std::vector<Module> Modules;
+			decltype(&GetThreadDescription) GetThreadDescriptionProc{ nullptr };
+		};
+
+		ModuleSymbolizer::ModuleSymbolizer() noexcept(true)
+		{
+			try
+			{
+				auto data = new ModuleSymbolizerData;
+				_data = data;
+
+				HMODULE ModuleList[1024];
+				DWORD cbNeeded = 0;
+				auto hProcess = GetCurrentProcess();
+				if (EnumProcessModules(hProcess, ModuleList, sizeof(ModuleList), &cbNeeded))
+				{
+					cbNeeded = std::min(cbNeeded, (DWORD)sizeof(ModuleList));
+					for (DWORD i = 0; i < (cbNeeded / sizeof(HMODULE)); i++)
+					{
+						CHAR szModName[MAX_PATH];
+						MODULEINFO Info;
+						if (GetModuleFileNameExA(hProcess, ModuleList[i], szModName, ARRAYSIZE(szModName)) &&
+							GetModuleInformation(hProcess, ModuleList[i], &Info, sizeof(MODULEINFO)))
+						{
+							std::string Name = PathFindFileNameA(szModName);
+							ProfilerSanitizeName(Name);
+							data->Modules.push_back({ (std::uintptr_t)Info.lpBaseOfDll,
+								(std::uintptr_t)Info.lpBaseOfDll + Info.SizeOfImage, Name });
+						}
+					}
+				}
+
+				std::sort(data->Modules.begin(), data->Modules.end(),
+					[](const ModuleSymbolizerData::Module& a, const ModuleSymbolizerData::Module& b)
+					{ return a.Start < b.Start; });
+
+				// Windows 10 1607 and newer
+				data->GetThreadDescriptionProc = (decltype(&GetThreadDescription))
+					GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetThreadDescription");
+			}
+			catch (const std::exception&)
+			{}
+		}
+
+		ModuleSymbolizer::~ModuleSymbolizer() noexcept(true)
+		{
+			if (_data)
+			{
+				delete (ModuleSymbolizerData*)_data;
+				_data = nullptr;
+			}
+		}
+
+		std::string ModuleSymbolizer::GetName(std::uintptr_t Address) const noexcept(true)
+		{
+			auto data = (ModuleSymbolizerData*)_data;
+			if (data)
+			{
+				auto it = std::upper_bound(data->Modules.begin(), data->Modules.end(), Address,
+					[](std::uintptr_t Value, const ModuleSymbolizerData::Module& Module) { return Value < Module.Start; });
+				if ((it != data->Modules.begin()) && (Address < (--it)->End))
+				{
+					// The start of the function is the same for every address inside it
+					DWORD64 ImageBase = 0;
+					auto Function = RtlLookupFunctionEntry(Address, &ImageBase, nullptr);
+					auto Rva = Function ? Function->BeginAddress : (std::uint32_t)(Address - it->Start);
+					return StringUtils::FormatString("%s+%X", it->Name.c_str(), Rva);
+				}
+			}
+
+			return StringUtils::FormatString("0x%llX", (std::uint64_t)Address);
+		}
+
+		std::string ModuleSymbolizer::GetThreadName(std::uint32_t ThreadId) const noexcept(true)
+		{
+			auto data = (ModuleSymbolizerData*)_data;
+			if (data && data->GetThreadDescriptionProc)
+			{
+				auto Thread = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, ThreadId);
+				if (Thread)
+				{
+					PWSTR Description = nullptr;
+					std::string Name;
+					if (SUCCEEDED(data->GetThreadDescriptionProc(Thread, &Description)) && Description)
+					{
+						Name = StringUtils::Utf16ToUtf8(Description);
+						LocalFree(Description);
+					}
+					CloseHandle(Thread);
+
+					if (!Name.empty())
+					{
+						ProfilerSanitizeName(Name);
+						return StringUtils::FormatString("%s_%u", Name.c_str(), ThreadId);
+					}
+				}
+			}
+
+			return StringUtils::FormatString("thread_%u", ThreadId);
+		}
+
+		///////////////////////////////////////////////////
+		/// ProfileAggregator
+
+		struct ProfileAggregatorData
+		{
+			struct Stack
+			{
+				std::uint64_t Count;
+				std::uint32_t ThreadId;
+				std::uint32_t Offset;
+				std::uint32_t Depth;
+			};
+
+			std::unordered_map<std::uint64_t, std::uint32_t> Index;
+			std::vector<Stack> Stacks;
+			std::vector<std::uintptr_t> Frames;
+			std::uint64_t Samples{ 0 };
+		};
+
+		ProfileAggregator::ProfileAggregator() noexcept(true) :
+			_data(new ProfileAggregatorData)
+		{}
+
+		ProfileAggregator::~ProfileAggregator() noexcept(true)
+		{
+			if (_data)
+			{
+				delete (ProfileAggregatorData*)_data;
+				_data = nullptr;
+			}
+		}
+
+		void ProfileAggregator::Add(std::uint32_t ThreadId, const std::uintptr_t* Frames, std::uint32_t Depth,
+			std::uint64_t Count) noexcept(true)
+		{
+			auto data = (ProfileAggregatorData*)_data;
+			if (!data || !Frames || !Depth || !Count)
+				return;
+
+			try
+			{
+				auto Key = HashUtils::FastHash64(Frames, Depth * sizeof(std::uintptr_t), ThreadId);
+
+				// On a collision with another stack, the next key
+				for (;; Key++)
+				{
+					auto it = data->Index.find(Key);
+					if (it == data->Index.end())
+					{
+						data->Index.emplace(Key, (std::uint32_t)data->Stacks.size());
+						data->Stacks.push_back({ Count, ThreadId, (std::uint32_t)data->Frames.size(), Depth });
+						data->Frames.insert(data->Frames.end(), Frames, Frames + Depth);
+						break;
+					}
+
+					auto& Stack = data->Stacks[it->second];
+					if ((Stack.ThreadId == ThreadId) && (Stack.Depth == Depth) &&
+						!memcmp(data->Frames.data() + Stack.Offset, Frames, Depth * sizeof(std::uintptr_t)))
+					{
+						Stack.Count += Count;
+						break;
+					}
+				}
+
+				data->Samples += Count;
+			}
+			catch (const std::exception&)
+			{}
+		}
+
+		void ProfileAggregator::Clear() noexcept(true)
+		{
+			auto data = (ProfileAggregatorData*)_data;
+			if (!data)
+				return;
+
+			data->Index.clear();
+			data->Stacks.clear();
+			data->Frames.clear();
+			data->Samples = 0;
+		}
+
+		std::uint64_t ProfileAggregator::GetSampleCount() const noexcept(true)
+		{
+			return _data ? ((ProfileAggregatorData*)_data)->Samples : 0;
+		}
+
+		std::uint32_t ProfileAggregator::GetStackCount() const noexcept(true)
+		{
+			return _data ? (std::uint32_t)((ProfileAggregatorData*)_data)->Stacks.size() : 0;
+		}
+
+		void ProfileAggregator::WriteFolded(TextFileStream& Stream, const ProfileSymbolizer& Symbolizer) const noexcept(true)
+		{
+			auto data = (ProfileAggregatorData*)_data;
+			if (!data)
+				return;
+
+			try
+			{
+				// Each address and thread is named once
+				std::unordered_map<std::uintptr_t, std::string> Names;
+				std::unordered_map<std::uint32_t, std::string> ThreadNames;
+				std::string Line;
+
+				for (auto& Stack : data->Stacks)
+				{
+					auto itThread = ThreadNames.find(Stack.ThreadId);
+					if (itThread == ThreadNames.end())
+						itThread = ThreadNames.emplace(Stack.ThreadId, Symbolizer.GetThreadName(Stack.ThreadId)).first;
+
+					Line = itThread->second;
+
+					// From the root to the leaf
+					auto Frames = data->Frames.data() + Stack.Offset;
+					for (auto i = Stack.Depth; i > 0; i--)
+					{
+						auto Address = Frames[i - 1];
+						auto itName = Names.find(Address);
+						if (itName == Names.end())
+							itName = Names.emplace(Address, Symbolizer.GetName(Address)).first;
+
+						Line.append(";").append(itName->second);
+					}
+
+					Stream.WriteLine("%s %llu", Line.c_str(), Stack.Count);
+				}
+			}
+			catch (const std::exception&)
+			{}
+		}
+
+		///////////////////////////////////////////////////
+		/// Profiler
+
+		struct ProfilerData
+		{
+			std::wstring FileName;
+			std::uint32_t Rate{ 0 };
+			std::uint32_t FlushSeconds{ 0 };
+			HANDLE Sampler{ nullptr };
+			HANDLE Writer{ nullptr };
+			HANDLE Wake{ nullptr };
+			DWORD SamplerId{ 0 };
+			DWORD WriterId{ 0 };
+			std::atomic_bool Terminated{ false };
+			// The sampler is the only writer, the writer thread the only reader
+			std::vector<Profiler::Sample> Ring;
+			std::atomic_uint32_t Head{ 0 };
+			std::atomic_uint32_t Tail{ 0 };
+			std::atomic_uint64_t Dropped{ 0 };
+			// Only the sampler uses it
+			std::vector<std::uint8_t> StackCopy;
+			ProfileAggregator Aggregator;
+
+			~ProfilerData() noexcept(true)
+			{
+				if (Wake) CloseHandle(Wake);
+			}
+		};
+
+		struct ProfilerThreadBasicInformation
+		{
+			LONG ExitStatus;
+			PVOID TebBaseAddress;
+			struct { HANDLE UniqueProcess; HANDLE UniqueThread; } ClientId;
+			ULONG_PTR AffinityMask;
+			LONG Priority;
+			LONG BasePriority;
+		};
+
+		typedef LONG(NTAPI* TNtQueryInformationThread)(HANDLE ThreadHandle, ULONG ThreadInformationClass,
+			PVOID ThreadInformation, ULONG ThreadInformationLength, PULONG ReturnLength);
+
+		// The upper end of the thread stack (NT_TIB::StackBase in its TEB), 0 if unknown
+		static std::uintptr_t ProfilerGetStackBase(TNtQueryInformationThread NtQueryInformationThreadProc,
+			HANDLE Thread) noexcept(true)
+		{
+			if (!NtQueryInformationThreadProc)
+				return 0;
+
+			ProfilerThreadBasicInformation Info{};
+			// ThreadBasicInformation
+			if ((NtQueryInformationThreadProc(Thread, 0, &Info, sizeof(Info), nullptr) < 0) || !Info.TebBaseAddress)
+				return 0;
+
+			__try
+			{
+				return (std::uintptr_t)((NT_TIB*)Info.TebBaseAddress)->StackBase;
+			}
+			__except (EXCEPTION_EXECUTE_HANDLER)
+			{
+				return 0;
+			}
+		}
+
+		// Runs while the thread is suspended: no locks, no allocations, only the copy
+		static std::size_t ProfilerCopyStack(std::uint8_t* Buffer, std::uintptr_t Rsp, std::size_t Size) noexcept(true)
+		{
+			__try
+			{
+				memcpy(Buffer, (const void*)Rsp, Size);
+				return Size;
+			}
+			__except (EXCEPTION_EXECUTE_HANDLER)
+			{
+				return 0;
+			}
+		}
+
+		// Unwinds the copy of the stack after the thread is resumed: RtlLookupFunctionEntry and RtlVirtualUnwind
+		// take the loader lock and the lock of the dynamic function tables, the suspended thread could hold them.
+		// The registers that point into the copied part (RSP, the frame pointer) are moved into the copy.
+		static std::uint32_t ProfilerWalkStack(CONTEXT* Context, std::uint8_t* Stack, std::size_t Size,
+			std::uintptr_t* Frames) noexcept(true)
+		{
+			std::uint32_t Depth = 0;
+			auto Original = (DWORD64)Context->Rsp;
+			auto Copy = (DWORD64)Stack;
+
+			auto Relocate = [Original, Copy, Size](DWORD64& Register)
+				{
+					if ((Register >= Original) && (Register < (Original + Size)))
+						Register = Copy + (Register - Original);
+				};
+
+			for (auto Register : { &Context->Rax, &Context->Rcx, &Context->Rdx, &Context->Rbx, &Context->Rsp,
+				&Context->Rbp, &Context->Rsi, &Context->Rdi, &Context->R8, &Context->R9, &Context->R10, &Context->R11,
+				&Context->R12, &Context->R13, &Context->R14, &Context->R15 })
+				Relocate(*Register);
+
+			__try
+			{
+				while ((Depth < Profiler::MAX_DEPTH) && Context->Rip)
+				{
+					// A return address points after the call, step back into it
+					Frames[Depth] = Depth ? (std::uintptr_t)(Context->Rip - 1) : (std::uintptr_t)Context->Rip;
+					Depth++;
+
+					// The rest of the stack wasn't copied
+					auto Rsp = Context->Rsp;
+					if ((Rsp < Copy) || ((Rsp + 8) > (Copy + Size)))
+						break;
+
+					DWORD64 ImageBase = 0;
+					auto Function = RtlLookupFunctionEntry(Context->Rip, &ImageBase, nullptr);
+					if (!Function)
+					{
+						// Only a leaf function may have no unwind info
+						if (Depth > 1)
+							break;
+
+						Context->Rip = *(DWORD64*)Context->Rsp;
+						Context->Rsp += 8;
+					}
+					else
+					{
+						PVOID HandlerData = nullptr;
+						DWORD64 EstablisherFrame = 0;
+						RtlVirtualUnwind(UNW_FLAG_NHANDLER, ImageBase, Context->Rip, Function, Context, &HandlerData,
+							&EstablisherFrame, nullptr);
+
+						// A machine frame or a frame pointer restores the address of the live stack
+						Relocate(Context->Rsp);
+						Relocate(Context->Rbp);
+					}
+
+					// The stack only goes up when unwinding
+					if (Context->Rsp <= Rsp)
+						break;
+				}
+			}
+			__except (EXCEPTION_EXECUTE_HANDLER)
+			{}
+
+			return Depth;
+		}
+
+		static void ProfilerCapture(ProfilerData* data, HANDLE Thread, DWORD ThreadId,
+			std::uintptr_t StackBase) noexcept(true)
+		{
+			auto Head = data->Head.load(std::memory_order_relaxed);
+			if ((Head - data->Tail.load(std::memory_order_acquire)) >= PROFILER_RING_SIZE)
+			{
+				data->Dropped++;
+				return;
+			}
+
+			if (SuspendThread(Thread) == (DWORD)-1)
+				return;
+
+			CONTEXT Context;
+			Context.ContextFlags = CONTEXT_CONTROL | CONTEXT_INTEGER;
+
+			std::size_t Copied = 0;
+			// Also waits until the thread is really suspended
+			bool HasContext = GetThreadContext(Thread, &Context);
+			if (HasContext && StackBase && (Context.Rsp < StackBase))
+				Copied = ProfilerCopyStack(data->StackCopy.data(), (std::uintptr_t)Context.Rsp,
+					std::min<std::size_t>(StackBase - Context.Rsp, PROFILER_STACK_COPY));
+
+			ResumeThread(Thread);
+
+			if (!HasContext)
+				return;
+
+			auto& Slot = data->Ring[Head & (PROFILER_RING_SIZE - 1)];
+			Slot.ThreadId = ThreadId;
+			Slot.Depth = ProfilerWalkStack(&Context, data->StackCopy.data(), Copied, Slot.Frames);
+
+			if (Slot.Depth)
+				data->Head.store(Head + 1, std::memory_order_release);
+		}
+
+		std::uint32_t Profiler::SamplerThread(void* param) noexcept(true)
+		{
+			auto data = (ProfilerData*)param;
+
+			struct ThreadEntry { DWORD Id; HANDLE Handle; std::uintptr_t StackBase; };
+			std::vector<ThreadEntry> Threads;
+
+			auto NtQueryInformationThreadProc = (TNtQueryInformationThread)
+				GetProcAddress(GetModuleHandleA("ntdll.dll"), "NtQueryInformationThread");
+
+			auto lamda_refresh_threads = [data, &Threads, NtQueryInformationThreadProc]()
+				{
+					for (auto& Entry : Threads)
+						CloseHandle(Entry.Handle);
+					Threads.clear();
+
+					auto Snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+					if (Snapshot == INVALID_HANDLE_VALUE)
+						return;
+
+					auto ProcessId = GetCurrentProcessId();
+					THREADENTRY32 Entry;
+					Entry.dwSize = sizeof(THREADENTRY32);
+
+					if (Thread32First(Snapshot, &Entry))
+					{
+						do
+						{
+							if ((Entry.th32OwnerProcessID != ProcessId) || (Entry.th32ThreadID == data->SamplerId) ||
+								(Entry.th32ThreadID == data->WriterId))
+								continue;
+
+							auto Handle = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT |
+								THREAD_QUERY_INFORMATION, FALSE, Entry.th32ThreadID);
+							if (Handle)
+								Threads.push_back({ Entry.th32ThreadID, Handle, ProfilerGetStackBase(NtQueryInformationThreadProc, Handle) });
+						} while (Thread32Next(Snapshot, &Entry));
+					}
+
+					CloseHandle(Snapshot);
+				};
+
+			// Without the high resolution flag the timer has the system tick (15.6 ms)
+			auto Timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+			if (!Timer)
+				Timer = CreateWaitableTimerW(nullptr, FALSE, nullptr);
+
+			LARGE_INTEGER DueTime;
+			DueTime.QuadPart = -(10000000ll / data->Rate);
+
+			auto LastRefresh = GetTickCount64() - PROFILER_THREADS_REFRESH_MS;
+			while (!data->Terminated)
+			{
+				auto Now = GetTickCount64();
+				if ((Now - LastRefresh) >= PROFILER_THREADS_REFRESH_MS)
+				{
+					LastRefresh = Now;
+					lamda_refresh_threads();
+				}
+
+				for (auto& Entry : Threads)
+					ProfilerCapture(data, Entry.Handle, Entry.Id, Entry.StackBase);
+
+				if (Timer && SetWaitableTimer(Timer, &DueTime, 0, nullptr, nullptr, FALSE))
+					WaitForSingleObject(Timer, INFINITE);
+				else
+					Sleep(1);
+			}
+
+			if (Timer)
+				CloseHandle(Timer);
+
+			for (auto& Entry : Threads)
+				CloseHandle(Entry.Handle);
+
+			return 0;
+		}
+
+		std::uint32_t Profiler::WriterThread(void* param) noexcept(true)
+		{
+			auto data = (ProfilerData*)param;
+
+			auto lamda_drain = [data]()
+				{
+					auto Head = data->Head.load(std::memory_order_acquire);
+					auto Tail = data->Tail.load(std::memory_order_relaxed);
+
+					for (; Tail != Head; Tail++)
+					{
+						auto& Slot = data->Ring[Tail & (PROFILER_RING_SIZE - 1)];
+						data->Aggregator.Add(Slot.ThreadId, Slot.Frames, Slot.Depth);
+					}
+
+					data->Tail.store(Tail, std::memory_order_release);
+				};
+
+			auto lamda_flush = [data]()
+				{
+					auto TempName = data->FileName + L".tmp";
+
+					{
+						ModuleSymbolizer Symbolizer;
+						TextFileStream Stream(TempName, FileStream::fmCreate);
+						data->Aggregator.WriteFolded(Stream, Symbolizer);
+					}
+
+					MoveFileExW(TempName.c_str(), data->FileName.c_str(), MOVEFILE_REPLACE_EXISTING);
+				};
+
+			auto LastFlush = GetTickCount64();
+			while (!data->Terminated)
+			{
+				WaitForSingleObject(data->Wake, 50);
+				lamda_drain();
+
+				auto Now = GetTickCount64();
+				if ((Now - LastFlush) >= (data->FlushSeconds * 1000ull))
+				{
+					LastFlush = Now;
+					lamda_flush();
+				}
+			}
+
+			lamda_drain();
+			lamda_flush();
+
+			return 0;
+		}
+
+		Profiler::~Profiler() noexcept(true)
+		{
+			Stop();
+		}
+
+		Profiler* Profiler::GetSingleton() noexcept(true)
+		{
+			return &sprofiler;
+		}
+
+		bool Profiler::Start(const std::wstring& fname, std::uint32_t Rate, std::uint32_t FlushSeconds) noexcept(true)
+		{
+			ScopeCriticalSection guard(_section);
+
+			if (_data)
+				return true;
+
+			ProfilerData* data = nullptr;
+
+			try
+			{
+				data = new ProfilerData;
+				data->FileName = fname;
+				data->Rate = std::clamp(Rate, PROFILER_RATE_MIN, PROFILER_RATE_MAX);
+				data->FlushSeconds = std::max(FlushSeconds, 1u);
+				data->Ring.resize(PROFILER_RING_SIZE);
+				data->StackCopy.resize(PROFILER_STACK_COPY + PROFILER_STACK_SLACK);
+				data->Wake = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+				if (!data->Wake)
+					throw std::runtime_error("Profiler: can't create event");
+
+				data->Writer = CreateThread(nullptr, 0, [](LPVOID param) -> DWORD
+					{
+						return (DWORD)Profiler::WriterThread(param);
+					}, data, CREATE_SUSPENDED, &data->WriterId);
+				data->Sampler = CreateThread(nullptr, 0, [](LPVOID param) -> DWORD
+					{
+						return (DWORD)Profiler::SamplerThread(param);
+					}, data, CREATE_SUSPENDED, &data->SamplerId);
+
+				if (!data->Writer || !data->Sampler)
+					throw std::runtime_error("Profiler: can't create threads");
+			}
+			catch (const std::exception& e)
+			{
+				_ERROR(e.what());
+
+				if (data)
+				{
+					// Created suspended, never run
+					for (auto Thread : { data->Writer, data->Sampler })
+					{
+						if (Thread)
+						{
+							TerminateThread(Thread, 0);
+							CloseHandle(Thread);
+						}
+					}
+
+					delete data;
+				}
+
+				return false;
+			}
+
+			Threads::SetThreadDesc(data->Sampler, "CKPE Profiler Sampler");
+			Threads::SetThreadDesc(data->Writer, "CKPE Profiler Writer");
+			SetThreadPriority(data->Sampler, THREAD_PRIORITY_HIGHEST);
+
+			_data = data;
+
+			ResumeThread(data->Writer);
+			ResumeThread(data->Sampler);
+
+			_MESSAGE(L"Profiler: sampling at %u Hz to \"%s\"", data->Rate, fname.c_str());
+
+			return true;
+		}
+
+		void Profiler::Stop() noexcept(true)
+		{
+			ScopeCriticalSection guard(_section);
+
+			auto data = (ProfilerData*)_data;
+			if (!data)
+				return;
+
+			data->Terminated = true;
+			SetEvent(data->Wake);
+
+			// When DLL unloads, the threads can't terminate under the loader lock, don't wait forever
+			bool terminated = WaitForSingleObject(data->Sampler, 1000) == WAIT_OBJECT_0;
+			terminated = (WaitForSingleObject(data->Writer, 5000) == WAIT_OBJECT_0) && terminated;
+			CloseHandle(data->Sampler);
+			CloseHandle(data->Writer);
+
+			_data = nullptr;
+
+			// If the threads are still alive, they own the data, leave it
+			if (terminated)
+				delete data;
+		}
+	}
+}
@@ -6,11 +6,16 @@
 #include <CKPE.Application.h>
 #include <CKPE.HashUtils.h>
 #include <CKPE.Stream.h>
+#include <CKPE.PathUtils.h>
+#include <CKPE.FileUtils.h>
 #include <CKPE.Common.Interface.h>
 #include <CKPE.Common.RTTI.h>
+#include <CKPE.Common.TaskScheduler.h>
 #include <CKPE.ErrorHandler.h>
 #include <CKPE.Common.MemoryManager.h>
+#include <CKPE.CriticalSection.h>
 #include <unordered_map>
+#include <algorithm>
 #include <format>
 
 extern "C"
@@ -27,7 +32,96 @@ namespace CKPE
 	{
 		static RTTI srtti;
 
-		std::unordered_map<std::uint32_t, RTTI::Info> srtti_data;
+		// Key is the hash of the mangled name, so most lookups never demangle
+		std::unordered_map<std::uint64_t, RTTI::Info> srtti_data;
+		// Demangled names, built only when the name can't be mangled back (templates, etc.)
+		static std::unordered_map<std::uint64_t, const RTTI::Info*> srtti_demangled;
+		static CriticalSection srtti_section;
+		// Sorted by vtable address
+		static std::vector<std::pair<std::uintptr_t, const RTTI::Info*>> srtti_address;
+
+		// Results of __RTDynamicCast for the concrete vtable, each thread has its own table
+		struct RTTICastCacheEntry
+		{
+			std::uintptr_t VTable;
+			const void* FromType;
+			const void* TargetType;
+			long VfDelta;
+			bool Success;
+			std::ptrdiff_t Delta;
+		};
+
+		constexpr static std::size_t RTTI_CAST_CACHE_SIZE = 512;
+		static thread_local RTTICastCacheEntry srtti_cast_cache[RTTI_CAST_CACHE_SIZE];
+
+		// Catalogue cache, valid only for the same file of the editor.
+		// The identity of the file is used, the relocations of ASLR change the sections in memory.
+		constexpr static std::uint32_t RTTI_CACHE_MAGIC = 'CTTR';
+		constexpr static std::uint32_t RTTI_CACHE_VERSION = 2;
+		constexpr static wchar_t RTTI_CACHE_FNAME[] = L"CreationKitPlatformExtended_RTTI.cache";
+
+#pragma pack(push, 1)
+		struct RTTICacheHeader
+		{
+			std::uint32_t Magic;
+			std::uint32_t Version;
+			std::uint64_t ImageHash;		// Module::GetImageHash
+			std::uint64_t FileSize;
+			std::uint32_t RDataSize;
+			std::uint32_t TextSize;
+			std::uint32_t Count;
+			std::uint32_t Reserved;
+			std::uint64_t Checksum;			// FastHash64 of the entries
+		};
+
+		// Names and class hierarchy are read from the image by the locator
+		struct RTTICacheEntry
+		{
+			std::uint64_t NameHash;			// FastHash64 of the mangled name
+			std::uint32_t VTableRVA;
+			std::uint32_t LocatorRVA;
+			std::uint32_t VFunctionCount;
+			std::uint32_t Reserved;
+		};
+#pragma pack(pop)
+
+		constexpr static std::size_t RTTI_SCAN_MIN_RANGE = 1024 * 1024;
+
+		// "class A::B" -> ".?AVB@A@@", false if the name needs back-references or isn't a simple name
+		static bool RTTIMangleName(const std::string_view& name, std::string& result) noexcept(true)
+		{
+			std::string_view type;
+			if (name.starts_with("class ")) { result = ".?AV"; type = name.substr(6); }
+			else if (name.starts_with("struct ")) { result = ".?AU"; type = name.substr(7); }
+			else return false;
+
+			std::vector<std::string_view> parts;
+			for (std::size_t pos = 0;;)
+			{
+				auto it = type.find("::", pos);
+				parts.emplace_back(type.substr(pos, it - pos));
+				if (it == std::string_view::npos) break;
+				pos = it + 2;
+			}
+
+			for (auto i = parts.size(); i > 0; i--)
+			{
+				auto& part = parts[i - 1];
+				if (part.empty()) return false;
+				for (auto ch : part)
+					if (!isalnum((unsigned char)ch) && (ch != '_'))
+						return false;
+				// The repeated names are written as back-references
+				for (std::size_t j = i; j < parts.size(); j++)
+					if (parts[j] == part)
+						return false;
+
+				result.append(part).push_back('@');
+			}
+
+			result.push_back('@');
+			return true;
+		}
 
 		bool RTTI::IsWithinDATA(std::uintptr_t addr) const noexcept(true)
 		{
@@ -58,30 +152,11 @@ namespace CKPE
 			return r;
 		}
 
-		[[nodiscard]] RTTI* RTTI::GetSingleton() noexcept(true)
+		void RTTI::ScanRange(std::uintptr_t start, std::uintptr_t end, std::vector<Info>& result) const noexcept(true)
 		{
-			return &srtti;
-		}
-
-		void RTTI::Initialize() noexcept(true)
-		{
-			auto _sapp = Interface::GetSingleton()->GetApplication();
-			
-			base     = _sapp->GetBase();
-			segrdata = _sapp->GetSegment(Segment::rdata);
-			segdata  = _sapp->GetSegment(Segment::data);
-			segtext  = _sapp->GetSegment(Segment::text);
-
-			srtti_data.clear();
-
-			for (uintptr_t i = segrdata.GetAddress(); 
-				i < (segrdata.GetEndAddress() - (sizeof(uintptr_t) << 1)); 
-				i++)
+			// Skip all non-2-aligned addresses. Not sure if this is OK or it skips tables.
+			for (uintptr_t i = (start + 1) & ~(uintptr_t)1; i < end; i += 2)
 			{
-				// Skip all non-2-aligned addresses. Not sure if this is OK or it skips tables.
-				if (i % 2 != 0)
-					continue;
-
 				// This might be a valid RTTI entry, so check if:
 				// - The COL points to somewhere in .rdata
 				// - The COL has a valid signature
@@ -96,26 +171,304 @@ namespace CKPE
 				auto locator = reinterpret_cast<CompleteObjectLocator*>(addr);
 				if (!IsValidCOL(locator))
 					continue;
-				
+
 				// skip childs
 				if (locator->Offset != 0)
 					continue;
 
-				auto rawName = locator->TypeDescriptor.Get(base)->name;
-
 				Info info{
 					.VTableAddress = i + sizeof(uintptr_t),
 					.VTableOffset = locator->Offset,
 					.VFunctionCount = 0,
-					.RawName = rawName,
+					.DemangledName = nullptr,
+					.RawName = locator->TypeDescriptor.Get(base)->name,
 					.Locator = locator,
 				};
 
-				info.Name = __unDNameEx(nullptr, rawName + 1, 0, malloc, free, nullptr, 0x2800);
 				info.VFunctionCount = GetCountVFunc(info.VTableAddress);
+				result.push_back(info);
+			}
+		}
+
+		[[nodiscard]] RTTI* RTTI::GetSingleton() noexcept(true)
+		{
+			return &srtti;
+		}
+
+		const char* RTTI::Demangle(const Info* info) const noexcept(true)
+		{
+			ScopeCriticalSection guard(srtti_section);
+
+			auto Name = info->DemangledName.Name.load(std::memory_order_acquire);
+			if (!Name)
+			{
+				Name = __unDNameEx(nullptr, info->RawName + 1, 0, malloc, free, nullptr, 0x2800);
+				info->DemangledName.Name.store(Name, std::memory_order_release);
+			}
+			return Name;
+		}
+
+		const char* RTTI::GetNameNoAlloc(const Info* info, char* Buffer, std::size_t Size) noexcept(true)
+		{
+			if (!info)
+				return nullptr;
+
+			auto Name = info->DemangledName.Name.load(std::memory_order_acquire);
+			if (Name)
+				return Name;
+
+			// ".?AVName@Namespace@@" is "class Namespace::Name", templates and back references are left as they are
+			auto Raw = info->RawName;
+			const char* Kind = nullptr;
+			if (!strncmp(Raw, ".?AV", 4))
+				Kind = "class ";
+			else if (!strncmp(Raw, ".?AU", 4))
+				Kind = "struct ";
+
+			auto End = Raw ? strstr(Raw, "@@") : nullptr;
+			if (!Kind || !End || !Buffer || (End == Raw + 4))
+				return Raw;
+
+			const char* Parts[16];
+			std::size_t Lengths[16];
+			std::size_t Count = 0;
+			for (auto Part = Raw + 4; Part < End;)
+			{
+				auto Next = (const char*)memchr(Part, '@', End - Part);
+				if (!Next) Next = End;
+				if ((Count == std::size(Parts)) || (Next == Part) || (*Part == '?') || ((*Part >= '0') && (*Part <= '9')))
+					return Raw;
+
+				Parts[Count] = Part;
+				Lengths[Count++] = Next - Part;
+				Part = Next + 1;
+			}
+
+			std::size_t Length = strlen(Kind);
+			for (std::size_t i = 0; i < Count; i++)
+				Length += Lengths[i] + (i ? 2 : 0);
+			if (Length >= Size)
+				return Raw;
+
+			// The innermost goes first in the mangled name
+			auto Out = Buffer;
+			Out += sprintf_s(Out, Size, "%s", Kind);
+			for (std::size_t i = Count; i-- > 0;)
+			{
+				memcpy(Out, Parts[i], Lengths[i]);
+				Out += Lengths[i];
+				if (i)
+				{
+					*Out++ = ':';
+					*Out++ = ':';
+				}
+			}
+			*Out = 0;
+
+			return Buffer;
+		}
+
+		bool RTTI::Scan() noexcept(true)
+		{
+			// The segment is split into ranges for the workers, each range collects its own entries
+			auto start = segrdata.GetAddress();
+			auto end = segrdata.GetEndAddress() - (sizeof(uintptr_t) << 1);
+			std::size_t size = end > start ? end - start : 0;
+
+			std::size_t count = std::max<std::size_t>(1, size / RTTI_SCAN_MIN_RANGE);
+			std::size_t step = (((size + count - 1) / count) + 1) & ~(std::size_t)1;
+
+			std::vector<std::vector<Info>> results(count);
+
+			auto Success = TaskScheduler::GetSingleton()->ParallelFor(0, count, 1, [&](std::size_t begin, std::size_t end_range)
+				{
+					for (auto n = begin; n < end_range; n++)
+					{
+						auto range_start = start + step * n;
+						ScanRange(range_start, std::min(range_start + step, end), results[n]);
+					}
+				}, "RTTIScan");
+
+			std::size_t total = 0;
+			for (auto& result : results)
+				total += result.size();
+			srtti_data.reserve(total);
+
+			for (auto& result : results)
+				for (auto& info : result)
+					srtti_data.insert({ HashUtils::FastHash64(info.RawName, strlen(info.RawName)), info });
+
+			return Success;
+		}
+
+		bool RTTI::LoadCache(const std::wstring& fname, std::uint64_t image_hash, std::uint64_t file_size) noexcept(true)
+		{
+			auto file = CreateFileW(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER size{};
+			HANDLE map = nullptr;
+			if (GetFileSizeEx(file, &size) && (size.QuadPart >= (LONGLONG)sizeof(RTTICacheHeader)))
+				map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			CloseHandle(file);
+
+			if (!map)
+				return false;
+
+			auto view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(map);
+
+			if (!view)
+				return false;
+
+			auto header = (const RTTICacheHeader*)view;
+			auto entries = (const RTTICacheEntry*)(header + 1);
+
+			bool result = (header->Magic == RTTI_CACHE_MAGIC) && (header->Version == RTTI_CACHE_VERSION) &&
+				(header->ImageHash == image_hash) && (header->FileSize == file_size) &&
+				(header->RDataSize == segrdata.GetSize()) && (header->TextSize == segtext.GetSize()) &&
+				((std::uint64_t)size.QuadPart == (sizeof(RTTICacheHeader) + (std::uint64_t)header->Count * sizeof(RTTICacheEntry))) &&
+				(header->Checksum == HashUtils::FastHash64(entries, (std::size_t)header->Count * sizeof(RTTICacheEntry)));
+
+			if (result)
+			{
+				srtti_data.reserve(header->Count);
+
+				for (std::uint32_t i = 0; i < header->Count; i++)
+				{
+					auto& entry = entries[i];
+					auto vtable = base + entry.VTableRVA;
+					auto locator = reinterpret_cast<CompleteObjectLocator*>(base + entry.LocatorRVA);
+
+					// The same checks as the scanner does
+					if (!IsWithinDATA((std::uintptr_t)locator) || (vtable < segrdata.GetAddress() + sizeof(std::uintptr_t)) ||
+						(vtable >= segrdata.GetEndAddress()) || !IsValidCOL(locator) ||
+						(*(std::uintptr_t*)(vtable - sizeof(std::uintptr_t)) != (std::uintptr_t)locator))
+					{
+						result = false;
+						break;
+					}
+
+					Info info{
+						.VTableAddress = vtable,
+						.VTableOffset = locator->Offset,
+						.VFunctionCount = entry.VFunctionCount,
+						.DemangledName = nullptr,
+						.RawName = locator->TypeDescriptor.Get(base)->name,
+						.Locator = locator,
+					};
 
-				srtti_data.insert({ HashUtils::MurmurHash32(info.Name), info});
+					srtti_data.insert({ entry.NameHash, info });
+				}
 			}
+
+			UnmapViewOfFile(view);
+			return result;
+		}
+
+		void RTTI::SaveCache(const std::wstring& fname, std::uint64_t image_hash, std::uint64_t file_size) const noexcept(true)
+		{
+			try
+			{
+				std::vector<RTTICacheEntry> entries;
+				entries.reserve(srtti_data.size());
+
+				for (const auto& i : srtti_data)
+					entries.push_back({
+						.NameHash = i.first,
+						.VTableRVA = (std::uint32_t)(i.second.VTableAddress - base),
+						.LocatorRVA = (std::uint32_t)((std::uintptr_t)i.second.Locator - base),
+						.VFunctionCount = (std::uint32_t)i.second.VFunctionCount,
+						.Reserved = 0,
+					});
+
+				RTTICacheHeader header{
+					.Magic = RTTI_CACHE_MAGIC,
+					.Version = RTTI_CACHE_VERSION,
+					.ImageHash = image_hash,
+					.FileSize = file_size,
+					.RDataSize = segrdata.GetSize(),
+					.TextSize = segtext.GetSize(),
+					.Count = (std::uint32_t)entries.size(),
+					.Reserved = 0,
+					.Checksum = HashUtils::FastHash64(entries.data(), entries.size() * sizeof(RTTICacheEntry)),
+				};
+
+				// Written aside, another editor may be reading the old one
+				auto tmp_fname = fname + L".tmp";
+				auto f = _wfsopen(tmp_fname.c_str(), L"wb", _SH_DENYWR);
+				if (!f)
+					return;
+
+				bool ok = (fwrite(&header, sizeof(header), 1, f) == 1) &&
+					(entries.empty() || (fwrite(entries.data(), sizeof(RTTICacheEntry), entries.size(), f) == entries.size()));
+				fclose(f);
+
+				if (!ok || !MoveFileExW(tmp_fname.c_str(), fname.c_str(), MOVEFILE_REPLACE_EXISTING))
+					DeleteFileW(tmp_fname.c_str());
+			}
+			catch (const std::exception&)
+			{}
+		}
+
+		void RTTI::Initialize() noexcept(true)
+		{
+			auto _sapp = Interface::GetSingleton()->GetApplication();
+			
+			base     = _sapp->GetBase();
+			segrdata = _sapp->GetSegment(Segment::rdata);
+			segdata  = _sapp->GetSegment(Segment::data);
+			segtext  = _sapp->GetSegment(Segment::text);
+
+			srtti_data.clear();
+			srtti_demangled.clear();
+			srtti_address.clear();
+
+			// Next to the logs, the folder of the editor may be read-only
+			auto cache_fname = PathUtils::GetCKPELogsPath() + RTTI_CACHE_FNAME;
+			auto image_hash = Module::GetImageHash((const void*)base);
+			auto file_size = FileUtils::GetFileSize(PathUtils::GetApplicationFileName());
+
+			// A stale or damaged cache is just built again
+			if (!file_size || !LoadCache(cache_fname, image_hash, file_size))
+			{
+				srtti_data.clear();
+				// An incomplete catalogue isn't saved, the next start scans again
+				if (!Scan())
+					_ERROR("RTTI: the scan of the image failed, some classes may be missing");
+				else if (file_size)
+				{
+					PathUtils::CreateFolder(PathUtils::GetCKPELogsPath());
+					SaveCache(cache_fname, image_hash, file_size);
+				}
+			}
+
+			BuildAddressIndex();
+		}
+
+		void RTTI::Initialize(std::uintptr_t Base, const Segment& Text, const Segment& Data, const Segment& RData) noexcept(true)
+		{
+			base     = Base;
+			segrdata = RData;
+			segdata  = Data;
+			segtext  = Text;
+
+			srtti_data.clear();
+			srtti_demangled.clear();
+			srtti_address.clear();
+
+			Scan();
+			BuildAddressIndex();
+		}
+
+		void RTTI::BuildAddressIndex() noexcept(true)
+		{
+			srtti_address.reserve(srtti_data.size());
+			for (const auto& i : srtti_data)
+				srtti_address.emplace_back(i.second.VTableAddress, &i.second);
+			std::sort(srtti_address.begin(), srtti_address.end());
 		}
 
 		void RTTI::Dump(const std::wstring& fname) const noexcept(true)
@@ -125,7 +478,7 @@ namespace CKPE
 			for (const auto& i : srtti_data)
 			{
 				auto& info = i.second;
-				stream.WriteLine("`%s`: VTable [0x%p, 0x%p offset, %lld functions] `%s`", info.Name,
+				stream.WriteLine("`%s`: VTable [0x%p, 0x%p offset, %lld functions] `%s`", info.GetName(),
 					info.VTableAddress - base, info.VTableOffset, info.VFunctionCount, info.RawName);
 				
 				// perchik71: output info about parent class
@@ -141,32 +494,122 @@ namespace CKPE
 							(parent_classes->BaseClassArray.Get(base)->ArrayOfBaseClassDescriptors[i]).Get(base);
 	
 						auto rawName = desc->TypeDescriptor.Get(base)->name;
-						auto Name = __unDNameEx(nullptr, rawName + 1, 0, malloc, free, nullptr, 0x2800);
+						auto it = srtti_data.find(HashUtils::FastHash64(rawName, strlen(rawName)));
+						if (it != srtti_data.end())
+							stream.WriteLine("\t\t#%u: flags(%x) `%s`:`%s`", desc->NumContainedBases, desc->Attributes,
+								it->second.GetName(), rawName);
+						else
+						{
+							// The base class has no vtable of its own
+							auto Name = __unDNameEx(nullptr, rawName + 1, 0, malloc, free, nullptr, 0x2800);
+							stream.WriteLine("\t\t#%u: flags(%x) `%s`:`%s`", desc->NumContainedBases, desc->Attributes,
+								Name, rawName);
+							free((void*)Name);
+						}
+					}
+				}
+			}
+		}
 
-						stream.WriteLine("\t\t#%u: flags(%x) `%s`:`%s`", desc->NumContainedBases, desc->Attributes, 
-							Name, rawName);
+		static std::string RTTIJsonEscape(const char* str)
+		{
+			std::string result;
+			for (; str && *str; str++)
+			{
+				if ((*str == '"') || (*str == '\\'))
+					result.push_back('\\');
+				result.push_back(*str);
+			}
+			return result;
+		}
+
+		void RTTI::DumpJson(const std::wstring& fname) const noexcept(true)
+		{
+			TextFileStream stream(fname, FileStream::fmCreate);
+
+			stream.WriteLine("{\"base\": \"0x%llX\", \"classes\": [", (std::uint64_t)base);
+
+			// Sorted by vtable, so dumps of the same editor can be compared
+			for (std::size_t n = 0; n < srtti_address.size(); n++)
+			{
+				auto& info = *srtti_address[n].second;
+				stream.WriteString("\t{\"name\": \"%s\", \"raw\": \"%s\", \"vtable\": \"0x%llX\", "
+					"\"offset\": %llu, \"functions\": %llu, \"bases\": [",
+					RTTIJsonEscape(info.GetName()).c_str(), RTTIJsonEscape(info.RawName).c_str(),
+					(std::uint64_t)(info.VTableAddress - base), (std::uint64_t)info.VTableOffset, info.VFunctionCount);
+
+				auto parent_classes = info.Locator->ClassDescriptor.Get(base);
+				if (parent_classes && (parent_classes->Attributes != ClassHierarchyDescriptor::HCD_NoInheritance))
+				{
+					// 0 - same object
+					for (std::uint32_t i = 1; i < parent_classes->NumBaseClasses; i++)
+					{
+						auto desc =
+							RVA<BaseClassDescriptor*>
+							(parent_classes->BaseClassArray.Get(base)->ArrayOfBaseClassDescriptors[i]).Get(base);
+
+						auto rawName = desc->TypeDescriptor.Get(base)->name;
+						auto it = srtti_data.find(HashUtils::FastHash64(rawName, strlen(rawName)));
+						auto Name = (it != srtti_data.end()) ? it->second.GetName() :
+							__unDNameEx(nullptr, rawName + 1, 0, malloc, free, nullptr, 0x2800);
+
+						stream.WriteString("%s{\"name\": \"%s\", \"raw\": \"%s\", \"flags\": %u, \"contained\": %u}",
+							(i > 1) ? ", " : "", RTTIJsonEscape(Name).c_str(), RTTIJsonEscape(rawName).c_str(),
+							desc->Attributes, desc->NumContainedBases);
+
+						if (it == srtti_data.end())
+							free((void*)Name);
 					}
 				}
+
+				stream.WriteLine("]}%s", ((n + 1) < srtti_address.size()) ? "," : "");
 			}
+
+			stream.WriteLine("]}");
 		}
 
 		const RTTI::Info* RTTI::Find(const std::string_view& name, bool error_if_no_found) const noexcept(true)
 		{
-			auto it = srtti_data.find(HashUtils::MurmurHash32(name.data(), name.length()));
-			if (it == srtti_data.end())
+			std::string mangled;
+			if (name.starts_with(".?A") || RTTIMangleName(name, mangled))
 			{
-				if (error_if_no_found)
-					ErrorHandler::Trigger(std::format("RTTI::Find \"{}\" had no results", name));
-				return nullptr;
+				std::string_view raw = mangled.empty() ? name : std::string_view(mangled);
+				auto it = srtti_data.find(HashUtils::FastHash64(raw.data(), raw.length()));
+				if ((it != srtti_data.end()) && (raw == it->second.RawName))
+					return &(it->second);
+			}
+			else
+			{
+				// Rare case, all names are demangled once
+				ScopeCriticalSection guard(srtti_section);
+
+				if (srtti_demangled.empty())
+				{
+					srtti_demangled.reserve(srtti_data.size());
+					for (const auto& i : srtti_data)
+					{
+						auto demangled = i.second.GetName();
+						if (demangled)
+							srtti_demangled.insert({ HashUtils::FastHash64(demangled, strlen(demangled)), &i.second });
+					}
+				}
+
+				auto it = srtti_demangled.find(HashUtils::FastHash64(name.data(), name.length()));
+				if (it != srtti_demangled.end())
+					return it->second;
 			}
-			return &(it->second);
+
+			if (error_if_no_found)
+				ErrorHandler::Trigger(std::format("RTTI::Find \"{}\" had no results", name));
+			return nullptr;
 		}
 
 		const RTTI::Info* RTTI::Find(const std::uintptr_t address, bool error_if_no_found) const noexcept(true)
 		{
-			for (const auto& info : srtti_data)
-				if (info.second.VTableAddress == address)
-					return &info.second;
+			auto it = std::lower_bound(srtti_address.begin(), srtti_address.end(), address,
+				[](const auto& entry, std::uintptr_t address) { return entry.first < address; });
+			if ((it != srtti_address.end()) && (it->first == address))
+				return it->second;
 
 			if (error_if_no_found)
 				ErrorHandler::Trigger(std::format("RTTI::Find \"{:x}\" had no results", address));
@@ -176,14 +619,41 @@ namespace CKPE
 		void* RTTI::Cast(const void* InPtr, long VfDelta, const char* lpstrFromType, const char* lpstrTargetType,
 			bool isReference)
 		{
-			auto FromInfo = Find(lpstrFromType);
-			auto TargetInfo = Find(lpstrTargetType);
+			return Cast(InPtr, VfDelta, Find(lpstrFromType), Find(lpstrTargetType), isReference);
+		}
+
+		void* RTTI::Cast(const void* InPtr, long VfDelta, const Info* FromInfo, const Info* TargetInfo,
+			bool isReference)
+		{
 			if (!FromInfo || !TargetInfo)
 				return nullptr;
-			return __RTDynamicCast((PVOID)InPtr, VfDelta,
-				(PVOID)FromInfo->Locator->TypeDescriptor.Get(base),
-				(PVOID)TargetInfo->Locator->TypeDescriptor.Get(base),
-				isReference);
+
+			auto FromType = (PVOID)FromInfo->Locator->TypeDescriptor.Get(base);
+			auto TargetType = (PVOID)TargetInfo->Locator->TypeDescriptor.Get(base);
+
+			if (!InPtr)
+				return __RTDynamicCast((PVOID)InPtr, VfDelta, FromType, TargetType, isReference);
+
+			// The result depends only on the concrete class, which is known by its vtable.
+			// __RTDynamicCast takes the vfptr at InPtr, VfDelta is subtracted only after.
+			auto VTable = *(const std::uintptr_t*)InPtr;
+			auto& entry = srtti_cast_cache[((VTable >> 3) ^ ((std::uintptr_t)TargetType >> 4)) & (RTTI_CAST_CACHE_SIZE - 1)];
+
+			if ((entry.VTable == VTable) && (entry.TargetType == TargetType) && (entry.FromType == FromType) &&
+				(entry.VfDelta == VfDelta) && (entry.Success || !isReference))
+				return entry.Success ? (void*)((std::uintptr_t)InPtr + entry.Delta) : nullptr;
+
+			// A failed reference cast throws std::bad_cast, nothing is cached then
+			auto Result = __RTDynamicCast((PVOID)InPtr, VfDelta, FromType, TargetType, isReference);
+
+			entry.VTable = VTable;
+			entry.FromType = FromType;
+			entry.TargetType = TargetType;
+			entry.VfDelta = VfDelta;
+			entry.Success = Result != nullptr;
+			entry.Delta = Result ? (std::intptr_t)Result - (std::intptr_t)InPtr : 0;
+
+			return Result;
 		}
 	}
 }
\ No newline at end of file
@@ -47,15 +47,11 @@ namespace CKPE
 				if (!zip.HasOpen())
 					throw RuntimeError(L"Relocator::Open file \"{}\" can't opened", fname_pak);
 
-				auto db_name = StringUtils::Utf16ToWinCP(fname_db);
-
-				for (std::uint32_t i = 0; i < zip.GetEntries()->Count(); i++)
+				auto idx = zip.GetEntries()->Find(StringUtils::Utf16ToWinCP(fname_db));
+				if (idx != ZipFileEntry::InvalidIndex)
 				{
-					auto entry = zip.GetEntries()->At(i);
-					if (entry.Empty() || !entry->Get()) continue;
-
-					auto sname = entry->Get()->GetName();
-					if (!_stricmp(sname.c_str(), db_name.c_str()))
+					auto entry = zip.GetEntries()->At(idx);
+					if (!entry.Empty() && entry->Get())
 					{
 						MemoryStream mstm;
 						if (!entry->Get()->ReadToStream(mstm))
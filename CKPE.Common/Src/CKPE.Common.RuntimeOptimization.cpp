@@ -10,10 +10,10 @@
 #include <CKPE.Patterns.h>
 #include <CKPE.Common.Interface.h>
 #include <CKPE.Common.RuntimeOptimization.h>
+#include <CKPE.Common.TaskScheduler.h>
 #include <concurrent_unordered_map.h>
 #include <concurrent_vector.h>
 #include <algorithm>
-#include <execution>
 #include <chrono>
 
 #include <CKPE.StringUtils.h>
@@ -193,8 +193,8 @@ namespace CKPE
 			ZydisDecoder decoder;
 			if (ZYDIS_SUCCESS(ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_ADDRESS_WIDTH_64)))
 			{
-				std::for_each(std::execution::par_unseq, &functionEntries[0], &functionEntries[functionEntryCount],
-					[&branchTargets, &nullsubTargets, &decoder, &app, &ecTableStart, &ecTableEnd](const RUNTIME_FUNCTION& Function)
+				auto lamda_function = [&branchTargets, &nullsubTargets, &decoder, &app, &ecTableStart, &ecTableEnd]
+					(const RUNTIME_FUNCTION& Function)
 					{
 						const std::uintptr_t base = app->GetBase();
 
@@ -241,7 +241,14 @@ namespace CKPE
 									branchTargets.push_back(ip);
 							}
 						}
-					});
+					};
+
+				TaskScheduler::GetSingleton()->ParallelFor(0, functionEntryCount, 256, 
+					[&functionEntries, &lamda_function](std::size_t Begin, std::size_t End)
+					{
+						for (auto i = Begin; i < End; i++)
+							lamda_function(functionEntries[i]);
+					}, "RemoveTrampolinesAndNullsubs");
 			}
 			else
 				throw RuntimeError("RuntimeOptimization: ZydisDecoderInit returned failed");
@@ -0,0 +1,400 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <CKPE.CriticalSection.h>
+#include <CKPE.Common.SearchIndex.h>
+#include <unordered_map>
+#include <shared_mutex>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <array>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		constexpr static std::size_t SEARCH_PARALLEL_MIN = 16384;
+		constexpr static std::size_t SEARCH_GRAIN = 4096;
+		constexpr static std::size_t SEARCH_CANCEL_CHECK = 1024;
+		constexpr static std::size_t SEARCH_INTERSECT_MAX = 3;
+		constexpr static std::size_t SEARCH_CHUNK_SIZE = 1024 * 1024;
+
+		// The folded texts one after another, each ends with zero. The chunks never move and the texts
+		// aren't changed, so a query compares them without the lock. It keeps the store alive over Clear.
+		struct SearchIndexText
+		{
+			std::vector<std::unique_ptr<char[]>> Chunks;
+			std::size_t Used{ 0 };
+			std::size_t Capacity{ 0 };
+			std::size_t Memory{ 0 };
+
+			const char* Append(const std::string& Text)
+			{
+				auto Size = Text.length() + 1;
+				if ((Used + Size) > Capacity)
+				{
+					Capacity = std::max(SEARCH_CHUNK_SIZE, Size);
+					Chunks.emplace_back(new char[Capacity]);
+					Used = 0;
+					Memory += Capacity;
+				}
+
+				auto Result = Chunks.back().get() + Used;
+				memcpy(Result, Text.c_str(), Size);
+				Used += Size;
+				return Result;
+			}
+		};
+
+		struct SearchIndexItem
+		{
+			std::uintptr_t Id;
+			const char* Text;
+			std::uint32_t Length;
+			bool Alive;
+		};
+
+		// What a query compares, taken under the lock
+		struct SearchCandidate
+		{
+			std::uintptr_t Id;
+			const char* Text;
+			std::uint32_t Length;
+			std::uint32_t Index;
+		};
+
+		struct SearchIndexData
+		{
+			mutable std::shared_mutex Lock;
+			std::shared_ptr<SearchIndexText> Text{ std::make_shared<SearchIndexText>() };
+			std::vector<SearchIndexItem> Items;
+			std::unordered_map<std::uintptr_t, std::uint32_t> Ids;
+			// Sorted by construction, the items are only appended
+			std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> Trigrams;
+			std::uint32_t Version{ 0 };
+
+			// The last query, the next one that contains it is looked for among its matches
+			CriticalSection LastSection;
+			std::string LastPattern;
+			std::vector<std::uint32_t> LastItems;
+			std::uint32_t LastVersion{ 0xFFFFFFFFul };
+		};
+
+		// As StrStrIA, by the code page
+		static const std::array<char, 256>& GetFoldTable() noexcept(true)
+		{
+			static const std::array<char, 256> table = []()
+				{
+					std::array<char, 256> result;
+					for (std::uint32_t i = 0; i < 256; i++)
+						result[i] = (char)i;
+					CharLowerBuffA(result.data() + 1, 255);
+					return result;
+				}();
+
+			return table;
+		}
+
+		static void Fold(std::string_view Text, std::string& Result)
+		{
+			auto& table = GetFoldTable();
+
+			Result.resize(Text.length());
+			for (std::size_t i = 0; i < Text.length(); i++)
+				Result[i] = table[(std::uint8_t)Text[i]];
+		}
+
+		[[nodiscard]] static inline std::uint32_t Trigram(const char* Text) noexcept(true)
+		{
+			return ((std::uint32_t)(std::uint8_t)Text[0] << 16) | ((std::uint32_t)(std::uint8_t)Text[1] << 8) |
+				(std::uint32_t)(std::uint8_t)Text[2];
+		}
+
+		static void Intersect(std::vector<std::uint32_t>& Result, const std::vector<std::uint32_t>& With)
+		{
+			std::size_t Count = 0;
+			auto It = With.begin();
+
+			for (auto Item : Result)
+			{
+				It = std::lower_bound(It, With.end(), Item);
+				if (It == With.end())
+					break;
+				if (*It == Item)
+					Result[Count++] = Item;
+			}
+
+			Result.resize(Count);
+		}
+
+		SearchIndex::SearchIndex() noexcept(true)
+		{
+			try
+			{
+				_data = new SearchIndexData;
+			}
+			catch (const std::exception&)
+			{}
+		}
+
+		SearchIndex::~SearchIndex() noexcept(true)
+		{
+			if (_data)
+			{
+				delete (SearchIndexData*)_data;
+				_data = nullptr;
+			}
+		}
+
+		void SearchIndex::Clear() noexcept(true)
+		{
+			auto data = (SearchIndexData*)_data;
+			if (!data)
+				return;
+
+			std::unique_lock lock(data->Lock);
+
+			try
+			{
+				// A running query still has the old one
+				data->Text = std::make_shared<SearchIndexText>();
+			}
+			catch (const std::exception&)
+			{}
+
+			data->Items.clear();
+			data->Items.shrink_to_fit();
+			data->Ids.clear();
+			data->Trigrams.clear();
+			data->Version++;
+		}
+
+		void SearchIndex::Add(std::uintptr_t Id, std::string_view Text) noexcept(true)
+		{
+			auto data = (SearchIndexData*)_data;
+			if (!data)
+				return;
+
+			try
+			{
+				// Folded and split without the lock
+				std::string Folded;
+				Fold(Text, Folded);
+
+				std::vector<std::uint32_t> Keys;
+				if (Folded.length() >= 3)
+				{
+					Keys.reserve(Folded.length() - 2);
+					for (std::size_t i = 0; (i + 2) < Folded.length(); i++)
+						Keys.push_back(Trigram(Folded.data() + i));
+
+					std::sort(Keys.begin(), Keys.end());
+					Keys.erase(std::unique(Keys.begin(), Keys.end()), Keys.end());
+				}
+
+				std::unique_lock lock(data->Lock);
+
+				auto Index = (std::uint32_t)data->Items.size();
+				auto It = data->Ids.find(Id);
+				if (It != data->Ids.end())
+				{
+					// The text has changed, the old one stays in the buffer and is skipped
+					data->Items[It->second].Alive = false;
+					It->second = Index;
+				}
+				else
+					data->Ids.emplace(Id, Index);
+
+				data->Items.push_back({ Id, data->Text->Append(Folded), (std::uint32_t)Folded.length(), true });
+
+				for (auto Key : Keys)
+					data->Trigrams[Key].push_back(Index);
+
+				data->Version++;
+			}
+			catch (const std::exception&)
+			{}
+		}
+
+		void SearchIndex::Remove(std::uintptr_t Id) noexcept(true)
+		{
+			auto data = (SearchIndexData*)_data;
+			if (!data)
+				return;
+
+			std::unique_lock lock(data->Lock);
+
+			auto It = data->Ids.find(Id);
+			if (It == data->Ids.end())
+				return;
+
+			data->Items[It->second].Alive = false;
+			data->Ids.erase(It);
+			data->Version++;
+		}
+
+		bool SearchIndex::Query(std::string_view Pattern, std::vector<std::uintptr_t>& Result,
+			const TaskGroup* Group) const noexcept(true)
+		{
+			Result.clear();
+
+			auto data = (SearchIndexData*)_data;
+			if (!data)
+				return true;
+
+			try
+			{
+				std::string Folded;
+				Fold(Pattern, Folded);
+
+				// Only the candidates are picked under the lock, an Add doesn't wait for the whole query
+				std::shared_ptr<SearchIndexText> Text;
+				std::vector<SearchCandidate> Snapshot;
+				std::uint32_t Version;
+
+				{
+					std::shared_lock lock(data->Lock);
+
+					std::vector<std::uint32_t> Candidates;
+					bool All = false;
+
+					{
+						ScopeCriticalSection guard(data->LastSection);
+
+						if ((data->LastVersion == data->Version) && (Folded.find(data->LastPattern) != std::string::npos))
+							Candidates = data->LastItems;
+						else if (Folded.length() >= 3)
+						{
+							// The rarest trigrams, the rest is up to the comparison
+							std::vector<const std::vector<std::uint32_t>*> Lists;
+							for (std::size_t i = 0; (i + 2) < Folded.length(); i++)
+							{
+								auto It = data->Trigrams.find(Trigram(Folded.data() + i));
+								if (It == data->Trigrams.end())
+								{
+									Lists.clear();
+									break;
+								}
+								Lists.push_back(&It->second);
+							}
+
+							if (!Lists.empty())
+							{
+								std::sort(Lists.begin(), Lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+								Lists.erase(std::unique(Lists.begin(), Lists.end()), Lists.end());
+
+								Candidates = *Lists[0];
+								for (std::size_t i = 1; (i < Lists.size()) && (i < SEARCH_INTERSECT_MAX) && !Candidates.empty(); i++)
+									Intersect(Candidates, *Lists[i]);
+							}
+						}
+						else
+							All = true;
+					}
+
+					auto Take = [&](std::uint32_t Index)
+						{
+							auto& Item = data->Items[Index];
+							if (Item.Alive)
+								Snapshot.push_back({ Item.Id, Item.Text, Item.Length, Index });
+						};
+
+					Snapshot.reserve(All ? data->Items.size() : Candidates.size());
+					if (All)
+						for (std::uint32_t i = 0; i < (std::uint32_t)data->Items.size(); i++)
+							Take(i);
+					else
+						for (auto Index : Candidates)
+							Take(Index);
+
+					Text = data->Text;
+					Version = data->Version;
+				}
+
+				auto Count = Snapshot.size();
+				auto Check = [&](std::size_t Begin, std::size_t End, std::vector<std::uint32_t>& Matches) -> bool
+					{
+						for (auto i = Begin; i < End; i++)
+						{
+							if (Group && !((i - Begin) % SEARCH_CANCEL_CHECK) && Group->IsCanceled())
+								return false;
+
+							auto& Candidate = Snapshot[i];
+							if (std::string_view(Candidate.Text, Candidate.Length).find(Folded) != std::string_view::npos)
+								Matches.push_back((std::uint32_t)i);
+						}
+
+						return true;
+					};
+
+				// Positions in the snapshot
+				std::vector<std::uint32_t> Matches;
+				if (Count >= SEARCH_PARALLEL_MIN)
+				{
+					std::vector<std::vector<std::uint32_t>> Pieces((Count + SEARCH_GRAIN - 1) / SEARCH_GRAIN);
+					TaskScheduler::GetSingleton()->ParallelFor(0, Count, SEARCH_GRAIN,
+						[&](std::size_t Begin, std::size_t End) { Check(Begin, End, Pieces[Begin / SEARCH_GRAIN]); },
+						"SearchIndex");
+
+					if (Group && Group->IsCanceled())
+						return false;
+
+					for (auto& Piece : Pieces)
+						Matches.insert(Matches.end(), Piece.begin(), Piece.end());
+				}
+				else if (!Check(0, Count, Matches))
+					return false;
+
+				Result.reserve(Matches.size());
+				for (auto& Match : Matches)
+				{
+					Result.push_back(Snapshot[Match].Id);
+					Match = Snapshot[Match].Index;
+				}
+
+				ScopeCriticalSection guard(data->LastSection);
+				data->LastPattern = std::move(Folded);
+				data->LastItems = std::move(Matches);
+				// An Add after the snapshot makes it stale
+				data->LastVersion = Version;
+
+				return true;
+			}
+			catch (const std::exception&)
+			{
+				Result.clear();
+				return false;
+			}
+		}
+
+		std::uint32_t SearchIndex::GetCount() const noexcept(true)
+		{
+			auto data = (SearchIndexData*)_data;
+			if (!data)
+				return 0;
+
+			std::shared_lock lock(data->Lock);
+			return (std::uint32_t)data->Ids.size();
+		}
+
+		std::size_t SearchIndex::GetMemoryUsage() const noexcept(true)
+		{
+			auto data = (SearchIndexData*)_data;
+			if (!data)
+				return 0;
+
+			std::shared_lock lock(data->Lock);
+
+			auto Result = sizeof(SearchIndexData) + data->Text->Memory +
+				data->Items.capacity() * sizeof(SearchIndexItem) +
+				data->Ids.size() * (sizeof(std::uintptr_t) + sizeof(std::uint32_t) + sizeof(void*) * 2);
+			for (auto& Posting : data->Trigrams)
+				Result += sizeof(Posting) + sizeof(void*) * 2 + Posting.second.capacity() * sizeof(std::uint32_t);
+
+			return Result;
+		}
+	}
+}
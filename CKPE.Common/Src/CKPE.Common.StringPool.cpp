@@ -0,0 +1,306 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <CKPE.HashUtils.h>
+#include <CKPE.CriticalSection.h>
+#include <CKPE.Common.TaskScheduler.h>
+#include <CKPE.Common.StringPool.h>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <string>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		// The same as the engine
+		constexpr static std::uint32_t POOL_BUCKETS = 0x10000;
+		constexpr static std::uint32_t POOL_STRIPES = 0x20;
+		constexpr static std::size_t POOL_BLOCK_SIZE = 64 * 1024;
+		constexpr static std::size_t POOL_FOLD_STACK = 512;
+		constexpr static std::size_t POOL_BULK_PARALLEL = 4096;
+
+		struct StringPoolNode
+		{
+			// Set before the node is published and never changed
+			StringPoolNode* Next;
+			std::uint64_t Hash;
+			std::uint32_t Length;
+			char Data[1];
+		};
+
+		struct StringPoolStripe
+		{
+			CriticalSection Section;
+			std::vector<char*> Blocks;
+			char* Current{ nullptr };
+			std::size_t Used{ POOL_BLOCK_SIZE };
+			std::size_t Memory{ 0 };
+			std::atomic_size_t Count{ 0 };
+
+			StringPoolNode* Allocate(std::size_t Length)
+			{
+				auto Size = (offsetof(StringPoolNode, Data) + Length + 1 + 7) & ~(std::size_t)7;
+
+				// Large ones get a block of their own, the current one stays
+				if (Size > (POOL_BLOCK_SIZE / 4))
+				{
+					Blocks.push_back(new char[Size]);
+					Memory += Size;
+					return (StringPoolNode*)Blocks.back();
+				}
+
+				if ((Used + Size) > POOL_BLOCK_SIZE)
+				{
+					Blocks.push_back(new char[POOL_BLOCK_SIZE]);
+					Current = Blocks.back();
+					Memory += POOL_BLOCK_SIZE;
+					Used = 0;
+				}
+
+				auto Node = (StringPoolNode*)(Current + Used);
+				Used += Size;
+				return Node;
+			}
+
+			~StringPoolStripe()
+			{
+				for (auto Block : Blocks)
+					delete[] Block;
+			}
+		};
+
+		struct StringPoolData
+		{
+			bool CaseInsensitive;
+			std::atomic<StringPoolNode*> Buckets[POOL_BUCKETS]{};
+			StringPoolStripe Stripes[POOL_STRIPES];
+
+			[[nodiscard]] inline static std::uint32_t BucketOf(std::uint64_t Hash) noexcept(true)
+			{
+				return (std::uint32_t)(Hash ^ (Hash >> 32)) & (POOL_BUCKETS - 1);
+			}
+
+			[[nodiscard]] inline static std::uint32_t StripeOf(std::uint32_t Bucket) noexcept(true)
+			{
+				return Bucket & (POOL_STRIPES - 1);
+			}
+
+			[[nodiscard]] std::uint64_t Hash(std::string_view Str) const noexcept(true)
+			{
+				if (!CaseInsensitive)
+					return HashUtils::FastHash64(Str.data(), Str.length());
+
+				// Folded in pieces through the seed, there's no copy of a long string
+				char Buffer[POOL_FOLD_STACK];
+				std::uint64_t Result = Str.length();
+				for (std::size_t Offset = 0; Offset < Str.length(); Offset += POOL_FOLD_STACK)
+				{
+					auto Length = std::min(POOL_FOLD_STACK, Str.length() - Offset);
+					for (std::size_t i = 0; i < Length; i++)
+					{
+						auto c = Str[Offset + i];
+						Buffer[i] = ((c >= 'A') && (c <= 'Z')) ? (char)(c + ('a' - 'A')) : c;
+					}
+					Result = HashUtils::FastHash64(Buffer, Length, Result);
+				}
+
+				return Result;
+			}
+
+			[[nodiscard]] bool Equal(const StringPoolNode* Node, std::uint64_t Hash, std::string_view Str) const noexcept(true)
+			{
+				if ((Node->Hash != Hash) || (Node->Length != Str.length()))
+					return false;
+
+				return CaseInsensitive ? !_strnicmp(Node->Data, Str.data(), Str.length()) :
+					!memcmp(Node->Data, Str.data(), Str.length());
+			}
+
+			[[nodiscard]] const char* Find(std::uint32_t Bucket, std::uint64_t Hash, std::string_view Str) const noexcept(true)
+			{
+				// Acquire pairs with the release in Insert, the node is complete when seen
+				for (auto Node = Buckets[Bucket].load(std::memory_order_acquire); Node; Node = Node->Next)
+					if (Equal(Node, Hash, Str))
+						return Node->Data;
+
+				return nullptr;
+			}
+
+			// The stripe of the bucket must be locked
+			const char* Insert(std::uint32_t Bucket, std::uint64_t Hash, std::string_view Str)
+			{
+				// Only this stripe prepends to the bucket, what's there now is all there is
+				auto Head = Buckets[Bucket].load(std::memory_order_relaxed);
+				for (auto Node = Head; Node; Node = Node->Next)
+					if (Equal(Node, Hash, Str))
+						return Node->Data;
+
+				auto& Stripe = Stripes[StripeOf(Bucket)];
+				auto Node = Stripe.Allocate(Str.length());
+				Node->Next = Head;
+				Node->Hash = Hash;
+				Node->Length = (std::uint32_t)Str.length();
+				memcpy(Node->Data, Str.data(), Str.length());
+				Node->Data[Str.length()] = 0;
+
+				Buckets[Bucket].store(Node, std::memory_order_release);
+				Stripe.Count.fetch_add(1, std::memory_order_relaxed);
+
+				return Node->Data;
+			}
+		};
+
+		StringPool::StringPool(bool CaseInsensitive) noexcept(true)
+		{
+			try
+			{
+				auto data = new StringPoolData;
+				data->CaseInsensitive = CaseInsensitive;
+				_data = data;
+			}
+			catch (const std::exception&)
+			{}
+		}
+
+		StringPool::~StringPool() noexcept(true)
+		{
+			if (_data)
+			{
+				delete (StringPoolData*)_data;
+				_data = nullptr;
+			}
+		}
+
+		const char* StringPool::Find(std::string_view Str) const noexcept(true)
+		{
+			auto data = (const StringPoolData*)_data;
+			if (!data)
+				return nullptr;
+
+			auto Hash = data->Hash(Str);
+			return data->Find(StringPoolData::BucketOf(Hash), Hash, Str);
+		}
+
+		const char* StringPool::Intern(std::string_view Str) noexcept(true)
+		{
+			auto data = (StringPoolData*)_data;
+			if (!data)
+				return nullptr;
+
+			auto Hash = data->Hash(Str);
+			auto Bucket = StringPoolData::BucketOf(Hash);
+
+			// Most are already there, that's without the lock
+			auto Result = data->Find(Bucket, Hash, Str);
+			if (Result)
+				return Result;
+
+			try
+			{
+				ScopeCriticalSection guard(data->Stripes[StringPoolData::StripeOf(Bucket)].Section);
+				return data->Insert(Bucket, Hash, Str);
+			}
+			catch (const std::exception&)
+			{
+				return nullptr;
+			}
+		}
+
+		void StringPool::InternBulk(const std::string_view* Strings, std::size_t Count, const char** Result) noexcept(true)
+		{
+			auto data = (StringPoolData*)_data;
+			if (!Strings || !Result || !Count)
+				return;
+
+			if (!data)
+			{
+				std::fill(Result, Result + Count, nullptr);
+				return;
+			}
+
+			std::fill(Result, Result + Count, nullptr);
+
+			try
+			{
+				std::vector<std::uint64_t> Hashes(Count);
+				auto HashRange = [&](std::size_t Begin, std::size_t End)
+					{
+						for (auto i = Begin; i < End; i++)
+						{
+							Hashes[i] = data->Hash(Strings[i]);
+							Result[i] = data->Find(StringPoolData::BucketOf(Hashes[i]), Hashes[i], Strings[i]);
+						}
+					};
+
+				if (Count >= POOL_BULK_PARALLEL)
+					TaskScheduler::GetSingleton()->ParallelFor(0, Count, 0, HashRange, "StringPool");
+				else
+					HashRange(0, Count);
+
+				// The missing ones by stripe, so each lock is taken once
+				std::vector<std::uint32_t> Missing;
+				for (std::size_t i = 0; i < Count; i++)
+					if (!Result[i])
+						Missing.push_back((std::uint32_t)i);
+
+				std::stable_sort(Missing.begin(), Missing.end(), [&Hashes](std::uint32_t a, std::uint32_t b)
+					{
+						return StringPoolData::StripeOf(StringPoolData::BucketOf(Hashes[a])) <
+							StringPoolData::StripeOf(StringPoolData::BucketOf(Hashes[b]));
+					});
+
+				for (std::size_t i = 0; i < Missing.size();)
+				{
+					auto Stripe = StringPoolData::StripeOf(StringPoolData::BucketOf(Hashes[Missing[i]]));
+					ScopeCriticalSection guard(data->Stripes[Stripe].Section);
+
+					for (; (i < Missing.size()) &&
+						(StringPoolData::StripeOf(StringPoolData::BucketOf(Hashes[Missing[i]])) == Stripe); i++)
+					{
+						auto Index = Missing[i];
+						Result[Index] = data->Insert(StringPoolData::BucketOf(Hashes[Index]), Hashes[Index], Strings[Index]);
+					}
+				}
+			}
+			catch (const std::exception&)
+			{
+				// Whatever is still null wasn't interned
+				for (std::size_t i = 0; i < Count; i++)
+					if (!Result[i])
+						Result[i] = Intern(Strings[i]);
+			}
+		}
+
+		std::size_t StringPool::GetCount() const noexcept(true)
+		{
+			auto data = (const StringPoolData*)_data;
+			if (!data)
+				return 0;
+
+			std::size_t Result = 0;
+			for (auto& Stripe : data->Stripes)
+				Result += Stripe.Count.load(std::memory_order_relaxed);
+			return Result;
+		}
+
+		std::size_t StringPool::GetMemoryUsage() const noexcept(true)
+		{
+			auto data = (StringPoolData*)_data;
+			if (!data)
+				return 0;
+
+			std::size_t Result = sizeof(StringPoolData);
+			for (auto& Stripe : data->Stripes)
+			{
+				ScopeCriticalSection guard(Stripe.Section);
+				Result += Stripe.Memory;
+			}
+			return Result;
+		}
+	}
+}
@@ -6,8 +6,13 @@
 #include <mmsystem.h>
 #include <CKPE.Common.Interface.h>
 #include <CKPE.Common.TableID.h>
+#include <CKPE.CriticalSection.h>
 #include <CKPE.HashUtils.h>
 #include <CKPE.Exception.h>
+#include <CKPE.Module.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
 namespace CKPE
 {
@@ -15,18 +20,69 @@ namespace CKPE
 	{
 		static TableID GlobalTableID;
 
+		constexpr static std::uint32_t TABLEID_FOURCC = MAKEFOURCC('C', 'K', 'T', 'I');
+		constexpr static std::uint32_t TABLEID_VERSION1 = 1;
+		constexpr static std::uint32_t TABLEID_VERSION2 = 2;
+
+		enum : std::uint8_t
+		{
+			TABLEID_BLOCK_UNKNOWN = 0,
+			TABLEID_BLOCK_OK,
+			TABLEID_BLOCK_BAD,
+		};
+
+		struct TableIDData
+		{
+			void* view{ nullptr };							// Mapped file
+			std::vector<std::uint8_t> memory;				// Or the copy of the stream
+			const std::uint32_t* rvas{ nullptr };
+			const std::uint32_t* crcs{ nullptr };			// Version 2 only, per block
+			const std::uint32_t* reverse{ nullptr };		// Ids sorted by rva from the file
+			std::uint32_t reverse_crc32{ 0 };
+			std::uint32_t count{ 0 };
+			std::uint32_t block_size{ 0 };
+			std::uint64_t image_hash{ 0 };
+			// State of the blocks, checked on the first access by any thread
+			std::unique_ptr<std::atomic_uint8_t[]> checked;
+			mutable std::vector<std::uint32_t> built_reverse;
+			mutable bool reverse_checked{ false };
+			mutable CriticalSection section;
+
+			~TableIDData() noexcept(true)
+			{
+				if (view) UnmapViewOfFile(view);
+			}
+		};
+
+		static bool TableIDMapFile(HANDLE file, TableIDData* data, std::size_t& size) noexcept(true)
+		{
+			LARGE_INTEGER file_size{};
+			if ((file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(file, &file_size) || !file_size.QuadPart)
+				return false;
+
+			auto map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!map)
+				return false;
+
+			data->view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(map);
+
+			size = (std::size_t)file_size.QuadPart;
+			return data->view != nullptr;
+		}
+
 		TableID::TableID(std::uintptr_t base) noexcept(true) :
-			_table(new std::vector<std::uint32_t>)
+			_data(new TableIDData)
 		{
 			Rebase(base);
 		}
 
 		TableID::~TableID() noexcept(true)
 		{
-			if (_table)
+			if (_data)
 			{
-				delete _table;
-				_table = nullptr;
+				delete (TableIDData*)_data;
+				_data = nullptr;
 			}
 		}
 
@@ -40,25 +96,52 @@ namespace CKPE
 
 		bool TableID::Open(const std::string& fname) noexcept(true)
 		{
-			MemoryStream mstm;
-			bool r = mstm.LoadFromFile(fname);
-			if (r) return Open(mstm);
-			return r;
+			Clear();
+
+			auto file = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL, nullptr);
+			std::size_t size = 0;
+			bool r = TableIDMapFile(file, (TableIDData*)_data, size);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+			if (!r)
+			{
+				_ERROR("TableID::Open can't map file \"%s\"", fname.c_str());
+				Clear();
+				return false;
+			}
+
+			return Parse(((TableIDData*)_data)->view, size);
 		}
 
 		bool TableID::Open(const std::wstring& fname) noexcept(true)
 		{
-			MemoryStream mstm;
-			bool r = mstm.LoadFromFile(fname);
-			if (r) return Open(mstm);
-			return r;
+			Clear();
+
+			auto file = CreateFileW(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL, nullptr);
+			std::size_t size = 0;
+			bool r = TableIDMapFile(file, (TableIDData*)_data, size);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+			if (!r)
+			{
+				_ERROR(L"TableID::Open can't map file \"%s\"", fname.c_str());
+				Clear();
+				return false;
+			}
+
+			return Parse(((TableIDData*)_data)->view, size);
 		}
 
 		bool TableID::Open(Stream& stm) noexcept(true)
 		{
+			Clear();
+
 			try
 			{
-				if (!_table)
+				auto data = (TableIDData*)_data;
+				if (!data)
 					throw std::runtime_error("TableID::Open Table no init");
 
 				auto msize = stm.GetSize();
@@ -67,40 +150,121 @@ namespace CKPE
 
 				stm.SetPosition(0);
 
-				TableIDHeader _header;
-				if (stm.Read(&_header, sizeof(TableIDHeader)) != sizeof(TableIDHeader))
+				data->memory.resize((std::size_t)msize);
+				if (stm.Read(data->memory.data(), (std::uint32_t)msize) != (std::uint32_t)msize)
 					throw std::runtime_error("TableID::Open stream data I/O error read");
+			}
+			catch (const std::exception& e)
+			{
+				_ERROR(e.what());
+				Clear();
 
-				if (_header.fourcc != MAKEFOURCC('C', 'K', 'T', 'I'))
+				return false;
+			}
+
+			return Parse(((TableIDData*)_data)->memory.data(), ((TableIDData*)_data)->memory.size());
+		}
+
+		bool TableID::Parse(const void* raw, std::size_t msize) noexcept(true)
+		{
+			auto data = (TableIDData*)_data;
+
+			try
+			{
+				if (msize < sizeof(std::uint32_t) * 2)
+					throw std::runtime_error("TableID::Open stream data no contain header tableid");
+
+				auto fourcc = ((const std::uint32_t*)raw)[0];
+				auto version = ((const std::uint32_t*)raw)[1];
+
+				if (fourcc != TABLEID_FOURCC)
 					throw std::runtime_error("TableID::Open stream data no tableid");
 
-				if (_header.count)
+				if (version == TABLEID_VERSION2)
 				{
-					std::size_t dsize = _header.count * sizeof(std::uint32_t);
-					if (dsize != (msize - sizeof(TableIDHeader)))
-						throw RuntimeError("TableID::Open stream data tableid invalid size ({} / {})", 
-							dsize, (msize - sizeof(TableIDHeader)));
+					if (msize < sizeof(TableIDHeader2))
+						throw std::runtime_error("TableID::Open stream data no contain header tableid");
+
+					TableIDHeader2 header;
+					memcpy(&header, raw, sizeof(TableIDHeader2));
+
+					auto header_crc32 = header.header_crc32;
+					header.header_crc32 = 0;
+					if (HashUtils::CRC32Buffer(&header, sizeof(TableIDHeader2)) != header_crc32)
+						throw std::runtime_error("TableID::Open stream data tableid invalid header crc32");
+
+					if (!header.block_size)
+						throw std::runtime_error("TableID::Open stream data tableid invalid block size");
 
-					_table->resize((std::size_t)_header.count);
-					if (_table->empty())
-						throw std::runtime_error("TableID::Open out of memory");
+					std::size_t blocks = ((std::size_t)header.count + header.block_size - 1) / header.block_size;
+					std::size_t dsize = sizeof(TableIDHeader2) + (header.count + blocks) * sizeof(std::uint32_t);
+					if (header.flags & fReverseIndex)
+						dsize += ((std::size_t)header.count + 1) * sizeof(std::uint32_t);
 
-					if (stm.Read(_table->data(), (std::uint32_t)dsize) != (std::uint32_t)dsize)
-						throw std::runtime_error("TableID::Open stream data I/O error read");
+					if (dsize != msize)
+						throw RuntimeError("TableID::Open stream data tableid invalid size ({} / {})", dsize, msize);
 
-					auto mcrc32 = HashUtils::CRC32Buffer(_table->data(), (std::uint32_t)dsize);
-					if (mcrc32 != _header.crc32)
+					auto table = (const std::uint32_t*)((const std::uint8_t*)raw + sizeof(TableIDHeader2));
+					data->rvas = table;
+					data->crcs = table + header.count;
+					if (header.flags & fReverseIndex)
 					{
-						_table->clear();
+						data->reverse = data->crcs + blocks;
+						data->reverse_crc32 = data->reverse[header.count];
+					}
+
+					// The rva are of another build of the editor
+					auto image_hash = Module::GetImageHash((const void*)_base);
+					if (header.image_hash && (header.image_hash != image_hash))
+						throw RuntimeError("TableID::Open stream data tableid for another image ({:x} / {:x})",
+							header.image_hash, image_hash);
+
+					data->count = header.count;
+					data->block_size = header.block_size;
+					data->image_hash = header.image_hash ? header.image_hash : image_hash;
+					data->checked = std::make_unique<std::atomic_uint8_t[]>(blocks);
+
+					ZeroMemory(&_header, sizeof(TableIDHeader));
+					_header.fourcc = header.fourcc;
+					_header.version = header.version;
+					_header.crc32 = header_crc32;
+					memcpy(_header.game, header.game, sizeof(_header.game));
+					_header.game_version = header.game_version;
+					_header.count = header.count;
+					_header.create_time = (time_t)header.create_time;
+				}
+				else
+				{
+					if (msize < sizeof(TableIDHeader))
+						throw std::runtime_error("TableID::Open stream data no contain header tableid");
+
+					TableIDHeader header;
+					memcpy(&header, raw, sizeof(TableIDHeader));
+
+					std::size_t dsize = header.count * sizeof(std::uint32_t);
+					if (dsize != (msize - sizeof(TableIDHeader)))
+						throw RuntimeError("TableID::Open stream data tableid invalid size ({} / {})", 
+							dsize, (msize - sizeof(TableIDHeader)));
 
+					// The old format has one crc32 for the whole table
+					auto table = (const std::uint32_t*)((const std::uint8_t*)raw + sizeof(TableIDHeader));
+					auto mcrc32 = HashUtils::CRC32Buffer(table, (std::uint32_t)dsize);
+					if (mcrc32 != header.crc32)
 						throw RuntimeError("TableID::Open stream data tableid invalid crc32 ({:x} / {:x})",
-							mcrc32, _header.crc32);
-					}
+							mcrc32, header.crc32);
+
+					data->rvas = table;
+					data->count = header.count;
+					// Version 1 doesn't know its image
+					data->image_hash = Module::GetImageHash((const void*)_base);
+
+					_header = header;
 				}
 			}
 			catch (const std::exception& e)
 			{
 				_ERROR(e.what());
+				Clear();
 
 				return false;
 			}
@@ -108,17 +272,152 @@ namespace CKPE
 			return true;
 		}
 
+		bool TableID::Save(const std::wstring& fname, bool reverse_index) const noexcept(true)
+		{
+			auto data = (TableIDData*)_data;
+			if (!data)
+				return false;
+
+			try
+			{
+				TableIDHeader2 header;
+				ZeroMemory(&header, sizeof(TableIDHeader2));
+
+				header.fourcc = TABLEID_FOURCC;
+				header.version = TABLEID_VERSION2;
+				header.image_hash = data->image_hash;
+				memcpy(header.game, _header.game, sizeof(header.game));
+				header.game_version = _header.game_version;
+				header.create_time = (std::uint64_t)(_header.create_time ? _header.create_time : time(nullptr));
+				header.count = data->count;
+				header.block_size = BLOCK_SIZE;
+				header.flags = reverse_index ? fReverseIndex : 0;
+				header.header_crc32 = HashUtils::CRC32Buffer(&header, sizeof(TableIDHeader2));
+
+				std::vector<std::uint32_t> rvas(data->count);
+				for (std::uint32_t id = 0; id < data->count; id++)
+					rvas[id] = Rva(id);
+
+				std::vector<std::uint32_t> crcs;
+				for (std::uint32_t i = 0; i < data->count; i += BLOCK_SIZE)
+					crcs.push_back(HashUtils::CRC32Buffer(rvas.data() + i,
+						(std::uint32_t)(std::min(BLOCK_SIZE, data->count - i) * sizeof(std::uint32_t))));
+
+				FileStream fstm(fname, FileStream::fmCreate);
+				fstm.Write(&header, sizeof(TableIDHeader2));
+				if (!rvas.empty()) fstm.Write(rvas.data(), (std::uint32_t)(rvas.size() * sizeof(std::uint32_t)));
+				if (!crcs.empty()) fstm.Write(crcs.data(), (std::uint32_t)(crcs.size() * sizeof(std::uint32_t)));
+
+				if (reverse_index)
+				{
+					std::vector<std::uint32_t> ids(data->count);
+					for (std::uint32_t id = 0; id < data->count; id++)
+						ids[id] = id;
+					std::stable_sort(ids.begin(), ids.end(),
+						[&rvas](std::uint32_t a, std::uint32_t b) { return rvas[a] < rvas[b]; });
+
+					auto crc32 = HashUtils::CRC32Buffer(ids.data(), (std::uint32_t)(ids.size() * sizeof(std::uint32_t)));
+					if (!ids.empty()) fstm.Write(ids.data(), (std::uint32_t)(ids.size() * sizeof(std::uint32_t)));
+					fstm.Write(&crc32, sizeof(crc32));
+				}
+			}
+			catch (const std::exception& e)
+			{
+				_ERROR(e.what());
+				return false;
+			}
+
+			return true;
+		}
+
 		void TableID::Clear() noexcept(true)
 		{
-			if (_table)
-				_table->clear();
+			if (_data)
+			{
+				delete (TableIDData*)_data;
+				_data = new TableIDData;
+			}
+
+			ZeroMemory(&_header, sizeof(TableIDHeader));
+		}
+
+		bool TableID::CheckBlock(std::uint32_t block) const noexcept(true)
+		{
+			auto data = (TableIDData*)_data;
+
+			// Version 1 is checked entirely on open
+			if (!data->crcs)
+				return true;
+
+			auto state = data->checked[block].load(std::memory_order_acquire);
+			if (state == TABLEID_BLOCK_UNKNOWN)
+			{
+				auto first = block * data->block_size;
+				auto count = std::min(data->block_size, data->count - first);
+				auto crc32 = HashUtils::CRC32Buffer(data->rvas + first, (std::uint32_t)(count * sizeof(std::uint32_t)));
+
+				// The mapped data is read-only, so any thread gets the same state, the first one reports it
+				std::uint8_t expected = TABLEID_BLOCK_UNKNOWN;
+				state = (crc32 == data->crcs[block]) ? TABLEID_BLOCK_OK : TABLEID_BLOCK_BAD;
+				if (data->checked[block].compare_exchange_strong(expected, state, std::memory_order_acq_rel) &&
+					(state == TABLEID_BLOCK_BAD))
+					_ERROR("TableID block %u is damaged (crc32 %08X / %08X), the ids %u-%u are ignored", block, crc32,
+						data->crcs[block], first, first + count - 1);
+			}
+
+			return state == TABLEID_BLOCK_OK;
+		}
+
+		const std::uint32_t* TableID::GetReverseIndex() const noexcept(true)
+		{
+			auto data = (TableIDData*)_data;
+
+			ScopeCriticalSection guard(data->section);
+
+			if (!data->reverse_checked)
+			{
+				data->reverse_checked = true;
+
+				if (data->reverse &&
+					(HashUtils::CRC32Buffer(data->reverse, (std::uint32_t)(data->count * sizeof(std::uint32_t))) != data->reverse_crc32))
+				{
+					_ERROR("TableID reverse index is damaged, it will be built again");
+					data->reverse = nullptr;
+				}
+
+				if (!data->reverse)
+				{
+					try
+					{
+						// The old format or the index is damaged
+						data->built_reverse.resize(data->count);
+						for (std::uint32_t id = 0; id < data->count; id++)
+							data->built_reverse[id] = id;
+						std::stable_sort(data->built_reverse.begin(), data->built_reverse.end(),
+							[data](std::uint32_t a, std::uint32_t b) { return data->rvas[a] < data->rvas[b]; });
+					}
+					catch (const std::exception&)
+					{
+						data->built_reverse.clear();
+					}
+				}
+			}
+
+			return data->reverse ? data->reverse : (data->built_reverse.empty() ? nullptr : data->built_reverse.data());
+		}
+
+		std::uint64_t TableID::ImageHash() const noexcept(true)
+		{
+			return _data ? ((TableIDData*)_data)->image_hash : 0;
 		}
 
 		std::uint32_t TableID::Rva(std::uint32_t id) const noexcept(true)
 		{
-			if (_table)
-				return _table->size() > id ? _table->at(id) : 0;
-			return 0;
+			auto data = (TableIDData*)_data;
+			if (!data || (id >= data->count))
+				return 0;
+
+			return CheckBlock(id / std::max(1u, data->block_size)) ? data->rvas[id] : 0;
 		}
 
 		std::uintptr_t TableID::Offset(std::uint32_t id) const noexcept(true)
@@ -127,6 +426,38 @@ namespace CKPE
 			return mrva ? (_base + mrva) : 0;
 		}
 
+		std::uint32_t TableID::Id(std::uint32_t rva, bool exact) const noexcept(true)
+		{
+			auto data = (TableIDData*)_data;
+			if (!data || !data->count || !rva)
+				return INVALID_ID;
+
+			auto reverse = GetReverseIndex();
+			if (!reverse)
+				return INVALID_ID;
+
+			// First id with a greater rva
+			auto it = std::upper_bound(reverse, reverse + data->count, rva,
+				[data](std::uint32_t value, std::uint32_t id) { return value < data->rvas[id]; });
+			if (it == reverse)
+				return INVALID_ID;
+
+			auto id = *(it - 1);
+			auto found = Rva(id);
+			if (!found || (exact && (found != rva)))
+				return INVALID_ID;
+
+			return id;
+		}
+
+		std::uint32_t TableID::IdByOffset(std::uintptr_t offset, bool exact) const noexcept(true)
+		{
+			if ((offset <= _base) || ((offset - _base) > 0xFFFFFFFFull))
+				return INVALID_ID;
+
+			return Id((std::uint32_t)(offset - _base), exact);
+		}
+
 		TableID* TableID::GetSingleton() noexcept(true)
 		{
 			return &GlobalTableID;
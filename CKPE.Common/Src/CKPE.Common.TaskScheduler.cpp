@@ -0,0 +1,508 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <CKPE.StringUtils.h>
+#include <CKPE.Common.Interface.h>
+#include <CKPE.Common.Threads.h>
+#include <CKPE.Common.TaskScheduler.h>
+#include <condition_variable>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+
+namespace CKPE
+{
+	namespace Common
+	{
+		constexpr static std::uint32_t SCHEDULER_WORKERS_MAX = 64;
+		constexpr static std::uint32_t SCHEDULER_IDLE_MS = 10;
+
+		static TaskScheduler stask_scheduler;
+		static thread_local std::int32_t sworker_id = -1;
+
+		// Nothing thrown by a task leaves the scheduler, false if it failed
+		template<typename F>
+		static bool CallTask(const char* Name, F&& Func) noexcept(true)
+		{
+			try
+			{
+				Func();
+				return true;
+			}
+			catch (const std::exception& e)
+			{
+				_ERROR("TaskScheduler: task \"%s\" failed: %s", Name ? Name : "", e.what());
+			}
+			catch (...)
+			{
+				_ERROR("TaskScheduler: task \"%s\" failed: unknown exception", Name ? Name : "");
+			}
+
+			return false;
+		}
+
+		struct TaskGroupData
+		{
+			std::atomic_int32_t Pending{ 0 };
+			std::atomic_bool Canceled{ false };
+			const char* Name{ nullptr };
+		};
+
+		struct SchedulerTask
+		{
+			std::function<void()> Func;
+			TaskGroupData* Group{ nullptr };
+		};
+
+		struct SchedulerQueue
+		{
+			CriticalSection Section;
+			std::deque<SchedulerTask> Tasks;
+		};
+
+		struct TaskSchedulerData
+		{
+			// One per worker, the last one for the threads outside the pool
+			std::vector<std::unique_ptr<SchedulerQueue>> Queues;
+			std::vector<HANDLE> Threads;
+			std::atomic_bool Terminated{ false };
+			std::atomic_uint32_t Queued{ 0 };
+			std::atomic_uint32_t Sleeping{ 0 };
+			// Changed by each finished or added task, TaskGroup::Wait sleeps on it
+			std::atomic_uint32_t Epoch{ 0 };
+			std::atomic_uint32_t Waiting{ 0 };
+			std::mutex SleepMutex;
+			std::condition_variable SleepCond;
+			LARGE_INTEGER Frequency{};
+
+			[[nodiscard]] inline std::uint32_t WorkerCount() const noexcept(true)
+			{
+				return (std::uint32_t)Queues.size() - 1;
+			}
+
+			void Push(SchedulerTask&& Task)
+			{
+				auto Id = sworker_id;
+				auto& Queue = Queues[((Id >= 0) && ((std::uint32_t)Id < WorkerCount())) ? Id : WorkerCount()];
+
+				{
+					ScopeCriticalSection guard(Queue->Section);
+					Queue->Tasks.push_back(std::move(Task));
+				}
+
+				Queued++;
+				if (Sleeping)
+					SleepCond.notify_one();
+			}
+
+			bool Pop(SchedulerTask& Task) noexcept(true)
+			{
+				if (!Queued)
+					return false;
+
+				auto Count = (std::uint32_t)Queues.size();
+				auto Id = sworker_id;
+				auto Own = ((Id >= 0) && ((std::uint32_t)Id < WorkerCount())) ? (std::uint32_t)Id : WorkerCount();
+
+				// Own queue from the back (the newest, still in cache), the others from the front
+				for (std::uint32_t i = 0; i < Count; i++)
+				{
+					auto& Queue = Queues[(Own + i) % Count];
+					ScopeCriticalSection guard(Queue->Section);
+
+					if (Queue->Tasks.empty())
+						continue;
+
+					if (!i && (Own != WorkerCount()))
+					{
+						Task = std::move(Queue->Tasks.back());
+						Queue->Tasks.pop_back();
+					}
+					else
+					{
+						Task = std::move(Queue->Tasks.front());
+						Queue->Tasks.pop_front();
+					}
+
+					Queued--;
+					return true;
+				}
+
+				return false;
+			}
+
+			// Only a task of the Group, from any queue
+			bool PopGroup(SchedulerTask& Task, const TaskGroupData* Group) noexcept(true)
+			{
+				if (!Queued)
+					return false;
+
+				for (auto& Queue : Queues)
+				{
+					ScopeCriticalSection guard(Queue->Section);
+
+					auto It = std::find_if(Queue->Tasks.begin(), Queue->Tasks.end(),
+						[Group](const SchedulerTask& Task) { return Task.Group == Group; });
+					if (It == Queue->Tasks.end())
+						continue;
+
+					Task = std::move(*It);
+					Queue->Tasks.erase(It);
+
+					Queued--;
+					return true;
+				}
+
+				return false;
+			}
+
+			void Execute(SchedulerTask& Task) noexcept(true)
+			{
+				auto Group = Task.Group;
+
+				if (!Group->Canceled)
+				{
+					LARGE_INTEGER Start, Finish;
+					auto Handler = TaskScheduler::GetSingleton()->OnTaskTiming;
+					if (Handler) QueryPerformanceCounter(&Start);
+
+					if (!CallTask(Group->Name, Task.Func))
+						Group->Canceled = true;
+
+					if (Handler)
+					{
+						QueryPerformanceCounter(&Finish);
+						Handler(Group->Name, sworker_id,
+							(std::uint64_t)((Finish.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart));
+					}
+				}
+
+				Task.Func = nullptr;
+				Group->Pending--;
+				// The group may be gone already, the waiters sleep on the scheduler
+				WakeWaiters();
+			}
+
+			void WakeWaiters() noexcept(true)
+			{
+				Epoch++;
+				if (Waiting)
+					Epoch.notify_all();
+			}
+		};
+
+		///////////////////////////////////////////////////
+		/// TaskGroup
+
+		TaskGroup::TaskGroup(const char* Name) noexcept(true) :
+			_data(new TaskGroupData)
+		{
+			((TaskGroupData*)_data)->Name = Name;
+		}
+
+		TaskGroup::~TaskGroup() noexcept(true)
+		{
+			if (_data)
+			{
+				// The tasks refer to the group
+				Wait();
+
+				delete (TaskGroupData*)_data;
+				_data = nullptr;
+			}
+		}
+
+		void TaskGroup::Run(std::function<void()> Func) noexcept(true)
+		{
+			auto group = (TaskGroupData*)_data;
+			if (!group || !Func)
+				return;
+
+			auto scheduler = (TaskSchedulerData*)TaskScheduler::GetSingleton()->GetData();
+
+			group->Pending++;
+			SchedulerTask Task{ std::move(Func), group };
+
+			try
+			{
+				if (scheduler && scheduler->WorkerCount())
+				{
+					scheduler->Push(std::move(Task));
+					// The waiter of the group may sleep, the task is for it to take too
+					scheduler->WakeWaiters();
+					return;
+				}
+			}
+			catch (const std::exception&)
+			{
+				// Couldn't queue, do it here
+			}
+
+			if (scheduler)
+				scheduler->Execute(Task);
+			else
+			{
+				if (!group->Canceled && !CallTask(group->Name, Task.Func))
+					group->Canceled = true;
+				group->Pending--;
+			}
+		}
+
+		void TaskGroup::Wait() noexcept(true)
+		{
+			auto group = (TaskGroupData*)_data;
+			if (!group)
+				return;
+
+			auto scheduler = (TaskSchedulerData*)TaskScheduler::GetSingleton()->GetData();
+
+			if (!scheduler)
+			{
+				// The tasks were done by Run, only the ones of the other threads are left
+				while (group->Pending > 0)
+					SwitchToThread();
+				return;
+			}
+
+			for (;;)
+			{
+				// Before the check, a task finished after it changes the epoch
+				auto Epoch = scheduler->Epoch.load();
+				if (group->Pending <= 0)
+					break;
+
+				// Help only with this group, the task of another one could wait for us. The rest of the group
+				// is running on the other threads, sleep until one of them is done or adds a task.
+				SchedulerTask Task;
+				if (scheduler->PopGroup(Task, group))
+					scheduler->Execute(Task);
+				else
+				{
+					scheduler->Waiting++;
+					scheduler->Epoch.wait(Epoch);
+					scheduler->Waiting--;
+				}
+			}
+		}
+
+		void TaskGroup::Cancel() noexcept(true)
+		{
+			if (_data)
+				((TaskGroupData*)_data)->Canceled = true;
+		}
+
+		bool TaskGroup::IsCanceled() const noexcept(true)
+		{
+			return _data ? ((TaskGroupData*)_data)->Canceled.load() : true;
+		}
+
+		bool TaskGroup::IsDone() const noexcept(true)
+		{
+			return _data ? ((TaskGroupData*)_data)->Pending <= 0 : true;
+		}
+
+		///////////////////////////////////////////////////
+		/// TaskScheduler
+
+		std::uint32_t TaskScheduler::WorkerThread(void* param) noexcept(true)
+		{
+			auto data = (TaskSchedulerData*)param;
+
+			while (!data->Terminated)
+			{
+				SchedulerTask Task;
+				if (data->Pop(Task))
+				{
+					data->Execute(Task);
+					continue;
+				}
+
+				// Push doesn't take the mutex, so a wake up can be missed, the timeout covers it
+				std::unique_lock<std::mutex> lock(data->SleepMutex);
+				data->Sleeping++;
+				data->SleepCond.wait_for(lock, std::chrono::milliseconds(SCHEDULER_IDLE_MS),
+					[data]() { return data->Queued || data->Terminated; });
+				data->Sleeping--;
+			}
+
+			return 0;
+		}
+
+		TaskScheduler::~TaskScheduler() noexcept(true)
+		{
+			Shutdown();
+		}
+
+		void* TaskScheduler::GetData() noexcept(true)
+		{
+			// Whoever comes first before Interface reads the settings
+			if (!_data)
+				Initialize();
+
+			return _data;
+		}
+
+		bool TaskScheduler::Initialize(std::uint32_t WorkerCount) noexcept(true)
+		{
+			ScopeCriticalSection guard(_section);
+
+			if (_data)
+				return true;
+
+			if (!WorkerCount)
+				WorkerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+			WorkerCount = std::min(WorkerCount, SCHEDULER_WORKERS_MAX);
+
+			TaskSchedulerData* data = nullptr;
+
+			try
+			{
+				data = new TaskSchedulerData;
+				QueryPerformanceFrequency(&data->Frequency);
+
+				for (std::uint32_t i = 0; i <= WorkerCount; i++)
+					data->Queues.emplace_back(std::make_unique<SchedulerQueue>());
+
+				for (std::uint32_t i = 0; i < WorkerCount; i++)
+				{
+					struct StartParam { TaskSchedulerData* Data; std::int32_t Id; };
+
+					auto Param = new StartParam{ data, (std::int32_t)i };
+					auto Thread = CreateThread(nullptr, 0, [](LPVOID param) -> DWORD
+						{
+							auto Start = *(StartParam*)param;
+							delete (StartParam*)param;
+
+							sworker_id = Start.Id;
+							return (DWORD)TaskScheduler::WorkerThread(Start.Data);
+						}, Param, 0, nullptr);
+
+					if (!Thread)
+					{
+						delete Param;
+						break;
+					}
+
+					Threads::SetThreadDesc(Thread, StringUtils::FormatString("CKPE Worker #%u", i).c_str());
+					data->Threads.push_back(Thread);
+				}
+
+				// Not all started, the queues of the missing workers are still taken from
+				if (data->Threads.size() != WorkerCount)
+					_WARNING("TaskScheduler: started %u of %u workers", (std::uint32_t)data->Threads.size(), WorkerCount);
+			}
+			catch (const std::exception& e)
+			{
+				_ERROR("TaskScheduler: %s", e.what());
+
+				if (data)
+				{
+					data->Terminated = true;
+					for (auto Thread : data->Threads)
+					{
+						WaitForSingleObject(Thread, INFINITE);
+						CloseHandle(Thread);
+					}
+					delete data;
+				}
+
+				return false;
+			}
+
+			_data = data;
+			return true;
+		}
+
+		void TaskScheduler::Shutdown() noexcept(true)
+		{
+			ScopeCriticalSection guard(_section);
+
+			auto data = (TaskSchedulerData*)_data;
+			if (!data)
+				return;
+
+			data->Terminated = true;
+			data->SleepCond.notify_all();
+
+			// When DLL unloads, the threads can't terminate under the loader lock, don't wait forever
+			bool terminated = true;
+			for (auto Thread : data->Threads)
+			{
+				terminated = (WaitForSingleObject(Thread, 1000) == WAIT_OBJECT_0) && terminated;
+				CloseHandle(Thread);
+			}
+
+			_data = nullptr;
+
+			// If the threads are still alive, they own the data, leave it
+			if (terminated)
+				delete data;
+		}
+
+		std::uint32_t TaskScheduler::GetWorkerCount() const noexcept(true)
+		{
+			return _data ? ((TaskSchedulerData*)_data)->WorkerCount() : 0;
+		}
+
+		std::int32_t TaskScheduler::GetCurrentWorkerId() noexcept(true)
+		{
+			return sworker_id;
+		}
+
+		bool TaskScheduler::ParallelFor(std::size_t Begin, std::size_t End, std::size_t Grain,
+			const std::function<void(std::size_t, std::size_t)>& Func, const char* Name) noexcept(true)
+		{
+			if (!Func)
+				return false;
+			if (End <= Begin)
+				return true;
+
+			auto data = (TaskSchedulerData*)GetData();
+			auto Workers = data ? data->WorkerCount() : 0;
+			auto Count = End - Begin;
+
+			// About 4 pieces per thread if not given
+			if (!Grain)
+				Grain = std::max<std::size_t>(1, Count / (((std::size_t)Workers + 1) * 4));
+
+			auto Pieces = (Count + Grain - 1) / Grain;
+			if ((Pieces == 1) || !Workers)
+				return CallTask(Name, [&]() { Func(Begin, End); });
+
+			TaskGroup Group(Name);
+			std::atomic_size_t Next{ 0 };
+
+			// The pieces are taken in turn, a worker busy with something else doesn't hold up the rest
+			auto Body = [&]()
+				{
+					for (auto Piece = Next++; (Piece < Pieces) && !Group.IsCanceled(); Piece = Next++)
+					{
+						auto PieceBegin = Begin + Piece * Grain;
+						Func(PieceBegin, std::min(PieceBegin + Grain, End));
+					}
+				};
+
+			auto Helpers = (std::uint32_t)std::min<std::size_t>(Pieces - 1, Workers);
+			for (std::uint32_t i = 0; i < Helpers; i++)
+				Group.Run(Body);
+
+			if (!CallTask(Name, Body))
+				Group.Cancel();
+
+			Group.Wait();
+			// A failed piece cancels the group, the pieces after it are skipped
+			return !Group.IsCanceled();
+		}
+
+		TaskScheduler* TaskScheduler::GetSingleton() noexcept(true)
+		{
+			return &stask_scheduler;
+		}
+	}
+}
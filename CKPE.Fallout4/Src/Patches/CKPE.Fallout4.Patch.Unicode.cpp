@@ -41,7 +41,8 @@ namespace CKPE
 				// The debug file without this option was more than 70 mb, compared to 2604 kb.
 				// Translation of fallout4.esm has become significantly faster.
 
-				if ((src == pre) || !IsValid(src) || !StringUtils::IsUtf8(src))
+				// ASCII is the same in any code page, it's returned untouched
+				if ((src == pre) || !IsValid(src) || StringUtils::IsASCII(src) || !StringUtils::IsUtf8(src))
 					return src;
 
 				std::string wincp_str = StringUtils::Utf8ToWinCP(src);
@@ -57,10 +57,27 @@ namespace CKPE
 						(1ull << ACTIVE_BIT_INDEX) | GetRefCount());
 				}
 
+				// Only if there is no handle yet, the ref count may change at the same time
+				[[nodiscard]] inline bool TrySetHandleEntryIndex(std::uint32_t HandleIndex) noexcept(true)
+				{
+					long Old = m_uiRefCount;
+					while (!((std::uint32_t)Old & (1ull << ACTIVE_BIT_INDEX)))
+					{
+						long New = (long)(std::uint32_t)(((std::uint64_t)HandleIndex << HANDLE_BIT_INDEX) |
+							(1ull << ACTIVE_BIT_INDEX) | ((std::uint32_t)Old & REF_COUNT_MASK));
+						long Prev = InterlockedCompareExchange(&m_uiRefCount, New, Old);
+						if (Prev == Old)
+							return true;
+						Old = Prev;
+					}
+
+					return false;
+				}
+
 				[[nodiscard]] inline std::uint32_t GetHandleEntryIndex() const noexcept(true)
 				{ return ((std::uint32_t)m_uiRefCount) >> HANDLE_BIT_INDEX; }
 				inline void ClearHandleEntryIndex() noexcept(true)
-				{ m_uiRefCount &= REF_COUNT_MASK; }
+				{ InterlockedAnd(&m_uiRefCount, (long)REF_COUNT_MASK); }
 				[[nodiscard]] inline bool IsHandleValid() const noexcept(true)
 				{ return ((std::uint32_t)m_uiRefCount & (1ull << ACTIVE_BIT_INDEX)) != 0; }
 			};
@@ -114,10 +131,27 @@ namespace CKPE
 						(1ull << ACTIVE_BIT_INDEX) | GetRefCount());
 				}
 
+				// Only if there is no handle yet, the ref count may change at the same time
+				[[nodiscard]] inline bool TrySetHandleEntryIndex(std::uint64_t HandleIndex) noexcept(true)
+				{
+					LONGLONG Old = m_uiRefCount;
+					while (!((std::uint64_t)Old & (1ull << ACTIVE_BIT_INDEX)))
+					{
+						LONGLONG New = (LONGLONG)((HandleIndex << HANDLE_BIT_INDEX) |
+							(1ull << ACTIVE_BIT_INDEX) | ((std::uint64_t)Old & REF_COUNT_MASK));
+						LONGLONG Prev = InterlockedCompareExchange64(&m_uiRefCount, New, Old);
+						if (Prev == Old)
+							return true;
+						Old = Prev;
+					}
+
+					return false;
+				}
+
 				[[nodiscard]] inline std::uint64_t GetHandleEntryIndex() const noexcept(true)
 				{ return ((std::uint64_t)m_uiRefCount) >> HANDLE_BIT_INDEX; }
 				inline void ClearHandleEntryIndex() noexcept(true)
-				{ m_uiRefCount &= REF_COUNT_MASK; }
+				{ InterlockedAnd64(&m_uiRefCount, (LONGLONG)REF_COUNT_MASK); }
 				[[nodiscard]] inline bool IsHandleValid() const noexcept(true)
 				{ return ((std::uint64_t)m_uiRefCount & (1ull << ACTIVE_BIT_INDEX)) != 0; }
 			};
@@ -0,0 +1,621 @@
+// Special thanks to Nukem: 
+// https://github.com/Nukem9/SkyrimSETest/blob/master/skyrim64_test/src/patches/CKSSE/BSPointerHandleManager.h
+// https://github.com/Nukem9/SkyrimSETest/blob/master/skyrim64_test/src/patches/CKSSE/BSPointerHandleManager.cpp
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <CKPE.CriticalSection.h>
+#include <CKPE.Asserts.h>
+#include <EditorAPI/NiAPI/NiPointer.h>
+
+namespace CKPE
+{
+	namespace SkyrimSE
+	{
+		namespace EditorAPI
+		{
+			using namespace NiAPI;
+
+			//
+			// The handles do not depend on the forms, HandleRef is any type with the interface of BSHandleRefObject
+			//
+			template<typename _Ty, int IndexBits = 20, int AgeCountBits = 6>
+			class IBSUntypedPointerHandle
+			{
+			public:
+				//
+				// NOTE: Handle index bits increased from 20 (vanilla) to 21 (limit doubled) or to 23 (limit doubled)
+				//
+				// 31       27       26    20             0
+				// |--------|--------|-----|--------------|
+				// | Unused | Active | Age | Handle Index |
+				// |--------|--------|-----|--------------|
+				//
+				constexpr static _Ty INDEX_BITS = IndexBits;
+				constexpr static _Ty AGE_BITS = AgeCountBits;
+				constexpr static _Ty UNUSED_BIT_START = INDEX_BITS + AGE_BITS;							// 26 in vanilla
+
+				constexpr static _Ty INDEX_MASK = (((_Ty)1) << INDEX_BITS) - ((_Ty)1);					// 0x00FFFFF
+				constexpr static _Ty AGE_MASK = ((((_Ty)1) << AGE_BITS) - ((_Ty)1)) << INDEX_BITS;		// 0x3F00000
+				constexpr static _Ty ACTIVE_BIT_MASK = ((_Ty)1) << UNUSED_BIT_START;					// 0x4000000
+
+				constexpr static _Ty MAX_HANDLE_COUNT = ((_Ty)1) << INDEX_BITS;
+
+			protected:
+				_Ty m_Bits;
+			public:
+				inline void SetBitwiseNull() { m_Bits = 0; }
+				inline bool IsBitwiseNull() const { return !m_Bits; }
+				inline _Ty GetIndex() const { return m_Bits & INDEX_MASK; }
+				inline _Ty GetAge() const { return m_Bits & AGE_MASK; }
+				inline void SetInUse() { m_Bits |= ACTIVE_BIT_MASK; }
+				inline void SetNotInUse() { m_Bits &= ~ACTIVE_BIT_MASK; }
+				inline bool IsInUse() const { return (m_Bits & ACTIVE_BIT_MASK) != 0; }
+				inline void IncrementAge() {
+					m_Bits = ((m_Bits << INDEX_BITS) & AGE_MASK) | (m_Bits & ~AGE_MASK);
+				}
+
+				void Set(_Ty Index, _Ty Age)
+				{
+					CKPE_ASSERT_MSG(Index < MAX_HANDLE_COUNT, "BSUntypedPointerHandle::Set - parameter Index is too large");
+
+					m_Bits = Index | Age;
+				}
+
+				void SetIndex(_Ty Index)
+				{
+					CKPE_ASSERT_MSG(Index < MAX_HANDLE_COUNT, "BSUntypedPointerHandle::Set - parameter Index is too large");
+
+					m_Bits = (Index & INDEX_MASK) | (m_Bits & ~INDEX_MASK);
+				}
+
+
+				IBSUntypedPointerHandle& operator=(const IBSUntypedPointerHandle& Other)
+				{
+					m_Bits = Other.m_Bits;
+					return *this;
+				}
+
+				bool operator==(const IBSUntypedPointerHandle& Other) const
+				{
+					return m_Bits == Other.m_Bits;
+				}
+
+				bool operator!=(const IBSUntypedPointerHandle& Other) const
+				{
+					return m_Bits != Other.m_Bits;
+				}
+
+				IBSUntypedPointerHandle() : m_Bits(0) {}
+			};
+			static_assert(sizeof(IBSUntypedPointerHandle<std::uint32_t>) == 0x4);
+
+			typedef IBSUntypedPointerHandle<std::uint32_t, 20, 6> BSUntypedPointerHandle_Original;
+			typedef IBSUntypedPointerHandle<std::uint32_t, 21, 6> BSUntypedPointerHandle_Extended;
+			typedef IBSUntypedPointerHandle<std::uint32_t, 23, 6> BSUntypedPointerHandle_Extended_Extremly;
+
+			template<typename _Ty, typename HandleType, typename HandleRef>
+			class IBSPointerHandleManagerEntry : public HandleType
+			{
+			private:
+				// Holds a reference as NiPointer would, the lookups read it at the same time as it is changed
+				HandleRef* m_Pointer{ nullptr };
+			public:
+				// The bits are changed with compare and swap, the lookups don't take a lock
+				[[nodiscard]] _Ty LoadBits() const
+				{
+					return std::atomic_ref<_Ty>(const_cast<_Ty&>(HandleType::m_Bits)).load(std::memory_order_acquire);
+				}
+
+				void StoreBits(_Ty Bits)
+				{
+					std::atomic_ref<_Ty>(HandleType::m_Bits).store(Bits, std::memory_order_release);
+				}
+
+				bool ExchangeBits(_Ty& Expected, _Ty Desired)
+				{
+					return std::atomic_ref<_Ty>(HandleType::m_Bits).compare_exchange_strong(Expected, Desired,
+						std::memory_order_acq_rel);
+				}
+
+				void SetNextFreeEntry(_Ty Index)
+				{
+					HandleType::m_Bits = (Index & HandleType::INDEX_MASK) | (HandleType::m_Bits & ~HandleType::INDEX_MASK);
+				}
+
+				_Ty GetNextFreeEntry() const
+				{
+					return HandleType::m_Bits & HandleType::INDEX_MASK;
+				}
+
+				void SetPointer(HandleRef* Pointer)
+				{
+					if (Pointer)
+						Pointer->IncRefCount();
+
+					auto Old = std::atomic_ref<HandleRef*>(m_Pointer).exchange(Pointer, std::memory_order_acq_rel);
+					if (Old)
+						Old->DecRefCount();
+				}
+
+				HandleRef* GetPointer() const
+				{
+					return std::atomic_ref<HandleRef*>(const_cast<HandleRef*&>(m_Pointer)).load(std::memory_order_acquire);
+				}
+
+				bool IsValid(_Ty Age) const
+				{
+					auto Bits = LoadBits();
+					return (Bits & HandleType::ACTIVE_BIT_MASK) && ((Bits & HandleType::AGE_MASK) == Age);
+				}
+			};
+
+			template<typename _Ty, typename HandleType, typename HandleRef>
+			class IBSPointerHandleManager
+			{
+			public:
+				constexpr static _Ty INVALID_INDEX = (_Ty)-1;
+				constexpr static _Ty FREE_BATCH_SIZE = 64;
+				constexpr static std::uint32_t FREE_RECLAIM_ROUNDS = 64;
+			protected:
+				struct FreeCache;
+
+				//
+				// The free indices are in a FIFO ring, so that an index is given out again as late as possible
+				// (the age has only 6 bits). Each thread takes them and gives them back in batches, so the lock
+				// of the ring is taken once per FREE_BATCH_SIZE creations or releases.
+				//
+				struct FreeRing
+				{
+					CriticalSection Section;
+					std::unique_ptr<_Ty[]> Indices;
+					std::uint64_t Head{ 0 };
+					std::uint64_t Tail{ 0 };
+					// The caches of all the threads, an empty ring takes back what they hold
+					std::vector<FreeCache*> Caches;
+
+					void Push(const _Ty* Items, _Ty Count)
+					{
+						for (_Ty i = 0; i < Count; i++)
+							Indices[(Tail++) % HandleType::MAX_HANDLE_COUNT] = Items[i];
+					}
+
+					_Ty Pop(_Ty* Items, _Ty Count)
+					{
+						_Ty Result = 0;
+						for (; (Result < Count) && (Head != Tail); Result++)
+							Items[Result] = Indices[(Head++) % HandleType::MAX_HANDLE_COUNT];
+						return Result;
+					}
+				};
+
+				//
+				// The lock of a cache is taken by its thread on each use and by the threads which found the ring
+				// empty, always before the lock of the ring (the latter only try it).
+				//
+				struct FreeCache
+				{
+					CriticalSection Section;
+					bool Registered{ false };
+					std::uint32_t Generation{ 0 };
+					_Ty AllocPos{ 0 };
+					_Ty AllocCount{ 0 };
+					_Ty ReleaseCount{ 0 };
+					_Ty Alloc[FREE_BATCH_SIZE];
+					_Ty Release[FREE_BATCH_SIZE];
+
+					// Left from before InitSDM
+					void Validate()
+					{
+						auto Current = FreeGeneration.load(std::memory_order_acquire);
+						if (Generation != Current)
+						{
+							Generation = Current;
+							AllocPos = AllocCount = ReleaseCount = 0;
+						}
+					}
+
+					// Everything it holds goes to the ring, under the locks of both
+					void MoveTo(FreeRing* Ring)
+					{
+						if (Generation == FreeGeneration.load(std::memory_order_acquire))
+						{
+							Ring->Push(Release, ReleaseCount);
+							Ring->Push(Alloc + AllocPos, AllocCount - AllocPos);
+						}
+
+						AllocPos = AllocCount = ReleaseCount = 0;
+					}
+
+					// The thread is gone, the indices it holds go back
+					~FreeCache()
+					{
+						auto Ring = FreeIndices.load(std::memory_order_acquire);
+						if (!Ring || !Registered)
+							return;
+
+						ScopeCriticalSection guard(Section);
+						ScopeCriticalSection ring_guard(Ring->Section);
+						MoveTo(Ring);
+						std::erase(Ring->Caches, this);
+					}
+				};
+
+				// Created once and never freed, the threads may give back their indices at any time up to the unload
+				inline static std::atomic<FreeRing*> FreeIndices{ nullptr };
+				inline static std::atomic<std::uint32_t> FreeGeneration{ 0 };
+				inline static thread_local FreeCache ThreadFreeCache;
+				inline static std::atomic<_Ty> UsedCount{ 0 };
+				inline static std::vector<IBSPointerHandleManagerEntry<_Ty, HandleType, HandleRef>> HandleEntries;
+				inline const static HandleType NullHandle;
+
+				// Under the lock of the ring, the caches which are busy right now are left for the next round
+				[[nodiscard]] static bool Reclaim(FreeRing* Ring, FreeCache& Own)
+				{
+					bool Busy = false;
+
+					for (auto Cache : Ring->Caches)
+					{
+						if (Cache == &Own)
+							continue;
+
+						if (!Cache->Section.TryLock())
+						{
+							Busy = true;
+							continue;
+						}
+
+						Cache->MoveTo(Ring);
+						Cache->Section.Unlock();
+					}
+
+					return Busy;
+				}
+
+				// The ring has to know the cache before it holds anything
+				static void Register(FreeRing* Ring, FreeCache& Cache)
+				{
+					if (Cache.Registered)
+						return;
+
+					ScopeCriticalSection ring_guard(Ring->Section);
+					Ring->Caches.push_back(&Cache);
+					Cache.Registered = true;
+				}
+
+				static _Ty AllocIndex()
+				{
+					auto Ring = FreeIndices.load(std::memory_order_acquire);
+					if (!Ring)
+						return INVALID_INDEX;
+
+					auto& Cache = ThreadFreeCache;
+					ScopeCriticalSection guard(Cache.Section);
+					Cache.Validate();
+					Register(Ring, Cache);
+
+					for (std::uint32_t Round = 0; Cache.AllocPos == Cache.AllocCount; Round++)
+					{
+						{
+							ScopeCriticalSection ring_guard(Ring->Section);
+							Cache.Validate();
+
+							// Own released ones go to the end of the queue first, they are the last to be taken
+							Ring->Push(Cache.Release, Cache.ReleaseCount);
+							Cache.ReleaseCount = 0;
+
+							Cache.AllocPos = 0;
+							Cache.AllocCount = Ring->Pop(Cache.Alloc, FREE_BATCH_SIZE);
+
+							// The rest of the free ones are in the caches of the other threads
+							if (!Cache.AllocCount)
+							{
+								auto Busy = Reclaim(Ring, Cache);
+								Cache.AllocCount = Ring->Pop(Cache.Alloc, FREE_BATCH_SIZE);
+
+								if (!Cache.AllocCount && (!Busy || (Round >= FREE_RECLAIM_ROUNDS)))
+									return INVALID_INDEX;
+							}
+						}
+
+						if (!Cache.AllocCount)
+							SwitchToThread();
+					}
+
+					UsedCount++;
+					return Cache.Alloc[Cache.AllocPos++];
+				}
+
+				static void ReleaseIndex(_Ty Index)
+				{
+					auto Ring = FreeIndices.load(std::memory_order_acquire);
+					auto& Cache = ThreadFreeCache;
+					ScopeCriticalSection guard(Cache.Section);
+					Cache.Validate();
+					Register(Ring, Cache);
+
+					UsedCount--;
+					Cache.Release[Cache.ReleaseCount++] = Index;
+
+					if (Cache.ReleaseCount == FREE_BATCH_SIZE)
+					{
+						ScopeCriticalSection ring_guard(Ring->Section);
+
+						// InitSDM was faster, the index is free in the new ring already
+						Cache.Validate();
+						Ring->Push(Cache.Release, Cache.ReleaseCount);
+						Cache.ReleaseCount = 0;
+					}
+				}
+
+				// Every active entry is released, the lock of the lookups is held by the caller
+				static void ReleaseAll()
+				{
+					for (_Ty i = 0; i < HandleType::MAX_HANDLE_COUNT; i++)
+					{
+						auto& arrayHandle = HandleEntries[i];
+
+						auto Bits = arrayHandle.LoadBits();
+						if (!(Bits & HandleType::ACTIVE_BIT_MASK) ||
+							!arrayHandle.ExchangeBits(Bits, Bits & ~HandleType::ACTIVE_BIT_MASK))
+							continue;
+
+						if (arrayHandle.GetPointer())
+							arrayHandle.GetPointer()->ClearHandleEntryIndex();
+
+						arrayHandle.SetPointer(nullptr);
+						ReleaseIndex(i);
+					}
+				}
+
+				[[nodiscard]] static _Ty NextAge(_Ty Index, _Ty Bits)
+				{
+					_Ty Age = (Bits + (((_Ty)1) << HandleType::INDEX_BITS)) & HandleType::AGE_MASK;
+
+					// Index 0 of age 0 is the null handle
+					if (!Index && !Age)
+						Age = ((_Ty)1) << HandleType::INDEX_BITS;
+
+					return Age;
+				}
+			public:
+				// The next indices to be given out and the last one given back
+				inline static _Ty GetHead()
+				{
+					auto Ring = FreeIndices.load(std::memory_order_acquire);
+					if (!Ring)
+						return INVALID_INDEX;
+
+					ScopeCriticalSection guard(Ring->Section);
+					return (Ring->Head != Ring->Tail) ? Ring->Indices[Ring->Head % HandleType::MAX_HANDLE_COUNT] :
+						INVALID_INDEX;
+				}
+
+				inline static _Ty GetTail()
+				{
+					auto Ring = FreeIndices.load(std::memory_order_acquire);
+					if (!Ring)
+						return INVALID_INDEX;
+
+					ScopeCriticalSection guard(Ring->Section);
+					return (Ring->Head != Ring->Tail) ? Ring->Indices[(Ring->Tail - 1) % HandleType::MAX_HANDLE_COUNT] :
+						INVALID_INDEX;
+				}
+
+				inline static _Ty GetUsedCount() { return UsedCount; }
+
+				static void InitSDM()
+				{
+					HandleEntries.resize(HandleType::MAX_HANDLE_COUNT);
+
+					// Again after KillSDM, the same ring is filled anew
+					auto Ring = FreeIndices.load(std::memory_order_acquire);
+					if (!Ring)
+					{
+						Ring = new FreeRing;
+						Ring->Indices = std::make_unique<_Ty[]>(HandleType::MAX_HANDLE_COUNT);
+					}
+
+					ScopeCriticalSection guard(Ring->Section);
+
+					for (_Ty i = 0; i < HandleType::MAX_HANDLE_COUNT; i++)
+					{
+						HandleEntries[i].StoreBits(i);
+						Ring->Indices[i] = i;
+					}
+
+					Ring->Head = 0;
+					Ring->Tail = HandleType::MAX_HANDLE_COUNT;
+					UsedCount = 0;
+
+					// The caches of the threads are dropped on their next use
+					FreeGeneration++;
+					FreeIndices.store(Ring, std::memory_order_release);
+				}
+			};
+
+			template<typename ObjectType, typename HandleType, typename Manager>
+			class IBSPointerHandleManagerInterface : public Manager
+			{
+				// The one who clears the active bit owns the release
+				static void Release(const HandleType& Handle)
+				{
+					const auto handleIndex = Handle.GetIndex();
+					auto& arrayHandle = Manager::HandleEntries[handleIndex];
+
+					auto Bits = arrayHandle.LoadBits();
+					while ((Bits & HandleType::ACTIVE_BIT_MASK) && ((Bits & HandleType::AGE_MASK) == Handle.GetAge()))
+					{
+						if (!arrayHandle.ExchangeBits(Bits, Bits & ~HandleType::ACTIVE_BIT_MASK))
+							continue;
+
+						if (arrayHandle.GetPointer())
+							arrayHandle.GetPointer()->ClearHandleEntryIndex();
+
+						arrayHandle.SetPointer(nullptr);
+						Manager::ReleaseIndex(handleIndex);
+						break;
+					}
+				}
+			public:
+				static HandleType GetCurrentHandle(ObjectType* Refr)
+				{
+					HandleType untypedHandle;
+
+					if (Refr && Refr->IsHandleValid())
+					{
+						auto handleIndex = (std::uint32_t)Refr->GetHandleEntryIndex();
+						auto& handle = Manager::HandleEntries[handleIndex];
+						auto Bits = handle.LoadBits();
+
+						// Being released right now
+						if ((Bits & HandleType::ACTIVE_BIT_MASK) && (handle.GetPointer() == Refr))
+							untypedHandle.Set(handleIndex, Bits & HandleType::AGE_MASK);
+					}
+
+					return untypedHandle;
+				}
+
+				static HandleType CreateHandle(ObjectType* Refr)
+				{
+					HandleType untypedHandle;
+
+					if (!Refr)
+						return untypedHandle;
+
+					// Shortcut: Check if the handle is already valid
+					untypedHandle = GetCurrentHandle(Refr);
+
+					if (untypedHandle != Manager::NullHandle)
+						return untypedHandle;
+
+					auto handleIndex = Manager::AllocIndex();
+					if (handleIndex == Manager::INVALID_INDEX)
+					{
+						CKPE_ASSERT_MSG_FMT(false, "OUT OF HANDLE ARRAY ENTRIES. Null handle created for pointer 0x%p.", Refr);
+						return untypedHandle;
+					}
+
+					// The entry is ready before the ref points to it
+					auto& newHandle = Manager::HandleEntries[handleIndex];
+					auto Age = Manager::NextAge(handleIndex, newHandle.LoadBits());
+					newHandle.SetPointer(Refr);
+					newHandle.StoreBits(handleIndex | Age | HandleType::ACTIVE_BIT_MASK);
+
+					for (std::uint32_t Spins = 0; !Refr->TrySetHandleEntryIndex(handleIndex); Spins++)
+					{
+						// Someone else was faster
+						untypedHandle = GetCurrentHandle(Refr);
+
+						if (untypedHandle != Manager::NullHandle)
+						{
+							newHandle.StoreBits(handleIndex | Age);
+							newHandle.SetPointer(nullptr);
+							Manager::ReleaseIndex(handleIndex);
+
+							return untypedHandle;
+						}
+
+						// Or is still releasing the old one, it may have been preempted between clearing the active bit
+						// and the index of the ref, so wait as long as it takes and give it the CPU
+						if (Spins < 64)
+							YieldProcessor();
+						else if (Spins < 1024)
+							SwitchToThread();
+						else
+							Sleep(0);
+					}
+
+					untypedHandle.Set(handleIndex, Age);
+					return untypedHandle;
+				}
+
+				static void Destroy1(const HandleType& Handle)
+				{
+					if (Handle.IsBitwiseNull())
+						return;
+
+					Release(Handle);
+				}
+
+				static void Destroy2(HandleType& Handle)
+				{
+					if (Handle.IsBitwiseNull())
+						return;
+
+					Release(Handle);
+
+					// Identical to Destroy1 except for this Handle.SetBitwiseNull();
+					Handle.SetBitwiseNull();
+				}
+
+				static bool GetSmartPointer1(const HandleType& Handle, NiPointer<ObjectType>& Out)
+				{
+					if (Handle.IsBitwiseNull())
+					{
+						Out = nullptr;
+						return false;
+					}
+
+					const auto handleIndex = Handle.GetIndex();
+					auto& arrayHandle = Manager::HandleEntries[handleIndex];
+
+					if (!arrayHandle.IsValid(Handle.GetAge()))
+					{
+						Out = nullptr;
+						return false;
+					}
+
+					Out = static_cast<ObjectType*>(arrayHandle.GetPointer());
+
+					if (!Out || (Out->GetHandleEntryIndex() != handleIndex))
+						Out = nullptr;
+
+					return Out != nullptr;
+				}
+
+				static bool GetSmartPointer2(HandleType& Handle, NiPointer<ObjectType>& Out)
+				{
+					if (!GetSmartPointer1(Handle, Out))
+					{
+						// Identical to GetSmartPointer1 except for this Handle.SetBitwiseNull();
+						Handle.SetBitwiseNull();
+						return false;
+					}
+
+					return true;
+				}
+
+				static ObjectType* GetPointer(std::uint32_t UniqueId)
+				{
+					const auto handleIndex = UniqueId & HandleType::INDEX_MASK;
+					auto& arrayHandle = Manager::HandleEntries[handleIndex];
+					auto Out = static_cast<ObjectType*>(arrayHandle.GetPointer());
+
+					if (!Out || (Out->GetHandleEntryIndex() != handleIndex))
+						Out = nullptr;
+
+					return Out;
+				}
+
+				static bool IsValid(const HandleType& Handle)
+				{
+					const auto handleIndex = Handle.GetIndex();
+					auto& arrayHandle = Manager::HandleEntries[handleIndex];
+
+					// Handle.IsBitwiseNull(); -- This if() is optimized away because the result is irrelevant
+
+					if (!arrayHandle.IsValid(Handle.GetAge()))
+						return false;
+
+					auto Pointer = arrayHandle.GetPointer();
+					return Pointer && (Pointer->GetHandleEntryIndex() == handleIndex);
+				}
+			};
+		}
+	}
+}
\ No newline at end of file
@@ -59,6 +59,8 @@ namespace CKPE
 				inline void UnlockUpdateLists() noexcept(true) { lock = false; }
 				void UpdateCellList() noexcept(true);
 				void UpdateObjectList() noexcept(true);
+				// Forget the indexed cells, called before the data is loaded again
+				static void ClearFilterIndex() noexcept(true);
 			};
 		}
 	}
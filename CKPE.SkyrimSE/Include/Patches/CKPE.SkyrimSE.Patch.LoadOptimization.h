@@ -26,6 +26,10 @@ namespace CKPE
 				virtual const char* GetOptionName() const noexcept(true);
 				virtual bool HasDependencies() const noexcept(true);
 				virtual std::vector<std::string> GetDependencies() const noexcept(true);
+
+				// Records inflated and the decompressor allocations saved by keeping one per thread
+				[[nodiscard]] static std::uint64_t GetInflateCount() noexcept(true);
+				[[nodiscard]] static std::uint64_t GetDecompressorAllocsAvoided() noexcept(true);
 			};
 		}
 	}
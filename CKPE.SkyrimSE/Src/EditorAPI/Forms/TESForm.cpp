@@ -48,7 +48,8 @@ namespace CKPE
 
 				const char* TESForm::TryGetFullName() const noexcept(true)
 				{
-					TESFullName* fullname = (TESFullName*)_DYNAMIC_CAST(this, 0, "class TESForm", "class TESFullName");
+					static Common::CastHandle<TESForm, TESFullName> FormToFullName("class TESForm", "class TESFullName");
+					TESFullName* fullname = FormToFullName(this);
 					return fullname ? fullname->GetFullName() : "";
 				}
 			}
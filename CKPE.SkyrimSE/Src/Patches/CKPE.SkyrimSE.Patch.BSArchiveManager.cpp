@@ -3,6 +3,7 @@
 // License: https://www.gnu.org/licenses/lgpl-3.0.html
 
 #include <windows.h>
+#include <unordered_set>
 #include <CKPE.Detours.h>
 #include <CKPE.SafeWrite.h>
 #include <CKPE.Asserts.h>
@@ -23,7 +24,8 @@ namespace CKPE
 		namespace Patch
 		{
 			std::vector<const EditorAPI::TESFile*> g_SelectedFilesArray;
-			std::vector<EditorAPI::BSString*> g_arrayArchivesAvailable;
+			// Lower case names
+			std::unordered_set<std::string> g_arrayArchivesAvailable;
 			std::uintptr_t pointer_BSArchiveManagerModded_sub = 0;
 			bool loaded_BSArchiveManagerModded_active = false;
 
@@ -61,6 +63,15 @@ namespace CKPE
 					return OldLooseLoadArchive(Loose, file_name, Unk1, Unk2);
 				}
 
+				[[nodiscard]] static std::string GetArchiveKey(const std::string& file_name)
+				{
+					auto key = StringUtils::Trim(file_name);
+					for (auto& ch : key)
+						if ((ch >= 'A') && (ch <= 'Z'))
+							ch += 'a' - 'A';
+					return key;
+				}
+
 				static void LoadArchive(const char* file_name)
 				{
 					if (EditorAPI::BSString::Utils::FileExists(EditorAPI::BSString::Utils::GetDataPath() + file_name))
@@ -78,7 +89,7 @@ namespace CKPE
 					{
 						do
 						{
-							g_arrayArchivesAvailable.push_back(new EditorAPI::BSString(FileFindData.cFileName));
+							g_arrayArchivesAvailable.insert(GetArchiveKey(FileFindData.cFileName));
 						} while (FindNextFile(hFindFile, &FileFindData));
 					}
 
@@ -96,20 +107,7 @@ namespace CKPE
 							{
 								do 
 								{
-									auto index = g_arrayArchivesAvailable.begin();
-									auto fname = StringUtils::Trim(stoken);
-
-									for (; index != g_arrayArchivesAvailable.end(); index++)
-									{
-										if (!_stricmp(fname.c_str(), (*index)->c_str()))
-											break;
-									}
-
-									if (index != g_arrayArchivesAvailable.end())
-									{
-										delete* index;
-										g_arrayArchivesAvailable.erase(index);
-									}
+									g_arrayArchivesAvailable.erase(GetArchiveKey(stoken));
 
 									stoken = strtok(NULL, ",");
 								} while (stoken);
@@ -194,16 +192,7 @@ namespace CKPE
 
 				static bool IsAvailableForLoad(LPCSTR ArchiveName)
 				{
-					auto index = g_arrayArchivesAvailable.begin();
-					auto fname = StringUtils::Trim(ArchiveName);
-
-					for (; index != g_arrayArchivesAvailable.end(); index++)
-					{
-						if (!_stricmp(fname.c_str(), (*index)->c_str()))
-							break;
-					}
-
-					return index != g_arrayArchivesAvailable.end();
+					return g_arrayArchivesAvailable.contains(GetArchiveKey(ArchiveName));
 				}
 			};
 
@@ -9,6 +9,7 @@
 #include <CKPE.Application.h>
 #include <CKPE.Common.Interface.h>
 #include <CKPE.Common.EditorUI.h>
+#include <CKPE.Common.SearchIndex.h>
 #include <CKPE.SkyrimSE.VersionLists.h>
 #include <EditorAPI/BSString.h>
 #include <EditorAPI/NiAPI/NiMemoryManager.h>
@@ -18,6 +19,9 @@
 
 #include <commctrl.h>
 #include <shlwapi.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
 
 #define UI_CELL_VIEW_ADD_CELL_ITEM					2579
 #define UI_CELL_VIEW_ADD_CELL_OBJECT_ITEM			2583
@@ -27,6 +31,7 @@
 #define UI_CELL_VIEW_VISIBLE_CELL_OBJECTS_CHECKBOX	5666	
 #define UI_CELL_VIEW_FILTER_CELL					2584	
 #define UI_CELL_VIEW_GO_BUTTON						3681
+#define UI_CELL_VIEW_FILTER_READY					(WM_USER + 34401)
 
 #define UI_CELL_VIEW_FILTER_CELL_SIZE				1024
 
@@ -42,6 +47,126 @@ namespace CKPE
 			char* str_CellViewWindow_Filter = nullptr;
 			char* str_CellViewWindow_FilterUser = nullptr;
 
+			// The cells are indexed in every listing, the filter is then looked up in the index off the UI thread,
+			// and the listing only checks the matches
+			struct CellViewWindowIndexStamp
+			{
+				std::uint32_t FormID;
+				const char* EditorID;
+				const char* FullName;
+				std::uint32_t Serial;
+			};
+
+			static Common::SearchIndex CellViewWindow_Index;
+			static std::unordered_map<const void*, CellViewWindowIndexStamp> CellViewWindow_IndexStamps;
+			static Common::TaskGroup* CellViewWindow_FilterTask = nullptr;
+			// Canceled and not done yet, deleted when they are (the delete would wait on the UI thread)
+			static std::vector<Common::TaskGroup*> CellViewWindow_CanceledTasks;
+			static std::atomic_uint32_t CellViewWindow_FilterGeneration{ 0 };
+			static CriticalSection CellViewWindow_FilterSection;
+			static std::vector<std::uintptr_t> CellViewWindow_FilterPending;
+			static std::unordered_set<std::uintptr_t> CellViewWindow_FilterMatches;
+			static bool CellViewWindow_FilterReady = false;
+			// The matches know the cells indexed up to this one
+			static std::uint32_t CellViewWindow_FilterSerial = 0;
+			static std::uint32_t CellViewWindow_IndexSerial = 0;
+
+			// When the current text was indexed, 0 if it's just now, then the text is in str_CellViewWindow_Filter
+			static std::uint32_t CellViewWindow_IndexCell(const EditorAPI::Forms::TESForm* form,
+				const char* editorID) noexcept(true)
+			{
+				CellViewWindowIndexStamp stamp{ form->FormID, editorID, form->FullName, 0 };
+				CellViewWindowIndexStamp* current = nullptr;
+
+				try
+				{
+					current = &CellViewWindow_IndexStamps[form];
+				}
+				catch (const std::exception&)
+				{}
+
+				// A renamed cell gets new strings, the same address may be another cell after the reload
+				if (current && (current->FormID == stamp.FormID) && (current->EditorID == stamp.EditorID) &&
+					(current->FullName == stamp.FullName))
+					return current->Serial;
+
+				sprintf_s(str_CellViewWindow_Filter, UI_CELL_VIEW_FILTER_CELL, "%s %08X %s",
+					editorID, stamp.FormID, stamp.FullName);
+
+				if (current)
+				{
+					stamp.Serial = ++CellViewWindow_IndexSerial;
+					*current = stamp;
+					CellViewWindow_Index.Add((std::uintptr_t)form, str_CellViewWindow_Filter);
+				}
+
+				return 0;
+			}
+
+			static void CellViewWindow_CancelFilter() noexcept(true)
+			{
+				CellViewWindow_FilterGeneration++;
+				CellViewWindow_FilterReady = false;
+
+				std::erase_if(CellViewWindow_CanceledTasks, [](auto Task)
+					{
+						if (!Task->IsDone())
+							return false;
+						delete Task;
+						return true;
+					});
+
+				if (CellViewWindow_FilterTask)
+				{
+					// The query gives up at the next check
+					CellViewWindow_FilterTask->Cancel();
+
+					try
+					{
+						CellViewWindow_CanceledTasks.push_back(CellViewWindow_FilterTask);
+					}
+					catch (const std::exception&)
+					{
+						delete CellViewWindow_FilterTask;
+					}
+
+					CellViewWindow_FilterTask = nullptr;
+				}
+			}
+
+			static void CellViewWindow_StartFilter(HWND Hwnd, const char* Pattern) noexcept(true)
+			{
+				CellViewWindow_CancelFilter();
+
+				try
+				{
+					auto Generation = CellViewWindow_FilterGeneration.load();
+					auto Serial = CellViewWindow_IndexSerial;
+					auto Task = new Common::TaskGroup("CellViewFilter");
+					CellViewWindow_FilterTask = Task;
+
+					Task->Run([Hwnd, Task, Generation, Serial, Text = std::string(Pattern)]()
+						{
+							std::vector<std::uintptr_t> Result;
+							if (!CellViewWindow_Index.Query(Text, Result, Task) ||
+								(Generation != CellViewWindow_FilterGeneration))
+								return;
+
+							{
+								ScopeCriticalSection guard(CellViewWindow_FilterSection);
+								CellViewWindow_FilterPending = std::move(Result);
+							}
+
+							PostMessageA(Hwnd, UI_CELL_VIEW_FILTER_READY, (WPARAM)Generation, (LPARAM)Serial);
+						});
+				}
+				catch (const std::exception&)
+				{
+					// Filtered in the listing as before
+					CellViewWindow::Singleton->UpdateCellList();
+				}
+			}
+
 			CellViewWindow::CellViewWindow() : Common::PatchBaseWindow()
 			{
 				SetName("Cell View Window");
@@ -234,6 +359,20 @@ namespace CKPE
 					SendMessageA(Handle, WM_COMMAND, MAKEWPARAM(2083, 1), 0);
 			}
 
+			void CellViewWindow::ClearFilterIndex() noexcept(true)
+			{
+				// The forms of the previous load are freed, their addresses are taken by the new ones
+				CellViewWindow_CancelFilter();
+				CellViewWindow_Index.Clear();
+				CellViewWindow_IndexStamps.clear();
+				CellViewWindow_FilterMatches.clear();
+				CellViewWindow_FilterSerial = 0;
+				CellViewWindow_IndexSerial = 0;
+
+				ScopeCriticalSection guard(CellViewWindow_FilterSection);
+				CellViewWindow_FilterPending.clear();
+			}
+
 			void CellViewWindow::UpdateObjectList() noexcept(true)
 			{
 				if (!lock)
@@ -330,6 +469,14 @@ namespace CKPE
 						if (iLen)
 							GetWindowTextA(hFilter, str_CellViewWindow_FilterUser, iLen + 1);
 
+						// The index is filled by the listings while the first chars are typed
+						if ((iLen > 2) && CellViewWindow_Index.GetCount())
+						{
+							CellViewWindow_StartFilter(Hwnd, str_CellViewWindow_FilterUser);
+							return 1;
+						}
+
+						CellViewWindow_CancelFilter();
 						CellViewWindow::Singleton->UpdateCellList();
 						return 1;
 					}
@@ -353,15 +500,21 @@ namespace CKPE
 					if (static_cast<bool>(GetPropA(Hwnd, Common::EditorUI::UI_USER_DATA_ACTIVE_CELLS_ONLY)))
 						*allowInsert = form->Active;
 
+					auto editorID = form->EditorID;
+					auto indexed = editorID ? CellViewWindow_IndexCell(form, editorID) : 0;
+
 					// Skip if a filter is installed and the form does not meet the requirements
-					if (*allowInsert && 
+					if (*allowInsert && editorID &&
 						reinterpret_cast<std::int32_t>(GetPropA(Hwnd, Common::EditorUI::UI_USER_DATA_FILTER_CELLS_LEN)) > 2)
 					{
-						auto editorID = form->EditorID;
-						if (editorID)
+						if (indexed && CellViewWindow_FilterReady && (indexed <= CellViewWindow_FilterSerial))
+							*allowInsert = CellViewWindow_FilterMatches.contains((std::uintptr_t)form);
+						else
 						{
-							sprintf_s(str_CellViewWindow_Filter, UI_CELL_VIEW_FILTER_CELL, "%s %08X %s",
-								editorID, form->FormID, form->FullName);
+							// New or renamed, not known by the query
+							if (indexed)
+								sprintf_s(str_CellViewWindow_Filter, UI_CELL_VIEW_FILTER_CELL, "%s %08X %s",
+									editorID, form->FormID, form->FullName);
 
 							*allowInsert = StrStrIA(str_CellViewWindow_Filter, str_CellViewWindow_FilterUser) != 0;
 						}
@@ -369,6 +522,25 @@ namespace CKPE
 
 					return 1;
 				}
+				else if (Message == UI_CELL_VIEW_FILTER_READY)
+				{
+					// The text has changed again since
+					if ((std::uint32_t)wParam != CellViewWindow_FilterGeneration)
+						return 1;
+
+					{
+						ScopeCriticalSection guard(CellViewWindow_FilterSection);
+
+						CellViewWindow_FilterMatches.clear();
+						CellViewWindow_FilterMatches.insert(CellViewWindow_FilterPending.begin(), CellViewWindow_FilterPending.end());
+						CellViewWindow_FilterPending.clear();
+					}
+
+					CellViewWindow_FilterSerial = (std::uint32_t)lParam;
+					CellViewWindow_FilterReady = true;
+					CellViewWindow::Singleton->UpdateCellList();
+					return 1;
+				}
 				else if (Message == UI_CELL_VIEW_ADD_CELL_OBJECT_ITEM)
 				{
 					auto form = reinterpret_cast<const EditorAPI::Forms::TESForm*>(wParam);
@@ -5,17 +5,22 @@
 #include <windows.h>
 #include <CKPE.Detours.h>
 #include <CKPE.Graphics.h>
+#include <CKPE.PathUtils.h>
 #include <CKPE.Application.h>
 #include <CKPE.Common.UIVarCommon.h>
 #include <CKPE.Common.Interface.h>
 #include <CKPE.Common.UIListView.h>
+#include <CKPE.Common.PluginHeaderScanner.h>
 #include <CKPE.SkyrimSE.VersionLists.h>
 #include <EditorAPI/TESFile.h>
 #include <Patches/CKPE.SkyrimSE.Patch.DataWindow.h>
+#include <Patches/CKPE.SkyrimSE.Patch.CellViewWindow.h>
 #include "../CKPE.Common/resource.h"
 
 #include <richedit.h>
 #include <commctrl.h>
+#include <atomic>
+#include <thread>
 
 #define UI_DATA_DIALOG_PLUGINLISTVIEW		1056
 #define UI_DATA_DIALOG_FILTERBOX			1003	// See: resource.rc
@@ -74,6 +79,36 @@ namespace CKPE
 				return true;
 			}
 
+			// Set while the headers are read, the list is repainted when they are
+			static std::atomic_bool sScanPending{ false };
+			static std::atomic<HWND> sScanList{ nullptr };
+
+			static void StartPluginScan(HWND ListHandle) noexcept(true)
+			{
+				// The dialog opened again, the running scan repaints the new list
+				sScanList = ListHandle;
+				if (sScanPending.exchange(true))
+					return;
+
+				try
+				{
+					std::thread([]()
+						{
+							Common::PluginHeaderScanner::GetSingleton()->Scan(PathUtils::GetDataPath());
+							sScanPending = false;
+
+							// The dialog may be closed already
+							auto ListHandle = sScanList.load();
+							if (IsWindow(ListHandle))
+								InvalidateRect(ListHandle, nullptr, FALSE);
+						}).detach();
+				}
+				catch (const std::exception&)
+				{
+					sScanPending = false;
+				}
+			}
+
 			INT_PTR CALLBACK DataWindow::HKWndProc(HWND Hwnd, UINT Message, WPARAM wParam, LPARAM lParam)
 			{
 				if (Message == WM_INITDIALOG)
@@ -86,6 +121,9 @@ namespace CKPE
 					_This->m_hWnd = Hwnd;
 					_This->m_pluginList = pluginListHandle;
 
+					// The headers for the owner-draw, read in parallel while the dialog is already shown
+					StartPluginScan(pluginListHandle);
+
 					_This->Style = WS_OVERLAPPED | WS_CAPTION | WS_BORDER | WS_SYSMENU;
 
 					// Subscribe to notifications when the user types in the filter text box
@@ -211,6 +249,9 @@ namespace CKPE
 
 						return 1;
 					}
+					else if (LOWORD(wParam) == IDOK)
+						// The files are loaded again, the cells indexed for the filter are gone
+						CellViewWindow::ClearFilterIndex();
 				}
 
 				return CallWindowProc(DataWindow::Singleton->GetOldWndProc(), Hwnd, Message, wParam, lParam);
@@ -222,8 +263,17 @@ namespace CKPE
 				CRECT rc = lpDrawItem->rcItem;
 				Canvas canvas(lpDrawItem->hDC);
 
-				auto type = EditorAPI::TESFile::GetTypeFile(
-					(EditorAPI::BSString::Utils::GetRelativeDataPath() + lpstrFileName).Get());
+				// Called on every paint, the file is opened only if it appeared after the scan
+				std::uint32_t type = 0;
+				if (!Common::PluginHeaderScanner::GetSingleton()->GetFlags(lpstrFileName, type))
+				{
+					// Not read yet, painted again after the scan
+					if (sScanPending)
+						return;
+
+					type = EditorAPI::TESFile::GetTypeFile(
+						(EditorAPI::BSString::Utils::GetRelativeDataPath() + lpstrFileName).Get());
+				}
 				if ((type & EditorAPI::TESFile::FILE_RECORD_ESM) == EditorAPI::TESFile::FILE_RECORD_ESM)
 					canvas.FillWithTransparent(rc, RGB(255, 0, 0), 10);
 				else if ((type & EditorAPI::TESFile::FILE_RECORD_ESL) == EditorAPI::TESFile::FILE_RECORD_ESL)
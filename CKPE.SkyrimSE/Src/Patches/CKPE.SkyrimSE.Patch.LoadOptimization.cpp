@@ -5,12 +5,16 @@
 #include <windows.h>
 #include <libdeflate.h>
 #include <intrin.h>
+#include <atomic>
+#include <vector>
 #include <CKPE.Detours.h>
 #include <CKPE.SafeWrite.h>
 #include <CKPE.HardwareInfo.h>
 #include <CKPE.Asserts.h>
 #include <CKPE.Application.h>
 #include <CKPE.Common.Interface.h>
+#include <CKPE.Common.DirectorySnapshot.h>
+#include <CKPE.Common.ArrayIndex.h>
 #include <CKPE.SkyrimSE.VersionLists.h>
 #include <EditorAPI/BSTArray.h>
 #include <Patches/CKPE.SkyrimSE.Patch.ProgressWindow.h>
@@ -54,14 +58,47 @@ namespace CKPE
 				return 0;
 			}
 
+			static std::atomic_uint64_t InflateCount = 0;
+			static std::atomic_uint64_t DecompressorAllocCount = 0;
+
+			// The decompressor keeps no state between calls, so one per thread is enough, freed when the thread ends
+			struct ThreadDecompressor
+			{
+				libdeflate_decompressor* Handle{ nullptr };
+
+				~ThreadDecompressor() noexcept(true)
+				{
+					if (Handle)
+						libdeflate_free_decompressor(Handle);
+				}
+
+				[[nodiscard]] libdeflate_decompressor* Get() noexcept(true)
+				{
+					if (!Handle)
+					{
+						Handle = libdeflate_alloc_decompressor();
+						if (Handle) DecompressorAllocCount++;
+					}
+
+					return Handle;
+				}
+			};
+
+			thread_local ThreadDecompressor CachedDecompressor;
+
 			static std::int32_t HKInflate(z_stream_s* Stream, std::int32_t Flush) noexcept(true)
 			{
 				std::size_t outBytes = 0;
-				libdeflate_decompressor* decompressor = libdeflate_alloc_decompressor();
+				libdeflate_decompressor* decompressor = CachedDecompressor.Get();
+
+				// Z_MEM_ERROR
+				if (!decompressor)
+					return -4;
+
+				InflateCount++;
 
 				libdeflate_result result = libdeflate_zlib_decompress(decompressor, Stream->next_in,
 					Stream->avail_in, Stream->next_out, Stream->avail_out, &outBytes);
-				libdeflate_free_decompressor(decompressor);
 
 				if (result == LIBDEFLATE_SUCCESS)
 				{
@@ -134,6 +171,29 @@ namespace CKPE
 				return status;
 			}
 
+			// false if there's surely no such file, the attributes stay invalid if the snapshot doesn't know
+			static bool FileAttributesFromSnapshot(const char* CanonicalFullPath, WIN32_FILE_ATTRIBUTE_DATA& fileInfo) noexcept(true)
+			{
+				Common::DirectorySnapshot::FileInfo Info;
+
+				switch (Common::DirectorySnapshot::GetSingleton()->Find(CanonicalFullPath, &Info))
+				{
+				case Common::DirectorySnapshot::rNotFound:
+					return false;
+				case Common::DirectorySnapshot::rFound:
+					fileInfo.dwFileAttributes = Info.Attributes;
+					fileInfo.nFileSizeLow = (DWORD)Info.Size;
+					fileInfo.nFileSizeHigh = (DWORD)(Info.Size >> 32);
+					fileInfo.ftLastWriteTime.dwLowDateTime = (DWORD)Info.WriteTime;
+					fileInfo.ftLastWriteTime.dwHighDateTime = (DWORD)(Info.WriteTime >> 32);
+					break;
+				default:
+					break;
+				}
+
+				return true;
+			}
+
 			static bool BSResource_LooseFileLocation_FileExists(const char* CanonicalFullPath, std::uint32_t* TotalSize)
 			{
 				WIN32_FILE_ATTRIBUTE_DATA fileInfo
@@ -163,6 +223,9 @@ namespace CKPE
 					}
 				}
 
+				if ((fileInfo.dwFileAttributes == INVALID_FILE_ATTRIBUTES) && !FileAttributesFromSnapshot(CanonicalFullPath, fileInfo))
+					return false;
+
 				if (fileInfo.dwFileAttributes == INVALID_FILE_ATTRIBUTES)
 				{
 					// Cache miss
@@ -213,6 +276,9 @@ namespace CKPE
 					}
 				}
 
+				if ((fileInfo.dwFileAttributes == INVALID_FILE_ATTRIBUTES) && !FileAttributesFromSnapshot(CanonicalFullPath, fileInfo))
+					return false;
+
 				if (fileInfo.dwFileAttributes == INVALID_FILE_ATTRIBUTES)
 				{
 					// Cache miss
@@ -227,10 +293,78 @@ namespace CKPE
 				return true;
 			}
 
+			constexpr static std::uint32_t ARRAY_INDEX_SLOTS = 4;
+			constexpr static std::uint32_t ARRAY_INDEX_SEARCHES = 4;
+
+			static std::uint32_t ArrayIndexThreshold = 0;
+
+			// The index of one of the recently searched arrays
+			struct ArrayIndexSlot
+			{
+				const void* Array{ nullptr };
+				std::uint32_t Searches{ 0 };
+				std::uint64_t Used{ 0 };
+				Common::ArrayIndex Index;
+			};
+
+			thread_local ArrayIndexSlot CachedArrayIndices[ARRAY_INDEX_SLOTS];
+			thread_local std::uint64_t CachedArrayIndexClock = 0;
+
+			static bool SearchArrayItemIndexed(EditorAPI::BSTArray<void*>& _array, void* _target,
+				std::uint32_t _start_index, std::uint32_t& _result) noexcept(true)
+			{
+				if (!ArrayIndexThreshold || (_array.size() < ArrayIndexThreshold))
+					return false;
+
+				ArrayIndexSlot* Entry = nullptr;
+				ArrayIndexSlot* Oldest = &CachedArrayIndices[0];
+
+				for (auto& Slot : CachedArrayIndices)
+				{
+					if (Slot.Array == &_array)
+					{
+						Entry = &Slot;
+						break;
+					}
+
+					if (Slot.Used < Oldest->Used)
+						Oldest = &Slot;
+				}
+
+				if (!Entry)
+				{
+					Entry = Oldest;
+					Entry->Array = &_array;
+					Entry->Searches = 0;
+					Entry->Index.Clear();
+				}
+
+				Entry->Used = ++CachedArrayIndexClock;
+
+				// One-off searches are cheaper without building anything
+				if (++Entry->Searches < ARRAY_INDEX_SEARCHES)
+					return false;
+
+				try
+				{
+					return Entry->Index.Search((void* const*)_array.data(), _array.size(), _target, _start_index, _result);
+				}
+				catch (const std::bad_alloc&)
+				{
+					Entry->Array = nullptr;
+					Entry->Index.Clear();
+					return false;
+				}
+			}
+
 			static DWORD SearchArrayItem_SSE41(EditorAPI::BSTArray<void*>& _array, void*& _target,
 				DWORD _start_index, std::int64_t Unused)
 			{
 				std::uint32_t index = _start_index;
+				if (SearchArrayItemIndexed(_array, _target, _start_index, index))
+					return index;
+
+				index = _start_index;
 				std::int64_t* data = (std::int64_t*)_array.data();
 
 				const std::uint32_t comparesPerIter = 4;
@@ -271,6 +405,10 @@ namespace CKPE
 			static DWORD SearchArrayItem(EditorAPI::BSTArray<void*>& _array, void*& _target,
 				DWORD _start_index, std::int64_t Unused)
 			{
+				std::uint32_t index = 0;
+				if (SearchArrayItemIndexed(_array, _target, _start_index, index))
+					return index;
+
 				for (std::uint32_t i = _start_index; i < _array.size(); i++)
 				{
 					if (_array[i] == _target)
@@ -280,6 +418,18 @@ namespace CKPE
 				return 0xFFFFFFFF;
 			}
 
+			std::uint64_t LoadOptimization::GetInflateCount() noexcept(true)
+			{
+				return InflateCount;
+			}
+
+			std::uint64_t LoadOptimization::GetDecompressorAllocsAvoided() noexcept(true)
+			{
+				auto Inflates = InflateCount.load();
+				auto Allocs = DecompressorAllocCount.load();
+				return (Inflates > Allocs) ? (Inflates - Allocs) : 0;
+			}
+
 			LoadOptimization::LoadOptimization() : Common::Patch()
 			{
 				SetName("Load Optimization");
@@ -331,6 +481,18 @@ namespace CKPE
 				// (BSSystemDir__NextEntry, BSResource__LooseFileLocation__FileExists)
 				//
 
+				// Existence of the loose files from the scan of Data, instead of asking the file system each time
+				if (interface->GetSettings()->ReadBool("CreationKit", "bDataSnapshot", false))
+				{
+					char Path[MAX_PATH];
+					auto Length = GetCurrentDirectoryA(MAX_PATH, Path);
+					if (Length && (Length < MAX_PATH))
+						Common::DirectorySnapshot::GetSingleton()->Start(std::string(Path, Length) + "\\Data\\");
+				}
+
+				// Large arrays searched over and over get a hashed index (0 - off)
+				ArrayIndexThreshold = interface->GetSettings()->ReadUInt("CreationKit", "uArrayIndexThreshold", 0);
+
 				// Utilize SSE4.1 instructions if available
 				if (HardwareInfo::CPU::HasSupportSSE41())
 					Detours::DetourJump(__CKPE_OFFSET(10), (std::uintptr_t)&SearchArrayItem_SSE41);
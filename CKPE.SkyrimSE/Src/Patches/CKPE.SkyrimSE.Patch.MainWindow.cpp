@@ -414,22 +414,24 @@ namespace CKPE
 								{
 									auto head = EditorAPI::BSPointerHandleManager_Extended_Extremly::GetHead();
 									auto tail = EditorAPI::BSPointerHandleManager_Extended_Extremly::GetTail();
+									auto used = EditorAPI::BSPointerHandleManager_Extended_Extremly::GetUsedCount();
 
 									Console::LogWarning(Console::SYSTEM,
-										"Dump SDM Info:\n\tHead: 0x%08X\n\tTail: 0x%08X\n\tMax: 0x%08X\n\tCapacity: %.2f%%",
-										head, tail, EditorAPI::BSUntypedPointerHandle_Extended_Extremly::MAX_HANDLE_COUNT,
-										((((long double)head) * 100.0f) /
+										"Dump SDM Info:\n\tHead: 0x%08X\n\tTail: 0x%08X\n\tUsed: 0x%08X\n\tMax: 0x%08X\n\tCapacity: %.2f%%",
+										head, tail, used, EditorAPI::BSUntypedPointerHandle_Extended_Extremly::MAX_HANDLE_COUNT,
+										((((long double)used) * 100.0f) /
 											(long double)EditorAPI::BSUntypedPointerHandle_Extended_Extremly::MAX_HANDLE_COUNT));
 								}
 								else
 								{
 									auto head = EditorAPI::BSPointerHandleManager_Extended::GetHead();
 									auto tail = EditorAPI::BSPointerHandleManager_Extended::GetTail();
+									auto used = EditorAPI::BSPointerHandleManager_Extended::GetUsedCount();
 
 									Console::LogWarning(Console::SYSTEM, 
-										"Dump SDM Info:\n\tHead: 0x%08X\n\tTail: 0x%08X\n\tMax: 0x%08X\n\tCapacity: %.2f%%",
-										head, tail, EditorAPI::BSUntypedPointerHandle_Extended::MAX_HANDLE_COUNT,
-										((((long double)head) * 100.0f) /
+										"Dump SDM Info:\n\tHead: 0x%08X\n\tTail: 0x%08X\n\tUsed: 0x%08X\n\tMax: 0x%08X\n\tCapacity: %.2f%%",
+										head, tail, used, EditorAPI::BSUntypedPointerHandle_Extended::MAX_HANDLE_COUNT,
+										((((long double)used) * 100.0f) /
 											(long double)EditorAPI::BSUntypedPointerHandle_Extended::MAX_HANDLE_COUNT));
 								}
 							}
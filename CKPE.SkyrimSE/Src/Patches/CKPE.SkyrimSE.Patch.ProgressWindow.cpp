@@ -10,6 +10,7 @@
 #include <CKPE.Common.ProgressTaskBar.h>
 #include <CKPE.SkyrimSE.VersionLists.h>
 #include <Patches/CKPE.SkyrimSE.Patch.MainWindow.h>
+#include <Patches/CKPE.SkyrimSE.Patch.LoadOptimization.h>
 #include <Patches/CKPE.SkyrimSE.Patch.ProgressWindow.h>
 
 namespace CKPE
@@ -106,6 +107,16 @@ namespace CKPE
 					ProgressWindow::Singleton->m_hWnd = nullptr;
 					ProgressWindow::Singleton->ProgressLabel = nullptr;
 					ProgressWindow::Singleton->Progress = nullptr;
+
+					// The loading is over, what it inflated since the previous one
+					static std::uint64_t LastInflates = 0, LastAllocsAvoided = 0;
+					auto Inflates = LoadOptimization::GetInflateCount();
+					auto AllocsAvoided = LoadOptimization::GetDecompressorAllocsAvoided();
+					if (Inflates > LastInflates)
+						_CONSOLE("Inflated %llu records, %llu decompressor allocations avoided",
+							Inflates - LastInflates, AllocsAvoided - std::min(AllocsAvoided, LastAllocsAvoided));
+					LastInflates = Inflates;
+					LastAllocsAvoided = AllocsAvoided;
 				}
 				break;
 				}
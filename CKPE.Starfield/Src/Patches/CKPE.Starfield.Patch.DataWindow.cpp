@@ -5,11 +5,13 @@
 #include <windows.h>
 #include <CKPE.Detours.h>
 #include <CKPE.Graphics.h>
+#include <CKPE.PathUtils.h>
 #include <CKPE.Application.h>
 #include <CKPE.Common.Interface.h>
 #include <CKPE.Common.EditorUI.h>
 #include <CKPE.Common.UIVarCommon.h>
 #include <CKPE.Common.UIListView.h>
+#include <CKPE.Common.PluginHeaderScanner.h>
 #include <CKPE.Starfield.VersionLists.h>
 #include <EditorAPI/TESFile.h>
 #include <Patches/CKPE.Starfield.Patch.DataWindow.h>
@@ -17,6 +19,8 @@
 
 #include <richedit.h>
 #include <commctrl.h>
+#include <atomic>
+#include <thread>
 
 #define UI_DATA_DIALOG_PLUGINLISTVIEW		1056
 #define UI_DATA_DIALOG_FILTERBOX			1003	// See: resource.rc
@@ -77,6 +81,36 @@ namespace CKPE
 				return true;
 			}
 
+			// Set while the headers are read, the list is repainted when they are
+			static std::atomic_bool sScanPending{ false };
+			static std::atomic<HWND> sScanList{ nullptr };
+
+			static void StartPluginScan(HWND ListHandle) noexcept(true)
+			{
+				// The dialog opened again, the running scan repaints the new list
+				sScanList = ListHandle;
+				if (sScanPending.exchange(true))
+					return;
+
+				try
+				{
+					std::thread([]()
+						{
+							Common::PluginHeaderScanner::GetSingleton()->Scan(PathUtils::GetDataPath());
+							sScanPending = false;
+
+							// The dialog may be closed already
+							auto ListHandle = sScanList.load();
+							if (IsWindow(ListHandle))
+								InvalidateRect(ListHandle, nullptr, FALSE);
+						}).detach();
+				}
+				catch (const std::exception&)
+				{
+					sScanPending = false;
+				}
+			}
+
 			LRESULT CALLBACK DataWindow::HKWndProc(HWND Hwnd, UINT Message, WPARAM wParam, LPARAM lParam) noexcept(true)
 			{
 				if (Message == WM_INITDIALOG)
@@ -89,6 +123,9 @@ namespace CKPE
 					_This->m_hWnd = Hwnd;
 					_This->m_pluginList = pluginListHandle;
 
+					// The headers for the owner-draw, read in parallel while the dialog is already shown
+					StartPluginScan(pluginListHandle);
+
 					_This->Style = WS_OVERLAPPED | WS_CAPTION | WS_BORDER | WS_SYSMENU;
 
 					// Subscribe to notifications when the user types in the filter text box
@@ -225,8 +262,17 @@ namespace CKPE
 				CRECT rc = lpDrawItem->rcItem;
 				Canvas canvas(lpDrawItem->hDC);
 
-				auto type = EditorAPI::TESFile::GetTypeFile(
-					(EditorAPI::BSString::Utils::GetRelativeDataPath() + lpstrFileName).Get());
+				// Called on every paint, the file is opened only if it appeared after the scan
+				std::uint32_t type = 0;
+				if (!Common::PluginHeaderScanner::GetSingleton()->GetFlags(lpstrFileName, type))
+				{
+					// Not read yet, painted again after the scan
+					if (sScanPending)
+						return;
+
+					type = EditorAPI::TESFile::GetTypeFile(
+						(EditorAPI::BSString::Utils::GetRelativeDataPath() + lpstrFileName).Get());
+				}
 
 				if ((type & EditorAPI::TESFile::FILE_RECORD_LIGHT) == EditorAPI::TESFile::FILE_RECORD_LIGHT)
 					canvas.FillWithTransparent(rc, RGB(0, 255, 0), 10);
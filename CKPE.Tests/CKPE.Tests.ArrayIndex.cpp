@@ -0,0 +1,202 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <intrin.h>
+#include <CKPE.Common.ArrayIndex.h>
+#include "CKPE.Tests.h"
+
+#include <random>
+#include <algorithm>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		using Common::ArrayIndex;
+
+		// As SearchArrayItem_SSE41 of the load optimization searches without the index
+		static std::uint32_t SearchSSE41(const std::vector<void*>& Items, const void* Target,
+			std::uint32_t Start) noexcept(true)
+		{
+			auto Index = Start;
+			auto Data = (const std::int64_t*)Items.data();
+			auto Count = (std::uint32_t)Items.size();
+			auto Iterations = (Count - std::min(Index, Count)) / 4;
+			auto Targets = _mm_set1_epi64x((std::int64_t)Target);
+
+			for (std::uint32_t i = 0; i < Iterations; i++)
+			{
+				auto Test1 = _mm_cmpeq_epi64(Targets, _mm_loadu_si128((const __m128i*)&Data[Index + 0]));
+				auto Test2 = _mm_cmpeq_epi64(Targets, _mm_loadu_si128((const __m128i*)&Data[Index + 2]));
+				if (_mm_movemask_pd(_mm_castsi128_pd(_mm_or_si128(Test1, Test2))))
+					break;
+				Index += 4;
+			}
+
+			for (; Index < Count; Index++)
+				if (Data[Index] == (std::int64_t)Target)
+					return Index;
+
+			return ArrayIndex::NONE;
+		}
+
+		// As the hook does: the index if it can answer, the usual search if not
+		static std::uint32_t SearchIndexed(ArrayIndex& Index, const std::vector<void*>& Items, const void* Target,
+			std::uint32_t Start, std::uint32_t* Answered = nullptr)
+		{
+			std::uint32_t Result = 0;
+			if (Index.Search(Items.data(), (std::uint32_t)Items.size(), Target, Start, Result))
+			{
+				if (Answered) (*Answered)++;
+				return Result;
+			}
+
+			return SearchSSE41(Items, Target, Start);
+		}
+
+		// Forms of the editor: distinct pointers aligned to 8, a few of them twice and a few nullptr
+		static std::vector<void*> RandomForms(std::mt19937_64& Random, std::size_t Count)
+		{
+			std::vector<void*> Items(Count);
+			for (std::size_t i = 0; i < Count; i++)
+				Items[i] = (void*)(0x10000000ull + i * 0x40);
+			for (std::size_t i = 0; i < (Count / 50); i++)
+				Items[Random() % Count] = (Random() & 1) ? nullptr : Items[Random() % Count];
+
+			std::shuffle(Items.begin(), Items.end(), Random);
+			return Items;
+		}
+
+		static bool CheckSearches(std::mt19937_64& Random, ArrayIndex& Index, const std::vector<void*>& Items,
+			std::uint32_t Searches, std::uint32_t* Answered = nullptr)
+		{
+			auto Count = (std::uint32_t)Items.size();
+			for (std::uint32_t i = 0; i < Searches; i++)
+			{
+				// Present, missing and nullptr, from the start and from anywhere
+				const void* Target = nullptr;
+				auto Kind = Random() % 8;
+				if ((Kind < 6) && Count)
+					Target = Items[Random() % Count];
+				else if (Kind == 6)
+					Target = (void*)(0x20000000ull + (Random() % 0x1000) * 8);
+
+				auto Start = (Random() & 1) ? 0 : (std::uint32_t)(Random() % (Count + 2));
+				if (SearchIndexed(Index, Items, Target, Start, Answered) != SearchSSE41(Items, Target, Start))
+					return false;
+			}
+
+			return true;
+		}
+
+		CKPE_TEST(ArrayIndexMatchesLinear)
+		{
+			std::mt19937_64 Random(43);
+
+			for (std::size_t Count : { 0, 1, 3, 64, 1000, 50000 })
+			{
+				auto Items = RandomForms(Random, Count);
+				ArrayIndex Index;
+				std::uint32_t Answered = 0;
+
+				CKPE_CHECK(CheckSearches(Random, Index, Items, 20000, &Answered));
+				CKPE_CHECK(Index.GetCount() == Count);
+				// Most of the hits are answered by the index
+				if (Count >= 64)
+					CKPE_CHECK(Answered > 20000 / 2);
+			}
+		}
+
+		CKPE_TEST(ArrayIndexFollowsChanges)
+		{
+			std::mt19937_64 Random(4300);
+			auto Items = RandomForms(Random, 1000);
+			ArrayIndex Index;
+			CKPE_CHECK(CheckSearches(Random, Index, Items, 1000));
+
+			// Pushed into the same buffer: appended to the index
+			Items.reserve(4000);
+			CKPE_CHECK(CheckSearches(Random, Index, Items, 100));
+			for (std::uint32_t i = 0; i < 500; i++)
+			{
+				Items.push_back((void*)(0x30000000ull + i * 0x40));
+				CKPE_CHECK(SearchIndexed(Index, Items, Items.back(), 0) == Items.size() - 1);
+			}
+			CKPE_CHECK(Index.GetCount() == Items.size());
+
+			// Moved to another buffer
+			Items.shrink_to_fit();
+			CKPE_CHECK(CheckSearches(Random, Index, Items, 1000));
+
+			// Erased from the end, the middle and the start
+			Items.resize(Items.size() - 10);
+			CKPE_CHECK(CheckSearches(Random, Index, Items, 1000));
+			Items.erase(Items.begin() + 700);
+			CKPE_CHECK(CheckSearches(Random, Index, Items, 1000));
+			Items.erase(Items.begin());
+			CKPE_CHECK(CheckSearches(Random, Index, Items, 1000));
+
+			// Inserted at the start
+			Items.insert(Items.begin(), (void*)0x40000000ull);
+			CKPE_CHECK(SearchIndexed(Index, Items, (void*)0x40000000ull, 0) == 0);
+			CKPE_CHECK(CheckSearches(Random, Index, Items, 1000));
+
+			// Replaced in place, the size is the same: the old item is missed, the new one is found
+			auto Old = Items[300];
+			Items[300] = (void*)0x50000000ull;
+			CKPE_CHECK(SearchIndexed(Index, Items, Old, 0) == SearchSSE41(Items, Old, 0));
+			CKPE_CHECK(SearchIndexed(Index, Items, Items[300], 0) == 300);
+			// Swapped: the index points at the other item, the usual search answers
+			std::swap(Items[100], Items[200]);
+			CKPE_CHECK(SearchIndexed(Index, Items, Items[100], 0) == SearchSSE41(Items, Items[100], 0));
+			CKPE_CHECK(CheckSearches(Random, Index, Items, 1000));
+
+			// The same item further on than the start
+			Items.push_back(Items[10]);
+			CKPE_CHECK(SearchIndexed(Index, Items, Items[10], 11) == Items.size() - 1);
+
+			Index.Clear();
+			CKPE_CHECK(!Index.GetCount());
+			CKPE_CHECK(CheckSearches(Random, Index, Items, 1000));
+		}
+
+		CKPE_BENCHMARK(ArrayIndexSearch)
+		{
+			std::mt19937_64 Random(43);
+
+			for (std::size_t Count : { 1000, 100000, 1000000 })
+			{
+				auto Items = RandomForms(Random, Count);
+
+				std::vector<void*> Targets(4096);
+				for (auto& Target : Targets)
+					Target = Items[Random() % Count];
+
+				// The linear search takes as long as the array, less of them
+				auto LinearSearches = (std::uint32_t)std::max<std::size_t>(100, 200000000 / Count);
+				std::uint64_t Sum = 0;
+				Stopwatch Watch;
+				for (std::uint32_t i = 0; i < LinearSearches; i++)
+					Sum += SearchSSE41(Items, Targets[i & 4095], 0);
+				auto LinearNs = Watch.GetMilliseconds() * 1000000.0 / LinearSearches;
+
+				ArrayIndex Index;
+				Watch.Restart();
+				Sum += SearchIndexed(Index, Items, Targets[0], 0);
+				auto BuildMs = Watch.GetMilliseconds();
+
+				constexpr std::uint32_t IndexSearches = 1000000;
+				std::uint32_t Answered = 0;
+				Watch.Restart();
+				for (std::uint32_t i = 0; i < IndexSearches; i++)
+					Sum += SearchIndexed(Index, Items, Targets[i & 4095], 0, &Answered);
+				auto IndexNs = Watch.GetMilliseconds() * 1000000.0 / IndexSearches;
+				CKPE_CHECK(Answered > IndexSearches / 2);
+
+				CKPE_BENCH_PRINT("%7zu items: SSE4.1 %10.1f ns, index %6.1f ns (built in %.2f ms), x%.0f (%llx)", Count,
+					LinearNs, IndexNs, BuildMs, LinearNs / IndexNs, (unsigned long long)Sum);
+			}
+		}
+	}
+}
@@ -0,0 +1,215 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <EditorAPI/BSPointerHandle.h>
+#include "CKPE.Tests.h"
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <algorithm>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		using namespace SkyrimSE::EditorAPI;
+
+		// The bits of BSHandleRefObject32T without the NiRefObject of the editor
+		template<std::uint32_t RefCountBits>
+		class HandleRefModel
+		{
+			std::atomic_uint32_t _bits{ 0 };
+		public:
+			constexpr static std::uint32_t ACTIVE_BIT_INDEX = RefCountBits;
+			constexpr static std::uint32_t HANDLE_BIT_INDEX = RefCountBits + 1;
+			constexpr static std::uint32_t REF_COUNT_MASK = (1u << RefCountBits) - 1u;
+
+			inline std::uint32_t IncRefCount() noexcept(true) { return (++_bits) & REF_COUNT_MASK; }
+			inline std::uint32_t DecRefCount() noexcept(true) { return (--_bits) & REF_COUNT_MASK; }
+			[[nodiscard]] inline std::uint32_t GetRefCount() const noexcept(true) { return _bits & REF_COUNT_MASK; }
+
+			[[nodiscard]] inline bool TrySetHandleEntryIndex(std::uint32_t HandleIndex) noexcept(true)
+			{
+				std::uint32_t Old = _bits;
+				while (!(Old & (1u << ACTIVE_BIT_INDEX)))
+				{
+					if (_bits.compare_exchange_weak(Old, (HandleIndex << HANDLE_BIT_INDEX) |
+						(1u << ACTIVE_BIT_INDEX) | (Old & REF_COUNT_MASK)))
+						return true;
+				}
+
+				return false;
+			}
+
+			[[nodiscard]] inline std::uint32_t GetHandleEntryIndex() const noexcept(true)
+			{ return _bits >> HANDLE_BIT_INDEX; }
+			inline void ClearHandleEntryIndex() noexcept(true) { _bits &= REF_COUNT_MASK; }
+			[[nodiscard]] inline bool IsHandleValid() const noexcept(true)
+			{ return (_bits & (1u << ACTIVE_BIT_INDEX)) != 0; }
+		};
+
+		typedef HandleRefModel<10> TestRef;
+
+		typedef IBSUntypedPointerHandle<std::uint32_t, 16, 6> StressHandle;
+		typedef IBSPointerHandleManager<std::uint32_t, StressHandle, TestRef> StressManager;
+		typedef IBSPointerHandleManagerInterface<TestRef, StressHandle, StressManager> StressInterface;
+
+		// Few entries, the caches of the threads hold a good part of them
+		typedef IBSUntypedPointerHandle<std::uint32_t, 10, 6> SmallHandle;
+		typedef IBSPointerHandleManager<std::uint32_t, SmallHandle, TestRef> SmallManager;
+		typedef IBSPointerHandleManagerInterface<TestRef, SmallHandle, SmallManager> SmallInterface;
+
+		struct SmallProbe : public SmallManager
+		{
+			[[nodiscard]] static const void* GetRing() noexcept(true) { return FreeIndices.load(); }
+		};
+
+		// Each handle gives its own ref or nothing
+		template<typename Interface, typename Handle>
+		[[nodiscard]] static bool LookupIsSane(const Handle& handle, TestRef* Refr)
+		{
+			NiPointer<TestRef> Pointer;
+			return !Interface::GetSmartPointer1(handle, Pointer) || (Pointer == Refr);
+		}
+
+		CKPE_TEST(BSPointerHandleManagerStress)
+		{
+			constexpr std::uint32_t Count = StressHandle::MAX_HANDLE_COUNT, Steps = 200000;
+
+			StressManager::InitSDM();
+			auto Refs = std::make_unique<TestRef[]>(Count);
+			auto Threads = std::clamp(std::thread::hardware_concurrency(), 4u, 16u);
+			std::atomic_uint32_t Failed{ 0 };
+
+			std::vector<std::thread> Workers;
+			for (std::uint32_t Thread = 0; Thread < Threads; Thread++)
+				Workers.emplace_back([&, Thread]()
+					{
+						std::uint64_t Random = 0x9E3779B97F4A7C15ull * (Thread + 1);
+						for (std::uint32_t Step = 0; Step < Steps; Step++)
+						{
+							Random ^= Random << 13; Random ^= Random >> 7; Random ^= Random << 17;
+
+							// Few refs, many threads on each of them
+							auto Refr = &Refs[(Random >> 8) % 4096];
+							switch (Random % 4)
+							{
+							case 0:
+							case 1:
+							{
+								auto Handle = StressInterface::CreateHandle(Refr);
+								if (Handle.IsBitwiseNull() || !LookupIsSane<StressInterface>(Handle, Refr))
+									Failed++;
+								break;
+							}
+							case 2:
+							{
+								auto Handle = StressInterface::GetCurrentHandle(Refr);
+								StressInterface::Destroy2(Handle);
+								break;
+							}
+							default:
+								if (!LookupIsSane<StressInterface>(StressInterface::GetCurrentHandle(Refr), Refr))
+									Failed++;
+								break;
+							}
+						}
+					});
+
+			for (auto& Worker : Workers)
+				Worker.join();
+
+			CKPE_CHECK(!Failed);
+
+			for (std::uint32_t i = 0; i < Count; i++)
+			{
+				auto Handle = StressInterface::GetCurrentHandle(&Refs[i]);
+				StressInterface::Destroy2(Handle);
+			}
+
+			CKPE_CHECK(StressManager::GetUsedCount() == 0);
+
+			// The threads are gone, not one index is lost: there is a handle for each entry
+			std::uint32_t Created = 0;
+			for (std::uint32_t i = 0; i < Count; i++)
+				if (!StressInterface::CreateHandle(&Refs[i]).IsBitwiseNull())
+					Created++;
+			CKPE_CHECK(Created == Count);
+
+			for (std::uint32_t i = 0; i < Count; i++)
+			{
+				auto Handle = StressInterface::GetCurrentHandle(&Refs[i]);
+				StressInterface::Destroy2(Handle);
+				CKPE_CHECK(!Refs[i].IsHandleValid() && !Refs[i].GetRefCount());
+			}
+		}
+
+		CKPE_TEST(BSPointerHandleManagerReclaim)
+		{
+			constexpr std::uint32_t Count = SmallHandle::MAX_HANDLE_COUNT, Threads = 4, Kept = 4;
+
+			SmallManager::InitSDM();
+			auto Ring = SmallProbe::GetRing();
+			auto Refs = std::make_unique<TestRef[]>(Count);
+			std::atomic_uint32_t Ready{ 0 };
+			std::atomic_bool Done{ false };
+
+			// Each thread takes a batch, holds a few handles and keeps the rest of the batch in its cache
+			std::vector<std::thread> Workers;
+			for (std::uint32_t Thread = 0; Thread < Threads; Thread++)
+				Workers.emplace_back([&, Thread]()
+					{
+						auto First = &Refs[Thread * Kept * 2];
+						for (std::uint32_t i = 0; i < Kept * 2; i++)
+							SmallInterface::CreateHandle(&First[i]);
+						for (std::uint32_t i = Kept; i < Kept * 2; i++)
+						{
+							auto Handle = SmallInterface::GetCurrentHandle(&First[i]);
+							SmallInterface::Destroy2(Handle);
+						}
+
+						Ready++;
+						while (!Done)
+							std::this_thread::yield();
+
+						for (std::uint32_t i = 0; i < Kept; i++)
+						{
+							auto Handle = SmallInterface::GetCurrentHandle(&First[i]);
+							SmallInterface::Destroy2(Handle);
+						}
+					});
+
+			while (Ready != Threads)
+				std::this_thread::yield();
+
+			// The ring alone is short of the free ones, all the entries are given out anyway
+			std::uint32_t Created = Threads * Kept;
+			for (std::uint32_t i = 0; i < Count; i++)
+				if (!Refs[i].IsHandleValid() && !SmallInterface::CreateHandle(&Refs[i]).IsBitwiseNull())
+					Created++;
+
+			CKPE_CHECK(Created == Count);
+			CKPE_CHECK(SmallManager::GetUsedCount() == Count);
+
+			Done = true;
+			for (auto& Worker : Workers)
+				Worker.join();
+
+			for (std::uint32_t i = 0; i < Count; i++)
+			{
+				auto Handle = SmallInterface::GetCurrentHandle(&Refs[i]);
+				SmallInterface::Destroy2(Handle);
+			}
+
+			CKPE_CHECK(SmallManager::GetUsedCount() == 0);
+
+			// Again, the same ring is filled anew
+			SmallManager::InitSDM();
+			CKPE_CHECK(SmallProbe::GetRing() == Ring);
+			CKPE_CHECK(SmallManager::GetHead() == 0);
+			CKPE_CHECK(SmallManager::GetTail() == Count - 1);
+		}
+	}
+}
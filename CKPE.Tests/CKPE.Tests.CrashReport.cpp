@@ -0,0 +1,210 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <CKPE.Detours.h>
+#include <CKPE.Common.CrashHandler.h>
+#include "CKPE.Tests.h"
+
+#include <atomic>
+#include <string.h>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		// The heap of the thread that writes the report is poisoned: each call made from it is counted.
+		// The CRT of each module is static, its malloc and new go to HeapAlloc of its own import table.
+		class HeapPoison
+		{
+			inline static std::atomic_uint32_t sthread{ 0 };
+			inline static std::atomic_uint32_t scalls{ 0 };
+			inline static decltype(&HeapAlloc) sHeapAlloc{ nullptr };
+			inline static decltype(&HeapReAlloc) sHeapReAlloc{ nullptr };
+			inline static decltype(&HeapFree) sHeapFree{ nullptr };
+
+			constexpr static const char* MODULES[] = { nullptr, "CKPE.dll", "CKPE.Common.dll" };
+
+			static LPVOID WINAPI HKHeapAlloc(HANDLE Heap, DWORD Flags, SIZE_T Bytes)
+			{
+				if (GetCurrentThreadId() == sthread) scalls++;
+				return sHeapAlloc(Heap, Flags, Bytes);
+			}
+
+			static LPVOID WINAPI HKHeapReAlloc(HANDLE Heap, DWORD Flags, LPVOID Memory, SIZE_T Bytes)
+			{
+				if (GetCurrentThreadId() == sthread) scalls++;
+				return sHeapReAlloc(Heap, Flags, Memory, Bytes);
+			}
+
+			static BOOL WINAPI HKHeapFree(HANDLE Heap, DWORD Flags, LPVOID Memory)
+			{
+				if (GetCurrentThreadId() == sthread) scalls++;
+				return sHeapFree(Heap, Flags, Memory);
+			}
+
+			static void Hook(bool Enable) noexcept(true)
+			{
+				for (auto Name : MODULES)
+				{
+					auto Base = (std::uintptr_t)GetModuleHandleA(Name);
+					if (!Base) continue;
+
+					Detours::DetourIAT(Base, "kernel32.dll", "HeapAlloc",
+						Enable ? (std::uintptr_t)HKHeapAlloc : (std::uintptr_t)sHeapAlloc);
+					Detours::DetourIAT(Base, "kernel32.dll", "HeapReAlloc",
+						Enable ? (std::uintptr_t)HKHeapReAlloc : (std::uintptr_t)sHeapReAlloc);
+					Detours::DetourIAT(Base, "kernel32.dll", "HeapFree",
+						Enable ? (std::uintptr_t)HKHeapFree : (std::uintptr_t)sHeapFree);
+				}
+			}
+		public:
+			HeapPoison() noexcept(true)
+			{
+				// Not through the import table, it's the one being hooked
+				auto Kernel = GetModuleHandleA("kernel32.dll");
+				sHeapAlloc = (decltype(&HeapAlloc))GetProcAddress(Kernel, "HeapAlloc");
+				sHeapReAlloc = (decltype(&HeapReAlloc))GetProcAddress(Kernel, "HeapReAlloc");
+				sHeapFree = (decltype(&HeapFree))GetProcAddress(Kernel, "HeapFree");
+
+				scalls = 0;
+				sthread = GetCurrentThreadId();
+				Hook(true);
+			}
+
+			~HeapPoison() noexcept(true)
+			{
+				sthread = 0;
+				Hook(false);
+			}
+
+			[[nodiscard]] inline std::uint32_t GetCalls() const noexcept(true) { return scalls; }
+			inline void Reset() noexcept(true) { scalls = 0; }
+		};
+
+		// Each line formatted on the stack and kept in a static buffer, so the stream itself doesn't use the heap.
+		// The file of the base class is opened before the heap is poisoned, nothing is written to it.
+		class StaticReportStream : public TextFileStream
+		{
+			constexpr static std::size_t LINE_SIZE = 4096;
+			inline static char stext[4 * 1024 * 1024];
+			inline static std::size_t slength{ 0 };
+
+			static void Put(const char* Line, int Length, bool NewLine) noexcept(true)
+			{
+				if ((Length < 0) || ((slength + Length + 2) >= sizeof(stext)))
+					return;
+
+				memcpy(stext + slength, Line, Length);
+				slength += Length;
+				if (NewLine) stext[slength++] = '\n';
+				stext[slength] = 0;
+			}
+
+			void Append(const char* Format, va_list Args, bool NewLine) const noexcept(true)
+			{
+				char Line[LINE_SIZE];
+				auto Length = _vsnprintf_s(Line, _TRUNCATE, Format, Args);
+				Put(Line, (Length < 0) ? (int)strnlen(Line, LINE_SIZE) : Length, NewLine);
+			}
+
+			void Append(const wchar_t* Format, va_list Args, bool NewLine) const noexcept(true)
+			{
+				wchar_t LineW[LINE_SIZE];
+				char Line[LINE_SIZE];
+				auto Length = _vsnwprintf_s(LineW, _TRUNCATE, Format, Args);
+				if (Length < 0) Length = (int)wcsnlen(LineW, LINE_SIZE);
+
+				Put(Line, WideCharToMultiByte(CP_UTF8, 0, LineW, Length, Line, (int)LINE_SIZE, nullptr, nullptr), NewLine);
+			}
+		public:
+			StaticReportStream(const std::wstring& FileName) : TextFileStream(FileName, FileStream::fmCreate)
+			{
+				slength = 0;
+				stext[0] = 0;
+			}
+
+			[[nodiscard]] inline bool Contains(const char* Str) const noexcept(true) { return strstr(stext, Str) != nullptr; }
+
+			virtual void Flush() const noexcept(true) {}
+
+			virtual void WriteString(const std::string_view& formatted_string, ...) const noexcept(true)
+			{ va_list ap; va_start(ap, formatted_string); Append(formatted_string.data(), ap, false); va_end(ap); }
+			virtual void WriteString(const std::wstring_view& formatted_string, ...) const noexcept(true)
+			{ va_list ap; va_start(ap, formatted_string); Append(formatted_string.data(), ap, false); va_end(ap); }
+			virtual void WriteString(const char* formatted_string, ...) const noexcept(true)
+			{ va_list ap; va_start(ap, formatted_string); Append(formatted_string, ap, false); va_end(ap); }
+			virtual void WriteString(const wchar_t* formatted_string, ...) const noexcept(true)
+			{ va_list ap; va_start(ap, formatted_string); Append(formatted_string, ap, false); va_end(ap); }
+			virtual void WriteLine(const std::string_view& formatted_string, ...) const noexcept(true)
+			{ va_list ap; va_start(ap, formatted_string); Append(formatted_string.data(), ap, true); va_end(ap); }
+			virtual void WriteLine(const std::wstring_view& formatted_string, ...) const noexcept(true)
+			{ va_list ap; va_start(ap, formatted_string); Append(formatted_string.data(), ap, true); va_end(ap); }
+			virtual void WriteLine(const char* formatted_string, ...) const noexcept(true)
+			{ va_list ap; va_start(ap, formatted_string); Append(formatted_string, ap, true); va_end(ap); }
+			virtual void WriteLine(const wchar_t* formatted_string, ...) const noexcept(true)
+			{ va_list ap; va_start(ap, formatted_string); Append(formatted_string, ap, true); va_end(ap); }
+		};
+
+		static const char CrashReportText[] = "Text for the string analysis of a register";
+
+		CKPE_TEST(CrashReportWithoutHeap)
+		{
+			StaticReportStream Stream(GetTempFileName(L"CKPE.Tests.CrashReport.log"));
+
+			// An access violation here, with a register that points to code, one to a string and a number
+			CONTEXT Context{};
+			RtlCaptureContext(&Context);
+			Context.Rax = Context.Rip;
+			Context.Rbx = (DWORD64)CrashReportText;
+			Context.Rcx = 12345;
+
+			EXCEPTION_RECORD Record{};
+			Record.ExceptionCode = EXCEPTION_ACCESS_VIOLATION;
+			Record.ExceptionAddress = (PVOID)Context.Rip;
+			Record.NumberParameters = 2;
+			Record.ExceptionInformation[0] = 0;
+			Record.ExceptionInformation[1] = 0x10;
+
+			EXCEPTION_POINTERS Pointers{ &Record, &Context };
+
+			bool Written = false;
+			std::uint32_t ProbeCalls = 0, ReportCalls = 0;
+			{
+				HeapPoison Poison;
+
+				// The hooks are in place
+				auto volatile Probe = malloc(64);
+				free(Probe);
+				ProbeCalls = Poison.GetCalls();
+				Poison.Reset();
+
+				Written = Common::CrashHandler::GetSingleton()->WriteReport(Stream, &Pointers);
+				ReportCalls = Poison.GetCalls();
+			}
+
+			CKPE_CHECK(ProbeCalls >= 2);
+			CKPE_CHECK(!ReportCalls);
+			if (ReportCalls)
+				printf("    %u heap calls while writing the report\n", ReportCalls);
+
+			CKPE_CHECK(Written);
+			CKPE_CHECK(Stream.Contains("====== CRASH INFO ======"));
+			CKPE_CHECK(Stream.Contains("EXCEPTION_ACCESS_VIOLATION"));
+			CKPE_CHECK(Stream.Contains("Tried to read memory at 0x0000000000000010"));
+			CKPE_CHECK(Stream.Contains("SYSTEM SPECS:"));
+			CKPE_CHECK(Stream.Contains("REGISTERS:"));
+			CKPE_CHECK(Stream.Contains("(size_t) [12345]"));
+			CKPE_CHECK(Stream.Contains(CrashReportText));
+			CKPE_CHECK(Stream.Contains("STACK:"));
+			CKPE_CHECK(Stream.Contains("PATCHES:"));
+			// The sections after all the others, nothing was cut off
+			CKPE_CHECK(Stream.Contains("MODULES:"));
+			CKPE_CHECK(Stream.Contains("CKPE.Common.dll"));
+			CKPE_CHECK(Stream.Contains("CKPE.Tests.exe+"));
+
+			CKPE_CHECK(!Common::CrashHandler::GetSingleton()->WriteReport(Stream, nullptr));
+		}
+	}
+}
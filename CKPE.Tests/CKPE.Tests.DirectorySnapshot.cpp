@@ -0,0 +1,235 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <CKPE.Common.DirectorySnapshot.h>
+#include "CKPE.Tests.h"
+
+#include <filesystem>
+#include <functional>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		using Common::DirectorySnapshot;
+
+		// A folder of its own in the temp one, removed with everything in it at the end
+		class TempTree
+		{
+			std::string _root;
+		public:
+			TempTree(const char* Name) noexcept(true)
+			{
+				std::error_code ec;
+				_root = (std::filesystem::temp_directory_path(ec) / Name).string() + "\\";
+				std::filesystem::remove_all(_root, ec);
+				std::filesystem::create_directories(_root, ec);
+			}
+
+			~TempTree() noexcept(true)
+			{
+				std::error_code ec;
+				std::filesystem::remove_all(_root, ec);
+			}
+
+			[[nodiscard]] inline const std::string& GetRoot() const noexcept(true) { return _root; }
+			[[nodiscard]] inline std::string GetPath(const std::string& Name) const noexcept(true) { return _root + Name; }
+
+			bool CreateFolder(const std::string& Name) const noexcept(true)
+			{
+				return CreateDirectoryA(GetPath(Name).c_str(), nullptr) != FALSE;
+			}
+
+			bool Write(const std::string& Name, std::uint32_t Size = 0) const noexcept(true)
+			{
+				auto Handle = CreateFileA(GetPath(Name).c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+					FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (Handle == INVALID_HANDLE_VALUE)
+					return false;
+
+				std::string Data(Size, 'x');
+				DWORD Written = 0;
+				bool Result = !Size || (WriteFile(Handle, Data.data(), Size, &Written, nullptr) && (Written == Size));
+				CloseHandle(Handle);
+				return Result;
+			}
+		};
+
+		static bool WaitFor(const std::function<bool()>& Done, std::uint32_t Milliseconds = 10000)
+		{
+			for (Stopwatch Watch; Watch.GetMilliseconds() < Milliseconds; Sleep(10))
+				if (Done())
+					return true;
+
+			return Done();
+		}
+
+		// The names folded by the snapshot are ASCII only, as is the temp folder of most users
+		static bool StartSnapshot(DirectorySnapshot& Snapshot, const TempTree& Tree, std::uint32_t Milliseconds = 10000)
+		{
+			if (!Snapshot.Start(Tree.GetRoot()))
+			{
+				printf("    skipped, the snapshot can't watch \"%s\"\n", Tree.GetRoot().c_str());
+				return false;
+			}
+
+			auto Ready = WaitFor([&]() { return Snapshot.IsReady(); }, Milliseconds);
+			CKPE_CHECK(Ready);
+			return Ready;
+		}
+
+		CKPE_TEST(DirectorySnapshotFindsAndMisses)
+		{
+			TempTree Tree("CKPE.Tests.Snapshot");
+			CKPE_CHECK(Tree.Write("a.txt", 10));
+			CKPE_CHECK(Tree.CreateFolder("Sub"));
+			CKPE_CHECK(Tree.Write("Sub\\B.NIF", 20));
+			CKPE_CHECK(Tree.CreateFolder("Sub\\Deep"));
+			CKPE_CHECK(Tree.Write("Sub\\Deep\\c.dds"));
+
+			DirectorySnapshot Snapshot;
+			if (!StartSnapshot(Snapshot, Tree))
+				return;
+
+			CKPE_CHECK(Snapshot.GetCount() == 5);
+
+			DirectorySnapshot::FileInfo Info{};
+			CKPE_CHECK(Snapshot.Find(Tree.GetPath("a.txt").c_str(), &Info) == DirectorySnapshot::rFound);
+			CKPE_CHECK((Info.Size == 10) && !(Info.Attributes & FILE_ATTRIBUTE_DIRECTORY));
+			CKPE_CHECK(Snapshot.Find("sub\\b.nif", &Info) == DirectorySnapshot::rFound);
+			CKPE_CHECK(Info.Size == 20);
+			CKPE_CHECK(Snapshot.Find("SUB/deep/C.DDS") == DirectorySnapshot::rFound);
+			CKPE_CHECK(Snapshot.Find("Sub\\", &Info) == DirectorySnapshot::rFound);
+			CKPE_CHECK(Info.Attributes & FILE_ATTRIBUTE_DIRECTORY);
+
+			// Nothing has changed since the scan, a miss is sure
+			CKPE_CHECK(Snapshot.Find(Tree.GetPath("missing.txt").c_str()) == DirectorySnapshot::rNotFound);
+			CKPE_CHECK(Snapshot.Find("Sub\\Deep\\missing.dds") == DirectorySnapshot::rNotFound);
+
+			// Not under the root or not ASCII, the file system answers
+			CKPE_CHECK(Snapshot.Find("C:\\Elsewhere\\a.txt") == DirectorySnapshot::rUnknown);
+			CKPE_CHECK(Snapshot.Find("\\\\server\\share\\a.txt") == DirectorySnapshot::rUnknown);
+			CKPE_CHECK(Snapshot.Find("Sub\\\xC4\xF3.txt") == DirectorySnapshot::rUnknown);
+
+			Snapshot.Stop();
+			CKPE_CHECK(!Snapshot.IsReady());
+			CKPE_CHECK(Snapshot.Find("a.txt") == DirectorySnapshot::rUnknown);
+		}
+
+		CKPE_TEST(DirectorySnapshotFollowsChanges)
+		{
+			TempTree Tree("CKPE.Tests.SnapshotChanges");
+			CKPE_CHECK(Tree.Write("old.txt"));
+
+			DirectorySnapshot Snapshot;
+			if (!StartSnapshot(Snapshot, Tree))
+				return;
+
+			// The first change reaches the table
+			CKPE_CHECK(Tree.Write("new0.txt", 5));
+			CKPE_CHECK(WaitFor([&]() { return Snapshot.Find("new0.txt") == DirectorySnapshot::rFound; }));
+
+			// Written right after a change, the files are never reported as missing, whether seen yet or not
+			for (std::uint32_t i = 1; i < 100; i++)
+			{
+				auto Name = "new" + std::to_string(i) + ".txt";
+				CKPE_CHECK(Tree.Write(Name));
+				CKPE_CHECK(Snapshot.Find(Name.c_str()) != DirectorySnapshot::rNotFound);
+			}
+
+			CKPE_CHECK(WaitFor([&]() { return Snapshot.Find("new99.txt") == DirectorySnapshot::rFound; }));
+
+			// Removed: no longer found at once, missing for sure once it settles
+			CKPE_CHECK(DeleteFileA(Tree.GetPath("old.txt").c_str()));
+			CKPE_CHECK(WaitFor([&]() { return Snapshot.Find("old.txt") != DirectorySnapshot::rFound; }));
+			CKPE_CHECK(WaitFor([&]() { return Snapshot.Find("old.txt") == DirectorySnapshot::rNotFound; }));
+
+			// A folder moved in gives one notification, what is in it is unknown until the next scan
+			TempTree Outside("CKPE.Tests.SnapshotOutside");
+			CKPE_CHECK(Outside.CreateFolder("Moved"));
+			CKPE_CHECK(Outside.Write("Moved\\inner.txt"));
+			CKPE_CHECK(MoveFileA(Outside.GetPath("Moved").c_str(), Tree.GetPath("Moved").c_str()));
+			CKPE_CHECK(WaitFor([&]() { return Snapshot.Find("Moved") == DirectorySnapshot::rFound; }));
+			CKPE_CHECK(Snapshot.Find("Moved\\inner.txt") == DirectorySnapshot::rUnknown);
+			CKPE_CHECK(Snapshot.Find("Moved\\other.txt") == DirectorySnapshot::rUnknown);
+
+			Snapshot.Stop();
+		}
+
+		CKPE_BENCHMARK(DirectorySnapshot500k)
+		{
+			constexpr std::uint32_t Folders = 500, FilesPerFolder = 1000, Lookups = 1000000, DiskLookups = 20000;
+
+			TempTree Tree("CKPE.Tests.Snapshot500k");
+			Stopwatch Watch;
+
+			char Name[64];
+			for (std::uint32_t Folder = 0; Folder < Folders; Folder++)
+			{
+				sprintf_s(Name, "d%03u", Folder);
+				if (!Tree.CreateFolder(Name))
+				{
+					CKPE_CHECK(false);
+					return;
+				}
+
+				for (std::uint32_t File = 0; File < FilesPerFolder; File++)
+				{
+					sprintf_s(Name, "d%03u\\f%04u.nif", Folder, File);
+					if (!Tree.Write(Name))
+					{
+						CKPE_CHECK(false);
+						return;
+					}
+				}
+			}
+
+			CKPE_BENCH_PRINT("%u files created in %.1f s", Folders * FilesPerFolder, Watch.GetMilliseconds() / 1000.0);
+
+			DirectorySnapshot Snapshot;
+			Watch.Restart();
+			if (!StartSnapshot(Snapshot, Tree, 600000))
+				return;
+
+			CKPE_BENCH_PRINT("scan: %.1f ms, %u items", Watch.GetMilliseconds(), Snapshot.GetCount());
+
+			// The full paths, as the loose file location of the editor gives them, every other one is missing
+			std::vector<std::string> Paths;
+			for (std::uint32_t i = 0; i < 4096; i++)
+			{
+				sprintf_s(Name, (i & 1) ? "d%03u\\g%04u.nif" : "d%03u\\f%04u.nif", (i * 7919) % Folders,
+					(i * 104729) % FilesPerFolder);
+				Paths.push_back(Tree.GetPath(Name));
+			}
+
+			std::uint32_t Found = 0, Missing = 0;
+			Watch.Restart();
+			for (std::uint32_t i = 0; i < Lookups; i++)
+			{
+				auto Result = Snapshot.Find(Paths[i & 4095].c_str());
+				Found += Result == DirectorySnapshot::rFound;
+				Missing += Result == DirectorySnapshot::rNotFound;
+			}
+			auto SnapshotTime = Watch.GetMilliseconds();
+			CKPE_CHECK((Found == Lookups / 2) && (Missing == Lookups / 2));
+
+			std::uint32_t DiskFound = 0;
+			Watch.Restart();
+			for (std::uint32_t i = 0; i < DiskLookups; i++)
+			{
+				WIN32_FILE_ATTRIBUTE_DATA Data;
+				DiskFound += GetFileAttributesExA(Paths[i & 4095].c_str(), GetFileExInfoStandard, &Data) != FALSE;
+			}
+			auto DiskTime = Watch.GetMilliseconds();
+			CKPE_CHECK(DiskFound == DiskLookups / 2);
+
+			auto SnapshotNs = SnapshotTime * 1000000.0 / Lookups, DiskNs = DiskTime * 1000000.0 / DiskLookups;
+			CKPE_BENCH_PRINT("Find:                 %8.1f ns", SnapshotNs);
+			CKPE_BENCH_PRINT("GetFileAttributesExA: %8.1f ns, x%.1f", DiskNs, DiskNs / SnapshotNs);
+
+			Snapshot.Stop();
+		}
+	}
+}
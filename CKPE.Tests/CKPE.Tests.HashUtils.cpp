@@ -0,0 +1,178 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <CKPE.HashUtils.h>
+#include "CKPE.Tests.h"
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <string.h>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		// Bit by bit, as the polynomials are written down
+		static std::uint32_t ReferenceCRC(const std::uint8_t* Data, std::size_t Size, std::uint32_t Polynomial) noexcept(true)
+		{
+			std::uint32_t Crc = 0xFFFFFFFFul;
+			for (std::size_t i = 0; i < Size; i++)
+			{
+				Crc ^= Data[i];
+				for (std::uint32_t Bit = 0; Bit < 8; Bit++)
+					Crc = (Crc >> 1) ^ ((Crc & 1) ? Polynomial : 0);
+			}
+			return ~Crc;
+		}
+
+		// A byte per step through a table, as CRC32Buffer worked before the slicing and the folding
+		static std::uint32_t TableCRC(const std::uint8_t* Data, std::size_t Size) noexcept(true)
+		{
+			static const auto Table = []()
+			{
+				std::array<std::uint32_t, 256> Result{};
+				for (std::uint32_t i = 0; i < 256; i++)
+				{
+					std::uint32_t Crc = i;
+					for (std::uint32_t Bit = 0; Bit < 8; Bit++)
+						Crc = (Crc >> 1) ^ ((Crc & 1) ? 0xEDB88320ul : 0);
+					Result[i] = Crc;
+				}
+				return Result;
+			}();
+
+			std::uint32_t Crc = 0xFFFFFFFFul;
+			for (std::size_t i = 0; i < Size; i++)
+				Crc = (Crc >> 8) ^ Table[(Crc ^ Data[i]) & 0xFF];
+			return ~Crc;
+		}
+
+		static std::vector<std::uint8_t> RandomBytes(std::mt19937& Random, std::size_t Size)
+		{
+			std::vector<std::uint8_t> Result(Size);
+			for (auto& Byte : Result)
+				Byte = (std::uint8_t)Random();
+			return Result;
+		}
+
+		CKPE_TEST(CRC32KnownValues)
+		{
+			CKPE_CHECK(HashUtils::CRC32("123456789") == 0xCBF43926ul);
+			CKPE_CHECK(HashUtils::CRC32Buffer("123456789", 9) == 0xCBF43926ul);
+			CKPE_CHECK(HashUtils::CRC32C("123456789", 9) == 0xE3069283ul);
+			CKPE_CHECK(HashUtils::CRC32Buffer("", 0) == 0);
+			CKPE_CHECK(HashUtils::CRC32C("", 0) == 0);
+		}
+
+		CKPE_TEST(CRC32MatchesReference)
+		{
+			std::mt19937 Random(27);
+
+			// Around the 16 and 64 byte blocks of the tables and the folding, and from any alignment
+			for (std::size_t Size = 0; Size < 1100; Size++)
+			{
+				auto Data = RandomBytes(Random, Size + 16);
+				auto Offset = Size % 16;
+				auto Ptr = Data.data() + Offset;
+
+				CKPE_CHECK(HashUtils::CRC32Buffer(Ptr, (std::uint32_t)Size) == ReferenceCRC(Ptr, Size, 0xEDB88320ul));
+				CKPE_CHECK(HashUtils::CRC32C(Ptr, Size) == ReferenceCRC(Ptr, Size, 0x82F63B78ul));
+			}
+
+			auto Large = RandomBytes(Random, 1 << 20);
+			CKPE_CHECK(HashUtils::CRC32Buffer(Large.data(), (std::uint32_t)Large.size()) ==
+				ReferenceCRC(Large.data(), Large.size(), 0xEDB88320ul));
+			CKPE_CHECK(HashUtils::CRC32C(Large.data(), Large.size()) ==
+				ReferenceCRC(Large.data(), Large.size(), 0x82F63B78ul));
+		}
+
+		CKPE_TEST(CRC32Incremental)
+		{
+			std::mt19937 Random(2700);
+
+			for (std::uint32_t Pass = 0; Pass < 200; Pass++)
+			{
+				auto Data = RandomBytes(Random, Random() % 5000);
+				auto Full = HashUtils::CRC32Buffer(Data.data(), (std::uint32_t)Data.size());
+				auto FullC = HashUtils::CRC32C(Data.data(), Data.size());
+
+				std::uint32_t Crc = 0xFFFFFFFFul, CrcC = 0xFFFFFFFFul;
+				Crc32State State;
+
+				for (std::size_t Offset = 0; Offset < Data.size();)
+				{
+					auto Piece = std::min<std::size_t>(Random() % 300, Data.size() - Offset);
+					Crc = HashUtils::CRC32Update(Data.data() + Offset, (std::uint32_t)Piece, Crc);
+					CrcC = HashUtils::CRC32CUpdate(Data.data() + Offset, Piece, CrcC);
+					State.Update(Data.data() + Offset, Piece);
+					Offset += Piece;
+				}
+
+				CKPE_CHECK(HashUtils::CRC32Final(Crc) == Full);
+				CKPE_CHECK(~CrcC == FullC);
+				CKPE_CHECK(State.Final() == Full);
+			}
+		}
+
+		CKPE_BENCHMARK(CRC32Throughput)
+		{
+			std::mt19937 Random(27);
+
+			// A record, a page of a file, a whole archive
+			for (std::size_t Size : { 64ull, 4096ull, 64ull << 20 })
+			{
+				auto Data = RandomBytes(Random, Size);
+				auto Passes = std::max<std::size_t>((256ull << 20) / Size, 1);
+				std::uint32_t Sum = 0;
+
+				auto Measure = [&](auto&& Func)
+				{
+					Stopwatch Watch;
+					for (std::size_t i = 0; i < Passes; i++)
+						Sum += Func(Data.data(), Size);
+					// MB/s
+					return ((double)Size * Passes / (1024.0 * 1024.0)) / (Watch.GetMilliseconds() / 1000.0);
+				};
+
+				auto Table = Measure([](const std::uint8_t* Ptr, std::size_t Len) { return TableCRC(Ptr, Len); });
+				auto Buffer = Measure([](const std::uint8_t* Ptr, std::size_t Len)
+					{ return HashUtils::CRC32Buffer(Ptr, (std::uint32_t)Len); });
+				auto Castagnoli = Measure([](const std::uint8_t* Ptr, std::size_t Len) { return HashUtils::CRC32C(Ptr, Len); });
+
+				CKPE_BENCH_PRINT("%8zu bytes: table %8.0f MB/s, CRC32Buffer %8.0f MB/s x%.1f, CRC32C %8.0f MB/s x%.1f (%x)",
+					Size, Table, Buffer, Buffer / Table, Castagnoli, Castagnoli / Table, Sum);
+			}
+		}
+
+		CKPE_TEST(MurmurHash3)
+		{
+			const char* Fox = "The quick brown fox jumps over the lazy dog";
+
+			CKPE_CHECK(HashUtils::MurmurHash3("", 0, 0) == 0);
+			CKPE_CHECK(HashUtils::MurmurHash3("", 0, 1) == 0x514E28B7ul);
+			CKPE_CHECK(HashUtils::MurmurHash3("Hello, world!", 13, 1234) == 0xFAF6CDB3ul);
+			CKPE_CHECK(HashUtils::MurmurHash3(Fox, strlen(Fox), 0) == 0x2E4FF723ul);
+
+			std::mt19937 Random(3);
+
+			for (std::uint32_t Pass = 0; Pass < 200; Pass++)
+			{
+				auto Data = RandomBytes(Random, Random() % 1000);
+				auto Seed = (std::uint32_t)Random();
+
+				// The tail of each piece is carried to the next one
+				Murmur3State State(Seed);
+				for (std::size_t Offset = 0; Offset < Data.size();)
+				{
+					auto Piece = std::min<std::size_t>(Random() % 7, Data.size() - Offset);
+					State.Update(Data.data() + Offset, Piece);
+					Offset += Piece;
+				}
+
+				CKPE_CHECK(State.Final() == HashUtils::MurmurHash3(Data.data(), Data.size(), Seed));
+			}
+		}
+	}
+}
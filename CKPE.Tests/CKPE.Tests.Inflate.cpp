@@ -0,0 +1,143 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <libdeflate.h>
+#include "CKPE.Tests.h"
+
+#include <random>
+#include <string.h>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		struct InflateRecord
+		{
+			std::vector<std::uint8_t> Compressed;
+			std::uint32_t Size;
+		};
+
+		// Compressed records as the plugins have them: NAVM and LAND are big arrays of floats and indices,
+		// NPC_ a few hundred bytes of fields. Most of them are small.
+		static std::vector<InflateRecord> SyntheticRecords(std::uint32_t Count, std::uint64_t& TotalSize)
+		{
+			std::mt19937 Random(41);
+			auto Compressor = libdeflate_alloc_compressor(6);
+			std::vector<InflateRecord> Records;
+			std::vector<std::uint8_t> Data;
+			TotalSize = 0;
+
+			for (std::uint32_t i = 0; (i < Count) && Compressor; i++)
+			{
+				auto Kind = Random() % 20;
+				std::uint32_t Size = (Kind < 14) ? 100 + Random() % 500 : ((Kind < 19) ? 1024 + Random() % 7168 :
+					16384 + Random() % 49152);
+
+				Data.resize(Size);
+				float Value = (float)(Random() % 1000);
+				for (std::uint32_t j = 0; (j + 4) <= Size; j += 4)
+				{
+					// Neighbouring vertices and heights differ a little, many fields are zero
+					auto Step = Random() % 16;
+					if (Step < 4)
+						Value += (float)Step * 0.25f;
+					else if (Step == 4)
+						Value = 0.0f;
+					memcpy(Data.data() + j, &Value, 4);
+				}
+
+				InflateRecord Record;
+				Record.Size = Size;
+				Record.Compressed.resize(libdeflate_zlib_compress_bound(Compressor, Size));
+				Record.Compressed.resize(libdeflate_zlib_compress(Compressor, Data.data(), Size,
+					Record.Compressed.data(), Record.Compressed.size()));
+				TotalSize += Size;
+				Records.push_back(std::move(Record));
+			}
+
+			if (Compressor)
+				libdeflate_free_compressor(Compressor);
+
+			return Records;
+		}
+
+		// As HKInflate did before: a decompressor for each record
+		static bool InflatePerCall(const InflateRecord& Record, std::uint8_t* Output) noexcept(true)
+		{
+			auto Decompressor = libdeflate_alloc_decompressor();
+			if (!Decompressor)
+				return false;
+
+			std::size_t Size = 0;
+			auto Result = libdeflate_zlib_decompress(Decompressor, Record.Compressed.data(), Record.Compressed.size(),
+				Output, Record.Size, &Size);
+			libdeflate_free_decompressor(Decompressor);
+			return (Result == LIBDEFLATE_SUCCESS) && (Size == Record.Size);
+		}
+
+		// As HKInflate does: one decompressor for each thread, freed when the thread ends
+		struct InflateThreadDecompressor
+		{
+			libdeflate_decompressor* Handle{ nullptr };
+
+			~InflateThreadDecompressor() noexcept(true)
+			{
+				if (Handle)
+					libdeflate_free_decompressor(Handle);
+			}
+		};
+
+		thread_local InflateThreadDecompressor CachedInflateDecompressor;
+
+		static bool InflateCached(const InflateRecord& Record, std::uint8_t* Output) noexcept(true)
+		{
+			auto& Decompressor = CachedInflateDecompressor.Handle;
+			if (!Decompressor)
+			{
+				Decompressor = libdeflate_alloc_decompressor();
+				if (!Decompressor)
+					return false;
+			}
+
+			std::size_t Size = 0;
+			auto Result = libdeflate_zlib_decompress(Decompressor, Record.Compressed.data(), Record.Compressed.size(),
+				Output, Record.Size, &Size);
+			return (Result == LIBDEFLATE_SUCCESS) && (Size == Record.Size);
+		}
+
+		CKPE_BENCHMARK(InflateRecords)
+		{
+			// Skyrim.esm alone has hundreds of thousands of compressed records
+			constexpr std::uint32_t Count = 200000;
+
+			std::uint64_t TotalSize = 0;
+			auto Records = SyntheticRecords(Count, TotalSize);
+			CKPE_CHECK(Records.size() == Count);
+			if (Records.size() != Count)
+				return;
+
+			std::uint64_t CompressedSize = 0;
+			for (auto& Record : Records)
+				CompressedSize += Record.Compressed.size();
+
+			CKPE_BENCH_PRINT("%u records, %.1f MB, %.1f MB compressed", Count, TotalSize / 1048576.0,
+				CompressedSize / 1048576.0);
+
+			std::vector<std::uint8_t> Output(65536);
+
+			for (auto [Name, Inflate] : { std::pair{ "per call", &InflatePerCall }, std::pair{ "cached", &InflateCached } })
+			{
+				std::uint32_t Failed = 0;
+				Stopwatch Watch;
+				for (auto& Record : Records)
+					Failed += !Inflate(Record, Output.data());
+				auto Time = Watch.GetMilliseconds();
+				CKPE_CHECK(!Failed);
+
+				CKPE_BENCH_PRINT("%-8s: %7.1f ms, %6.0f ns a record, %6.1f MB/s", Name, Time, Time * 1000000.0 / Count,
+					(TotalSize / 1048576.0) / (Time / 1000.0));
+			}
+		}
+	}
+}
@@ -0,0 +1,172 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <CKPE.Common.IntervalIndex.h>
+#include "CKPE.Tests.h"
+
+#include <random>
+#include <limits>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		using Common::IntervalIndex;
+
+		struct Region { std::uintptr_t Start, End; };
+
+		static void GetRegionRange(const Region& Item, std::uintptr_t& Start, std::uintptr_t& End) noexcept(true)
+		{
+			Start = Item.Start;
+			End = Item.End;
+		}
+
+		// As the crash report searched before the index
+		static const Region* LinearResolve(const std::vector<Region>& Regions, std::uintptr_t Address) noexcept(true)
+		{
+			for (auto& Item : Regions)
+				if ((Address >= Item.Start) && (Address < Item.End))
+					return &Item;
+			return nullptr;
+		}
+
+		// Modules of the editor: not overlapping, some of them next to each other, in the order of loading
+		static std::vector<Region> RandomRegions(std::mt19937_64& Random, std::size_t Count)
+		{
+			std::vector<Region> Regions;
+			std::uintptr_t Address = 0x10000;
+			for (std::size_t i = 0; i < Count; i++)
+			{
+				auto Gap = (Random() % 3) ? (Random() % 0x100000) & ~0xFFFull : 0;
+				auto Size = ((Random() % 0x400000) & ~0xFFFull) + 0x1000;
+				Regions.push_back({ Address + Gap, Address + Gap + Size });
+				Address += Gap + Size;
+			}
+
+			std::shuffle(Regions.begin(), Regions.end(), Random);
+			return Regions;
+		}
+
+		CKPE_TEST(IntervalIndexMatchesLinear)
+		{
+			std::mt19937_64 Random(37);
+
+			for (std::size_t Count : { 0, 1, 2, 5, 300, 5000 })
+			{
+				auto Regions = RandomRegions(Random, Count);
+				IntervalIndex<Region> Index;
+				Index.Build(Regions, GetRegionRange);
+				CKPE_CHECK(Index.GetCount() == Count);
+
+				std::uintptr_t Low = 0, High = 0x20000;
+				for (auto& Item : Regions)
+					High = std::max(High, Item.End + 0x10000);
+
+				std::uint32_t Wrong = 0;
+				for (std::uint32_t i = 0; i < 200000; i++)
+				{
+					std::uintptr_t Address;
+					switch (Random() % 4)
+					{
+					case 0:
+						// Anywhere, misses below, above and in the gaps
+						Address = Low + Random() % (High - Low);
+						break;
+					case 1:
+					{
+						// The edges of a region
+						auto Item = Regions.empty() ? Region{ 0, 1 } : Regions[Random() % Regions.size()];
+						std::uintptr_t Edges[] = { Item.Start, Item.End - 1, Item.End, Item.Start - 1 };
+						Address = Edges[Random() % 4];
+						break;
+					}
+					default:
+						// A few regions over and over, as a stack is, the cache is hit
+						if (Regions.empty())
+							Address = Random();
+						else
+						{
+							auto& Item = Regions[Random() % std::min<std::size_t>(Regions.size(), 6)];
+							Address = Item.Start + Random() % (Item.End - Item.Start);
+						}
+						break;
+					}
+
+					if (Index.Find(Address) != LinearResolve(Regions, Address))
+						Wrong++;
+				}
+
+				CKPE_CHECK(!Wrong);
+				CKPE_CHECK(Index.Find(0) == LinearResolve(Regions, 0));
+				CKPE_CHECK(Index.Find(std::numeric_limits<std::uintptr_t>::max()) == nullptr);
+			}
+		}
+
+		CKPE_TEST(IntervalIndexRebuild)
+		{
+			std::vector<Region> First = { { 0x1000, 0x2000 }, { 0x3000, 0x4000 } };
+			std::vector<Region> Second = { { 0x1800, 0x3800 } };
+
+			IntervalIndex<Region> Index;
+			Index.Build(First, GetRegionRange);
+			CKPE_CHECK(Index.Find(0x1FFF) == &First[0]);
+			CKPE_CHECK(Index.Find(0x3000) == &First[1]);
+			CKPE_CHECK(Index.Find(0x2000) == nullptr);
+
+			// Nothing of the first list is left in the cache
+			Index.Build(Second, GetRegionRange);
+			CKPE_CHECK(Index.Find(0x1FFF) == &Second[0]);
+			CKPE_CHECK(Index.Find(0x3000) == &Second[0]);
+			CKPE_CHECK(Index.Find(0x1000) == nullptr);
+			CKPE_CHECK(Index.Find(0x3800) == nullptr);
+
+			// An empty range isn't an interval
+			std::vector<Region> Empty = { { 0x5000, 0x5000 }, { 0x6000, 0x7000 } };
+			Index.Build(Empty, GetRegionRange);
+			CKPE_CHECK(Index.GetCount() == 1);
+			CKPE_CHECK(Index.Find(0x5000) == nullptr);
+			CKPE_CHECK(Index.Find(0x6000) == &Empty[1]);
+
+			Index.Clear();
+			CKPE_CHECK(Index.Empty());
+			CKPE_CHECK(Index.Find(0x6000) == nullptr);
+		}
+
+		CKPE_BENCHMARK(IntervalIndexLookup)
+		{
+			constexpr std::uint32_t Lookups = 1000000;
+
+			std::mt19937_64 Random(37);
+			for (std::size_t Count : { 300, 3000, 30000 })
+			{
+				// 300 modules and several thousands of memory regions are usual for the editor
+				auto Regions = RandomRegions(Random, Count);
+				IntervalIndex<Region> Index;
+				Index.Build(Regions, GetRegionRange);
+
+				std::vector<std::uintptr_t> Addresses;
+				for (std::uint32_t i = 0; i < 4096; i++)
+				{
+					auto& Item = Regions[Random() % Regions.size()];
+					Addresses.push_back(Item.Start + Random() % (Item.End - Item.Start));
+				}
+
+				std::uintptr_t Sum = 0;
+				Stopwatch Watch;
+				for (std::uint32_t i = 0; i < Lookups; i++)
+					Sum += (std::uintptr_t)Index.Find(Addresses[i & 4095]);
+				auto IndexNs = Watch.GetMilliseconds() * 1000000.0 / Lookups;
+
+				auto LinearLookups = Lookups / 100;
+				Watch.Restart();
+				for (std::uint32_t i = 0; i < LinearLookups; i++)
+					Sum += (std::uintptr_t)LinearResolve(Regions, Addresses[i & 4095]);
+				auto LinearNs = Watch.GetMilliseconds() * 1000000.0 / LinearLookups;
+
+				CKPE_BENCH_PRINT("%5zu regions: index %6.1f ns, linear %9.1f ns, x%.0f (%zx)", Count, IndexNs, LinearNs,
+					LinearNs / IndexNs, (std::size_t)Sum);
+			}
+		}
+	}
+}
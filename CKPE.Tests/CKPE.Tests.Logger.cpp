@@ -0,0 +1,161 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <CKPE.Logger.h>
+#include <CKPE.PackedArgs.h>
+#include "CKPE.Tests.h"
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <cstdarg>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		constexpr static std::uint32_t LOGGER_THREADS = 8;
+
+		// As _MESSAGE does it, the args are packed and formatted by the writer thread
+		static void LogMessage(const Logger& Log, const char* Format, ...) noexcept(true)
+		{
+			va_list ap;
+			va_start(ap, Format);
+			Log.WriteStringVa(Logger::tMessage, Format, ap);
+			va_end(ap);
+		}
+
+		// "T<thread> <index>" from each thread, the other lines are skipped. A spilled message may pass
+		// the queued ones of its thread, so the order is checked only if nothing is written directly.
+		static bool CheckLoggerOutput(const std::wstring& FileName, std::uint32_t Threads, std::uint32_t Count,
+			bool Ordered)
+		{
+			std::ifstream File{ std::filesystem::path(FileName) };
+			if (!File)
+				return false;
+
+			std::vector<std::uint32_t> Next(Threads, 0), Lines(Threads, 0);
+			std::string Line;
+			bool InOrder = true;
+
+			while (std::getline(File, Line))
+			{
+				std::uint32_t Thread, Index;
+				if ((sscanf(Line.c_str(), "T%u %u", &Thread, &Index) != 2) || (Thread >= Threads))
+					continue;
+
+				// The messages of one thread keep their order
+				if (Index != Next[Thread])
+					InOrder = false;
+				Next[Thread] = Index + 1;
+				Lines[Thread]++;
+			}
+
+			for (auto Value : Lines)
+				if (Value != Count)
+					return false;
+
+			return InOrder || !Ordered;
+		}
+
+		static double WriteFromThreads(const Logger& Log, std::uint32_t Threads, std::uint32_t Count, bool Packed)
+		{
+			Stopwatch Watch;
+			std::vector<std::thread> Writers;
+
+			for (std::uint32_t Thread = 0; Thread < Threads; Thread++)
+				Writers.emplace_back([&Log, Thread, Count, Packed]()
+					{
+						for (std::uint32_t i = 0; i < Count; i++)
+						{
+							if (Packed)
+								LogMessage(Log, "T%u %u packed message with a string \"%s\"", Thread, i, "argument");
+							else
+								Log.Write("T%u %u formatted message with a string \"%s\"", Thread, i, "argument");
+						}
+					});
+
+			for (auto& Writer : Writers)
+				Writer.join();
+
+			return Watch.GetMilliseconds();
+		}
+
+		// The packed message as the writer thread would make it, "<unpacked>" if Pack refused the format
+		static std::string PackAndFormat(const char* Format, ...)
+		{
+			va_list ap;
+			va_start(ap, Format);
+			std::string Buffer;
+			std::uint32_t Count = 0;
+			bool Packed = PackedArgs::Pack(Buffer, Format, ap, Count);
+			va_end(ap);
+
+			return Packed ? PackedArgs::Format(Format, Buffer.data(), Buffer.size(), Count) : "<unpacked>";
+		}
+
+		CKPE_TEST(PackedArgsSameAsPrintf)
+		{
+			CKPE_CHECK(PackAndFormat("%d %5u %-4x| %08.3f %s", -7, 42u, 0xABu, 3.14159, "text") ==
+				"-7    42 ab  | 0003.142 text");
+			CKPE_CHECK(PackAndFormat("[%c][%3c][%-3c]", 'a', 'b', 'c') == "[a][  b][c  ]");
+			CKPE_CHECK(PackAndFormat("[%lc][%4lc]", L'x', L'y') == "[x][   y]");
+			CKPE_CHECK(PackAndFormat("[%.3s][%6s][%*d]", "abcdef", "ab", 4, 9) == "[abc][    ab][   9]");
+			CKPE_CHECK(PackAndFormat("%s", (const char*)nullptr) == "(null)");
+			// A pointer to ANSI_STRING, it can't be read as char*
+			CKPE_CHECK(PackAndFormat("%Z", (void*)nullptr) == "<unpacked>");
+			CKPE_CHECK(PackAndFormat("%d%n", 1, (int*)nullptr) == "<unpacked>");
+		}
+
+		CKPE_TEST(LoggerAsyncKeepsEverything)
+		{
+			auto FileName = GetTempFileName(L"CKPE.Tests.Logger.log");
+
+			for (auto Policy : { Logger::fpBlock, Logger::fpSpill })
+			{
+				for (bool Packed : { false, true })
+				{
+					{
+						Logger Log;
+						CKPE_CHECK(Log.Open(FileName));
+						CKPE_CHECK(Log.StartAsync(Policy));
+						WriteFromThreads(Log, LOGGER_THREADS, 20000, Packed);
+						CKPE_CHECK(Log.GetDroppedCount() == 0);
+						Log.Close();
+					}
+
+					CKPE_CHECK(CheckLoggerOutput(FileName, LOGGER_THREADS, 20000, Policy == Logger::fpBlock));
+				}
+			}
+		}
+
+		CKPE_BENCHMARK(LoggerAsyncThroughput)
+		{
+			constexpr std::uint32_t Count = 1000000;
+			auto FileName = GetTempFileName(L"CKPE.Tests.Logger.log");
+
+			for (bool Packed : { false, true })
+			{
+				double Time, Total;
+
+				{
+					Logger Log;
+					CKPE_CHECK(Log.Open(FileName));
+					CKPE_CHECK(Log.StartAsync(Logger::fpBlock));
+
+					Stopwatch Watch;
+					Time = WriteFromThreads(Log, LOGGER_THREADS, Count, Packed);
+					// Until the last one is in the file
+					Log.Close();
+					Total = Watch.GetMilliseconds();
+				}
+
+				CKPE_CHECK(CheckLoggerOutput(FileName, LOGGER_THREADS, Count, true));
+				CKPE_BENCH_PRINT("%s: %u threads x %u messages, %.0f ms in the threads (%.0f ns a message), %.0f ms to the file",
+					Packed ? "packed" : "formatted", LOGGER_THREADS, Count, Time,
+					(Time * 1000000.0) / ((double)LOGGER_THREADS * Count), Total);
+			}
+		}
+	}
+}
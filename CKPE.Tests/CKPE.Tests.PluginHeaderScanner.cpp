@@ -0,0 +1,202 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <CKPE.Common.PluginHeaderScanner.h>
+#include "CKPE.Tests.h"
+
+#include <string.h>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		// The TES4 record, the subrecords are appended and the size is set by Get()
+		class TES4Builder
+		{
+			std::vector<std::uint8_t> _data;
+		public:
+			TES4Builder(std::uint32_t Flags = 0, std::uint16_t FormVersion = 44)
+			{
+				Append("TES4", 4);
+				Append32(0);
+				Append32(Flags);
+				Append32(0);					// FormID
+				Append32(0);					// Version control
+				Append16(FormVersion);
+				Append16(0);
+			}
+
+			void Append(const void* Data, std::size_t Size)
+			{
+				_data.insert(_data.end(), (const std::uint8_t*)Data, (const std::uint8_t*)Data + Size);
+			}
+
+			void Append16(std::uint16_t Value) { Append(&Value, sizeof(Value)); }
+			void Append32(std::uint32_t Value) { Append(&Value, sizeof(Value)); }
+
+			void Sub(const char* Signature, const void* Data, std::size_t Size)
+			{
+				// The size that doesn't fit goes before it in XXXX
+				if (Size > 0xFFFF)
+				{
+					Append("XXXX", 4);
+					Append16(4);
+					Append32((std::uint32_t)Size);
+				}
+
+				Append(Signature, 4);
+				Append16((Size > 0xFFFF) ? 0 : (std::uint16_t)Size);
+				Append(Data, Size);
+			}
+
+			void SubString(const char* Signature, const std::string& Value)
+			{
+				Sub(Signature, Value.c_str(), Value.length() + 1);
+			}
+
+			void Hedr(float Version, std::uint32_t RecordCount, std::uint32_t NextObjectID)
+			{
+				std::uint8_t Data[12];
+				memcpy(Data, &Version, 4);
+				memcpy(Data + 4, &RecordCount, 4);
+				memcpy(Data + 8, &NextObjectID, 4);
+				Sub("HEDR", Data, sizeof(Data));
+			}
+
+			void Master(const std::string& Name)
+			{
+				std::uint64_t Size = 0;
+				SubString("MAST", Name);
+				Sub("DATA", &Size, sizeof(Size));
+			}
+
+			[[nodiscard]] std::vector<std::uint8_t> Get() const
+			{
+				auto Result = _data;
+				auto DataSize = (std::uint32_t)(Result.size() - 24);
+				memcpy(Result.data() + 4, &DataSize, 4);
+				return Result;
+			}
+		};
+
+		static std::vector<std::uint8_t> MakeTES4()
+		{
+			TES4Builder Builder(Common::PluginHeaderScanner::FLAG_MASTER | Common::PluginHeaderScanner::FLAG_LOCALIZED);
+			Builder.Hedr(1.71f, 12345, 0x800);
+			Builder.SubString("CNAM", "perchik71");
+			Builder.SubString("SNAM", "Test plugin");
+			Builder.Master("Skyrim.esm");
+			Builder.Master("Update.esm");
+			Builder.Sub("INTV", "\x01\x00\x00\x00", 4);
+			return Builder.Get();
+		}
+
+		CKPE_TEST(PluginHeaderParse)
+		{
+			auto Data = MakeTES4();
+
+			// A record that follows doesn't matter
+			auto WithRecord = Data;
+			WithRecord.insert(WithRecord.end(), { 'G', 'R', 'U', 'P', 24, 0, 0, 0 });
+			WithRecord.resize(WithRecord.size() + 16);
+
+			for (auto Buffer : { &Data, &WithRecord })
+			{
+				Common::PluginHeaderScanner::Header Header;
+				CKPE_CHECK(Common::PluginHeaderScanner::Parse(Buffer->data(), Buffer->size(), Header));
+				CKPE_CHECK(Header.IsMaster() && Header.IsLocalized());
+				CKPE_CHECK(Header.FormVersion == 44);
+				CKPE_CHECK(Header.Version == 1.71f);
+				CKPE_CHECK(Header.RecordCount == 12345);
+				CKPE_CHECK(Header.NextObjectID == 0x800);
+				CKPE_CHECK(Header.Author == "perchik71");
+				CKPE_CHECK(Header.Description == "Test plugin");
+				CKPE_CHECK((Header.Masters.size() == 2) && (Header.Masters[0] == "Skyrim.esm") &&
+					(Header.Masters[1] == "Update.esm"));
+			}
+
+			// Nothing but the record
+			TES4Builder Builder(0, 131);
+			auto Empty = Builder.Get();
+			Common::PluginHeaderScanner::Header Header;
+			CKPE_CHECK(Common::PluginHeaderScanner::Parse(Empty.data(), Empty.size(), Header));
+			CKPE_CHECK(!Header.IsMaster() && (Header.FormVersion == 131) && Header.Masters.empty());
+		}
+
+		CKPE_TEST(PluginHeaderParseBroken)
+		{
+			auto Data = MakeTES4();
+			Common::PluginHeaderScanner::Header Header;
+
+			CKPE_CHECK(!Common::PluginHeaderScanner::Parse(nullptr, Data.size(), Header));
+
+			// Cut anywhere
+			for (std::size_t Size = 0; Size < Data.size(); Size++)
+				CKPE_CHECK(!Common::PluginHeaderScanner::Parse(Data.data(), Size, Header));
+
+			auto Broken = Data;
+			memcpy(Broken.data(), "TES3", 4);
+			CKPE_CHECK(!Common::PluginHeaderScanner::Parse(Broken.data(), Broken.size(), Header));
+
+			Broken = Data;
+			Broken[10] |= 0x04;			// Compressed
+			CKPE_CHECK(!Common::PluginHeaderScanner::Parse(Broken.data(), Broken.size(), Header));
+
+			// The first subrecord (HEDR) is larger than the record
+			Broken = Data;
+			Broken[24 + 4] = 0xFF;
+			Broken[24 + 5] = 0xFF;
+			CKPE_CHECK(!Common::PluginHeaderScanner::Parse(Broken.data(), Broken.size(), Header));
+
+			// A few bytes after the last subrecord, within the record
+			TES4Builder Builder;
+			Builder.Hedr(1.0f, 0, 0);
+			Builder.Append("INTV", 4);
+			auto Tail = Builder.Get();
+			CKPE_CHECK(!Common::PluginHeaderScanner::Parse(Tail.data(), Tail.size(), Header));
+
+			// XXXX that isn't 4 bytes
+			TES4Builder BadExtended;
+			BadExtended.Sub("XXXX", "\x10\x00", 2);
+			BadExtended.SubString("SNAM", "Description");
+			auto Extended = BadExtended.Get();
+			CKPE_CHECK(!Common::PluginHeaderScanner::Parse(Extended.data(), Extended.size(), Header));
+		}
+
+		CKPE_TEST(PluginHeaderParseExtended)
+		{
+			std::string Description(70000, 'd');
+
+			TES4Builder Builder;
+			Builder.Hedr(0.96f, 1, 2);
+			Builder.SubString("SNAM", Description);
+			Builder.SubString("CNAM", "Author");
+			auto Data = Builder.Get();
+
+			Common::PluginHeaderScanner::Header Header;
+			CKPE_CHECK(Common::PluginHeaderScanner::Parse(Data.data(), Data.size(), Header));
+			CKPE_CHECK(Header.Description == Description);
+			CKPE_CHECK(Header.Author == "Author");
+		}
+
+		CKPE_TEST(PluginHeaderRead)
+		{
+			auto Data = MakeTES4();
+			auto FileName = GetTempFileName(L"CKPE.Tests.Header.esm");
+
+			auto f = _wfopen(FileName.c_str(), L"wb");
+			CKPE_CHECK(f);
+			if (!f)
+				return;
+			fwrite(Data.data(), 1, Data.size(), f);
+			fclose(f);
+
+			Common::PluginHeaderScanner::Header Header;
+			CKPE_CHECK(Common::PluginHeaderScanner::Read(FileName, Header));
+			CKPE_CHECK((Header.RecordCount == 12345) && (Header.Masters.size() == 2));
+
+			CKPE_CHECK(!Common::PluginHeaderScanner::Read(GetTempFileName(L"CKPE.Tests.Missing.esm"), Header));
+		}
+	}
+}
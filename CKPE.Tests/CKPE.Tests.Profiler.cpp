@@ -0,0 +1,228 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <CKPE.Common.Profiler.h>
+#include "CKPE.Tests.h"
+
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <map>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		using Common::ProfileAggregator;
+		using Common::ProfileSymbolizer;
+		using Common::ModuleSymbolizer;
+
+		// "f<hex>" for each address, "t<id>" for each thread, the calls are counted
+		class SyntheticSymbolizer : public ProfileSymbolizer
+		{
+			mutable std::atomic_uint32_t _names{ 0 };
+			mutable std::atomic_uint32_t _threads{ 0 };
+		public:
+			[[nodiscard]] virtual std::string GetName(std::uintptr_t Address) const noexcept(true)
+			{
+				_names++;
+				char Name[32];
+				sprintf_s(Name, "f%llx", (std::uint64_t)Address);
+				return Name;
+			}
+
+			[[nodiscard]] virtual std::string GetThreadName(std::uint32_t ThreadId) const noexcept(true)
+			{
+				_threads++;
+				return "t" + std::to_string(ThreadId);
+			}
+
+			[[nodiscard]] inline std::uint32_t GetNameCalls() const noexcept(true) { return _names; }
+			[[nodiscard]] inline std::uint32_t GetThreadNameCalls() const noexcept(true) { return _threads; }
+		};
+
+		// The lines of the folded profile, sorted, the order of the stacks isn't defined
+		static std::vector<std::string> WriteFolded(const ProfileAggregator& Aggregator,
+			const ProfileSymbolizer& Symbolizer, const wchar_t* Name)
+		{
+			auto FileName = GetTempFileName(Name);
+
+			{
+				TextFileStream Stream(FileName, FileStream::fmCreate);
+				Aggregator.WriteFolded(Stream, Symbolizer);
+			}
+
+			std::vector<std::string> Lines;
+			std::ifstream File{ std::filesystem::path(FileName) };
+			std::string Line;
+			while (std::getline(File, Line))
+			{
+				if (!Line.empty() && (Line.back() == '\r'))
+					Line.pop_back();
+				if (!Line.empty())
+					Lines.push_back(Line);
+			}
+
+			std::sort(Lines.begin(), Lines.end());
+			return Lines;
+		}
+
+		CKPE_TEST(ProfileAggregatorFoldsStacks)
+		{
+			ProfileAggregator Aggregator;
+			SyntheticSymbolizer Symbolizer;
+
+			// From the leaf to the root
+			const std::uintptr_t Load[] = { 0x30, 0x20, 0x10 };
+			const std::uintptr_t Save[] = { 0x40, 0x20, 0x10 };
+			const std::uintptr_t Root[] = { 0x10 };
+
+			Aggregator.Add(1, Load, 3);
+			Aggregator.Add(1, Load, 3);
+			Aggregator.Add(1, Load, 3, 5);
+			Aggregator.Add(1, Save, 3);
+			// The same stack of another thread is another line
+			Aggregator.Add(2, Load, 3);
+			// A part of a stack isn't the stack
+			Aggregator.Add(1, Load + 1, 2);
+			Aggregator.Add(1, Root, 1, 3);
+
+			// Nothing to add
+			Aggregator.Add(1, nullptr, 3);
+			Aggregator.Add(1, Load, 0);
+			Aggregator.Add(1, Load, 3, 0);
+
+			CKPE_CHECK(Aggregator.GetSampleCount() == 13);
+			CKPE_CHECK(Aggregator.GetStackCount() == 5);
+
+			auto Lines = WriteFolded(Aggregator, Symbolizer, L"CKPE.Tests.Profile.folded");
+			std::vector<std::string> Expected =
+			{
+				"t1;f10 3",
+				"t1;f10;f20 1",
+				"t1;f10;f20;f30 7",
+				"t1;f10;f20;f40 1",
+				"t2;f10;f20;f30 1",
+			};
+			CKPE_CHECK(Lines == Expected);
+
+			// Each address and thread is named once
+			CKPE_CHECK(Symbolizer.GetNameCalls() == 4);
+			CKPE_CHECK(Symbolizer.GetThreadNameCalls() == 2);
+
+			Aggregator.Clear();
+			CKPE_CHECK(!Aggregator.GetSampleCount() && !Aggregator.GetStackCount());
+			CKPE_CHECK(WriteFolded(Aggregator, Symbolizer, L"CKPE.Tests.Profile.folded").empty());
+
+			// Counts again from zero
+			Aggregator.Add(3, Save, 3, 2);
+			CKPE_CHECK(WriteFolded(Aggregator, Symbolizer, L"CKPE.Tests.Profile.folded") ==
+				std::vector<std::string>{ "t3;f10;f20;f40 2" });
+		}
+
+		CKPE_TEST(ProfileAggregatorMatchesMap)
+		{
+			std::mt19937_64 Random(39);
+			ProfileAggregator Aggregator;
+			SyntheticSymbolizer Symbolizer;
+
+			// As a sampler sees them: a few threads, a few hot paths, deep recursion now and then
+			std::map<std::string, std::uint64_t> Expected;
+			std::uint64_t Samples = 0;
+			for (std::uint32_t i = 0; i < 50000; i++)
+			{
+				std::uintptr_t Frames[Common::Profiler::MAX_DEPTH];
+				auto Depth = (std::uint32_t)(1 + Random() % ((Random() % 8) ? 6 : Common::Profiler::MAX_DEPTH));
+				for (std::uint32_t j = 0; j < Depth; j++)
+					Frames[j] = 0x1000 + (Random() % 4) * 0x10;
+
+				auto ThreadId = (std::uint32_t)(Random() % 3);
+				auto Count = (Random() % 4) + 1;
+				Aggregator.Add(ThreadId, Frames, Depth, Count);
+				Samples += Count;
+
+				auto Line = Symbolizer.GetThreadName(ThreadId);
+				for (auto j = Depth; j > 0; j--)
+					Line += ";" + Symbolizer.GetName(Frames[j - 1]);
+				Expected[Line] += Count;
+			}
+
+			CKPE_CHECK(Aggregator.GetSampleCount() == Samples);
+			CKPE_CHECK(Aggregator.GetStackCount() == Expected.size());
+
+			std::vector<std::string> ExpectedLines;
+			for (auto& [Line, Count] : Expected)
+				ExpectedLines.push_back(Line + " " + std::to_string(Count));
+			std::sort(ExpectedLines.begin(), ExpectedLines.end());
+
+			CKPE_CHECK(WriteFolded(Aggregator, Symbolizer, L"CKPE.Tests.ProfileRandom.folded") == ExpectedLines);
+		}
+
+		CKPE_TEST(ModuleSymbolizerNames)
+		{
+			ModuleSymbolizer Symbolizer;
+
+			// Any address of a function has the name of its start
+			CONTEXT Context{};
+			RtlCaptureContext(&Context);
+			DWORD64 ImageBase = 0;
+			auto Function = RtlLookupFunctionEntry(Context.Rip, &ImageBase, nullptr);
+			CKPE_CHECK(Function && (ImageBase == (DWORD64)GetModuleHandleA(nullptr)));
+			if (Function)
+			{
+				char Expected[64];
+				sprintf_s(Expected, "CKPE.Tests.exe+%X", (std::uint32_t)Function->BeginAddress);
+				CKPE_CHECK(Symbolizer.GetName((std::uintptr_t)Context.Rip) == Expected);
+				CKPE_CHECK(Symbolizer.GetName((std::uintptr_t)(ImageBase + Function->BeginAddress)) == Expected);
+				CKPE_CHECK(Symbolizer.GetName((std::uintptr_t)(ImageBase + Function->EndAddress - 1)) == Expected);
+			}
+
+			// Of another module and outside of any
+			auto Kernel = Symbolizer.GetName((std::uintptr_t)GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetTickCount64"));
+			CKPE_CHECK((Kernel.find('+') != std::string::npos) && (Kernel.rfind("0x", 0) != 0));
+			CKPE_CHECK(Symbolizer.GetName(0x10) == "0x10");
+
+			// The description of the thread without spaces and ';', the id after it
+			auto Id = GetCurrentThreadId();
+			auto SetThreadDescriptionProc = (decltype(&SetThreadDescription))
+				GetProcAddress(GetModuleHandleA("kernel32.dll"), "SetThreadDescription");
+			if (SetThreadDescriptionProc)
+			{
+				SetThreadDescriptionProc(GetCurrentThread(), L"Test; main thread");
+				CKPE_CHECK(Symbolizer.GetThreadName(Id) == "Test__main_thread_" + std::to_string(Id));
+				SetThreadDescriptionProc(GetCurrentThread(), L"");
+			}
+			CKPE_CHECK(Symbolizer.GetThreadName(Id) == "thread_" + std::to_string(Id));
+		}
+
+		CKPE_BENCHMARK(ProfileAggregatorAdd)
+		{
+			constexpr std::uint32_t Samples = 1000000;
+
+			// 1 kHz for 16 minutes of 1 thread, 2000 different stacks of 30 frames
+			std::mt19937_64 Random(39);
+			std::vector<std::uintptr_t> Stacks(2000 * 30);
+			for (auto& Frame : Stacks)
+				Frame = 0x140000000ull + (Random() % 5000) * 0x40;
+
+			ProfileAggregator Aggregator;
+			Stopwatch Watch;
+			for (std::uint32_t i = 0; i < Samples; i++)
+				Aggregator.Add(1, Stacks.data() + (Random() % 2000) * 30, 30);
+			auto AddTime = Watch.GetMilliseconds();
+
+			SyntheticSymbolizer Symbolizer;
+			Watch.Restart();
+			auto Lines = WriteFolded(Aggregator, Symbolizer, L"CKPE.Tests.ProfileBench.folded");
+			auto WriteTime = Watch.GetMilliseconds();
+			CKPE_CHECK(Lines.size() == Aggregator.GetStackCount());
+
+			CKPE_BENCH_PRINT("Add: %.1f ns a sample, %u stacks", AddTime * 1000000.0 / Samples, Aggregator.GetStackCount());
+			CKPE_BENCH_PRINT("WriteFolded: %.1f ms", WriteTime);
+		}
+	}
+}
@@ -0,0 +1,209 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <CKPE.Common.RTTI.h>
+#include "CKPE.Tests.h"
+
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <string.h>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		// An image as the linker lays it out: .text, .rdata with the locators and the vtables, .data with
+		// the type descriptors. Everything is addressed by RVA from the start of the buffer.
+		class SyntheticImage
+		{
+		public:
+			constexpr static std::uint32_t TEXT_RVA = 0x1000;
+			constexpr static std::uint32_t TEXT_SIZE = 0x10000;
+			constexpr static std::uint32_t RDATA_RVA = TEXT_RVA + TEXT_SIZE;
+			constexpr static std::uint32_t RDATA_SIZE = 4 * 1024 * 1024;
+			constexpr static std::uint32_t DATA_RVA = RDATA_RVA + RDATA_SIZE;
+			constexpr static std::uint32_t DATA_SIZE = 0x40000;
+
+			struct Class
+			{
+				std::string RawName;
+				std::uint32_t VTableRVA;
+				std::uint32_t FunctionCount;
+			};
+		private:
+			std::vector<std::uint8_t> _image;
+			std::uint32_t _data{ DATA_RVA };
+			std::vector<Class> _classes;
+
+			template<typename T>
+			T* At(std::uint32_t RVA) { return (T*)(_image.data() + RVA); }
+		public:
+			SyntheticImage() : _image(DATA_RVA + DATA_SIZE, 0)
+			{
+				memset(_image.data() + TEXT_RVA, 0xCC, TEXT_SIZE);
+			}
+
+			[[nodiscard]] std::uintptr_t GetBase() const noexcept(true) { return (std::uintptr_t)_image.data(); }
+			[[nodiscard]] const std::vector<Class>& GetClasses() const noexcept(true) { return _classes; }
+
+			[[nodiscard]] Segment GetSegment(std::uint32_t RVA, std::uint32_t Size) const noexcept(true)
+			{
+				return Segment(GetBase(), GetBase() + RVA, Size);
+			}
+
+			// The locator, its hierarchy and the vtable at RVA, the type descriptor in .data.
+			// A vtable of a base subobject (Offset != 0) isn't a class of its own.
+			void AddClass(const std::string& RawName, std::uint32_t RVA, std::uint32_t FunctionCount, std::uint32_t Offset = 0)
+			{
+				using RTTI = Common::RTTI;
+
+				auto TypeRVA = _data;
+				auto Type = At<RTTI::TypeDescriptor>(TypeRVA);
+				memcpy(Type->name, RawName.c_str(), RawName.length() + 1);
+				_data += (std::uint32_t)((offsetof(RTTI::TypeDescriptor, name) + RawName.length() + 1 + 15) & ~15);
+
+				auto LocatorRVA = RVA;
+				auto HierarchyRVA = LocatorRVA + 0x20;
+				auto ArrayRVA = HierarchyRVA + 0x10;
+				auto BaseRVA = ArrayRVA + 0x8;
+				auto VTableRVA = BaseRVA + 0x20 + 8;
+
+				auto Locator = At<RTTI::CompleteObjectLocator>(LocatorRVA);
+				Locator->Signature = RTTI::CompleteObjectLocator::COL_Signature64;
+				Locator->Offset = Offset;
+				Locator->TypeDescriptor.offset = TypeRVA;
+				Locator->ClassDescriptor.offset = HierarchyRVA;
+
+				auto Hierarchy = At<RTTI::ClassHierarchyDescriptor>(HierarchyRVA);
+				Hierarchy->NumBaseClasses = 1;
+				Hierarchy->BaseClassArray.offset = ArrayRVA;
+				*At<std::uint32_t>(ArrayRVA) = BaseRVA;
+				At<RTTI::BaseClassDescriptor>(BaseRVA)->TypeDescriptor.offset = TypeRVA;
+
+				*At<std::uintptr_t>(VTableRVA - 8) = GetBase() + LocatorRVA;
+				for (std::uint32_t i = 0; i < FunctionCount; i++)
+					*At<std::uintptr_t>(VTableRVA + i * 8) = GetBase() + TEXT_RVA + ((RVA / 8 + i) * 16) % TEXT_SIZE;
+
+				if (!Offset)
+					_classes.push_back({ RawName, VTableRVA, FunctionCount });
+			}
+		};
+
+		static SyntheticImage* MakeImage()
+		{
+			auto Image = new SyntheticImage;
+
+			// Spread over the whole .rdata, so the pieces of the scan cut between them
+			constexpr std::uint32_t Count = 3000;
+			constexpr std::uint32_t Step = ((SyntheticImage::RDATA_SIZE - 0x100) / Count) & ~7u;
+
+			for (std::uint32_t i = 0; i < Count; i++)
+			{
+				std::string Name;
+				switch (i % 3)
+				{
+				case 0: Name = ".?AVClass" + std::to_string(i) + "@@"; break;
+				case 1: Name = ".?AUStruct" + std::to_string(i) + "@Space@@"; break;
+				default: Name = ".?AV?$Template" + std::to_string(i) + "@H@@"; break;
+				}
+
+				Image->AddClass(Name, SyntheticImage::RDATA_RVA + i * Step, 1 + i % 9);
+				if (!(i % 10))
+					Image->AddClass(Name, SyntheticImage::RDATA_RVA + i * Step + Step / 2, 2, 16);
+			}
+
+			return Image;
+		}
+
+		CKPE_TEST(RTTISyntheticImage)
+		{
+			std::unique_ptr<SyntheticImage> Image(MakeImage());
+			auto Base = Image->GetBase();
+
+			Common::RTTI Rtti;
+			Rtti.Initialize(Base, Image->GetSegment(SyntheticImage::TEXT_RVA, SyntheticImage::TEXT_SIZE),
+				Image->GetSegment(SyntheticImage::DATA_RVA, SyntheticImage::DATA_SIZE),
+				Image->GetSegment(SyntheticImage::RDATA_RVA, SyntheticImage::RDATA_SIZE));
+
+			for (auto& Class : Image->GetClasses())
+			{
+				auto Info = Rtti.Find(Class.RawName, false);
+				CKPE_CHECK(Info);
+				if (!Info)
+					continue;
+
+				CKPE_CHECK(Info->VTableAddress == Base + Class.VTableRVA);
+				CKPE_CHECK(Info->VFunctionCount == Class.FunctionCount);
+				CKPE_CHECK(!strcmp(Info->RawName, Class.RawName.c_str()));
+				CKPE_CHECK(Rtti.Find(Base + Class.VTableRVA, false) == Info);
+			}
+
+			// Only the start of a vtable
+			CKPE_CHECK(!Rtti.Find(Base + Image->GetClasses()[0].VTableRVA + 8, false));
+
+			// By the demangled name, mangled back or through the names demangled once
+			auto Class = Rtti.Find("class Class0", false);
+			auto Struct = Rtti.Find("struct Space::Struct1", false);
+			CKPE_CHECK(Class && (Class->VTableAddress == Base + Image->GetClasses()[0].VTableRVA));
+			CKPE_CHECK(Struct && (Struct->VTableAddress == Base + Image->GetClasses()[1].VTableRVA));
+			CKPE_CHECK(!Rtti.Find("class Space::Struct1", false));
+
+			// Without the heap, the templates are left mangled
+			char Buffer[256];
+			auto Info = Rtti.Find(".?AVClass3@@", false);
+			CKPE_CHECK(Info && !strcmp(Common::RTTI::GetNameNoAlloc(Info, Buffer, sizeof(Buffer)), "class Class3"));
+			Info = Rtti.Find(".?AUStruct4@Space@@", false);
+			CKPE_CHECK(Info && !strcmp(Common::RTTI::GetNameNoAlloc(Info, Buffer, sizeof(Buffer)), "struct Space::Struct4"));
+			CKPE_CHECK(Info && !strcmp(Common::RTTI::GetNameNoAlloc(Info, Buffer, 8), ".?AUStruct4@Space@@"));
+			Info = Rtti.Find(".?AV?$Template5@H@@", false);
+			CKPE_CHECK(Info && !strcmp(Common::RTTI::GetNameNoAlloc(Info, Buffer, sizeof(Buffer)), ".?AV?$Template5@H@@"));
+
+			auto Template = Rtti.Find("class Template2<int>", false);
+			CKPE_CHECK(Template && !strcmp(Template->RawName, ".?AV?$Template2@H@@"));
+			CKPE_CHECK(Template && !strcmp(Common::RTTI::GetNameNoAlloc(Template, Buffer, sizeof(Buffer)), "class Template2<int>"));
+		}
+
+		CKPE_TEST(RTTIDemangleThreads)
+		{
+			std::unique_ptr<SyntheticImage> Image(MakeImage());
+
+			Common::RTTI Rtti;
+			Rtti.Initialize(Image->GetBase(), Image->GetSegment(SyntheticImage::TEXT_RVA, SyntheticImage::TEXT_SIZE),
+				Image->GetSegment(SyntheticImage::DATA_RVA, SyntheticImage::DATA_SIZE),
+				Image->GetSegment(SyntheticImage::RDATA_RVA, SyntheticImage::RDATA_SIZE));
+
+			std::vector<const Common::RTTI::Info*> Infos;
+			for (auto& Class : Image->GetClasses())
+				Infos.push_back(Rtti.Find(Class.RawName, false));
+
+			// Every thread demangles all of them, the first name stays
+			constexpr std::uint32_t Threads = 8;
+			std::vector<std::vector<const char*>> Names(Threads, std::vector<const char*>(Infos.size()));
+			std::vector<std::thread> Workers;
+			for (std::uint32_t t = 0; t < Threads; t++)
+				Workers.emplace_back([&, t]()
+					{
+						for (std::size_t i = 0; i < Infos.size(); i++)
+						{
+							auto Index = (i + t * 97) % Infos.size();
+							Names[t][Index] = Infos[Index] ? Infos[Index]->GetName() : nullptr;
+						}
+					});
+
+			for (auto& Worker : Workers)
+				Worker.join();
+
+			for (std::size_t i = 0; i < Infos.size(); i++)
+			{
+				CKPE_CHECK(Names[0][i]);
+				for (std::uint32_t t = 1; t < Threads; t++)
+					CKPE_CHECK(Names[t][i] == Names[0][i]);
+			}
+
+			CKPE_CHECK(Names[0][0] && !strcmp(Names[0][0], "class Class0"));
+			CKPE_CHECK(Names[0][1] && !strcmp(Names[0][1], "struct Space::Struct1"));
+		}
+	}
+}
@@ -0,0 +1,286 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <shlwapi.h>
+#include <CKPE.Common.SearchIndex.h>
+#include <CKPE.Common.TaskScheduler.h>
+#include "CKPE.Tests.h"
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cctype>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		// What the index must answer: the items in the order they were added, a changed text goes to the end
+		class SearchModel
+		{
+			std::vector<std::pair<std::uintptr_t, std::string>> _items;
+		public:
+			void Add(std::uintptr_t Id, const std::string& Text)
+			{
+				Remove(Id);
+				_items.emplace_back(Id, Text);
+			}
+
+			void Remove(std::uintptr_t Id)
+			{
+				std::erase_if(_items, [Id](auto& Item) { return Item.first == Id; });
+			}
+
+			void Clear() { _items.clear(); }
+
+			[[nodiscard]] std::vector<std::uintptr_t> Query(const std::string& Pattern) const
+			{
+				// The texts are ASCII here, so the folding is the same as in the index
+				auto Lower = [](std::string Text)
+					{
+						std::transform(Text.begin(), Text.end(), Text.begin(), [](char c) { return (char)tolower(c); });
+						return Text;
+					};
+
+				auto Folded = Lower(Pattern);
+				std::vector<std::uintptr_t> Result;
+				for (auto& Item : _items)
+					if (Lower(Item.second).find(Folded) != std::string::npos)
+						Result.push_back(Item.first);
+				return Result;
+			}
+
+			[[nodiscard]] std::size_t GetCount() const noexcept(true) { return _items.size(); }
+		};
+
+		static std::string RandomName(std::mt19937& Random)
+		{
+			static const char* Parts[] =
+			{
+				"Whiterun", "Riften", "Solitude", "Markarth", "Windhelm", "Falkreath", "Dawnstar", "Morthal",
+				"Exterior", "Interior", "Cave", "Mine", "Tomb", "Fort", "Tower", "Camp", "Farm", "House", "Hall",
+				"Barrow", "Ruins", "Shrine", "Temple", "Keep", "Bridge", "Road", "Lake", "River", "Mountain",
+			};
+
+			std::string Result;
+			auto Count = 2 + Random() % 3;
+			for (std::uint32_t i = 0; i < Count; i++)
+				Result += Parts[Random() % std::size(Parts)];
+
+			char Number[16];
+			sprintf_s(Number, "%02u", (std::uint32_t)(Random() % 100));
+			return Result + Number;
+		}
+
+		static void CheckQuery(const Common::SearchIndex& Index, const SearchModel& Model, const std::string& Pattern)
+		{
+			std::vector<std::uintptr_t> Result;
+			CKPE_CHECK(Index.Query(Pattern, Result));
+			CKPE_CHECK(Result == Model.Query(Pattern));
+		}
+
+		CKPE_TEST(SearchIndexQueries)
+		{
+			Common::SearchIndex Index;
+			SearchModel Model;
+
+			auto Add = [&](std::uintptr_t Id, const std::string& Text) { Index.Add(Id, Text); Model.Add(Id, Text); };
+			auto Remove = [&](std::uintptr_t Id) { Index.Remove(Id); Model.Remove(Id); };
+
+			Add(1, "WhiterunExterior01");
+			Add(2, "RiftenRatway");
+			Add(3, "whiterunDragonsreach");
+			Add(4, "Ab");
+			Add(5, "");
+			Add(6, "Solitude Blue Palace 0001A2B3");
+
+			// Shorter than a trigram, empty, any case, not there at all
+			for (auto Pattern : { "", "a", "ab", "run", "WHITERUN", "wHiTeRuN", "runext", "Palace 0001a2", "zzz",
+				"ratwayx", "1", "01" })
+				CheckQuery(Index, Model, Pattern);
+
+			// The text of an Id is replaced, it's found by the new one only
+			Add(1, "MarkarthUnderstoneKeep");
+			CheckQuery(Index, Model, "whiterun");
+			CheckQuery(Index, Model, "understone");
+
+			Remove(3);
+			Remove(42);
+			CheckQuery(Index, Model, "whiterun");
+			CKPE_CHECK(Index.GetCount() == Model.GetCount());
+
+			// Narrowed from the previous result, then wider again, then changed in between
+			CheckQuery(Index, Model, "ar");
+			CheckQuery(Index, Model, "mar");
+			CheckQuery(Index, Model, "markarth");
+			CheckQuery(Index, Model, "ar");
+			CheckQuery(Index, Model, "mark");
+			Add(7, "MarkarthTreasury");
+			CheckQuery(Index, Model, "markarth");
+
+			Index.Clear();
+			Model.Clear();
+			CKPE_CHECK(Index.GetCount() == 0);
+			CheckQuery(Index, Model, "markarth");
+			CheckQuery(Index, Model, "");
+		}
+
+		CKPE_TEST(SearchIndexRandom)
+		{
+			std::mt19937 Random(49);
+			Common::SearchIndex Index;
+			SearchModel Model;
+
+			// Big enough for the parallel comparison
+			for (std::uintptr_t Id = 0; Id < 30000; Id++)
+			{
+				auto Text = RandomName(Random);
+				Index.Add(Id, Text);
+				Model.Add(Id, Text);
+			}
+
+			for (std::uint32_t Pass = 0; Pass < 2000; Pass++)
+			{
+				auto Id = (std::uintptr_t)(Random() % 40000);
+				if (Random() % 3)
+				{
+					auto Text = RandomName(Random);
+					Index.Add(Id, Text);
+					Model.Add(Id, Text);
+				}
+				else
+				{
+					Index.Remove(Id);
+					Model.Remove(Id);
+				}
+			}
+
+			CKPE_CHECK(Index.GetCount() == Model.GetCount());
+
+			for (std::uint32_t Pass = 0; Pass < 100; Pass++)
+			{
+				// A piece of a name, typed one letter at a time as in the filter
+				auto Name = RandomName(Random);
+				auto Start = Random() % (Name.length() - 3);
+				auto Length = 1 + Random() % std::min<std::size_t>(10, Name.length() - Start);
+
+				for (std::size_t i = 1; i <= Length; i++)
+					CheckQuery(Index, Model, Name.substr(Start, i));
+			}
+		}
+
+		CKPE_TEST(SearchIndexCanceled)
+		{
+			Common::SearchIndex Index;
+			for (std::uintptr_t Id = 0; Id < 100; Id++)
+				Index.Add(Id, "CellName");
+
+			Common::TaskGroup Group;
+			Group.Cancel();
+
+			std::vector<std::uintptr_t> Result;
+			CKPE_CHECK(!Index.Query("cell", Result, &Group));
+
+			// The canceled query doesn't spoil the next one
+			CKPE_CHECK(Index.Query("cell", Result));
+			CKPE_CHECK(Result.size() == 100);
+		}
+
+		CKPE_TEST(SearchIndexAddDuringQuery)
+		{
+			constexpr std::uintptr_t Count = 40000;
+			Common::SearchIndex Index;
+			std::atomic_bool Done{ false };
+			std::atomic_uint32_t Wrong{ 0 }, Queries{ 0 };
+
+			// The odd ones match, whatever the query sees of the index
+			std::thread Reader([&]()
+				{
+					std::vector<std::uintptr_t> Result;
+					while (!Done)
+					{
+						if (!Index.Query("match", Result))
+							Wrong++;
+						for (auto Id : Result)
+							if (!(Id & 1))
+								Wrong++;
+						Queries++;
+					}
+				});
+
+			for (std::uint32_t Round = 0; Round < 2; Round++)
+			{
+				// The query keeps the texts it compares over the clear
+				Index.Clear();
+				for (std::uintptr_t Id = 0; Id < Count; Id++)
+					Index.Add(Id, (Id & 1) ? "Cell Match " + std::to_string(Id) : "Cell Other " + std::to_string(Id));
+			}
+
+			Done = true;
+			Reader.join();
+
+			CKPE_CHECK(!Wrong);
+			CKPE_CHECK(Queries > 0);
+
+			std::vector<std::uintptr_t> Result;
+			CKPE_CHECK(Index.Query("match", Result));
+			CKPE_CHECK(Result.size() == Count / 2);
+		}
+
+		CKPE_BENCHMARK(SearchIndex100k)
+		{
+			constexpr std::uintptr_t Count = 100000;
+
+			std::mt19937 Random(100);
+			std::vector<std::string> Texts;
+			for (std::uintptr_t Id = 0; Id < Count; Id++)
+				Texts.push_back(RandomName(Random));
+
+			Common::SearchIndex Index;
+			Stopwatch Watch;
+			for (std::uintptr_t Id = 0; Id < Count; Id++)
+				Index.Add(Id, Texts[Id]);
+			CKPE_BENCH_PRINT("add: %zu items in %.2f ms, %.1f MB", (std::size_t)Count, Watch.GetMilliseconds(),
+				Index.GetMemoryUsage() / 1048576.0);
+
+			// As StrStrIA over all the items, what the filter did before
+			auto Linear = [&](const char* Pattern)
+				{
+					std::size_t Found = 0;
+					for (auto& Text : Texts)
+						Found += StrStrIA(Text.c_str(), Pattern) != nullptr;
+					return Found;
+				};
+
+			std::vector<std::uintptr_t> Result;
+			for (auto Pattern : { "wh", "whi", "whiterun", "whiterunfort", "temple0", "riftenmine42", "xyz" })
+			{
+				// The first one isn't helped by the previous query
+				Index.Query("-", Result);
+
+				Watch.Restart();
+				Index.Query(Pattern, Result);
+				auto Time = Watch.GetMilliseconds();
+
+				Watch.Restart();
+				auto Found = Linear(Pattern);
+				auto LinearTime = Watch.GetMilliseconds();
+
+				CKPE_CHECK(Result.size() == Found);
+				CKPE_BENCH_PRINT("\"%s\": %zu found in %.3f ms, linear %.3f ms", Pattern, Result.size(), Time, LinearTime);
+			}
+
+			// Typed one letter at a time, each query from the matches of the previous one
+			const std::string Typed = "riftentower";
+			Index.Query("-", Result);
+			Watch.Restart();
+			for (std::size_t i = 1; i <= Typed.length(); i++)
+				Index.Query(Typed.substr(0, i), Result);
+			CKPE_BENCH_PRINT("typed \"%s\": %zu found, %.3f ms for all %zu queries", Typed.c_str(), Result.size(),
+				Watch.GetMilliseconds(), Typed.length());
+		}
+	}
+}
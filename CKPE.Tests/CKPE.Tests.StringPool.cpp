@@ -0,0 +1,297 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <CKPE.Common.StringPool.h>
+#include "CKPE.Tests.h"
+
+#include <random>
+#include <cctype>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string.h>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		static std::string RandomEditorId(std::mt19937& Random, std::size_t Length)
+		{
+			static const char Letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+
+			std::string Result(Length, 0);
+			for (auto& c : Result)
+				c = Letters[Random() % (std::size(Letters) - 1)];
+			return Result;
+		}
+
+		// As BSStringCache of the editor: 0x10000 chains behind 0x20 spin locks, a lookup locks as an insert does
+		class StripedStringCache
+		{
+			struct Entry
+			{
+				Entry* Next;
+				std::string Text;
+			};
+
+			std::unique_ptr<Entry*[]> _lut{ new Entry*[0x10000]{} };
+			std::atomic_flag _locks[0x20]{};
+
+			[[nodiscard]] static std::uint32_t Hash(std::string_view Str) noexcept(true)
+			{
+				std::uint32_t Value = 2166136261u;
+				for (auto c : Str)
+					Value = (Value ^ (std::uint8_t)tolower((std::uint8_t)c)) * 16777619u;
+				return Value ^ (Value >> 16);
+			}
+		public:
+			~StripedStringCache() noexcept(true)
+			{
+				for (std::uint32_t i = 0; i < 0x10000; i++)
+					for (auto Item = _lut[i]; Item;)
+					{
+						auto Next = Item->Next;
+						delete Item;
+						Item = Next;
+					}
+			}
+
+			const char* Intern(std::string_view Str)
+			{
+				auto Bucket = Hash(Str) & 0xFFFF;
+				auto& Lock = _locks[Bucket & 0x1F];
+				while (Lock.test_and_set(std::memory_order_acquire))
+					std::this_thread::yield();
+
+				const char* Result = nullptr;
+				for (auto Item = _lut[Bucket]; Item && !Result; Item = Item->Next)
+					if ((Item->Text.length() == Str.length()) && !_strnicmp(Item->Text.c_str(), Str.data(), Str.length()))
+						Result = Item->Text.c_str();
+
+				if (!Result)
+				{
+					_lut[Bucket] = new Entry{ _lut[Bucket], std::string(Str) };
+					Result = _lut[Bucket]->Text.c_str();
+				}
+
+				Lock.clear(std::memory_order_release);
+				return Result;
+			}
+		};
+
+		CKPE_TEST(StringPoolIntern)
+		{
+			Common::StringPool Pool;
+
+			CKPE_CHECK(!Pool.Find("IronSword"));
+			auto Str = Pool.Intern("IronSword");
+			CKPE_CHECK(Str && !strcmp(Str, "IronSword"));
+			CKPE_CHECK(Pool.Find("IronSword") == Str);
+			CKPE_CHECK(Pool.Intern(std::string("IronSword")) == Str);
+
+			// The case doesn't matter, the first text is kept
+			CKPE_CHECK(Pool.Intern("IRONSWORD") == Str);
+			CKPE_CHECK(Pool.Find("ironsword") == Str);
+			CKPE_CHECK(!strcmp(Str, "IronSword"));
+
+			// A prefix is another string
+			auto Prefix = Pool.Intern("IronSwor");
+			CKPE_CHECK(Prefix && (Prefix != Str) && !strcmp(Prefix, "IronSwor"));
+
+			auto Empty = Pool.Intern("");
+			CKPE_CHECK(Empty && !*Empty && (Pool.Intern(std::string_view()) == Empty));
+
+			// Past the stack buffer of the folding and past the size of a shared block
+			for (auto Length : { 511, 512, 513, 1500, 20000, 100000 })
+			{
+				std::string Long(Length, 'x');
+				Long.front() = 'A';
+				Long.back() = 'Z';
+
+				auto Interned = Pool.Intern(Long);
+				CKPE_CHECK(Interned && (strlen(Interned) == Long.length()) && !memcmp(Interned, Long.data(), Long.length()));
+
+				for (auto& c : Long)
+					c = (char)toupper(c);
+				CKPE_CHECK(Pool.Find(Long) == Interned);
+
+				Long[Length / 2] = 'y';
+				CKPE_CHECK(!Pool.Find(Long));
+			}
+
+			CKPE_CHECK(Pool.GetCount() == 9);
+			CKPE_CHECK(Pool.GetMemoryUsage() > 100000);
+		}
+
+		CKPE_TEST(StringPoolCaseSensitive)
+		{
+			Common::StringPool Pool(false);
+
+			auto Str = Pool.Intern("IronSword");
+			auto Upper = Pool.Intern("IRONSWORD");
+			CKPE_CHECK(Str && Upper && (Str != Upper));
+			CKPE_CHECK(!Pool.Find("ironsword"));
+			CKPE_CHECK(Pool.Find("IRONSWORD") == Upper);
+			CKPE_CHECK(Pool.GetCount() == 2);
+		}
+
+		CKPE_TEST(StringPoolBulk)
+		{
+			std::mt19937 Random(27);
+
+			// Duplicates in the same call, some in another case, some interned before
+			std::vector<std::string> Texts;
+			for (std::uint32_t i = 0; i < 10000; i++)
+			{
+				if (!Texts.empty() && !(Random() % 4))
+				{
+					auto Text = Texts[Random() % Texts.size()];
+					if (Random() % 2)
+						for (auto& c : Text)
+							c = (char)tolower(c);
+					Texts.push_back(Text);
+				}
+				else
+					Texts.push_back(RandomEditorId(Random, 4 + Random() % 40));
+			}
+
+			for (auto Parallel : { false, true })
+			{
+				Common::StringPool Pool, Expected;
+
+				// The parallel hashing starts at a few thousand strings
+				auto Count = Parallel ? Texts.size() : (std::size_t)1000;
+
+				for (std::size_t i = 0; i < Count; i += 7)
+					Pool.Intern(Texts[i]);
+
+				std::vector<std::string_view> Strings(Texts.begin(), Texts.begin() + Count);
+				std::vector<const char*> Result(Count);
+				Pool.InternBulk(Strings.data(), Count, Result.data());
+
+				for (std::size_t i = 0; i < Count; i++)
+				{
+					Expected.Intern(Texts[i]);
+					CKPE_CHECK(Result[i] && !_stricmp(Result[i], Texts[i].c_str()));
+					CKPE_CHECK(Pool.Intern(Texts[i]) == Result[i]);
+				}
+
+				CKPE_CHECK(Pool.GetCount() == Expected.GetCount());
+			}
+		}
+
+		CKPE_TEST(StringPoolThreads)
+		{
+			constexpr std::uint32_t Threads = 8;
+
+			std::mt19937 Random(8);
+			std::vector<std::string> Texts;
+			for (std::uint32_t i = 0; i < 20000; i++)
+				Texts.push_back(RandomEditorId(Random, 4 + Random() % 30));
+
+			Common::StringPool Pool;
+			std::vector<std::vector<const char*>> Results(Threads, std::vector<const char*>(Texts.size()));
+
+			// Every thread interns all the strings, starting from its own place
+			std::vector<std::thread> Workers;
+			for (std::uint32_t t = 0; t < Threads; t++)
+				Workers.emplace_back([&, t]()
+					{
+						for (std::size_t i = 0; i < Texts.size(); i++)
+						{
+							auto Index = (i + t * Texts.size() / Threads) % Texts.size();
+							Results[t][Index] = Pool.Intern(Texts[Index]);
+						}
+					});
+
+			for (auto& Worker : Workers)
+				Worker.join();
+
+			Common::StringPool Expected;
+			for (auto& Text : Texts)
+				Expected.Intern(Text);
+
+			for (std::size_t i = 0; i < Texts.size(); i++)
+			{
+				CKPE_CHECK(Results[0][i] && !_stricmp(Results[0][i], Texts[i].c_str()));
+				for (std::uint32_t t = 1; t < Threads; t++)
+					CKPE_CHECK(Results[t][i] == Results[0][i]);
+			}
+
+			CKPE_CHECK(Pool.GetCount() == Expected.GetCount());
+		}
+
+		CKPE_BENCHMARK(StringPoolContention)
+		{
+			constexpr std::uint32_t Operations = 4000000;
+
+			// The EditorIDs and paths of the loaded plugins, then every BSFixedString made from them
+			std::mt19937 Random(47);
+			std::vector<std::string> Texts;
+			for (std::uint32_t i = 0; i < 100000; i++)
+				Texts.push_back(RandomEditorId(Random, 6 + Random() % 40));
+
+			// Each thread runs its share, one in a hundred strings is new
+			auto Run = [&](std::uint32_t Threads, auto&& Intern) -> double
+				{
+					std::atomic_bool Go{ false };
+					std::atomic_uint32_t Failed{ 0 };
+					std::vector<std::thread> Workers;
+
+					for (std::uint32_t t = 0; t < Threads; t++)
+						Workers.emplace_back([&, t]()
+							{
+								std::mt19937 Random(t);
+								char New[64];
+								while (!Go)
+									std::this_thread::yield();
+
+								for (std::uint32_t i = 0; i < (Operations / Threads); i++)
+								{
+									if (!(i % 100))
+									{
+										sprintf_s(New, "New_%u_%u", t, i);
+										Failed += !Intern(std::string_view(New));
+									}
+									else
+										Failed += !Intern(std::string_view(Texts[Random() % Texts.size()]));
+								}
+							});
+
+					Stopwatch Watch;
+					Go = true;
+					for (auto& Worker : Workers)
+						Worker.join();
+					auto Time = Watch.GetMilliseconds();
+
+					CKPE_CHECK(!Failed);
+					return Time;
+				};
+
+			CKPE_BENCH_PRINT("%u operations, 99%% of them lookups", Operations);
+
+			for (std::uint32_t Threads : { 1, 2, 4, 8, 16, 32 })
+			{
+				double PoolTime, StripedTime;
+
+				{
+					Common::StringPool Pool;
+					for (auto& Text : Texts)
+						Pool.Intern(Text);
+					PoolTime = Run(Threads, [&Pool](std::string_view Str) { return Pool.Intern(Str); });
+				}
+
+				{
+					StripedStringCache Cache;
+					for (auto& Text : Texts)
+						Cache.Intern(Text);
+					StripedTime = Run(Threads, [&Cache](std::string_view Str) { return Cache.Intern(Str); });
+				}
+
+				CKPE_BENCH_PRINT("%2u threads: StringPool %7.1f ms, striped locks %7.1f ms, x%.1f", Threads, PoolTime,
+					StripedTime, StripedTime / PoolTime);
+			}
+		}
+	}
+}
@@ -0,0 +1,400 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <CKPE.StringUtils.h>
+#include "CKPE.Tests.h"
+
+#include <random>
+#include <algorithm>
+#include <string.h>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		// RFC 3629 byte by byte: no overlong forms, no surrogates, nothing above U+10FFFF
+		static bool ReferenceIsUtf8(const std::string& Text) noexcept(true)
+		{
+			auto p = (const std::uint8_t*)Text.data();
+			auto End = p + Text.length();
+
+			while (p < End)
+			{
+				auto c = *p;
+				std::size_t Length;
+				std::uint8_t Min = 0x80, Max = 0xBF;
+
+				if (c < 0x80) { p++; continue; }
+				else if ((c >= 0xC2) && (c <= 0xDF)) Length = 2;
+				else if ((c >= 0xE0) && (c <= 0xEF))
+				{
+					Length = 3;
+					if (c == 0xE0) Min = 0xA0;
+					else if (c == 0xED) Max = 0x9F;
+				}
+				else if ((c >= 0xF0) && (c <= 0xF4))
+				{
+					Length = 4;
+					if (c == 0xF0) Min = 0x90;
+					else if (c == 0xF4) Max = 0x8F;
+				}
+				else
+					return false;
+
+				if ((std::size_t)(End - p) < Length)
+					return false;
+				if ((p[1] < Min) || (p[1] > Max))
+					return false;
+				for (std::size_t i = 2; i < Length; i++)
+					if ((p[i] & 0xC0) != 0x80)
+						return false;
+
+				p += Length;
+			}
+
+			return true;
+		}
+
+		static void AppendCodePoint(std::string& Text, std::uint32_t Code)
+		{
+			if (Code < 0x80)
+				Text.push_back((char)Code);
+			else if (Code < 0x800)
+			{
+				Text.push_back((char)(0xC0 | (Code >> 6)));
+				Text.push_back((char)(0x80 | (Code & 0x3F)));
+			}
+			else if (Code < 0x10000)
+			{
+				Text.push_back((char)(0xE0 | (Code >> 12)));
+				Text.push_back((char)(0x80 | ((Code >> 6) & 0x3F)));
+				Text.push_back((char)(0x80 | (Code & 0x3F)));
+			}
+			else
+			{
+				Text.push_back((char)(0xF0 | (Code >> 18)));
+				Text.push_back((char)(0x80 | ((Code >> 12) & 0x3F)));
+				Text.push_back((char)(0x80 | ((Code >> 6) & 0x3F)));
+				Text.push_back((char)(0x80 | (Code & 0x3F)));
+			}
+		}
+
+		// Mostly valid text with a few broken bytes, so both answers come up often
+		static std::string RandomText(std::mt19937& Random)
+		{
+			std::string Text;
+			auto Count = Random() % 48;
+
+			for (std::uint32_t i = 0; i < Count; i++)
+			{
+				std::uint32_t Code;
+				switch (Random() % 5)
+				{
+				case 0: Code = 0x20 + Random() % 0x60; break;
+				case 1: Code = 0x80 + Random() % 0x780; break;
+				case 2: Code = 0x800 + Random() % 0xF800; break;
+				case 3: Code = 0x10000 + Random() % 0x100000; break;
+				default: Code = Random() % 0x80; break;
+				}
+
+				// The surrogates can't be encoded, take another one
+				if ((Code >= 0xD800) && (Code <= 0xDFFF))
+					Code -= 0x1000;
+
+				AppendCodePoint(Text, Code);
+			}
+
+			switch (Random() % 4)
+			{
+			case 0:
+				// Any byte
+				if (!Text.empty())
+					Text[Random() % Text.length()] = (char)Random();
+				break;
+			case 1:
+				// Cut in the middle of a sequence
+				if (!Text.empty())
+					Text.resize(Random() % Text.length());
+				break;
+			case 2:
+				// The lead bytes of the forbidden forms
+				Text.insert(Text.begin() + (Text.empty() ? 0 : Random() % Text.length()),
+					"\xC0\xC1\xE0\xED\xF0\xF4\xF5\xFF"[Random() % 8]);
+				break;
+			default:
+				break;
+			}
+
+			return Text;
+		}
+
+		CKPE_TEST(Utf8Validator)
+		{
+			const std::pair<const char*, bool> Cases[] =
+			{
+				{ "", true },
+				{ "plain ascii text, longer than the sixteen bytes of a block", true },
+				{ "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82", true },
+				{ "\xE2\x82\xAC \xEF\xBF\xBF \xF0\x9F\x98\x80 \xF4\x8F\xBF\xBF", true },
+				{ "\xC0\x80", false },							// overlong 2
+				{ "\xC1\xBF", false },
+				{ "\xE0\x80\x80", false },						// overlong 3
+				{ "\xE0\x9F\xBF", false },
+				{ "\xF0\x80\x80\x80", false },					// overlong 4
+				{ "\xF0\x8F\xBF\xBF", false },
+				{ "\xED\xA0\x80", false },						// surrogate
+				{ "\xED\xBF\xBF", false },
+				{ "\xF4\x90\x80\x80", false },					// above U+10FFFF
+				{ "\xF5\x80\x80\x80", false },
+				{ "\xFF", false },
+				{ "\x80", false },								// continuation alone
+				{ "a\xBF b", false },
+				{ "\xD0", false },								// cut at the end
+				{ "\xE2\x82", false },
+				{ "\xF0\x9F\x98", false },
+				{ "\xE2\x82 ", false },							// cut before ascii
+				{ "\xD0\x9F\x9F", false },						// too many continuations
+			};
+
+			for (auto& Case : Cases)
+			{
+				std::string Text(Case.first);
+				CKPE_CHECK(StringUtils::IsUtf8(Text) == Case.second);
+				CKPE_CHECK(StringUtils::IsUtf8(Case.first) == Case.second);
+				CKPE_CHECK(ReferenceIsUtf8(Text) == Case.second);
+
+				// The same at every position of the 16 byte blocks
+				for (std::size_t Shift = 1; Shift < 40; Shift++)
+				{
+					auto Shifted = std::string(Shift, 'x') + Text;
+					CKPE_CHECK(StringUtils::IsUtf8(Shifted) == Case.second);
+					CKPE_CHECK(StringUtils::IsUtf8((Shifted + std::string(Shift, 'y')).c_str()) == Case.second);
+				}
+			}
+		}
+
+		CKPE_TEST(Utf8ValidatorFuzz)
+		{
+			std::mt19937 Random(48);
+
+			for (std::uint32_t Pass = 0; Pass < 200000; Pass++)
+			{
+				auto Text = RandomText(Random);
+				auto Expected = ReferenceIsUtf8(Text);
+
+				CKPE_CHECK(StringUtils::IsUtf8(Text) == Expected);
+				if (!memchr(Text.data(), 0, Text.length()))
+					CKPE_CHECK(StringUtils::IsUtf8(Text.c_str()) == Expected);
+			}
+		}
+
+		CKPE_BENCHMARK(Utf8ValidatorSpeed)
+		{
+			std::mt19937 Random(4800);
+			std::string Ascii, Mixed;
+
+			while (Mixed.length() < (64 << 20))
+			{
+				std::uint32_t Code = (Random() % 4) ? (0x20 + Random() % 0x60) : (0x400 + Random() % 0x100);
+				AppendCodePoint(Mixed, Code);
+				Ascii.push_back((char)(0x20 + Random() % 0x60));
+			}
+
+			Stopwatch Watch;
+			bool Result = StringUtils::IsUtf8(Ascii);
+			auto Time = Watch.GetMilliseconds();
+			CKPE_CHECK(Result);
+			CKPE_BENCH_PRINT("ascii: %.1f MB in %.2f ms, %.0f MB/s", Ascii.length() / 1048576.0, Time,
+				(Ascii.length() / 1048576.0) / (Time / 1000.0));
+
+			Watch.Restart();
+			Result = StringUtils::IsUtf8(Mixed);
+			Time = Watch.GetMilliseconds();
+			CKPE_CHECK(Result);
+			CKPE_BENCH_PRINT("cyrillic 25%%: %.1f MB in %.2f ms, %.0f MB/s", Mixed.length() / 1048576.0, Time,
+				(Mixed.length() / 1048576.0) / (Time / 1000.0));
+
+			// The short strings of the editor, mostly broken ones
+			std::vector<std::string> Texts;
+			for (std::uint32_t i = 0; i < 1000000; i++)
+				Texts.push_back(RandomText(Random));
+
+			std::size_t Valid = 0;
+			Watch.Restart();
+			for (auto& Text : Texts)
+				Valid += StringUtils::IsUtf8(Text);
+			Time = Watch.GetMilliseconds();
+
+			std::size_t Expected = 0;
+			for (auto& Text : Texts)
+				Expected += ReferenceIsUtf8(Text);
+			CKPE_CHECK(Valid == Expected);
+
+			CKPE_BENCH_PRINT("fuzz: %zu strings (%zu valid) in %.2f ms", Texts.size(), Valid, Time);
+		}
+
+		// The conversions through UTF-16 as they were before the table, the text up to the first zero
+		static std::string ReferenceUtf8ToWinCP(const std::string& Text)
+		{
+			auto WideLength = MultiByteToWideChar(CP_UTF8, 0, Text.data(), (int)Text.length(), nullptr, 0);
+			std::wstring Wide((std::size_t)std::max(WideLength, 0), 0);
+			if (Wide.empty() || (MultiByteToWideChar(CP_UTF8, 0, Text.data(), (int)Text.length(), Wide.data(), WideLength) <= 0))
+				return "";
+
+			auto Length = WideCharToMultiByte(CP_ACP, 0, Wide.data(), WideLength, nullptr, 0, nullptr, nullptr);
+			std::string Result((std::size_t)std::max(Length, 0), 0);
+			if (Result.empty() || (WideCharToMultiByte(CP_ACP, 0, Wide.data(), WideLength, Result.data(), Length,
+				nullptr, nullptr) <= 0))
+				return "";
+
+			return Result.c_str();
+		}
+
+		static std::string ReferenceWinCPToUtf8(const std::string& Text)
+		{
+			auto WideLength = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, Text.data(), (int)Text.length(), nullptr, 0);
+			std::wstring Wide((std::size_t)std::max(WideLength, 0), 0);
+			if (Wide.empty() || (MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, Text.data(), (int)Text.length(), Wide.data(),
+				WideLength) <= 0))
+				return "";
+
+			auto Length = WideCharToMultiByte(CP_UTF8, 0, Wide.data(), WideLength, nullptr, 0, nullptr, nullptr);
+			std::string Result((std::size_t)std::max(Length, 0), 0);
+			if (Result.empty() || (WideCharToMultiByte(CP_UTF8, 0, Wide.data(), WideLength, Result.data(), Length,
+				nullptr, nullptr) <= 0))
+				return "";
+
+			return Result.c_str();
+		}
+
+		// The characters of the high half of the system code page
+		static std::vector<std::uint32_t> GetCodePageChars()
+		{
+			std::vector<std::uint32_t> Chars;
+			for (std::uint32_t c = 0x80; c < 0x100; c++)
+			{
+				auto ch = (char)c;
+				wchar_t w = 0;
+				if ((MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, &ch, 1, &w, 1) == 1) && ((w < 0xD800) || (w > 0xDFFF)))
+					Chars.push_back(w);
+			}
+			return Chars;
+		}
+
+		// Valid UTF-8 without zeros: ASCII, the code page, the ones it has a best fit for and the ones it doesn't have
+		static std::string RandomCodePageUtf8(std::mt19937& Random, const std::vector<std::uint32_t>& Chars)
+		{
+			std::string Text;
+			auto Count = Random() % 64;
+
+			for (std::uint32_t i = 0; i < Count; i++)
+			{
+				std::uint32_t Code;
+				switch (Random() % 8)
+				{
+				case 0: case 1: case 2: Code = 0x20 + Random() % 0x5F; break;
+				case 3: case 4: case 5: Code = Chars.empty() ? 0x41 : Chars[Random() % Chars.size()]; break;
+				case 6: Code = 0x80 + Random() % 0x500; break;
+				default: Code = (Random() % 2) ? 0x800 + Random() % 0xD000 : 0x10000 + Random() % 0x100000; break;
+				}
+
+				AppendCodePoint(Text, Code);
+			}
+
+			return Text;
+		}
+
+		// Any bytes but zero, the high ones in runs as a translated text has them
+		static std::string RandomCodePageText(std::mt19937& Random)
+		{
+			std::string Text(Random() % 80, 0);
+			bool High = false;
+			for (auto& c : Text)
+			{
+				if (!(Random() % 6))
+					High = !High;
+				c = High ? (char)(0x80 + Random() % 0x80) : (char)(1 + Random() % 0x7F);
+			}
+			return Text;
+		}
+
+		CKPE_TEST(CodePageTableFuzz)
+		{
+			CPINFO Info{};
+			if (!GetCPInfo(CP_ACP, &Info) || (Info.MaxCharSize != 1))
+				printf("    the code page %u isn't single-byte, compared without the table\n", GetACP());
+
+			std::mt19937 Random(480);
+			auto Chars = GetCodePageChars();
+
+			// Each byte of the code page alone, at the end of a 16 byte block and after it
+			for (std::uint32_t c = 0x80; c < 0x100; c++)
+			{
+				for (auto Text : { std::string(1, (char)c), std::string(15, 'a') + (char)c,
+					std::string(16, 'a') + (char)c + "tail" })
+				{
+					auto Utf8 = StringUtils::WinCPToUtf8(Text);
+					CKPE_CHECK(Utf8 == ReferenceWinCPToUtf8(Text));
+					CKPE_CHECK(StringUtils::Utf8ToWinCP(Utf8) == ReferenceUtf8ToWinCP(Utf8));
+				}
+			}
+
+			std::uint32_t Wrong = 0;
+			for (std::uint32_t Pass = 0; Pass < 200000; Pass++)
+			{
+				auto Utf8 = RandomCodePageUtf8(Random, Chars);
+				Wrong += StringUtils::Utf8ToWinCP(Utf8) != ReferenceUtf8ToWinCP(Utf8);
+
+				auto Text = RandomCodePageText(Random);
+				Wrong += StringUtils::WinCPToUtf8(Text) != ReferenceWinCPToUtf8(Text);
+			}
+			CKPE_CHECK(!Wrong);
+
+			// ASCII comes back untouched
+			CKPE_CHECK(StringUtils::Utf8ToWinCP("plain text") == "plain text");
+			CKPE_CHECK(StringUtils::WinCPToUtf8("plain text") == "plain text");
+			CKPE_CHECK(StringUtils::Utf8ToWinCP("").empty() && StringUtils::WinCPToUtf8("").empty());
+		}
+
+		CKPE_BENCHMARK(CodePageTableSpeed)
+		{
+			std::mt19937 Random(4801);
+			auto Chars = GetCodePageChars();
+
+			// The strings of a translated plugin, one in four characters is out of ASCII
+			std::vector<std::string> Texts, Utf8Texts;
+			std::size_t Size = 0;
+			for (std::uint32_t i = 0; i < 1000000; i++)
+			{
+				std::string Utf8;
+				auto Count = 4 + Random() % 60;
+				for (std::uint32_t j = 0; j < Count; j++)
+					AppendCodePoint(Utf8, ((Random() % 4) || Chars.empty()) ? 0x20 + Random() % 0x5F : Chars[Random() % Chars.size()]);
+
+				Texts.push_back(ReferenceUtf8ToWinCP(Utf8));
+				Utf8Texts.push_back(std::move(Utf8));
+				Size += Texts.back().length();
+			}
+
+			CKPE_BENCH_PRINT("%zu strings, %.1f MB in the code page %u", Texts.size(), Size / 1048576.0, GetACP());
+
+			auto Measure = [&](const char* Name, const std::vector<std::string>& Input, auto&& Convert)
+				{
+					std::size_t Length = 0;
+					Stopwatch Watch;
+					for (auto& Text : Input)
+						Length += Convert(Text).length();
+					auto Time = Watch.GetMilliseconds();
+					CKPE_BENCH_PRINT("%-22s %7.1f ms, %5.0f ns a string (%zu)", Name, Time, Time * 1000000.0 / Input.size(),
+						Length);
+				};
+
+			Measure("WinCPToUtf8:", Texts, [](const std::string& Text) { return StringUtils::WinCPToUtf8(Text); });
+			Measure("through UTF-16:", Texts, [](const std::string& Text) { return ReferenceWinCPToUtf8(Text); });
+			Measure("Utf8ToWinCP:", Utf8Texts, [](const std::string& Text) { return StringUtils::Utf8ToWinCP(Text); });
+			Measure("through UTF-16:", Utf8Texts, [](const std::string& Text) { return ReferenceUtf8ToWinCP(Text); });
+		}
+	}
+}
@@ -0,0 +1,197 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <CKPE.Common.TaskScheduler.h>
+#include "CKPE.Tests.h"
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <algorithm>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		using Common::TaskGroup;
+		using Common::TaskScheduler;
+
+		// Each index exactly once
+		static bool ParallelForCovers(std::size_t Count, std::size_t Grain)
+		{
+			auto Visits = std::make_unique<std::atomic_uint32_t[]>(Count);
+			for (std::size_t i = 0; i < Count; i++)
+				Visits[i] = 0;
+
+			if (!TaskScheduler::GetSingleton()->ParallelFor(0, Count, Grain, [&](std::size_t Begin, std::size_t End)
+				{
+					for (auto i = Begin; i < End; i++)
+						Visits[i]++;
+				}, "Test"))
+				return false;
+
+			for (std::size_t i = 0; i < Count; i++)
+				if (Visits[i] != 1)
+					return false;
+
+			return true;
+		}
+
+		// Some work that the compiler can't remove
+		static std::uint64_t Spin(std::uint64_t Value, std::uint32_t Rounds)
+		{
+			for (std::uint32_t i = 0; i < Rounds; i++)
+				Value = (Value ^ (Value >> 31)) * 0x9E3779B97F4A7C15ull + i;
+			return Value;
+		}
+
+		CKPE_TEST(TaskSchedulerParallelForCovers)
+		{
+			for (std::size_t Count : { 1, 2, 7, 100, 1000, 100000 })
+				for (std::size_t Grain : { 0, 1, 3, 64, 100000 })
+					CKPE_CHECK(ParallelForCovers(Count, Grain));
+
+			// An empty range is done
+			CKPE_CHECK(TaskScheduler::GetSingleton()->ParallelFor(5, 5, 0, [](std::size_t, std::size_t) {}));
+		}
+
+		CKPE_TEST(TaskSchedulerNestedStress)
+		{
+			constexpr std::uint32_t Outer = 64, Inner = 1000, Callers = 4, Rounds = 20;
+			std::atomic_uint64_t Total{ 0 };
+			std::atomic_uint32_t Failed{ 0 };
+
+			// Outside the pool, the groups and the nested loops of all the callers share the workers
+			std::vector<std::thread> Threads;
+			for (std::uint32_t Caller = 0; Caller < Callers; Caller++)
+				Threads.emplace_back([&]()
+					{
+						for (std::uint32_t Round = 0; Round < Rounds; Round++)
+						{
+							TaskGroup Group("TestGroup");
+							for (std::uint32_t i = 0; i < 8; i++)
+								Group.Run([&]()
+									{
+										if (!TaskScheduler::GetSingleton()->ParallelFor(0, Outer, 1,
+											[&](std::size_t Begin, std::size_t End)
+											{
+												for (auto i = Begin; i < End; i++)
+													if (!TaskScheduler::GetSingleton()->ParallelFor(0, Inner, 16,
+														[&](std::size_t First, std::size_t Last) { Total += Last - First; }))
+														Failed++;
+											}))
+											Failed++;
+									});
+							Group.Wait();
+						}
+					});
+
+			for (auto& Thread : Threads)
+				Thread.join();
+
+			CKPE_CHECK(!Failed);
+			CKPE_CHECK(Total == (std::uint64_t)Callers * Rounds * 8 * Outer * Inner);
+		}
+
+		CKPE_TEST(TaskGroupWaitsOnlyForItself)
+		{
+			auto Workers = TaskScheduler::GetSingleton()->GetWorkerCount();
+			if (!Workers)
+				return;
+
+			std::atomic_bool Release{ false };
+			std::atomic_uint32_t Started{ 0 };
+
+			// All the workers are busy, the tasks after that stay in the queue
+			TaskGroup Busy("Busy");
+			for (std::uint32_t i = 0; i < Workers; i++)
+				Busy.Run([&]()
+					{
+						Started++;
+						while (!Release) std::this_thread::yield();
+					});
+			while (Started != Workers)
+				std::this_thread::yield();
+
+			// Queued before the other one, a wait that takes any task would block on it
+			TaskGroup Blocked("Blocked");
+			Blocked.Run([&]() { while (!Release) std::this_thread::yield(); });
+
+			std::atomic_bool Done{ false };
+			TaskGroup Quick("Quick");
+			Quick.Run([&]() { Done = true; });
+			Quick.Wait();
+			CKPE_CHECK(Done);
+			CKPE_CHECK(!Release);
+
+			Release = true;
+			Blocked.Wait();
+			Busy.Wait();
+		}
+
+		CKPE_TEST(TaskGroupCancelSkipsQueued)
+		{
+			auto Workers = TaskScheduler::GetSingleton()->GetWorkerCount();
+			if (!Workers)
+				return;
+
+			std::atomic_bool Release{ false };
+			std::atomic_uint32_t Runs{ 0 };
+
+			// No more than one task a worker can start before the cancel
+			TaskGroup Group("Cancel");
+			for (std::uint32_t i = 0; i < 1000; i++)
+				Group.Run([&]() { Runs++; while (!Release) std::this_thread::yield(); });
+
+			Group.Cancel();
+			CKPE_CHECK(Group.IsCanceled());
+			CKPE_CHECK(!Group.IsDone());
+			Release = true;
+
+			// Without Wait, as the filter of the cell view reaps its groups
+			while (!Group.IsDone())
+				std::this_thread::yield();
+
+			CKPE_CHECK(Runs <= Workers);
+		}
+
+		CKPE_BENCHMARK(TaskSchedulerScaling)
+		{
+			constexpr std::size_t Count = 1 << 16;
+			constexpr std::uint32_t Rounds = 2000;
+
+			auto Scheduler = TaskScheduler::GetSingleton();
+			auto Restore = Scheduler->GetWorkerCount();
+			auto Max = std::max(std::thread::hardware_concurrency(), 2u);
+			double Single = 0.0;
+
+			for (std::uint32_t Threads = 1; Threads <= Max; Threads <<= 1)
+			{
+				// The caller works too, one thread is one piece
+				Scheduler->Shutdown();
+				Scheduler->Initialize(std::max(Threads - 1, 1u));
+
+				std::atomic_uint64_t Sum{ 0 };
+				Stopwatch Watch;
+				CKPE_CHECK(Scheduler->ParallelFor(0, Count, (Threads == 1) ? Count : 0,
+					[&](std::size_t Begin, std::size_t End)
+					{
+						std::uint64_t Value = 0;
+						for (auto i = Begin; i < End; i++)
+							Value += Spin(i, Rounds);
+						Sum += Value;
+					}, "Scaling"));
+				auto Time = Watch.GetMilliseconds();
+
+				if (Threads == 1)
+					Single = Time;
+				CKPE_BENCH_PRINT("%2u threads: %8.1f ms, x%.2f (%llx)", Threads, Time, Single / Time,
+					(unsigned long long)Sum.load());
+			}
+
+			Scheduler->Shutdown();
+			Scheduler->Initialize(Restore);
+		}
+	}
+}
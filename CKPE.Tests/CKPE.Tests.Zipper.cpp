@@ -0,0 +1,333 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <CKPE.Zipper.h>
+#include <CKPE.HashUtils.h>
+#include "CKPE.Tests.h"
+
+#include <algorithm>
+#include <cctype>
+#include <string.h>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		// Stored entries only, the index is built from the central directory and nothing else is needed
+		class StoredZipWriter
+		{
+			std::string _local, _central;
+			std::uint16_t _count{ 0 };
+
+			static void Put16(std::string& Out, std::uint16_t Value) noexcept(true)
+			{
+				Out.push_back((char)(Value & 0xFF));
+				Out.push_back((char)(Value >> 8));
+			}
+
+			static void Put32(std::string& Out, std::uint32_t Value) noexcept(true)
+			{
+				Put16(Out, (std::uint16_t)(Value & 0xFFFF));
+				Put16(Out, (std::uint16_t)(Value >> 16));
+			}
+		public:
+			// The name is the data too, the CRC tells which of the entries was found
+			void Add(const std::string& Name) noexcept(true)
+			{
+				auto Crc = HashUtils::CRC32Buffer(Name.data(), (std::uint32_t)Name.length());
+				auto Offset = (std::uint32_t)_local.length();
+
+				Put32(_local, 0x04034B50ul);
+				Put16(_local, 20);
+				Put16(_local, 0);				// flags
+				Put16(_local, 0);				// stored
+				Put16(_local, 0);				// time
+				Put16(_local, 0x21);			// 1980-01-01
+				Put32(_local, Crc);
+				Put32(_local, (std::uint32_t)Name.length());
+				Put32(_local, (std::uint32_t)Name.length());
+				Put16(_local, (std::uint16_t)Name.length());
+				Put16(_local, 0);
+				_local += Name;
+				_local += Name;
+
+				Put32(_central, 0x02014B50ul);
+				Put16(_central, 20);
+				Put16(_central, 20);
+				Put16(_central, 0);
+				Put16(_central, 0);
+				Put16(_central, 0);
+				Put16(_central, 0x21);
+				Put32(_central, Crc);
+				Put32(_central, (std::uint32_t)Name.length());
+				Put32(_central, (std::uint32_t)Name.length());
+				Put16(_central, (std::uint16_t)Name.length());
+				Put16(_central, 0);				// extra
+				Put16(_central, 0);				// comment
+				Put16(_central, 0);				// disk
+				Put16(_central, 0);				// internal attributes
+				Put32(_central, 0);				// external attributes
+				Put32(_central, Offset);
+				_central += Name;
+
+				_count++;
+			}
+
+			[[nodiscard]] bool Save(const std::wstring& FileName) const noexcept(true)
+			{
+				std::string End;
+				Put32(End, 0x06054B50ul);
+				Put16(End, 0);
+				Put16(End, 0);
+				Put16(End, _count);
+				Put16(End, _count);
+				Put32(End, (std::uint32_t)_central.length());
+				Put32(End, (std::uint32_t)_local.length());
+				Put16(End, 0);
+
+				FILE* File = nullptr;
+				if (_wfopen_s(&File, FileName.c_str(), L"wb") || !File)
+					return false;
+
+				bool Result = (fwrite(_local.data(), 1, _local.length(), File) == _local.length()) &&
+					(fwrite(_central.data(), 1, _central.length(), File) == _central.length()) &&
+					(fwrite(End.data(), 1, End.length(), File) == End.length());
+				fclose(File);
+				return Result;
+			}
+		};
+
+		// The linear search of the entries which the index replaced
+		static std::size_t LinearFind(const std::vector<std::string>& Names, const char* Name) noexcept(true)
+		{
+			for (std::size_t i = 0; i < Names.size(); i++)
+				if (!_stricmp(Names[i].c_str(), Name))
+					return i;
+
+			return ZipFileEntry::InvalidIndex;
+		}
+
+		static std::vector<std::string> ReadNames(const ZipFileEntries* Entries) noexcept(true)
+		{
+			std::vector<std::string> Names;
+			for (std::size_t i = 0; i < Entries->Count(); i++)
+			{
+				auto Entry = Entries->At(i);
+				Names.push_back(Entry.Empty() ? std::string() : Entry->Get()->GetName());
+			}
+			return Names;
+		}
+
+		[[nodiscard]] static std::uint32_t GetEntryCrc(const ZipFileEntries* Entries, std::size_t Index) noexcept(true)
+		{
+			auto Entry = Entries->At(Index);
+			return Entry.Empty() ? 0 : Entry->Get()->GetCrc32();
+		}
+
+		CKPE_TEST(ZipperFindIgnoresCase)
+		{
+			StoredZipWriter Writer;
+			Writer.Add("Dialogs/Main.json");				// 0
+			Writer.Add("DIALOGS/main.JSON");				// 1, the same name in another case
+			Writer.Add("Dialogs/Sub/Edit.json");			// 2
+			Writer.Add("dialogs/about.json");				// 3
+			Writer.Add("Dialogsx.json");					// 4, the prefix without the slash
+			Writer.Add("Item@1");							// 5
+			Writer.Add("Item`1");							// 6, 0x40 and 0x60 differ only by the case bit
+			Writer.Add("Item[1]");							// 7
+			Writer.Add("Item{1}");							// 8, same for 0x5B and 0x7B
+			Writer.Add("Patches/Skyrim.relb");				// 9
+
+			auto FileName = GetTempFileName(L"CKPE.Tests.ZipperCase.zip");
+			CKPE_CHECK(Writer.Save(FileName));
+
+			UnZipper Zip;
+			CKPE_CHECK(Zip.OpenFile(FileName));
+			if (!Zip.HasOpen())
+				return;
+
+			auto Entries = Zip.GetEntries();
+			CKPE_CHECK(Entries->Count() == 10);
+
+			// The first one of the same name wins, as with the linear search
+			CKPE_CHECK(Entries->Find("Dialogs/Main.json") == 0);
+			CKPE_CHECK(Entries->Find("dialogs/main.json") == 0);
+			CKPE_CHECK(Entries->Find("DIALOGS/MAIN.JSON") == 0);
+			CKPE_CHECK(Zip.IndexOf("DiAlOgS/mAiN.jSoN") == 0);
+			CKPE_CHECK(Zip.IndexOf(L"DIALOGS/SUB/EDIT.JSON") == 2);
+			CKPE_CHECK(Entries->Find(std::string("patches/SKYRIM.RELB")) == 9);
+
+			// Only A-Z are folded, the neighbours of the letters are other names
+			CKPE_CHECK(Entries->Find("item@1") == 5);
+			CKPE_CHECK(Entries->Find("ITEM`1") == 6);
+			CKPE_CHECK(Entries->Find("item[1]") == 7);
+			CKPE_CHECK(Entries->Find("ITEM{1}") == 8);
+
+			CKPE_CHECK(GetEntryCrc(Entries, Entries->Find("dialogs/sub/edit.json")) ==
+				HashUtils::CRC32Buffer("Dialogs/Sub/Edit.json", 21));
+
+			// A prefix or a longer name isn't the entry
+			CKPE_CHECK(Entries->Find("Dialogs/Main.jso") == ZipFileEntry::InvalidIndex);
+			CKPE_CHECK(Entries->Find("Dialogs/Main.json2") == ZipFileEntry::InvalidIndex);
+			CKPE_CHECK(Entries->Find("Dialogs/") == ZipFileEntry::InvalidIndex);
+			CKPE_CHECK(Entries->Find("") == ZipFileEntry::InvalidIndex);
+			CKPE_CHECK(Entries->Find((const char*)nullptr) == ZipFileEntry::InvalidIndex);
+			CKPE_CHECK(Zip.IndexOf("") == ZipFileEntry::InvalidIndex);
+
+			// In the order of the folded names, both of the same name are listed
+			std::vector<std::size_t> Found;
+			CKPE_CHECK(Entries->FindByPrefix("DIALOGS/", Found) == 4);
+			CKPE_CHECK(Found == std::vector<std::size_t>({ 3, 0, 1, 2 }));
+
+			Found.clear();
+			CKPE_CHECK(Entries->FindByPrefix("dialogs", Found) == 5);
+			CKPE_CHECK(Found.back() == 4);
+
+			Found.clear();
+			CKPE_CHECK(Entries->FindByPrefix("Item", Found) == 4);
+			CKPE_CHECK(Found == std::vector<std::size_t>({ 5, 7, 6, 8 }));
+
+			Found.clear();
+			CKPE_CHECK(Entries->FindByPrefix("Missing/", Found) == 0);
+			CKPE_CHECK(Found.empty());
+
+			// An empty prefix gives all of them
+			CKPE_CHECK(Entries->FindByPrefix("", Found) == 10);
+
+			Zip.Close();
+			CKPE_CHECK(Zip.IndexOf("Dialogs/Main.json") == ZipFileEntry::InvalidIndex);
+		}
+
+		CKPE_TEST(ZipperThousandsOfEntries)
+		{
+			constexpr std::uint32_t Count = 5000;
+
+			// Folders of a mod package, many names share a long prefix and differ only at the end
+			StoredZipWriter Writer;
+			char Name[128];
+			for (std::uint32_t i = 0; i < Count; i++)
+			{
+				sprintf_s(Name, "%s/Folder%02u/File%05u.%s", (i & 1) ? "Meshes" : "Textures", i % 37, i,
+					(i & 1) ? "NIF" : "dds");
+				Writer.Add(Name);
+			}
+
+			auto FileName = GetTempFileName(L"CKPE.Tests.ZipperThousands.zip");
+			CKPE_CHECK(Writer.Save(FileName));
+
+			UnZipper Zip;
+			CKPE_CHECK(Zip.OpenFile(FileName));
+			if (!Zip.HasOpen())
+				return;
+
+			auto Entries = Zip.GetEntries();
+			CKPE_CHECK(Entries->Count() == Count);
+
+			auto Names = ReadNames(Entries);
+			CKPE_CHECK(Names.size() == Count);
+
+			// Every entry in any case, and a miss next to each of them
+			std::uint32_t Wrong = 0;
+			for (std::uint32_t i = 0; i < Count; i++)
+			{
+				auto Upper = Names[i], Lower = Names[i];
+				for (auto& c : Upper) c = (char)toupper((std::uint8_t)c);
+				for (auto& c : Lower) c = (char)tolower((std::uint8_t)c);
+
+				if ((Entries->Find(Names[i]) != i) || (Entries->Find(Upper) != i) || (Zip.IndexOf(Lower) != i))
+					Wrong++;
+
+				auto Missing = Names[i];
+				Missing.back() = '_';
+				if ((Entries->Find(Missing) != ZipFileEntry::InvalidIndex) || (LinearFind(Names, Missing.c_str()) !=
+					ZipFileEntry::InvalidIndex))
+					Wrong++;
+			}
+			CKPE_CHECK(!Wrong);
+
+			// The same answers as the linear search, on the names a package really asks for
+			for (std::uint32_t i = 0; i < Count; i += 97)
+			{
+				sprintf_s(Name, "textures/folder%02u/file%05u.DDS", i % 37, i);
+				CKPE_CHECK(Entries->Find(Name) == LinearFind(Names, Name));
+				sprintf_s(Name, "MESHES/FOLDER%02u/FILE%05u.nif", i % 37, i);
+				CKPE_CHECK(Entries->Find(Name) == LinearFind(Names, Name));
+			}
+
+			// The prefix of a folder, each found entry has it and none of the others
+			std::vector<std::size_t> Found;
+			auto Total = Entries->FindByPrefix("meshes/FOLDER05/", Found);
+			std::size_t Expected = 0;
+			for (auto& Entry : Names)
+				Expected += !_strnicmp(Entry.c_str(), "Meshes/Folder05/", 16);
+
+			CKPE_CHECK(Expected && (Total == Expected) && (Found.size() == Expected));
+			CKPE_CHECK(std::is_sorted(Found.begin(), Found.end(), [&](std::size_t a, std::size_t b)
+				{ return _stricmp(Names[a].c_str(), Names[b].c_str()) < 0; }));
+			for (auto Index : Found)
+				CKPE_CHECK(!_strnicmp(Names[Index].c_str(), "Meshes/Folder05/", 16));
+
+			Found.clear();
+			CKPE_CHECK(Entries->FindByPrefix("Textures/", Found) == Count / 2);
+		}
+
+		CKPE_BENCHMARK(ZipperFind)
+		{
+			constexpr std::uint32_t Lookups = 1000000;
+
+			for (std::uint32_t Count : { 100, 1000, 10000 })
+			{
+				StoredZipWriter Writer;
+				char Name[128];
+				for (std::uint32_t i = 0; i < Count; i++)
+				{
+					sprintf_s(Name, "Patches/Folder%02u/Patch%05u.relb", i % 37, i);
+					Writer.Add(Name);
+				}
+
+				auto FileName = GetTempFileName(L"CKPE.Tests.ZipperFind.zip");
+				if (!Writer.Save(FileName))
+				{
+					CKPE_CHECK(false);
+					return;
+				}
+
+				UnZipper Zip;
+				CKPE_CHECK(Zip.OpenFile(FileName));
+				if (!Zip.HasOpen())
+					return;
+
+				auto Entries = Zip.GetEntries();
+				auto Names = ReadNames(Entries);
+
+				std::vector<std::string> Keys;
+				for (std::uint32_t i = 0; i < 1024; i++)
+				{
+					sprintf_s(Name, "PATCHES/folder%02u/patch%05u.RELB", (i * 7919) % Count % 37, (i * 7919) % Count);
+					Keys.push_back(Name);
+				}
+
+				for (auto& Key : Keys)
+					CKPE_CHECK(Entries->Find(Key) == LinearFind(Names, Key.c_str()));
+
+				std::size_t Sum = 0;
+				Stopwatch Watch;
+				for (std::uint32_t i = 0; i < Lookups; i++)
+					Sum += Entries->Find(Keys[i & 1023]);
+				auto IndexNs = Watch.GetMilliseconds() * 1000000.0 / Lookups;
+
+				// Far fewer, it is quadratic over the whole package
+				auto LinearLookups = std::max(Lookups / Count, 1000u);
+				std::size_t LinearSum = 0;
+				Watch.Restart();
+				for (std::uint32_t i = 0; i < LinearLookups; i++)
+					LinearSum += LinearFind(Names, Keys[i & 1023].c_str());
+				auto LinearNs = Watch.GetMilliseconds() * 1000000.0 / LinearLookups;
+
+				CKPE_BENCH_PRINT("%5u entries: Find %7.1f ns, linear %10.1f ns, x%.0f (%zu, %zu)", Count, IndexNs,
+					LinearNs, LinearNs / IndexNs, Sum, LinearSum);
+			}
+		}
+	}
+}
@@ -0,0 +1,110 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <CKPE.Common.TaskScheduler.h>
+#include "CKPE.Tests.h"
+
+#include <filesystem>
+#include <atomic>
+#include <string.h>
+
+// Usage: CKPE.Tests [-bench] [name...]
+// Without names all the tests are run, the benchmarks only with -bench.
+// The exit code is the number of the failed tests.
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		static std::atomic_uint32_t sfailed_checks{ 0 };
+		static std::vector<std::wstring> stemp_files;
+
+		std::vector<TestCase>& GetTests() noexcept(true)
+		{
+			// Filled from the static initializers of the other files
+			static std::vector<TestCase> tests;
+			return tests;
+		}
+
+		void Fail(const char* File, std::int32_t Line, const char* Expression) noexcept(true)
+		{
+			// Only the first ones, a broken loop shouldn't flood the output
+			if (sfailed_checks++ < 20)
+				printf("    FAILED %s(%d): %s\n", File, Line, Expression);
+		}
+
+		std::wstring GetTempFileName(const wchar_t* Name) noexcept(true)
+		{
+			std::error_code ec;
+			auto Path = (std::filesystem::temp_directory_path(ec) / Name).wstring();
+			stemp_files.push_back(Path);
+			return Path;
+		}
+
+		static bool IsSelected(const TestCase& Test, int argc, char** argv, bool Benchmarks) noexcept(true)
+		{
+			bool AnyName = false;
+			for (int i = 1; i < argc; i++)
+			{
+				if (argv[i][0] == '-')
+					continue;
+
+				AnyName = true;
+				if (!_stricmp(argv[i], Test.Name))
+					return true;
+			}
+
+			return !AnyName && (!Test.Benchmark || Benchmarks);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	using namespace CKPE;
+
+	bool Benchmarks = false;
+	for (int i = 1; i < argc; i++)
+		if (!_stricmp(argv[i], "-bench"))
+			Benchmarks = true;
+
+	// The same pool as in the editor, the parallel paths are tested too
+	Common::TaskScheduler::GetSingleton()->Initialize();
+	printf("Workers: %u\n", Common::TaskScheduler::GetSingleton()->GetWorkerCount());
+
+	std::uint32_t Total = 0, Failed = 0;
+	for (auto& Test : Tests::GetTests())
+	{
+		if (!Tests::IsSelected(Test, argc, argv, Benchmarks))
+			continue;
+
+		printf("%s %s\n", Test.Benchmark ? "[BENCH]" : "[TEST] ", Test.Name);
+
+		auto Checks = Tests::sfailed_checks.load();
+		Tests::Stopwatch Watch;
+		Test.Func();
+		auto Time = Watch.GetMilliseconds();
+
+		Total++;
+		if (Tests::sfailed_checks != Checks)
+		{
+			Failed++;
+			printf("    failed (%.1f ms)\n", Time);
+		}
+		else
+			printf("    ok (%.1f ms)\n", Time);
+	}
+
+	Common::TaskScheduler::GetSingleton()->Shutdown();
+
+	for (auto& File : Tests::stemp_files)
+	{
+		std::error_code ec;
+		std::filesystem::remove(File, ec);
+	}
+
+	printf("%u of %u passed\n", Total - Failed, Total);
+	return (int)Failed;
+}
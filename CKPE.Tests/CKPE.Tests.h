@@ -0,0 +1,65 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace CKPE
+{
+	namespace Tests
+	{
+		typedef void (*TTestFunc)();
+
+		struct TestCase
+		{
+			const char* Name;
+			TTestFunc Func;
+			bool Benchmark;
+		};
+
+		// The tests of all the files, in the order the files are initialized
+		[[nodiscard]] std::vector<TestCase>& GetTests() noexcept(true);
+		// Counted for the current test, it goes on after a failed check
+		void Fail(const char* File, std::int32_t Line, const char* Expression) noexcept(true);
+		// Temporary file of the test, removed by the runner at the end
+		[[nodiscard]] std::wstring GetTempFileName(const wchar_t* Name) noexcept(true);
+
+		struct TestRegistrar
+		{
+			inline TestRegistrar(const char* Name, TTestFunc Func, bool Benchmark) noexcept(true)
+			{ GetTests().push_back({ Name, Func, Benchmark }); }
+		};
+
+		class Stopwatch
+		{
+			std::chrono::steady_clock::time_point _start{ std::chrono::steady_clock::now() };
+		public:
+			inline void Restart() noexcept(true) { _start = std::chrono::steady_clock::now(); }
+			[[nodiscard]] inline double GetMilliseconds() const noexcept(true)
+			{ return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count(); }
+		};
+	}
+}
+
+#define CKPE_TEST(Name) \
+	static void Name(); \
+	static CKPE::Tests::TestRegistrar Name##_Registrar(#Name, &Name, false); \
+	static void Name()
+
+// Run only with -bench, the results are printed
+#define CKPE_BENCHMARK(Name) \
+	static void Name(); \
+	static CKPE::Tests::TestRegistrar Name##_Registrar(#Name, &Name, true); \
+	static void Name()
+
+#define CKPE_CHECK(Expression) \
+	do { if (!(Expression)) CKPE::Tests::Fail(__FILE__, __LINE__, #Expression); } while (0)
+
+#define CKPE_BENCH_PRINT(...) \
+	do { printf("    "); printf(__VA_ARGS__); printf("\n"); } while (0)
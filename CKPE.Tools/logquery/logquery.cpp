@@ -0,0 +1,514 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/gpl-3.0.html
+
+#include <windows.h>
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The file format is described in CKPE.Common\Include\CKPE.Common.LogCapture.h,
+// the structures are copied here so the tool doesn't depend on the CKPE headers.
+
+constexpr static uint32_t CKLOG_MAGIC = 'GLKC';
+constexpr static uint32_t CKLOG_VERSION = 1;
+constexpr static uint32_t CKLOG_NULL_STRING = 0xFFFFFFFFul;
+
+enum record_type : uint8_t { rt_template = 1, rt_message };
+enum arg_type : uint8_t { at_int = 0, at_double, at_string, at_wstring, at_pointer, at_char, at_wchar };
+
+#pragma pack(push, 1)
+struct file_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t start_time;
+    uint64_t start_counter;
+    uint64_t frequency;
+};
+
+struct record_header
+{
+    uint8_t type;
+    uint8_t reserved[3];
+    uint32_t size;
+};
+
+struct template_record
+{
+    record_header header;
+    uint32_t id;
+    uint32_t length;
+};
+
+struct message_record
+{
+    record_header header;
+    uint64_t counter;
+    uint64_t source;
+    uint32_t thread_id;
+    uint32_t template_id;
+    uint8_t severity;
+    uint8_t arg_count;
+    uint8_t reserved[2];
+};
+#pragma pack(pop)
+
+struct arg_value
+{
+    arg_type type;
+    int64_t i;
+    double d;
+    std::string s;
+    bool is_null;
+};
+
+struct query
+{
+    int severity = -1;
+    int64_t thread_id = -1;
+    int64_t template_id = -1;
+    std::string text;
+    double time_from = -1.0;
+    double time_to = -1.0;
+    bool count_by_template = false;
+    bool list_templates = false;
+    bool json = false;
+};
+
+static const char* severity_names[] = { "message", "warning", "error", "fatal", "console" };
+
+static void hello()
+{
+    std::cout << "logquery copyright (c) 2025 the CKPE developers.\n";
+    std::cout << "Search and export of the CKPE structured log (.cklog).\n\n\n";
+}
+
+static void example()
+{
+    std::cout << "usage: logquery [infile] [options]...\n"
+        "  --severity <message|warning|error|fatal|console>\n"
+        "  --thread <id>\n"
+        "  --template <id>\n"
+        "  --text <substring>        search in the formatted message\n"
+        "  --from <sec> --to <sec>   time range, seconds since the log was opened\n"
+        "  --count-by-template       number of messages of each format\n"
+        "  --list-templates          all formats of the log\n"
+        "  --export <text|json>      output format, json is one object per line\n";
+}
+
+static std::string wide_to_utf8(const wchar_t* a_str, size_t a_len)
+{
+    if (!a_len) return {};
+    int size = WideCharToMultiByte(CP_UTF8, 0, a_str, (int)a_len, nullptr, 0, nullptr, nullptr);
+    std::string result(size, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, a_str, (int)a_len, result.data(), size, nullptr, nullptr);
+    return result;
+}
+
+static bool read_args(const uint8_t* a_data, const uint8_t* a_end, uint32_t a_count, std::vector<arg_value>& a_args)
+{
+    a_args.clear();
+
+    for (uint32_t i = 0; i < a_count; i++)
+    {
+        if (a_data >= a_end) return false;
+
+        arg_value arg{ (arg_type)*a_data++, 0, 0.0, {}, false };
+        switch (arg.type)
+        {
+        case at_int:
+        case at_pointer:
+        case at_char:
+        case at_wchar:
+            if ((a_end - a_data) < 8) return false;
+            memcpy(&arg.i, a_data, 8);
+            a_data += 8;
+            break;
+        case at_double:
+            if ((a_end - a_data) < 8) return false;
+            memcpy(&arg.d, a_data, 8);
+            a_data += 8;
+            break;
+        case at_string:
+        case at_wstring:
+        {
+            uint32_t len;
+            if ((a_end - a_data) < 4) return false;
+            memcpy(&len, a_data, 4);
+            a_data += 4;
+            if (len == CKLOG_NULL_STRING)
+            {
+                arg.is_null = true;
+                break;
+            }
+            if ((uint32_t)(a_end - a_data) < len) return false;
+            if (arg.type == at_wstring)
+            {
+                std::wstring ws(len / sizeof(wchar_t), L'\0');
+                memcpy(ws.data(), a_data, ws.length() * sizeof(wchar_t));
+                arg.s = wide_to_utf8(ws.c_str(), ws.length());
+            }
+            else
+                arg.s.assign((const char*)a_data, len);
+            a_data += len;
+            break;
+        }
+        default:
+            return false;
+        }
+
+        a_args.push_back(std::move(arg));
+    }
+
+    return true;
+}
+
+// Formats the message again: each printf spec is rebuilt for the stored value
+static std::string render(const std::string& a_format, const std::vector<arg_value>& a_args)
+{
+    std::string result;
+    size_t next = 0;
+    char buffer[512];
+
+    for (size_t i = 0; i < a_format.length(); i++)
+    {
+        if (a_format[i] != '%')
+        {
+            result.push_back(a_format[i]);
+            continue;
+        }
+
+        if (a_format[i + 1] == '%')
+        {
+            result.push_back('%');
+            i++;
+            continue;
+        }
+
+        std::string spec = "%";
+        size_t p = i + 1;
+
+        while (p < a_format.length() && strchr("-+ #0", a_format[p])) spec.push_back(a_format[p++]);
+        auto take_number = [&]()
+        {
+            if (a_format[p] == '*')
+            {
+                spec += (next < a_args.size()) ? std::to_string(a_args[next++].i) : "0";
+                p++;
+            }
+            else while (p < a_format.length() && isdigit((uint8_t)a_format[p])) spec.push_back(a_format[p++]);
+        };
+        take_number();
+        if (a_format[p] == '.')
+        {
+            spec.push_back(a_format[p++]);
+            take_number();
+        }
+
+        // the length is skipped, the value is already widened
+        if (!strncmp(&a_format[p], "I64", 3) || !strncmp(&a_format[p], "I32", 3)) p += 3;
+        else while (p < a_format.length() && strchr("hlLwzjtI", a_format[p])) p++;
+
+        if (p >= a_format.length())
+            break;
+
+        char conv = a_format[p];
+        i = p;
+
+        if (next >= a_args.size())
+        {
+            result.append("<?>");
+            continue;
+        }
+
+        auto& arg = a_args[next++];
+        switch (arg.type)
+        {
+        case at_int:
+            spec += "ll";
+            spec.push_back(conv);
+            snprintf(buffer, sizeof(buffer), spec.c_str(), arg.i);
+            result.append(buffer);
+            break;
+        case at_double:
+            spec.push_back(conv);
+            snprintf(buffer, sizeof(buffer), spec.c_str(), arg.d);
+            result.append(buffer);
+            break;
+        case at_pointer:
+            snprintf(buffer, sizeof(buffer), "%016llX", (unsigned long long)arg.i);
+            result.append(buffer);
+            break;
+        case at_char:
+            result.push_back((char)arg.i);
+            break;
+        case at_wchar:
+        {
+            wchar_t wc = (wchar_t)arg.i;
+            result.append(wide_to_utf8(&wc, 1));
+            break;
+        }
+        default:
+            if (arg.is_null)
+                result.append("(null)");
+            else
+            {
+                // width and precision of the strings
+                spec += "s";
+                int size = snprintf(nullptr, 0, spec.c_str(), arg.s.c_str());
+                std::string s(size, '\0');
+                snprintf(s.data(), (size_t)size + 1, spec.c_str(), arg.s.c_str());
+                result.append(s);
+            }
+            break;
+        }
+    }
+
+    return result;
+}
+
+static std::string json_escape(const std::string& a_str)
+{
+    std::string result;
+    result.reserve(a_str.length() + 16);
+
+    for (auto ch : a_str)
+    {
+        switch (ch)
+        {
+        case '"': result.append("\\\""); break;
+        case '\\': result.append("\\\\"); break;
+        case '\n': result.append("\\n"); break;
+        case '\r': result.append("\\r"); break;
+        case '\t': result.append("\\t"); break;
+        default:
+            if ((uint8_t)ch < 0x20)
+            {
+                char buffer[8];
+                snprintf(buffer, sizeof(buffer), "\\u%04X", (uint8_t)ch);
+                result.append(buffer);
+            }
+            else
+                result.push_back(ch);
+        }
+    }
+
+    return result;
+}
+
+static bool parse_args(int a_argc, char* a_argv[], query& a_query)
+{
+    for (int i = 2; i < a_argc; i++)
+    {
+        std::string opt = a_argv[i];
+        bool has_value = (i + 1) < a_argc;
+
+        if (opt == "--count-by-template")
+            a_query.count_by_template = true;
+        else if (opt == "--list-templates")
+            a_query.list_templates = true;
+        else if (!has_value)
+        {
+            std::cout << "ERROR: option \"" << opt << "\" requires a value\n";
+            return false;
+        }
+        else if (opt == "--severity")
+        {
+            std::string value = a_argv[++i];
+            for (int s = 0; s < _ARRAYSIZE(severity_names); s++)
+                if (!_stricmp(value.c_str(), severity_names[s]))
+                    a_query.severity = s;
+            if (a_query.severity == -1)
+            {
+                std::cout << "ERROR: unknown severity \"" << value << "\"\n";
+                return false;
+            }
+        }
+        else if (opt == "--thread")
+            a_query.thread_id = strtoll(a_argv[++i], nullptr, 0);
+        else if (opt == "--template")
+            a_query.template_id = strtoll(a_argv[++i], nullptr, 0);
+        else if (opt == "--text")
+            a_query.text = a_argv[++i];
+        else if (opt == "--from")
+            a_query.time_from = atof(a_argv[++i]);
+        else if (opt == "--to")
+            a_query.time_to = atof(a_argv[++i]);
+        else if (opt == "--export")
+            a_query.json = !_stricmp(a_argv[++i], "json");
+        else
+        {
+            std::cout << "ERROR: unknown option \"" << opt << "\"\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool run(const char* a_filename, const query& a_query)
+{
+    std::ifstream stream(a_filename, std::ios::binary);
+    if (!stream.is_open())
+    {
+        std::cout << "ERROR: can't open file \"" << a_filename << "\"\n";
+        return false;
+    }
+
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    file_header header;
+    if ((data.size() < sizeof(header)) || (memcpy(&header, data.data(), sizeof(header)), header.magic != CKLOG_MAGIC))
+    {
+        std::cout << "ERROR: it's not the structured log of CKPE\n";
+        return false;
+    }
+
+    if (header.version != CKLOG_VERSION)
+    {
+        std::cout << "ERROR: unsupported version " << header.version << "\n";
+        return false;
+    }
+
+    if (!header.frequency) header.frequency = 1;
+
+    std::map<uint32_t, std::string> templates;
+    std::map<uint32_t, uint64_t> counts;
+    std::vector<arg_value> args;
+
+    size_t offset = sizeof(header);
+    while ((offset + sizeof(record_header)) <= data.size())
+    {
+        record_header rec;
+        memcpy(&rec, &data[offset], sizeof(rec));
+
+        // the tail of the file can be incomplete after the crash
+        if ((rec.size < sizeof(record_header)) || ((offset + rec.size) > data.size()))
+            break;
+
+        auto record = &data[offset];
+        offset += rec.size;
+
+        if (rec.type == rt_template)
+        {
+            template_record tmpl;
+            if (rec.size < sizeof(tmpl)) continue;
+            memcpy(&tmpl, record, sizeof(tmpl));
+            if ((sizeof(tmpl) + tmpl.length) > rec.size) continue;
+            templates[tmpl.id].assign((const char*)record + sizeof(tmpl), tmpl.length);
+            continue;
+        }
+
+        if ((rec.type != rt_message) || (rec.size < sizeof(message_record)))
+            continue;
+
+        message_record msg;
+        memcpy(&msg, record, sizeof(msg));
+
+        double time = (double)(int64_t)(msg.counter - header.start_counter) / (double)header.frequency;
+
+        if ((a_query.severity != -1) && (msg.severity != a_query.severity)) continue;
+        if ((a_query.thread_id != -1) && (msg.thread_id != (uint64_t)a_query.thread_id)) continue;
+        if ((a_query.template_id != -1) && (msg.template_id != (uint64_t)a_query.template_id)) continue;
+        if ((a_query.time_from >= 0.0) && (time < a_query.time_from)) continue;
+        if ((a_query.time_to >= 0.0) && (time > a_query.time_to)) continue;
+
+        if (a_query.list_templates)
+            continue;
+
+        std::string text;
+        if (!a_query.text.empty() || !a_query.count_by_template)
+        {
+            auto it = templates.find(msg.template_id);
+            if (it == templates.end()) continue;
+            if (!read_args(record + sizeof(msg), record + rec.size, msg.arg_count, args)) continue;
+
+            text = render(it->second, args);
+            while (!text.empty() && ((text.back() == '\n') || (text.back() == '\r'))) text.pop_back();
+            if (!a_query.text.empty() && (text.find(a_query.text) == std::string::npos)) continue;
+        }
+
+        if (a_query.count_by_template)
+        {
+            counts[msg.template_id]++;
+            continue;
+        }
+
+        auto severity = msg.severity < _ARRAYSIZE(severity_names) ? severity_names[msg.severity] : "unknown";
+        char buffer[128];
+
+        if (a_query.json)
+        {
+            snprintf(buffer, sizeof(buffer),
+                "{\"time\":%.6f,\"thread\":%u,\"severity\":\"%s\",\"template\":%u,\"source\":\"%016llX\",\"text\":\"",
+                time, msg.thread_id, severity, msg.template_id, (unsigned long long)msg.source);
+            std::cout << buffer << json_escape(text) << "\"}\n";
+        }
+        else
+        {
+            snprintf(buffer, sizeof(buffer), "[%12.6f] [%5u] [%-7s] ", time, msg.thread_id, severity);
+            std::cout << buffer << text << "\n";
+        }
+    }
+
+    if (a_query.list_templates)
+    {
+        for (auto& it : templates)
+        {
+            if (a_query.json)
+                std::cout << "{\"template\":" << it.first << ",\"format\":\"" << json_escape(it.second) << "\"}\n";
+            else
+                std::cout << it.first << "\t" << it.second << (it.second.ends_with('\n') ? "" : "\n");
+        }
+    }
+    else if (a_query.count_by_template)
+    {
+        std::vector<std::pair<uint64_t, uint32_t>> sorted;
+        for (auto& it : counts)
+            sorted.emplace_back(it.second, it.first);
+        std::sort(sorted.begin(), sorted.end(), std::greater<>());
+
+        for (auto& it : sorted)
+        {
+            auto& format = templates[it.second];
+            if (a_query.json)
+                std::cout << "{\"template\":" << it.second << ",\"count\":" << it.first << ",\"format\":\"" <<
+                    json_escape(format) << "\"}\n";
+            else
+            {
+                std::string line = format;
+                while (!line.empty() && ((line.back() == '\n') || (line.back() == '\r'))) line.pop_back();
+                std::cout << it.first << "\t" << it.second << "\t" << line << "\n";
+            }
+        }
+    }
+
+    return true;
+}
+
+int main(int a_argc, char* a_argv[])
+{
+    if (a_argc == 1)
+    {
+        hello();
+        example();
+
+        return 0;
+    }
+
+    query q;
+    if (!parse_args(a_argc, a_argv, q))
+        return -1;
+
+    return run(a_argv[1], q) ? 0 : -1;
+}
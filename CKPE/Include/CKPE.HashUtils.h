@@ -27,5 +27,45 @@ namespace CKPE
 		static std::uint64_t MurmurHash64A(const void* key, std::size_t len, std::uint64_t seed = 0) noexcept(true);
 		static std::uint32_t MurmurHash32(const std::string& key, std::uint32_t seed = 0) noexcept(true);
 		static std::uint64_t MurmurHash64A(const std::string& key, std::uint64_t seed = 0) noexcept(true);
+		// CRC-32C (Castagnoli), SSE4.2 crc32 instruction if available.
+		// It isn't compatible with CRC32, use only for new formats.
+		static std::uint32_t CRC32C(const void* in, const std::size_t size) noexcept(true);
+		static std::uint32_t CRC32CUpdate(const void* in, const std::size_t size, std::uint32_t prev_crc) noexcept(true);
+		// MurmurHash3 x86_32, the same as Murmur3State.
+		static std::uint32_t MurmurHash3(const void* key, std::size_t len, std::uint32_t seed = 0) noexcept(true);
+		// Fast non-cryptographic 64-bit hash (xxh3-style) for in-memory tables only.
+		// The result isn't stable between versions, don't save it to files.
+		static std::uint64_t FastHash64(const void* key, std::size_t len, std::uint64_t seed = 0) noexcept(true);
+		static std::uint64_t FastHash64(const std::string& key, std::uint64_t seed = 0) noexcept(true);
+	};
+
+	// Incremental CRC32, the result is the same as HashUtils::CRC32Buffer
+	class CKPE_API Crc32State
+	{
+		std::uint32_t _crc{ 0xFFFFFFFFul };
+	public:
+		constexpr Crc32State() noexcept(true) = default;
+
+		inline void Reset() noexcept(true) { _crc = 0xFFFFFFFFul; }
+		void Update(const void* in, const std::size_t size) noexcept(true);
+		[[nodiscard]] inline std::uint32_t Final() const noexcept(true) { return ~_crc; }
+	};
+
+	// Incremental MurmurHash3 x86_32, the result is the same as HashUtils::MurmurHash3
+	class CKPE_API Murmur3State
+	{
+		std::uint32_t _seed{ 0 };
+		std::uint32_t _hash{ 0 };
+		std::uint32_t _tail{ 0 };
+		std::uint32_t _tail_size{ 0 };
+		std::uint64_t _total{ 0 };
+	public:
+		constexpr Murmur3State(std::uint32_t seed = 0) noexcept(true) :
+			_seed(seed), _hash(seed)
+		{}
+
+		void Reset() noexcept(true);
+		void Update(const void* in, const std::size_t size) noexcept(true);
+		[[nodiscard]] std::uint32_t Final() const noexcept(true);
 	};
 }
\ No newline at end of file
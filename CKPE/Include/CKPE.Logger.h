@@ -7,7 +7,9 @@
 #include <string>
 #include <string_view>
 #include <cstdint>
+#include <cstdarg>
 #include <format>
+#include <atomic>
 #include <CKPE.Common.h>
 #include <CKPE.CriticalSection.h>
 
@@ -16,8 +18,15 @@ namespace CKPE
 	class CKPE_API Logger
 	{
 		void* _handle{ nullptr };
+		std::atomic<void*> _async{ nullptr };
+		// Threads that use the queue of the async writer right now, StopAsync waits for them
+		mutable std::atomic_uint32_t _async_users{ 0 };
 		std::wstring* _fname{ nullptr };
 		CriticalSection _section;
+
+		void DrainAsync(void* async) const noexcept(true);
+		bool PushAsync(std::uint32_t type_msg, const std::string& record, bool packed, std::uint32_t count) const noexcept(true);
+		static std::uint32_t AsyncWriterThread(void* param) noexcept(true);
 	public:
 		enum Setting : std::uint32_t {
 			sAutoFlush							= 1 << 0,
@@ -34,6 +43,14 @@ namespace CKPE
 			tFatalError
 		};
 
+		// What to do with a message when the ring buffer of the async writer is full
+		enum FullPolicy : std::uint32_t
+		{
+			fpDrop = 0,		// discard the message (counted in GetDroppedCount)
+			fpBlock,		// wait on the calling thread until the writer frees a slot
+			fpSpill,		// write the message directly on the calling thread
+		};
+
 		Logger() noexcept(true) = default;
 		Logger(const Logger&) = delete;
 		Logger& operator=(const Logger&) = delete;
@@ -80,10 +97,25 @@ namespace CKPE
 
 		void WriteString(TypeMsg type_msg, const std::string& message) const noexcept(true);
 		void WriteString(TypeMsg type_msg, const std::wstring& message) const noexcept(true);
-
+		// With the async writer the args are only packed and the writer thread formats the message
+		void WriteStringVa(TypeMsg type_msg, const char* format, va_list ap) const noexcept(true);
+		// The args already packed by PackedArgs, false if the async writer can't take them (not started,
+		// fatal error, too long), then the message must be written as usual
+		bool WriteStringPacked(TypeMsg type_msg, const char* format, const std::string& args,
+			std::uint32_t count) const noexcept(true);
+
+		// Writes out everything that is queued by the async writer and flushes the file
 		virtual void Flush() const noexcept(true);
 		virtual void NewLine() const noexcept(true);
 
+		// Messages are queued to a lock-free ring buffer and written to file in batches
+		// by a background thread. Fatal errors and too long messages are always written directly.
+		// The writer is restarted when the log is opened again.
+		bool StartAsync(FullPolicy policy = fpSpill) noexcept(true);
+		void StopAsync() noexcept(true);
+		[[nodiscard]] inline virtual bool HasAsync() const noexcept(true) { return _async.load() != nullptr; }
+		[[nodiscard]] std::uint64_t GetDroppedCount() const noexcept(true);
+
 		inline virtual void SetSettings(std::uint32_t new_settings) noexcept(true) { _settings = new_settings; };
 		[[nodiscard]] inline constexpr virtual bool HasAutoFlush() const noexcept(true) { return _settings & sAutoFlush; }
 		[[nodiscard]] inline constexpr virtual bool HasAlwaysNewLine() const noexcept(true) { return _settings & sAlwaysNewLine; }
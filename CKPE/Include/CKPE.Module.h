@@ -77,6 +77,10 @@ namespace CKPE
 
 		[[nodiscard]] const void* GetProcAddress(const char* name) const noexcept(true);
 
+		// Identity of the image file from its PE header, the relocations of the loader don't change it
+		[[nodiscard]] static std::uint64_t GetImageHash(const void* base) noexcept(true);
+		[[nodiscard]] inline std::uint64_t GetImageHash() const noexcept(true) { return GetImageHash(_handle); }
+
 		friend class Application;
 	};
 
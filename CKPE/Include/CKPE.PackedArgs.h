@@ -0,0 +1,47 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#pragma once
+
+#include <cstdint>
+#include <cstdarg>
+#include <string>
+#include <CKPE.Common.h>
+
+namespace CKPE
+{
+	// The args of a printf format copied out of the va_list without formatting, so the text can be
+	// made later: by the async writer of the log or offline. Each arg is a type byte and the value.
+	class CKPE_API PackedArgs
+	{
+		constexpr PackedArgs() noexcept(true) = default;
+		PackedArgs(const PackedArgs&) = delete;
+		PackedArgs& operator=(const PackedArgs&) = delete;
+	public:
+		enum ArgType : std::uint8_t
+		{
+			atInt = 0,			// int64
+			atDouble,			// double
+			atString,			// u32 length + chars (length 0xFFFFFFFF is nullptr)
+			atWString,			// u32 length in bytes + UTF-16 chars (length 0xFFFFFFFF is nullptr)
+			atPointer,			// u64
+			atChar,				// int64, for %c
+			atWChar,			// int64, for %lc
+		};
+
+		constexpr static std::uint32_t ARGS_MAX = 32;
+		constexpr static std::uint32_t STRING_MAX = 4096;
+		constexpr static std::uint32_t NULL_STRING = 0xFFFFFFFFul;
+
+		// Appends the args to Buffer, Count is their number. False if the format has %n, an unknown spec
+		// or more than ARGS_MAX args, the rest isn't packed then and the message must be formatted as usual.
+		// The strings are read up to the precision of their spec, so they may be not zero-terminated.
+		// Wide - the format is a wchar_t one converted to UTF-8: %s and %c take wchar_t, %S and %C take char.
+		static bool Pack(std::string& Buffer, const char* Format, va_list Args, std::uint32_t& Count,
+			bool Wide = false) noexcept(true);
+		// The message, each spec of the format is rebuilt for the stored value (strings are UTF-8)
+		[[nodiscard]] static std::string Format(const char* Format, const void* Args, std::size_t Size,
+			std::uint32_t Count) noexcept(true);
+	};
+}
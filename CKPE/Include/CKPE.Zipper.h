@@ -78,10 +78,18 @@ namespace CKPE
 	{
 		const TZipObject* _class_owner{ nullptr };
 		std::vector<ZipFileEntry*>* _items{ nullptr };
+		// Names of entries from the central directory, lower case
+		std::vector<std::string>* _names{ nullptr };
+		// Open-addressing table, stores index + 1 of entry (0 - empty slot)
+		std::vector<std::uint32_t>* _slots{ nullptr };
+		// Indices of entries sorted by name, for prefix enumeration
+		std::vector<std::uint32_t>* _sorted{ nullptr };
 		CriticalSection _section;
 
 		ZipFileEntries(const ZipFileEntries&) = delete;
 		ZipFileEntries& operator=(const ZipFileEntries&) = delete;
+
+		void BuildIndex() noexcept(true);
 	public:
 		ZipFileEntries(const TZipObject* class_owner) noexcept(true);
 		virtual ~ZipFileEntries() noexcept(true);
@@ -90,6 +98,15 @@ namespace CKPE
 		[[nodiscard]] virtual inline const TZipObject* Zip() const noexcept(true) { return _class_owner; }
 
 		[[nodiscard]] virtual SmartPointer<ZipFileScopeEntry> At(std::size_t idx) const noexcept(true);
+
+		// Case-insensitive search by the name of the entry, O(1).
+		// Returns ZipFileEntry::InvalidIndex if it is not found.
+		[[nodiscard]] virtual std::size_t Find(const char* fname) const noexcept(true);
+		[[nodiscard]] virtual std::size_t Find(const std::string& fname) const noexcept(true);
+		// Case-insensitive enumeration of entries whose name begins with prefix (ex. "Dialogs/").
+		// Indices are returned in name order.
+		virtual std::size_t FindByPrefix(const char* prefix, std::vector<std::size_t>& result) const noexcept(true);
+		virtual std::size_t FindByPrefix(const std::string& prefix, std::vector<std::size_t>& result) const noexcept(true);
 		
 		virtual bool AddFile(const char* fname) noexcept(true);
 		virtual bool AddFile(const wchar_t* fname) noexcept(true);
@@ -3,12 +3,16 @@
 // License: https://www.gnu.org/licenses/lgpl-3.0.html
 
 #include <CKPE.HashUtils.h>
+#include <CKPE.HardwareInfo.h>
 #include <CKPE.Stream.h>
 #include <memory>
+#include <array>
+#include <cstring>
+#include <intrin.h>
 
 namespace CKPE
 {
-	static constexpr size_t BUFFER_SIZE = 16 * 1024;
+	static constexpr size_t BUFFER_SIZE = 64 * 1024;
 
 	static constexpr uint32_t crc_table[256] = {
 		0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
@@ -56,6 +60,248 @@ namespace CKPE
 		0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 	};
 
+	using crc_slice_table_t = std::array<std::array<std::uint32_t, 256>, 16>;
+
+	static constexpr crc_slice_table_t MakeSliceTable(std::uint32_t poly) noexcept(true)
+	{
+		crc_slice_table_t t{};
+
+		for (std::uint32_t i = 0; i < 256; i++)
+		{
+			std::uint32_t c = i;
+			for (std::uint32_t j = 0; j < 8; j++)
+				c = (c & 1) ? ((c >> 1) ^ poly) : (c >> 1);
+			t[0][i] = c;
+		}
+
+		for (std::uint32_t k = 1; k < 16; k++)
+			for (std::uint32_t i = 0; i < 256; i++)
+				t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+
+		return t;
+	}
+
+	static constexpr crc_slice_table_t crc_slice_table = MakeSliceTable(0xEDB88320ul);
+	static constexpr crc_slice_table_t crc32c_slice_table = MakeSliceTable(0x82F63B78ul);
+
+	static inline std::uint32_t ReadU32(const std::uint8_t* p) noexcept(true)
+	{
+		std::uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static inline std::uint64_t ReadU64(const std::uint8_t* p) noexcept(true)
+	{
+		std::uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	// Slicing-by-16, crc isn't inverted (internal state)
+	static std::uint32_t CRC32Slice16(const crc_slice_table_t& t, std::uint32_t crc, const std::uint8_t* buf,
+		std::size_t size) noexcept(true)
+	{
+		while (size >= 16)
+		{
+			std::uint32_t a = ReadU32(buf) ^ crc;
+			std::uint32_t b = ReadU32(buf + 4);
+			std::uint32_t c = ReadU32(buf + 8);
+			std::uint32_t d = ReadU32(buf + 12);
+
+			crc = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24] ^
+				t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^ t[9][(b >> 16) & 0xFF] ^ t[8][b >> 24] ^
+				t[7][c & 0xFF] ^ t[6][(c >> 8) & 0xFF] ^ t[5][(c >> 16) & 0xFF] ^ t[4][c >> 24] ^
+				t[3][d & 0xFF] ^ t[2][(d >> 8) & 0xFF] ^ t[1][(d >> 16) & 0xFF] ^ t[0][d >> 24];
+
+			buf += 16;
+			size -= 16;
+		}
+
+		while (size--)
+			crc = t[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+
+		return crc;
+	}
+
+	// PCLMULQDQ folding (Intel, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ").
+	// Needs size >= 64 and a multiple of 16, crc isn't inverted (internal state).
+	static std::uint32_t CRC32Fold_PCLMUL(std::uint32_t crc, const std::uint8_t* buf, std::size_t size) noexcept(true)
+	{
+		alignas(16) static constexpr std::uint64_t k1k2[] = { 0x0154442bd4ull, 0x01c6e41596ull };
+		alignas(16) static constexpr std::uint64_t k3k4[] = { 0x01751997d0ull, 0x00ccaa009eull };
+		alignas(16) static constexpr std::uint64_t k5k0[] = { 0x0163cd6124ull, 0x0000000000ull };
+		alignas(16) static constexpr std::uint64_t poly[] = { 0x01db710641ull, 0x01f7011641ull };
+
+		__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+		x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+		x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+		x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+		x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+		x0 = _mm_load_si128((const __m128i*)k1k2);
+
+		buf += 64;
+		size -= 64;
+
+		// Parallel fold blocks of 64
+		while (size >= 64)
+		{
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+			x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+			x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+			x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+			y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+			y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+			y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+			y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+			buf += 64;
+			size -= 64;
+		}
+
+		// Fold into 128-bits
+		x0 = _mm_load_si128((const __m128i*)k3k4);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+		// Single fold blocks of 16
+		while (size >= 16)
+		{
+			x2 = _mm_loadu_si128((const __m128i*)buf);
+
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+			buf += 16;
+			size -= 16;
+		}
+
+		// Fold 128-bits to 64-bits
+		x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+		x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+		x1 = _mm_srli_si128(x1, 8);
+		x1 = _mm_xor_si128(x1, x2);
+
+		x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_and_si128(x1, x3);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		// Barrett reduce to 32-bits
+		x0 = _mm_load_si128((const __m128i*)poly);
+
+		x2 = _mm_and_si128(x1, x3);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+		x2 = _mm_and_si128(x2, x3);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		return (std::uint32_t)_mm_extract_epi32(x1, 1);
+	}
+
+	static bool HasCRC32Fold() noexcept(true)
+	{
+		static const bool supported = HardwareInfo::CPU::HasSupportPCLMULQDQ() &&
+			HardwareInfo::CPU::HasSupportSSE41();
+		return supported;
+	}
+
+	static bool HasCRC32CInstruction() noexcept(true)
+	{
+		static const bool supported = HardwareInfo::CPU::HasSupportSSE42();
+		return supported;
+	}
+
+	static std::uint32_t CRC32Raw(std::uint32_t crc, const std::uint8_t* buf, std::size_t size) noexcept(true)
+	{
+		if ((size >= 64) && HasCRC32Fold())
+		{
+			auto chunk = size & ~(std::size_t)15;
+			crc = CRC32Fold_PCLMUL(crc, buf, chunk);
+			buf += chunk;
+			size -= chunk;
+		}
+
+		return CRC32Slice16(crc_slice_table, crc, buf, size);
+	}
+
+	static std::uint32_t CRC32CRaw(std::uint32_t crc, const std::uint8_t* buf, std::size_t size) noexcept(true)
+	{
+		if (!HasCRC32CInstruction())
+			return CRC32Slice16(crc32c_slice_table, crc, buf, size);
+
+		std::uint64_t crc64 = crc;
+		while (size >= 8)
+		{
+			crc64 = _mm_crc32_u64(crc64, ReadU64(buf));
+			buf += 8;
+			size -= 8;
+		}
+
+		crc = (std::uint32_t)crc64;
+		while (size--)
+			crc = _mm_crc32_u8(crc, *buf++);
+
+		return crc;
+	}
+
+	static inline std::uint32_t Murmur3Mix(std::uint32_t k) noexcept(true)
+	{
+		k *= 0xcc9e2d51ul;
+		k = _rotl(k, 15);
+		k *= 0x1b873593ul;
+		return k;
+	}
+
+	static inline std::uint32_t Murmur3Round(std::uint32_t h, std::uint32_t k) noexcept(true)
+	{
+		h ^= Murmur3Mix(k);
+		h = _rotl(h, 13);
+		return h * 5 + 0xe6546b64ul;
+	}
+
+	static inline std::uint64_t FastHashMul128Fold(std::uint64_t a, std::uint64_t b) noexcept(true)
+	{
+		std::uint64_t hi;
+		std::uint64_t lo = _umul128(a, b, &hi);
+		return lo ^ hi;
+	}
+
+	static inline std::uint64_t FastHashAvalanche(std::uint64_t h) noexcept(true)
+	{
+		h ^= h >> 37;
+		h *= 0x165667919E3779F9ull;
+		h ^= h >> 32;
+		return h;
+	}
+
 	std::uint32_t HashUtils::CRC32(const char* in) noexcept(true)
 	{
 		std::uint32_t crc = 0xFFFFFFFFul;
@@ -68,24 +314,12 @@ namespace CKPE
 
 	std::uint32_t HashUtils::CRC32Buffer(const void* in, const std::uint32_t size) noexcept(true)
 	{
-		std::uint32_t crc = 0xFFFFFFFFul;
-		const std::uint8_t* buf = (const std::uint8_t*)in;
-
-		for (std::uint32_t i = 0; i < size; ++i)
-			crc = crc_table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
-
-		return ~crc;
+		return ~CRC32Raw(0xFFFFFFFFul, (const std::uint8_t*)in, size);
 	}
 
 	std::uint32_t HashUtils::CRC32Update(const void* in, const std::uint32_t size, std::uint32_t prev_crc) noexcept(true)
 	{
-		std::uint32_t crc = prev_crc;
-		const std::uint8_t* buf = (const std::uint8_t*)in;
-
-		for (std::uint32_t i = 0; i < size; ++i)
-			crc = crc_table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
-
-		return crc;
+		return CRC32Raw(prev_crc, (const std::uint8_t*)in, size);
 	}
 
 	std::uint32_t HashUtils::CRC32Final(std::uint32_t crc) noexcept(true)
@@ -103,7 +337,7 @@ namespace CKPE
 
 			std::uint64_t pos = 0;
 			std::uint32_t rlen = 0;
-			std::uint32_t crc = 0xFFFFFFFFul;
+			Crc32State crc;
 
 			std::unique_ptr<char[]> buffer = std::make_unique<char[]>(BUFFER_SIZE);
 
@@ -111,13 +345,13 @@ namespace CKPE
 			{
 				rlen = stream.Read((void*)buffer.get(), BUFFER_SIZE);
 				if (rlen > 0)
-					crc = CRC32Update((void*)buffer.get(), rlen, crc);
+					crc.Update((void*)buffer.get(), rlen);
 				else
 					break;
 				pos += rlen;
 			} while (pos < size);
 
-			return CRC32Final(crc);
+			return crc.Final();
 		}
 		catch (const std::exception&)
 		{
@@ -135,7 +369,7 @@ namespace CKPE
 
 			std::uint64_t pos = 0;
 			std::uint32_t rlen = 0;
-			std::uint32_t crc = 0xFFFFFFFFul;
+			Crc32State crc;
 
 			std::unique_ptr<char[]> buffer = std::make_unique<char[]>(BUFFER_SIZE);
 
@@ -143,13 +377,13 @@ namespace CKPE
 			{
 				rlen = stream.Read((void*)buffer.get(), BUFFER_SIZE);
 				if (rlen > 0)
-					crc = CRC32Update((void*)buffer.get(), rlen, crc);
+					crc.Update((void*)buffer.get(), rlen);
 				else
 					break;
 				pos += rlen;
 			} while (pos < size);
 
-			return CRC32Final(crc);
+			return crc.Final();
 		}
 		catch (const std::exception&)
 		{
@@ -270,4 +504,150 @@ namespace CKPE
 	{
 		return MurmurHash64A(key.c_str(), key.length(), seed);
 	}
+
+	std::uint32_t HashUtils::CRC32C(const void* in, const std::size_t size) noexcept(true)
+	{
+		return ~CRC32CRaw(0xFFFFFFFFul, (const std::uint8_t*)in, size);
+	}
+
+	std::uint32_t HashUtils::CRC32CUpdate(const void* in, const std::size_t size, std::uint32_t prev_crc) noexcept(true)
+	{
+		return CRC32CRaw(prev_crc, (const std::uint8_t*)in, size);
+	}
+
+	std::uint32_t HashUtils::MurmurHash3(const void* key, std::size_t len, std::uint32_t seed) noexcept(true)
+	{
+		Murmur3State state(seed);
+		state.Update(key, len);
+		return state.Final();
+	}
+
+	std::uint64_t HashUtils::FastHash64(const void* key, std::size_t len, std::uint64_t seed) noexcept(true)
+	{
+		// Secret values are taken from the xxh3 default secret
+		constexpr std::uint64_t s0 = 0xbe4ba423396cfeb8ull;
+		constexpr std::uint64_t s1 = 0x1cad21f72c81017cull;
+		constexpr std::uint64_t s2 = 0xdb979083e96dd4deull;
+		constexpr std::uint64_t s3 = 0x1f67b3b7a4a44072ull;
+		constexpr std::uint64_t s4 = 0x78e5c0cc4ee679cbull;
+		constexpr std::uint64_t s5 = 0x2172ffcc7dd05a82ull;
+		constexpr std::uint64_t p1 = 0x9E3779B185EBCA87ull;
+
+		auto p = (const std::uint8_t*)key;
+
+		if (len <= 16)
+		{
+			if (len > 8)
+			{
+				auto lo = ReadU64(p) ^ (s0 + seed);
+				auto hi = ReadU64(p + len - 8) ^ (s1 - seed);
+				return FastHashAvalanche(len + _byteswap_uint64(lo) + hi + FastHashMul128Fold(lo, hi));
+			}
+
+			if (len >= 4)
+			{
+				auto v = (((std::uint64_t)ReadU32(p)) << 32) | ReadU32(p + len - 4);
+				return FastHashAvalanche(FastHashMul128Fold(v ^ (s2 + seed), p1 + len));
+			}
+
+			if (len > 0)
+			{
+				auto c = ((std::uint32_t)p[0] << 16) | ((std::uint32_t)p[len >> 1] << 24) |
+					(std::uint32_t)p[len - 1] | ((std::uint32_t)len << 8);
+				return FastHashAvalanche((c ^ (s3 + seed)) * p1);
+			}
+
+			return FastHashAvalanche(seed ^ s4);
+		}
+
+		// Two independent accumulators over 32-byte stripes, the last stripe overlaps the tail
+		std::uint64_t acc0 = len * p1;
+		std::uint64_t acc1 = seed ^ s5;
+
+		auto last = p + len - 32;
+		if (len > 32)
+		{
+			for (; p < last; p += 32)
+			{
+				acc0 += FastHashMul128Fold(ReadU64(p) ^ (s0 + seed), ReadU64(p + 8) ^ (s1 - seed));
+				acc1 += FastHashMul128Fold(ReadU64(p + 16) ^ (s2 + seed), ReadU64(p + 24) ^ (s3 - seed));
+			}
+
+			p = last;
+			acc0 += FastHashMul128Fold(ReadU64(p) ^ (s4 + seed), ReadU64(p + 8) ^ (s5 - seed));
+			acc1 += FastHashMul128Fold(ReadU64(p + 16) ^ (s0 + seed), ReadU64(p + 24) ^ (s1 - seed));
+		}
+		else
+		{
+			// 17..32 bytes
+			acc0 += FastHashMul128Fold(ReadU64(p) ^ (s0 + seed), ReadU64(p + 8) ^ (s1 - seed));
+			p += len - 16;
+			acc1 += FastHashMul128Fold(ReadU64(p) ^ (s2 + seed), ReadU64(p + 8) ^ (s3 - seed));
+		}
+
+		return FastHashAvalanche(acc0 + _rotl64(acc1, 31));
+	}
+
+	std::uint64_t HashUtils::FastHash64(const std::string& key, std::uint64_t seed) noexcept(true)
+	{
+		return FastHash64(key.c_str(), key.length(), seed);
+	}
+
+	void Crc32State::Update(const void* in, const std::size_t size) noexcept(true)
+	{
+		_crc = CRC32Raw(_crc, (const std::uint8_t*)in, size);
+	}
+
+	void Murmur3State::Reset() noexcept(true)
+	{
+		_hash = _seed;
+		_tail = 0;
+		_tail_size = 0;
+		_total = 0;
+	}
+
+	void Murmur3State::Update(const void* in, const std::size_t size) noexcept(true)
+	{
+		auto p = (const std::uint8_t*)in;
+		auto n = size;
+
+		_total += size;
+
+		// Complete the block remaining from the previous call
+		while (_tail_size && n)
+		{
+			_tail |= (std::uint32_t)(*p++) << (_tail_size << 3);
+			n--;
+
+			if (++_tail_size == 4)
+			{
+				_hash = Murmur3Round(_hash, _tail);
+				_tail = 0;
+				_tail_size = 0;
+			}
+		}
+
+		for (; n >= 4; p += 4, n -= 4)
+			_hash = Murmur3Round(_hash, ReadU32(p));
+
+		for (; n; n--, _tail_size++)
+			_tail |= (std::uint32_t)(*p++) << (_tail_size << 3);
+	}
+
+	std::uint32_t Murmur3State::Final() const noexcept(true)
+	{
+		std::uint32_t h = _hash;
+
+		if (_tail_size)
+			h ^= Murmur3Mix(_tail);
+
+		h ^= (std::uint32_t)_total;
+		h ^= h >> 16;
+		h *= 0x85ebca6bul;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35ul;
+		h ^= h >> 16;
+
+		return h;
+	}
 }
\ No newline at end of file
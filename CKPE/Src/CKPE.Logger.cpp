@@ -8,9 +8,12 @@
 #include <cstdarg>
 #include <filesystem>
 #include <array>
+#include <atomic>
+#include <memory>
 #include <CKPE.Logger.h>
 #include <CKPE.ErrorHandler.h>
 #include <CKPE.StringUtils.h>
+#include <CKPE.PackedArgs.h>
 
 namespace CKPE
 {
@@ -23,6 +26,136 @@ namespace CKPE
 			"[FATALERROR] ",
 	};
 
+	// Count of slots must be power of two
+	constexpr static std::size_t ASYNC_SLOT_COUNT = 4096;
+	constexpr static std::size_t ASYNC_SLOT_TEXT = 500;
+	constexpr static std::size_t ASYNC_BATCH_SIZE = 64 * 1024;
+	constexpr static std::uint32_t ASYNC_WAKE_INTERVAL = 20;
+
+	struct LoggerAsyncSlot
+	{
+		std::atomic<std::uint64_t> seq;
+		std::uint32_t type;
+		std::uint32_t len;
+		std::uint32_t count;		// of the args, if packed
+		bool packed;				// the text is the format and the packed args after it
+		char text[ASYNC_SLOT_TEXT];
+	};
+
+	// Bounded MPSC queue (D. Vyukov), consumer is anyone who holds the section of logger
+	struct LoggerAsync
+	{
+		alignas(64) std::atomic<std::uint64_t> enqueue_pos{ 0 };
+		alignas(64) std::atomic<std::uint64_t> dequeue_pos{ 0 };
+		alignas(64) std::atomic<bool> signaled{ false };
+		std::atomic<bool> stop{ false };
+		std::atomic<std::uint64_t> dropped{ 0 };
+		Logger::FullPolicy policy{ Logger::fpSpill };
+		const Logger* owner{ nullptr };
+		HANDLE wake{ nullptr };
+		HANDLE thread{ nullptr };
+		std::unique_ptr<LoggerAsyncSlot[]> slots;
+		std::string batch;
+
+		LoggerAsync(const Logger* logger, Logger::FullPolicy full_policy) :
+			policy(full_policy), owner(logger), slots(std::make_unique<LoggerAsyncSlot[]>(ASYNC_SLOT_COUNT))
+		{
+			for (std::size_t i = 0; i < ASYNC_SLOT_COUNT; i++)
+				slots[i].seq.store(i, std::memory_order_relaxed);
+
+			batch.reserve(ASYNC_BATCH_SIZE + ASYNC_SLOT_TEXT + 32);
+			wake = CreateEventA(nullptr, false, false, nullptr);
+		}
+
+		~LoggerAsync()
+		{
+			if (wake) CloseHandle(wake);
+		}
+
+		void Wake() noexcept(true)
+		{
+			if (!signaled.exchange(true, std::memory_order_acq_rel))
+				SetEvent(wake);
+		}
+
+		bool TryPush(Logger::TypeMsg type, const std::string& message, bool packed, std::uint32_t count) noexcept(true)
+		{
+			auto pos = enqueue_pos.load(std::memory_order_relaxed);
+			LoggerAsyncSlot* slot = nullptr;
+
+			for (;;)
+			{
+				slot = &slots[pos & (ASYNC_SLOT_COUNT - 1)];
+				auto seq = slot->seq.load(std::memory_order_acquire);
+				auto diff = (std::int64_t)seq - (std::int64_t)pos;
+
+				if (!diff)
+				{
+					if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (diff < 0)
+					// full
+					return false;
+				else
+					pos = enqueue_pos.load(std::memory_order_relaxed);
+			}
+
+			slot->type = (std::uint32_t)type;
+			slot->len = (std::uint32_t)message.length();
+			slot->count = count;
+			slot->packed = packed;
+			memcpy(slot->text, message.c_str(), message.length());
+			slot->seq.store(pos + 1, std::memory_order_release);
+
+			// Wake up the writer, if a quarter of the buffer is used
+			if ((pos - dequeue_pos.load(std::memory_order_relaxed)) >= (ASYNC_SLOT_COUNT >> 2))
+				Wake();
+
+			return true;
+		}
+
+		// Returns false if need to write the message directly
+		bool Push(Logger::TypeMsg type, const std::string& message, bool packed, std::uint32_t count) noexcept(true)
+		{
+			if (message.length() >= ASYNC_SLOT_TEXT)
+				return false;
+
+			if (TryPush(type, message, packed, count))
+				return true;
+
+			switch (policy)
+			{
+			case Logger::fpDrop:
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			case Logger::fpBlock:
+				do
+				{
+					Wake();
+					SwitchToThread();
+				} while (!TryPush(type, message, packed, count));
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		bool Pop(LoggerAsyncSlot*& slot) noexcept(true)
+		{
+			auto pos = dequeue_pos.load(std::memory_order_relaxed);
+			slot = &slots[pos & (ASYNC_SLOT_COUNT - 1)];
+			return slot->seq.load(std::memory_order_acquire) == (pos + 1);
+		}
+
+		void Release(LoggerAsyncSlot* slot) noexcept(true)
+		{
+			auto pos = dequeue_pos.load(std::memory_order_relaxed);
+			slot->seq.store(pos + ASYNC_SLOT_COUNT, std::memory_order_release);
+			dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+		}
+	};
+
 	Logger::~Logger()
 	{
 		Close();
@@ -35,7 +168,20 @@ namespace CKPE
 
 	bool Logger::Open(const std::wstring& fname) noexcept(true)
 	{
-		ScopeCriticalSection{ _section };
+		// Close stops the async writer, it's started again for the new file
+		bool restart_async = false;
+		auto policy = fpSpill;
+
+		{
+			ScopeCriticalSection guard{ _section };
+
+			auto async = (LoggerAsync*)_async.load();
+			if (async)
+			{
+				restart_async = true;
+				policy = async->policy;
+			}
+		}
 
 		Close();
 
@@ -69,6 +215,9 @@ namespace CKPE
 				if (_fname) *_fname = fname;
 			}
 
+			if (restart_async)
+				StartAsync(policy);
+
 			char timeBuffer[80];
 			struct tm* timeInfo;
 			time_t rawtime;
@@ -84,6 +233,8 @@ namespace CKPE
 
 	void Logger::Close() noexcept(true)
 	{
+		StopAsync();
+
 		ScopeCriticalSection guard{ _section };
 
 		if (HasOpen())
@@ -173,8 +324,178 @@ namespace CKPE
 	{
 		ScopeCriticalSection guard{ _section };
 
+		DrainAsync(_async.load());
+
+		if (HasOpen())
+			fflush((FILE*)_handle);
+	}
+
+	void Logger::DrainAsync(void* queue) const noexcept(true)
+	{
+		// The section must be locked
+		auto async = (LoggerAsync*)queue;
+		if (!async) return;
+
+		auto& batch = async->batch;
+		LoggerAsyncSlot* slot = nullptr;
+
+		while (async->Pop(slot))
+		{
+			if (slot->type != TypeMsg::tMessage)
+				batch.append(TYPEMSG_PREFIX[slot->type]);
+
+			if (slot->packed)
+			{
+				// Formatted here, not on the thread that logged it. The format is zero-terminated in the slot.
+				auto args = strlen(slot->text) + 1;
+				auto message = PackedArgs::Format(slot->text, slot->text + args, slot->len - args, slot->count);
+
+				batch.append(message);
+
+				if (HasOutputDebugger() && IsDebuggerPresent())
+					OutputDebugStringA(message.c_str());
+			}
+			else
+				batch.append(slot->text, slot->len);
+
+			if (HasAlwaysNewLine())
+				batch.push_back('\n');
+
+			async->Release(slot);
+
+			if (batch.length() >= ASYNC_BATCH_SIZE)
+			{
+				if (HasOpen())
+					fwrite(batch.data(), 1, batch.length(), (FILE*)_handle);
+				batch.clear();
+			}
+		}
+
+		if (!batch.empty())
+		{
+			if (HasOpen())
+				fwrite(batch.data(), 1, batch.length(), (FILE*)_handle);
+			batch.clear();
+		}
+	}
+
+	std::uint32_t Logger::AsyncWriterThread(void* param) noexcept(true)
+	{
+		// Its own queue, Logger::_async is already another one or nullptr when the writer is stopped
+		auto async = (LoggerAsync*)param;
+		auto logger = async->owner;
+
+		for (;;)
+		{
+			WaitForSingleObject(async->wake, ASYNC_WAKE_INTERVAL);
+			async->signaled.store(false, std::memory_order_release);
+
+			if (async->stop.load(std::memory_order_acquire))
+				break;
+
+			ScopeCriticalSection guard{ logger->_section };
+
+			logger->DrainAsync(async);
+
+			if (logger->HasAutoFlush() && logger->HasOpen())
+				fflush((FILE*)logger->_handle);
+		}
+
+		return 0;
+	}
+
+	bool Logger::StartAsync(FullPolicy policy) noexcept(true)
+	{
+		ScopeCriticalSection guard{ _section };
+
+		if (_async.load())
+			return true;
+
+		try
+		{
+			auto async = new LoggerAsync(this, policy);
+			if (!async->wake)
+			{
+				delete async;
+				return false;
+			}
+
+			async->thread = CreateThread(nullptr, 0, [](LPVOID param) -> DWORD
+				{
+					return (DWORD)Logger::AsyncWriterThread(param);
+				}, async, 0, nullptr);
+
+			if (!async->thread)
+			{
+				delete async;
+				return false;
+			}
+
+			_async.store(async);
+
+			return true;
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+	}
+
+	void Logger::StopAsync() noexcept(true)
+	{
+		LoggerAsync* async = nullptr;
+
+		{
+			ScopeCriticalSection guard{ _section };
+			async = (LoggerAsync*)_async.exchange(nullptr);
+		}
+
+		if (!async) return;
+
+		// The threads that have already taken the queue finish their push, the writer still works for fpBlock.
+		// When DLL unloads or a thread crashed in the middle of it, don't wait forever.
+		auto start = GetTickCount64();
+		while (_async_users.load() && ((GetTickCount64() - start) < 1000))
+			SwitchToThread();
+		bool unused = !_async_users.load();
+
+		async->stop.store(true, std::memory_order_release);
+		SetEvent(async->wake);
+
+		bool terminated = WaitForSingleObject(async->thread, 1000) == WAIT_OBJECT_0;
+		CloseHandle(async->thread);
+
+		ScopeCriticalSection guard{ _section };
+
+		DrainAsync(async);
 		if (HasOpen())
 			fflush((FILE*)_handle);
+
+		// If the thread is still alive or someone is still pushing, they own the queue, leave it
+		if (terminated && unused)
+			delete async;
+	}
+
+	bool Logger::PushAsync(std::uint32_t type_msg, const std::string& record, bool packed,
+		std::uint32_t count) const noexcept(true)
+	{
+		// Both seq_cst: either the queue is already nullptr here, or StopAsync sees this user and waits
+		_async_users.fetch_add(1);
+		auto async = (LoggerAsync*)_async.load();
+		bool queued = async && async->Push((TypeMsg)type_msg, record, packed, count);
+		_async_users.fetch_sub(1);
+
+		return queued;
+	}
+
+	std::uint64_t Logger::GetDroppedCount() const noexcept(true)
+	{
+		_async_users.fetch_add(1);
+		auto async = (LoggerAsync*)_async.load();
+		auto dropped = async ? async->dropped.load(std::memory_order_relaxed) : 0;
+		_async_users.fetch_sub(1);
+
+		return dropped;
 	}
 
 	void Logger::NewLine() const noexcept(true)
@@ -187,8 +508,20 @@ namespace CKPE
 
 	void Logger::WriteString(TypeMsg type_msg, const std::string& message) const noexcept(true)
 	{
+		if ((type_msg != TypeMsg::tFatalError) && _async.load(std::memory_order_relaxed) &&
+			PushAsync(type_msg, message, false, 0))
+		{
+			if (HasOutputDebugger() && IsDebuggerPresent())
+				OutputDebugStringA(message.c_str());
+
+			return;
+		}
+
 		ScopeCriticalSection guard{ _section };
 
+		// Keep the order of messages
+		DrainAsync(_async.load());
+
 		if (HasOpen())
 		{
 			if (type_msg != TypeMsg::tMessage)
@@ -219,13 +552,60 @@ namespace CKPE
 		WriteString(type_msg, StringUtils::Utf16ToUtf8(message));
 	}
 
+	void Logger::WriteStringVa(TypeMsg type_msg, const char* format, va_list ap) const noexcept(true)
+	{
+		if (!format) return;
+
+		if ((type_msg != TypeMsg::tFatalError) && _async.load(std::memory_order_relaxed))
+		{
+			// Copying the args is cheaper than vsprintf
+			thread_local std::string args;
+			args.clear();
+
+			std::uint32_t count = 0;
+			va_list copy;
+			va_copy(copy, ap);
+			bool packed = PackedArgs::Pack(args, format, copy, count);
+			va_end(copy);
+
+			if (packed && WriteStringPacked(type_msg, format, args, count))
+				return;
+		}
+
+		WriteString(type_msg, StringUtils::FormatStringVa(format, ap));
+	}
+
+	bool Logger::WriteStringPacked(TypeMsg type_msg, const char* format, const std::string& args,
+		std::uint32_t count) const noexcept(true)
+	{
+		if (!format || (type_msg == TypeMsg::tFatalError) || !_async.load(std::memory_order_relaxed))
+			return false;
+
+		auto format_len = strnlen(format, ASYNC_SLOT_TEXT);
+		if ((format_len + 1 + args.length()) >= ASYNC_SLOT_TEXT)
+			return false;
+
+		try
+		{
+			// The slot holds the zero-terminated format and the args after it
+			thread_local std::string record;
+			record.assign(format, format_len + 1);
+			record.append(args);
+
+			return PushAsync(type_msg, record, true, count);
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+	}
+
 #ifndef CKPE_NO_LOGGER_FUNCTION
 	CKPE_API void _FATALERROR(const std::string_view& formatted_message, ...)
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
-		_slogger.WriteString(Logger::tFatalError,
-			StringUtils::FormatStringVa(formatted_message.data(), ap));
+		_slogger.WriteStringVa(Logger::tFatalError, formatted_message.data(), ap);
 		va_end(ap);
 	}
 
@@ -233,8 +613,7 @@ namespace CKPE
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
-		_slogger.WriteString(Logger::tError,
-			StringUtils::FormatStringVa(formatted_message.data(), ap));
+		_slogger.WriteStringVa(Logger::tError, formatted_message.data(), ap);
 		va_end(ap);
 	}
 
@@ -242,8 +621,7 @@ namespace CKPE
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
-		_slogger.WriteString(Logger::tWarning,
-			StringUtils::FormatStringVa(formatted_message.data(), ap));
+		_slogger.WriteStringVa(Logger::tWarning, formatted_message.data(), ap);
 		va_end(ap);
 	}
 
@@ -251,8 +629,7 @@ namespace CKPE
 	{
 		va_list ap;
 		va_start(ap, &formatted_message);
-		_slogger.WriteString(Logger::tMessage,
-			StringUtils::FormatStringVa(formatted_message.data(), ap));
+		_slogger.WriteStringVa(Logger::tMessage, formatted_message.data(), ap);
 		va_end(ap);
 	}
 
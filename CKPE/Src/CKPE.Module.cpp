@@ -5,6 +5,7 @@
 #include <windows.h>
 #include <CKPE.Module.h>
 #include <CKPE.PathUtils.h>
+#include <CKPE.HashUtils.h>
 #include <stdexcept>
 
 namespace CKPE
@@ -123,6 +124,32 @@ namespace CKPE
 		return _handle ? ::GetProcAddress((HMODULE)_handle, name) : nullptr;
 	}
 
+	std::uint64_t Module::GetImageHash(const void* base) noexcept(true)
+	{
+		// Also the images mapped as a resource
+		auto* image = (const char*)(std::uintptr_t(base) & ~3);
+		if (!image)
+			return 0;
+
+		auto* dosHeader = (const IMAGE_DOS_HEADER*)image;
+		auto* ntHeader = (const IMAGE_NT_HEADERS*)(image + dosHeader->e_lfanew);
+
+		// ImageBase isn't used, the loader writes the real base there
+		std::uint32_t identity[] =
+		{
+			ntHeader->FileHeader.Machine,
+			ntHeader->FileHeader.NumberOfSections,
+			ntHeader->FileHeader.TimeDateStamp,
+			ntHeader->OptionalHeader.CheckSum,
+			ntHeader->OptionalHeader.SizeOfImage,
+			ntHeader->OptionalHeader.SizeOfCode,
+			ntHeader->OptionalHeader.AddressOfEntryPoint,
+		};
+
+		// Saved in the files of TableID and RTTI, so a hash which never changes
+		return HashUtils::MurmurHash64A(identity, sizeof(identity));
+	}
+
 	ScopeLoadedModule::ScopeLoadedModule(const Module& m) noexcept(true) :
 		_m(&m)
 	{}
@@ -0,0 +1,372 @@
+﻿// Copyright © 2025 aka perchik71. All rights reserved.
+// Contacts: <email:timencevaleksej@gmail.com>
+// License: https://www.gnu.org/licenses/lgpl-3.0.html
+
+#include <windows.h>
+#include <stdio.h>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <CKPE.StringUtils.h>
+#include <CKPE.PackedArgs.h>
+
+namespace CKPE
+{
+	struct PackedArgValue
+	{
+		PackedArgs::ArgType Type;
+		std::int64_t Int;
+		double Double;
+		std::string String;
+		bool IsNull;
+	};
+
+	static inline void PackAppend(std::string& Buffer, const void* Data, std::size_t Size)
+	{
+		Buffer.append((const char*)Data, Size);
+	}
+
+	template<typename T>
+	static inline void PackAppendValue(std::string& Buffer, PackedArgs::ArgType Type, T Value)
+	{
+		Buffer.push_back((char)Type);
+		PackAppend(Buffer, &Value, sizeof(T));
+	}
+
+	static bool PackWalk(std::string& Buffer, const char* Format, va_list va, std::uint32_t& Count, bool Wide)
+	{
+		Count = 0;
+
+		for (auto p = Format; *p; p++)
+		{
+			if (*p != '%')
+				continue;
+
+			p++;
+			if (*p == '%')
+				continue;
+
+			if (Count >= PackedArgs::ARGS_MAX)
+				return false;
+
+			// flags
+			while (*p && strchr("-+ #0", *p)) p++;
+			// width
+			if (*p == '*')
+			{
+				PackAppendValue(Buffer, PackedArgs::atInt, (std::int64_t)va_arg(va, int));
+				Count++;
+				p++;
+			}
+			else while ((*p >= '0') && (*p <= '9')) p++;
+			// precision, the most chars of a string that may be read
+			std::int64_t precision = -1;
+			if (*p == '.')
+			{
+				p++;
+				if (*p == '*')
+				{
+					precision = (std::int64_t)va_arg(va, int);
+					PackAppendValue(Buffer, PackedArgs::atInt, precision);
+					Count++;
+					p++;
+				}
+				else for (precision = 0; (*p >= '0') && (*p <= '9'); p++)
+					precision = std::min<std::int64_t>(precision * 10 + (*p - '0'), PackedArgs::STRING_MAX);
+			}
+
+			if (Count >= PackedArgs::ARGS_MAX)
+				return false;
+
+			// length (MSVC)
+			enum { lNone, lShort, lChar, lLong, l64 } length = lNone;
+			if ((p[0] == 'h') && (p[1] == 'h')) { length = lChar; p += 2; }
+			else if (p[0] == 'h') { length = lShort; p++; }
+			else if ((p[0] == 'l') && (p[1] == 'l')) { length = l64; p += 2; }
+			else if ((p[0] == 'I') && (p[1] == '6') && (p[2] == '4')) { length = l64; p += 3; }
+			else if ((p[0] == 'I') && (p[1] == '3') && (p[2] == '2')) { length = lNone; p += 3; }
+			else if (strchr("zjtI", p[0])) { length = l64; p++; }
+			else if ((p[0] == 'l') || (p[0] == 'w')) { length = lLong; p++; }
+			else if (p[0] == 'L') p++;
+
+			if (!*p)
+				return false;
+
+			switch (*p)
+			{
+			case 'd':
+			case 'i':
+			{
+				std::int64_t v = (length == l64) ? va_arg(va, std::int64_t) : (std::int64_t)va_arg(va, int);
+				if (length == lShort) v = (short)v;
+				else if (length == lChar) v = (signed char)v;
+				PackAppendValue(Buffer, PackedArgs::atInt, v);
+				break;
+			}
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'o':
+			{
+				std::uint64_t v = (length == l64) ? va_arg(va, std::uint64_t) : (std::uint64_t)va_arg(va, unsigned int);
+				if (length == lShort) v = (unsigned short)v;
+				else if (length == lChar) v = (unsigned char)v;
+				PackAppendValue(Buffer, PackedArgs::atInt, (std::int64_t)v);
+				break;
+			}
+			case 'e':
+			case 'E':
+			case 'f':
+			case 'F':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				PackAppendValue(Buffer, PackedArgs::atDouble, va_arg(va, double));
+				break;
+			case 'p':
+				PackAppendValue(Buffer, PackedArgs::atPointer, (std::uint64_t)va_arg(va, void*));
+				break;
+			case 'c':
+			case 'C':
+			{
+				// The upper case is the other width, h and l set it explicitly
+				bool wide = (length == lLong) || ((length != lShort) && ((*p == 'C') != Wide));
+				PackAppendValue(Buffer, wide ? PackedArgs::atWChar : PackedArgs::atChar,
+					(std::int64_t)va_arg(va, int));
+				break;
+			}
+			case 's':
+			case 'S':
+			{
+				// A negative precision from * is the same as none
+				std::size_t max = (precision < 0) ? PackedArgs::STRING_MAX :
+					std::min<std::size_t>((std::size_t)precision, PackedArgs::STRING_MAX);
+
+				if ((length == lLong) || ((length != lShort) && ((*p == 'S') != Wide)))
+				{
+					auto s = va_arg(va, const wchar_t*);
+					std::uint32_t len = s ? (std::uint32_t)(wcsnlen(s, max) * sizeof(wchar_t)) :
+						PackedArgs::NULL_STRING;
+					PackAppendValue(Buffer, PackedArgs::atWString, len);
+					if (s) PackAppend(Buffer, s, len);
+				}
+				else
+				{
+					auto s = va_arg(va, const char*);
+					std::uint32_t len = s ? (std::uint32_t)strnlen(s, max) : PackedArgs::NULL_STRING;
+					PackAppendValue(Buffer, PackedArgs::atString, len);
+					if (s) PackAppend(Buffer, s, len);
+				}
+				break;
+			}
+			default:
+				// %n, %Z (a pointer to ANSI_STRING/UNICODE_STRING) or unknown, the rest of the args can't be read safely
+				return false;
+			}
+
+			Count++;
+		}
+
+		return true;
+	}
+
+	static bool PackRead(const std::uint8_t* Data, const std::uint8_t* End, std::uint32_t Count,
+		std::vector<PackedArgValue>& Values)
+	{
+		for (std::uint32_t i = 0; i < Count; i++)
+		{
+			if (Data >= End) return false;
+
+			PackedArgValue Value{ (PackedArgs::ArgType)*Data++, 0, 0.0, {}, false };
+			switch (Value.Type)
+			{
+			case PackedArgs::atInt:
+			case PackedArgs::atPointer:
+			case PackedArgs::atChar:
+			case PackedArgs::atWChar:
+				if ((End - Data) < 8) return false;
+				memcpy(&Value.Int, Data, 8);
+				Data += 8;
+				break;
+			case PackedArgs::atDouble:
+				if ((End - Data) < 8) return false;
+				memcpy(&Value.Double, Data, 8);
+				Data += 8;
+				break;
+			case PackedArgs::atString:
+			case PackedArgs::atWString:
+			{
+				std::uint32_t len;
+				if ((End - Data) < 4) return false;
+				memcpy(&len, Data, 4);
+				Data += 4;
+				if (len == PackedArgs::NULL_STRING)
+				{
+					Value.IsNull = true;
+					break;
+				}
+				if ((std::uint32_t)(End - Data) < len) return false;
+				if (Value.Type == PackedArgs::atWString)
+				{
+					std::wstring ws(len / sizeof(wchar_t), L'\0');
+					memcpy(ws.data(), Data, ws.length() * sizeof(wchar_t));
+					Value.String = StringUtils::Utf16ToUtf8(ws);
+				}
+				else
+					Value.String.assign((const char*)Data, len);
+				Data += len;
+				break;
+			}
+			default:
+				return false;
+			}
+
+			Values.push_back(std::move(Value));
+		}
+
+		return true;
+	}
+
+	bool PackedArgs::Pack(std::string& Buffer, const char* Format, va_list Args, std::uint32_t& Count,
+		bool Wide) noexcept(true)
+	{
+		Count = 0;
+		if (!Format)
+			return false;
+
+		try
+		{
+			return PackWalk(Buffer, Format, Args, Count, Wide);
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+	}
+
+	std::string PackedArgs::Format(const char* Format, const void* Args, std::size_t Size,
+		std::uint32_t Count) noexcept(true)
+	{
+		std::string Result;
+		if (!Format)
+			return Result;
+
+		try
+		{
+			std::vector<PackedArgValue> Values;
+			Values.reserve(Count);
+			PackRead((const std::uint8_t*)Args, (const std::uint8_t*)Args + Size, Count, Values);
+
+			std::size_t Next = 0;
+			char Buffer[512];
+			std::string Spec;
+
+			for (auto p = Format; *p; p++)
+			{
+				if (*p != '%')
+				{
+					Result.push_back(*p);
+					continue;
+				}
+
+				if (p[1] == '%')
+				{
+					Result.push_back('%');
+					p++;
+					continue;
+				}
+
+				Spec = "%";
+				p++;
+
+				while (*p && strchr("-+ #0", *p)) Spec.push_back(*p++);
+				auto TakeNumber = [&]()
+					{
+						if (*p == '*')
+						{
+							Spec += (Next < Values.size()) ? std::to_string(Values[Next++].Int) : "0";
+							p++;
+						}
+						else while ((*p >= '0') && (*p <= '9')) Spec.push_back(*p++);
+					};
+				TakeNumber();
+				// A char has no precision
+				auto WidthLength = Spec.length();
+				if (*p == '.')
+				{
+					Spec.push_back(*p++);
+					TakeNumber();
+				}
+
+				auto AppendString = [&](const std::string& Spec, const char* String)
+					{
+						auto Length = snprintf(nullptr, 0, Spec.c_str(), String);
+						if (Length > 0)
+						{
+							auto Offset = Result.length();
+							Result.resize(Offset + (std::size_t)Length);
+							snprintf(Result.data() + Offset, (std::size_t)Length + 1, Spec.c_str(), String);
+						}
+					};
+
+				// The length is skipped, the value is already widened
+				if (!strncmp(p, "I64", 3) || !strncmp(p, "I32", 3)) p += 3;
+				else while (*p && strchr("hlLwzjtI", *p)) p++;
+
+				if (!*p)
+					break;
+
+				if (Next >= Values.size())
+				{
+					Result.append("<?>");
+					continue;
+				}
+
+				auto& Value = Values[Next++];
+				switch (Value.Type)
+				{
+				case atInt:
+					Spec += "ll";
+					Spec.push_back(*p);
+					snprintf(Buffer, sizeof(Buffer), Spec.c_str(), Value.Int);
+					Result.append(Buffer);
+					break;
+				case atDouble:
+					Spec.push_back(*p);
+					snprintf(Buffer, sizeof(Buffer), Spec.c_str(), Value.Double);
+					Result.append(Buffer);
+					break;
+				case atPointer:
+					snprintf(Buffer, sizeof(Buffer), "%016llX", (unsigned long long)Value.Int);
+					Result.append(Buffer);
+					break;
+				case atChar:
+				case atWChar:
+				{
+					// As a string of one char, so the width is kept
+					auto Char = (Value.Type == atChar) ? std::string(1, (char)Value.Int) :
+						StringUtils::Utf16ToUtf8(std::wstring(1, (wchar_t)Value.Int));
+					// A zero char would end the log line, only its width is kept
+					if (!Char.empty() && !Char[0])
+						Char.clear();
+					Spec.resize(WidthLength);
+					AppendString(Spec + "s", Char.c_str());
+					break;
+				}
+				default:
+					if (Value.IsNull)
+						Result.append("(null)");
+					else
+						// Width and precision of the strings
+						AppendString(Spec + "s", Value.String.c_str());
+					break;
+				}
+			}
+		}
+		catch (const std::exception&)
+		{}
+
+		return Result;
+	}
+}
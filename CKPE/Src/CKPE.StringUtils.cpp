@@ -6,8 +6,12 @@
 #include <limits.h>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <bit>
+#include <immintrin.h>
 #include <CKPE.StringUtils.h>
+#include <CKPE.HardwareInfo.h>
 #include "Impl/utfcpp/utf8.h"
 #include "Impl/utf8.h"
 
@@ -15,13 +19,337 @@
 
 namespace CKPE
 {
-	bool StringUtils::IsASCII(const std::string& src) noexcept(true)
+	// The strings of the CK are mostly ASCII: it's checked by 16 bytes, UTF-8 is validated by the SSSE3
+	// lookups of Keiser and Lemire ("Validating UTF-8 In Less Than One Instruction Per Byte"), and a single-byte
+	// code page is converted by table, not through UTF-16.
+
+	constexpr static std::uint8_t UTF8_TOO_SHORT = 1 << 0;
+	constexpr static std::uint8_t UTF8_TOO_LONG = 1 << 1;
+	constexpr static std::uint8_t UTF8_OVERLONG_3 = 1 << 2;
+	constexpr static std::uint8_t UTF8_TOO_LARGE = 1 << 3;
+	constexpr static std::uint8_t UTF8_SURROGATE = 1 << 4;
+	constexpr static std::uint8_t UTF8_OVERLONG_2 = 1 << 5;
+	constexpr static std::uint8_t UTF8_TOO_LARGE_1000 = 1 << 6;
+	constexpr static std::uint8_t UTF8_OVERLONG_4 = 1 << 6;
+	constexpr static std::uint8_t UTF8_TWO_CONTS = 1 << 7;
+	constexpr static std::uint8_t UTF8_CARRY = UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS;
+
+	static bool HasASCIIOnly(const char* src, std::size_t length) noexcept(true)
 	{
-		for (std::size_t i = 0; i < src.length(); i++)
+		std::size_t i = 0;
+		for (; (i + 32) <= length; i += 32)
+		{
+			auto a = _mm_loadu_si128((const __m128i*)(src + i));
+			auto b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+			if (_mm_movemask_epi8(_mm_or_si128(a, b))) return false;
+		}
+		for (; (i + 16) <= length; i += 16)
+			if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(src + i)))) return false;
+		for (; i < length; i++)
 			if (src[i] & 0x80) return false;
 		return true;
 	}
 
+	// The length and whether it's all ASCII in one pass. The loads are aligned, so they don't cross into
+	// another page, the bytes before the string are masked out.
+	static std::size_t ScanASCII(const char* src, bool& ascii) noexcept(true)
+	{
+		auto zero = _mm_setzero_si128();
+		auto misalign = (std::uint32_t)((std::uintptr_t)src & 15);
+		auto p = (const char*)((std::uintptr_t)src & ~(std::uintptr_t)15);
+		auto chunk = _mm_load_si128((const __m128i*)p);
+		std::uint32_t zeros = ((std::uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero)) >> misalign) << misalign;
+		std::uint32_t highs = ((std::uint32_t)_mm_movemask_epi8(chunk) >> misalign) << misalign;
+		std::uint32_t high = 0;
+
+		while (!zeros)
+		{
+			high |= highs;
+			p += 16;
+			chunk = _mm_load_si128((const __m128i*)p);
+			zeros = (std::uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero));
+			highs = (std::uint32_t)_mm_movemask_epi8(chunk);
+		}
+
+		auto end = (std::uint32_t)std::countr_zero(zeros);
+		high |= highs & ((1u << end) - 1);
+
+		ascii = !high;
+		return (std::size_t)(p - src) + end;
+	}
+
+	struct Utf8Validator
+	{
+		__m128i Error{ _mm_setzero_si128() };
+		__m128i PrevInput{ _mm_setzero_si128() };
+		__m128i PrevIncomplete{ _mm_setzero_si128() };
+
+		void Check(__m128i Input) noexcept(true)
+		{
+			// ASCII, only a sequence not finished before it is wrong
+			if (!_mm_movemask_epi8(Input))
+			{
+				Error = _mm_or_si128(Error, PrevIncomplete);
+				return;
+			}
+
+			const auto LowNibble = _mm_set1_epi8(0x0F);
+			const auto Byte1High = _mm_setr_epi8(
+				UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+				UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+				(char)UTF8_TWO_CONTS, (char)UTF8_TWO_CONTS, (char)UTF8_TWO_CONTS, (char)UTF8_TWO_CONTS,
+				UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+				UTF8_TOO_SHORT,
+				UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+				UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+			const auto Byte1Low = _mm_setr_epi8(
+				(char)(UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4),
+				(char)(UTF8_CARRY | UTF8_OVERLONG_2),
+				(char)UTF8_CARRY,
+				(char)UTF8_CARRY,
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+				(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000));
+			const auto Byte2High = _mm_setr_epi8(
+				UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+				UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+				(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4),
+				(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE),
+				(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+				(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+				UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+
+			// The errors of two bytes next to each other
+			auto Prev1 = _mm_alignr_epi8(Input, PrevInput, 15);
+			auto Special = _mm_and_si128(_mm_and_si128(
+				_mm_shuffle_epi8(Byte1High, _mm_and_si128(_mm_srli_epi16(Prev1, 4), LowNibble)),
+				_mm_shuffle_epi8(Byte1Low, _mm_and_si128(Prev1, LowNibble))),
+				_mm_shuffle_epi8(Byte2High, _mm_and_si128(_mm_srli_epi16(Input, 4), LowNibble)));
+
+			// The continuations of the 3 and 4 byte sequences must be where two continuations are in a row
+			auto Third = _mm_subs_epu8(_mm_alignr_epi8(Input, PrevInput, 14), _mm_set1_epi8(0xE0 - 0x80));
+			auto Fourth = _mm_subs_epu8(_mm_alignr_epi8(Input, PrevInput, 13), _mm_set1_epi8(0xF0 - 0x80));
+			auto Must23 = _mm_and_si128(_mm_or_si128(Third, Fourth), _mm_set1_epi8((char)0x80));
+
+			Error = _mm_or_si128(Error, _mm_xor_si128(Must23, Special));
+			// A lead byte in the last 3 that needs more
+			PrevIncomplete = _mm_subs_epu8(Input, _mm_setr_epi8(
+				(char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+				(char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xEF, (char)0xDF, (char)0xBF));
+			PrevInput = Input;
+		}
+
+		[[nodiscard]] bool IsValid(const char* src, std::size_t length) noexcept(true)
+		{
+			std::size_t i = 0;
+			for (; (i + 16) <= length; i += 16)
+				Check(_mm_loadu_si128((const __m128i*)(src + i)));
+
+			if (i < length)
+			{
+				// The zeros after are ASCII, so the unfinished sequence is caught
+				alignas(16) char Tail[16]{};
+				memcpy(Tail, src + i, length - i);
+				Check(_mm_load_si128((const __m128i*)Tail));
+			}
+
+			Error = _mm_or_si128(Error, PrevIncomplete);
+			return _mm_movemask_epi8(_mm_cmpeq_epi8(Error, _mm_setzero_si128())) == 0xFFFF;
+		}
+	};
+
+	static bool ValidateUtf8(const char* src, std::size_t length) noexcept(true)
+	{
+		static const bool ssse3 = HardwareInfo::CPU::HasSupportSSSE3();
+		if (!ssse3)
+			return utf8::is_valid(src, src + length);
+
+		Utf8Validator validator;
+		return validator.IsValid(src, length);
+	}
+
+	struct CodePageTable
+	{
+		// UTF-8 of 0x80..0xFF, the length in the high byte
+		std::uint32_t ToUtf8[128]{};
+		// 0 - not in the code page or doesn't come back the same, the system decides (best fit and so on)
+		std::uint8_t FromUtf16[0x10000]{};
+	};
+
+	static std::unique_ptr<CodePageTable> CreateCodePageTable() noexcept(true)
+	{
+		CPINFO info{};
+		if (!GetCPInfo(CP_ACP, &info) || (info.MaxCharSize != 1))
+			return nullptr;
+
+		std::unique_ptr<CodePageTable> table;
+
+		try
+		{
+			table = std::make_unique<CodePageTable>();
+		}
+		catch (const std::exception&)
+		{
+			return nullptr;
+		}
+
+		for (std::uint32_t c = 0x80; c < 0x100; c++)
+		{
+			auto ch = (char)c;
+			wchar_t w = 0;
+			if ((MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, &ch, 1, &w, 1) != 1) || ((w >= 0xD800) && (w <= 0xDFFF)))
+				return nullptr;
+
+			std::uint32_t u = w;
+			if (u < 0x80)
+				table->ToUtf8[c - 0x80] = (1u << 24) | u;
+			else if (u < 0x800)
+				table->ToUtf8[c - 0x80] = (2u << 24) | (0xC0 | (u >> 6)) | ((0x80 | (u & 0x3F)) << 8);
+			else
+				table->ToUtf8[c - 0x80] = (3u << 24) | (0xE0 | (u >> 12)) | ((0x80 | ((u >> 6) & 0x3F)) << 8) |
+					((0x80 | (u & 0x3F)) << 16);
+
+			char back = 0;
+			BOOL used = FALSE;
+			if ((u >= 0x80) && (WideCharToMultiByte(CP_ACP, 0, &w, 1, &back, 1, nullptr, &used) == 1) &&
+				!used && ((std::uint8_t)back == c))
+				table->FromUtf16[u] = (std::uint8_t)c;
+		}
+
+		return table;
+	}
+
+	static const CodePageTable* GetCodePageTable() noexcept(true)
+	{
+		// nullptr for the multi-byte code pages
+		static const auto table = CreateCodePageTable();
+		return table.get();
+	}
+
+	// How many ASCII bytes are at the start
+	static std::size_t SkipASCII(const char* src, std::size_t length) noexcept(true)
+	{
+		std::size_t i = 0;
+		for (; (i + 16) <= length; i += 16)
+		{
+			auto mask = (std::uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(src + i)));
+			if (mask) return i + std::countr_zero(mask);
+		}
+		while ((i < length) && !(src[i] & 0x80)) i++;
+		return i;
+	}
+
+	static bool Utf8ToWinCPByTable(const std::string& src, std::string& result) noexcept(true)
+	{
+		auto table = GetCodePageTable();
+		if (!table)
+			return false;
+
+		try
+		{
+			// As the system conversion, up to the first zero
+			auto length = strnlen(src.data(), src.length());
+			auto p = src.data();
+			auto end = p + length;
+
+			result.clear();
+			result.reserve(length);
+
+			while (p < end)
+			{
+				auto n = SkipASCII(p, (std::size_t)(end - p));
+				result.append(p, n);
+				p += n;
+
+				if (p >= end)
+					break;
+
+				auto c = (std::uint8_t)p[0];
+				std::uint32_t u;
+
+				if (((c & 0xE0) == 0xC0) && ((end - p) >= 2) && (((std::uint8_t)p[1] & 0xC0) == 0x80))
+				{
+					u = ((c & 0x1Fu) << 6) | ((std::uint8_t)p[1] & 0x3Fu);
+					if (u < 0x80) return false;
+					p += 2;
+				}
+				else if (((c & 0xF0) == 0xE0) && ((end - p) >= 3) && (((std::uint8_t)p[1] & 0xC0) == 0x80) &&
+					(((std::uint8_t)p[2] & 0xC0) == 0x80))
+				{
+					u = ((c & 0x0Fu) << 12) | (((std::uint8_t)p[1] & 0x3Fu) << 6) | ((std::uint8_t)p[2] & 0x3Fu);
+					if ((u < 0x800) || ((u >= 0xD800) && (u <= 0xDFFF))) return false;
+					p += 3;
+				}
+				else
+					// 4 bytes aren't in a single-byte code page, the rest is invalid
+					return false;
+
+				auto b = table->FromUtf16[u];
+				if (!b)
+					return false;
+
+				result.push_back((char)b);
+			}
+
+			return true;
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+	}
+
+	static bool WinCPToUtf8ByTable(const std::string& src, std::string& result) noexcept(true)
+	{
+		auto table = GetCodePageTable();
+		if (!table)
+			return false;
+
+		try
+		{
+			auto length = strnlen(src.data(), src.length());
+			auto p = src.data();
+			auto end = p + length;
+
+			result.clear();
+			result.reserve(length + (length >> 1));
+
+			while (p < end)
+			{
+				auto n = SkipASCII(p, (std::size_t)(end - p));
+				result.append(p, n);
+				p += n;
+
+				for (; (p < end) && (*p & 0x80); p++)
+				{
+					auto packed = table->ToUtf8[(std::uint8_t)*p - 0x80];
+					auto chars = (const char*)&packed;
+					result.append(chars, packed >> 24);
+				}
+			}
+
+			return true;
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+	}
+
+	bool StringUtils::IsASCII(const std::string& src) noexcept(true)
+	{
+		return HasASCIIOnly(src.data(), src.length());
+	}
+
 	bool StringUtils::IsUtf8(const std::string& src) noexcept(true)
 	{
 #ifdef UNICODE_USES_WINDOWS
@@ -98,16 +426,16 @@ namespace CKPE
 
 		return true;
 #else
-		return utf8::is_valid(src);
+		return ValidateUtf8(src.data(), src.length());
 #endif // DEBUG
 	}
 
 	bool StringUtils::IsASCII(const char* src) noexcept(true)
 	{
 		if (!src) return false;
-		for (std::size_t i = 0; src[i]; i++)
-			if (src[i] & 0x80) return false;
-		return true;
+		bool ascii;
+		ScanASCII(src, ascii);
+		return ascii;
 	}
 
 	bool StringUtils::IsUtf8(const char* src) noexcept(true)
@@ -188,7 +516,9 @@ namespace CKPE
 
 		return true;
 #else
-		return utf8::is_valid(src);
+		bool ascii;
+		auto length = ScanASCII(src, ascii);
+		return ascii || ValidateUtf8(src, length);
 #endif // DEBUG
 	}
 
@@ -247,6 +577,9 @@ namespace CKPE
 	{
 		if (IsASCII(src) || !src.length()) return src;
 
+		std::string r;
+		if (Utf8ToWinCPByTable(src, r)) return r;
+
 #ifdef UNICODE_USES_WINDOWS
 		auto wlen = MultiByteToWideChar(CP_UTF8, 0, src.c_str(), (int)src.length(), 0, 0);
 		if ((wlen > 0) && (wlen < (std::size_t)std::numeric_limits<int>::max()))
@@ -300,6 +633,9 @@ namespace CKPE
 	{
 		if (IsASCII(src) || !src.length()) return src;
 
+		std::string r;
+		if (WinCPToUtf8ByTable(src, r)) return r;
+
 		auto len = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, src.c_str(), (int)src.length(), 0, 0);
 		if (len > 0)
 		{
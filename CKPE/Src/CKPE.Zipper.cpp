@@ -5,6 +5,7 @@
 #include <zip.h>
 #include <memory>
 #include <format>
+#include <algorithm>
 #include <CKPE.StringUtils.h>
 #include <CKPE.PathUtils.h>
 #include <CKPE.Zipper.h>
@@ -14,6 +15,34 @@
 
 namespace CKPE
 {
+	static inline char ZipFoldChar(char c) noexcept(true)
+	{
+		return ((c >= 'A') && (c <= 'Z')) ? (char)(c + ('a' - 'A')) : c;
+	}
+
+	// FNV-1a over case-folded chars
+	static std::uint32_t ZipNameHash(const char* s) noexcept(true)
+	{
+		std::uint32_t h = 0x811C9DC5ul;
+		for (; *s; s++)
+		{
+			h ^= (std::uint8_t)ZipFoldChar(*s);
+			h *= 0x01000193ul;
+		}
+		return h;
+	}
+
+	static bool ZipNameEqual(const std::string& folded, const char* s) noexcept(true)
+	{
+		std::size_t i = 0;
+		for (; s[i]; i++)
+		{
+			if ((i >= folded.length()) || (folded[i] != ZipFoldChar(s[i])))
+				return false;
+		}
+		return i == folded.length();
+	}
+
 	TZipObject::~TZipObject() noexcept(true)
 	{
 		if (_handle)
@@ -194,12 +223,15 @@ namespace CKPE
 	}
 
 	ZipFileEntries::ZipFileEntries(const TZipObject* class_owner) noexcept(true) :
-		_class_owner(class_owner), _items(new std::vector<ZipFileEntry*>)
+		_class_owner(class_owner), _items(new std::vector<ZipFileEntry*>), _names(new std::vector<std::string>),
+		_slots(new std::vector<std::uint32_t>), _sorted(new std::vector<std::uint32_t>)
 	{
 		if (_class_owner && _items && dynamic_cast<const UnZipper*>(_class_owner))
 		{
 			for (size_t i = 0; i < Count(); i++)
 				_items->push_back(new ZipFileEntry(this, i));
+
+			BuildIndex();
 		}
 	}
 
@@ -210,6 +242,100 @@ namespace CKPE
 			delete _items;
 			_items = nullptr;
 		}
+
+		if (_names)
+		{
+			delete _names;
+			_names = nullptr;
+		}
+
+		if (_slots)
+		{
+			delete _slots;
+			_slots = nullptr;
+		}
+
+		if (_sorted)
+		{
+			delete _sorted;
+			_sorted = nullptr;
+		}
+	}
+
+	void ZipFileEntries::BuildIndex() noexcept(true)
+	{
+		if (!_names || !_slots || !_sorted)
+			return;
+
+		try
+		{
+			auto handle = _class_owner->GetHandle<zip_t>();
+			auto total = Count();
+
+			// Read all names from the central directory only once
+			_names->resize(total);
+			for (std::size_t i = 0; i < total; i++)
+			{
+				if (zip_entry_openbyindex(handle, i) < 0)
+					continue;
+
+				auto s = zip_entry_name(handle);
+				if (s)
+				{
+					auto& name = _names->at(i);
+					name = s;
+					for (auto& c : name) c = ZipFoldChar(c);
+				}
+
+				zip_entry_close(handle);
+			}
+
+			// Capacity is a power of two and at least twice the number of entries
+			std::size_t capacity = 16;
+			while (capacity < (total << 1))
+				capacity <<= 1;
+
+			_slots->assign(capacity, 0);
+			auto mask = capacity - 1;
+
+			for (std::size_t i = 0; i < total; i++)
+			{
+				auto& name = _names->at(i);
+				if (name.empty()) continue;
+
+				auto slot = ZipNameHash(name.c_str()) & mask;
+				bool duplicate = false;
+				while (auto v = (*_slots)[slot])
+				{
+					// Same name twice, the first one wins as with a linear search
+					if (_names->at(v - 1) == name)
+					{
+						duplicate = true;
+						break;
+					}
+
+					slot = (slot + 1) & mask;
+				}
+
+				if (!duplicate)
+					(*_slots)[slot] = (std::uint32_t)(i + 1);
+			}
+
+			_sorted->resize(total);
+			for (std::size_t i = 0; i < total; i++)
+				(*_sorted)[i] = (std::uint32_t)i;
+
+			std::stable_sort(_sorted->begin(), _sorted->end(), [this](std::uint32_t a, std::uint32_t b)
+				{ return _names->at(a) < _names->at(b); });
+		}
+		catch (const std::exception&)
+		{
+			_names->clear();
+			_slots->clear();
+			_sorted->clear();
+
+			const_cast<TZipObject*>(_class_owner)->LastError = ZIP_EOOMEM;
+		}
 	}
 
 	std::size_t ZipFileEntries::Count() const noexcept(true)
@@ -253,6 +379,66 @@ namespace CKPE
 		return MakeSmartPointer<ZipFileScopeEntry>(_items->at(idx));
 	}
 
+	std::size_t ZipFileEntries::Find(const char* fname) const noexcept(true)
+	{
+		if (!fname || !fname[0] || !_slots || _slots->empty())
+			return ZipFileEntry::InvalidIndex;
+
+		auto mask = _slots->size() - 1;
+		auto slot = ZipNameHash(fname) & mask;
+
+		while (auto v = (*_slots)[slot])
+		{
+			if (ZipNameEqual((*_names)[v - 1], fname))
+				return (std::size_t)(v - 1);
+
+			slot = (slot + 1) & mask;
+		}
+
+		return ZipFileEntry::InvalidIndex;
+	}
+
+	std::size_t ZipFileEntries::Find(const std::string& fname) const noexcept(true)
+	{
+		return Find(fname.c_str());
+	}
+
+	std::size_t ZipFileEntries::FindByPrefix(const char* prefix, std::vector<std::size_t>& result) const noexcept(true)
+	{
+		if (!prefix || !_sorted || _sorted->empty())
+			return 0;
+
+		try
+		{
+			std::string folded = prefix;
+			for (auto& c : folded) c = ZipFoldChar(c);
+
+			auto it = std::lower_bound(_sorted->begin(), _sorted->end(), folded,
+				[this](std::uint32_t idx, const std::string& key) { return _names->at(idx) < key; });
+
+			std::size_t count = 0;
+			for (; it != _sorted->end(); it++, count++)
+			{
+				auto& name = _names->at(*it);
+				if (name.compare(0, folded.length(), folded))
+					break;
+
+				result.push_back(*it);
+			}
+
+			return count;
+		}
+		catch (const std::exception&)
+		{
+			return 0;
+		}
+	}
+
+	std::size_t ZipFileEntries::FindByPrefix(const std::string& prefix, std::vector<std::size_t>& result) const noexcept(true)
+	{
+		return FindByPrefix(prefix.c_str(), result);
+	}
+
 	bool ZipFileEntries::AddFile(const char* fname) noexcept(true)
 	{
 		if (!fname || !fname[0])
@@ -527,14 +713,7 @@ namespace CKPE
 		if (!HasOpen() || !fname || !fname[0])
 			return ZipFileEntry::InvalidIndex;
 
-		for (size_t i = 0; i < _entries->Count(); i++)
-		{
-			auto entry = _entries->At(i);
-			if (!entry.Empty() && entry->Get() && !_stricmp(entry->Get()->GetName().c_str(), fname))
-				return i;
-		}
-
-		return ZipFileEntry::InvalidIndex;
+		return _entries->Find(fname);
 	}
 
 	std::size_t UnZipper::IndexOf(const wchar_t* fname) const noexcept(true)